@@ -18,6 +18,7 @@ option ( ENABLE_STATIC_DAQ "link static DAQ modules" ON )
 option ( ENABLE_SHELL "enable shell support" OFF )
 option ( ENABLE_APPID_THIRD_PARTY "enable third party appid" OFF )
 option ( ENABLE_UNIT_TESTS "enable unit tests" OFF )
+option ( ENABLE_BENCHMARK_TESTS "enable benchmark tests" OFF )
 option ( ENABLE_PIGLET "enable piglet test harness" OFF )
 
 option ( ENABLE_COREFILES "Prevent Snort from generating core files" ON )
@@ -67,6 +67,8 @@ Optional Features:
     --enable-appid-third-party
                             enable third party appid
     --enable-unit-tests     build unit tests
+    --enable-benchmark-tests
+                            build benchmark tests (requires unit tests)
     --enable-piglet         build piglet test harness
     --disable-static-daq    link static DAQ modules
     --disable-html-docs     don't create the HTML documentation
@@ -318,6 +320,12 @@ while [ $# -ne 0 ]; do
         --disable-unit-tests)
             append_cache_entry ENABLE_UNIT_TESTS        BOOL false
             ;;
+        --enable-benchmark-tests)
+            append_cache_entry ENABLE_BENCHMARK_TESTS   BOOL true
+            ;;
+        --disable-benchmark-tests)
+            append_cache_entry ENABLE_BENCHMARK_TESTS   BOOL false
+            ;;
         --enable-piglet)
             append_cache_entry ENABLE_PIGLET            BOOL true
             ;;
@@ -0,0 +1,97 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// decompress_module.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "decompress_module.h"
+
+#include "main/snort_config.h"
+
+#include "file_decomp_config.h"
+
+using namespace snort;
+
+#define s_name "decompress"
+#define s_help \
+    "configure limits shared by the swf, pdf and zip file decompressors"
+
+static const Parameter s_params[] =
+{
+    { "memcap", Parameter::PT_INT, "0:maxSZ", "0",
+      "maximum working memory of decompression contexts across all packet threads "
+      "(bytes, 0 to disable)" },
+
+    { "max_ratio", Parameter::PT_INT, "0:65535", "0",
+      "stop decompressing a file once its output exceeds this multiple of its input "
+      "(0 to disable)" },
+
+    { "pool_size", Parameter::PT_INT, "0:64", "8",
+      "number of idle decompression contexts each packet thread keeps for reuse" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
+THREAD_LOCAL FileDecompStats file_decomp_stats;
+
+static const PegInfo decomp_pegs[] =
+{
+    { CountType::SUM, "swf_bytes_in", "swf bytes submitted for decompression" },
+    { CountType::SUM, "swf_bytes_out", "swf bytes produced by decompression" },
+    { CountType::SUM, "swf_usecs", "microseconds spent decompressing swf" },
+    { CountType::SUM, "pdf_bytes_in", "pdf bytes submitted for decompression" },
+    { CountType::SUM, "pdf_bytes_out", "pdf bytes produced by decompression" },
+    { CountType::SUM, "pdf_usecs", "microseconds spent decompressing pdf" },
+    { CountType::SUM, "zip_bytes_in", "zip bytes submitted for decompression" },
+    { CountType::SUM, "zip_bytes_out", "zip bytes produced by decompression" },
+    { CountType::SUM, "zip_usecs", "microseconds spent decompressing zip" },
+    { CountType::SUM, "contexts_created", "inflate and lzma contexts allocated" },
+    { CountType::SUM, "contexts_reused", "inflate and lzma contexts reused from a thread pool" },
+    { CountType::SUM, "memcap_failures", "context allocations refused by the memcap" },
+    { CountType::SUM, "ratio_limits", "files no longer decompressed due to max_ratio" },
+    { CountType::END, nullptr, nullptr }
+};
+
+DecompressModule::DecompressModule() : Module(s_name, s_help, s_params)
+{ }
+
+bool DecompressModule::set(const char*, Value& v, SnortConfig* sc)
+{
+    if ( v.is("memcap") )
+        sc->file_decomp->memcap = v.get_size();
+
+    else if ( v.is("max_ratio") )
+        sc->file_decomp->max_ratio = v.get_uint32();
+
+    else if ( v.is("pool_size") )
+        sc->file_decomp->pool_size = v.get_uint32();
+
+    else
+        return false;
+
+    return true;
+}
+
+const PegInfo* DecompressModule::get_pegs() const
+{ return decomp_pegs; }
+
+PegCount* DecompressModule::get_counts() const
+{ return (PegCount*)&file_decomp_stats; }
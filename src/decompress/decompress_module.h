@@ -0,0 +1,62 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// decompress_module.h
+// global file decompression limits and per-format counts
+
+#ifndef DECOMPRESS_MODULE_H
+#define DECOMPRESS_MODULE_H
+
+#include "framework/module.h"
+#include "main/thread.h"
+
+struct FileDecompFormatStats
+{
+    PegCount bytes_in;
+    PegCount bytes_out;
+    PegCount usecs;
+};
+
+struct FileDecompStats
+{
+    FileDecompFormatStats swf;
+    FileDecompFormatStats pdf;
+    FileDecompFormatStats zip;
+    PegCount contexts_created;
+    PegCount contexts_reused;
+    PegCount memcap_failures;
+    PegCount ratio_limits;
+};
+
+extern THREAD_LOCAL FileDecompStats file_decomp_stats;
+
+class DecompressModule : public snort::Module
+{
+public:
+    DecompressModule();
+
+    bool set(const char*, snort::Value&, snort::SnortConfig*) override;
+
+    const PegInfo* get_pegs() const override;
+    PegCount* get_counts() const override;
+
+    Usage get_usage() const override
+    { return GLOBAL; }
+};
+
+#endif
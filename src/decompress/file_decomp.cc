@@ -27,14 +27,24 @@
 #include <cassert>
 
 #include "detection/detection_util.h"
+#include "main/thread.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
 #include "utils/util.h"
 
+#include "decompress_module.h"
+#include "file_decomp_config.h"
 #include "file_decomp_pdf.h"
+#include "file_decomp_pool.h"
 #include "file_decomp_swf.h"
 #include "file_decomp_zip.h"
 
 #ifdef UNIT_TEST
+#include <algorithm>
+#include <vector>
+
 #include "catch/snort_catch.h"
+#include "main/snort_config.h"
 #endif
 
 using namespace snort;
@@ -47,6 +57,12 @@ static const char SWF_LZMA_Sig[3] = { 'Z', 'W', 'S' };
 static const char SWF_Uncomp_Sig[3] = { 'F', 'W', 'S' };
 static const char ZIP_Sig[4] = { 'P', 'K', 0x03, 0x04 };
 
+/* The ratio limit only applies once a file has produced this much output */
+#define RATIO_MIN_OUT (64 * 1024)
+
+/* Clock ticks not yet counted in the usecs pegs, per file type */
+static THREAD_LOCAL uint64_t Decomp_Ticks[FILE_TYPE_MAX];
+
 /* Please assure that the following value correlates with the set of sig's */
 #define MAX_SIG_LENGTH (5)
 
@@ -302,16 +318,62 @@ fd_session_t* File_Decomp_New()
     return New_Session;
 }
 
-/* Process Decompression.  The session Next_In, Avail_In, Next_Out, Avail_Out MUST have been
-   set by caller.
-*/
-fd_status_t File_Decomp(fd_session_t* SessionPtr)
+static FileDecompFormatStats* Get_Format_Stats(uint8_t File_Type)
 {
-    fd_status_t Return_Code;
+    switch ( File_Type )
+    {
+    case FILE_TYPE_SWF:
+        return &file_decomp_stats.swf;
+    case FILE_TYPE_PDF:
+        return &file_decomp_stats.pdf;
+    case FILE_TYPE_ZIP:
+        return &file_decomp_stats.zip;
+    }
+    return nullptr;
+}
 
-    if ( (SessionPtr == nullptr) || (SessionPtr->State == STATE_NEW) ||
-        (SessionPtr->Next_In == nullptr) || (SessionPtr->Next_Out == nullptr) )
-        return( File_Decomp_Error );
+static void Update_Stats(fd_session_t* SessionPtr, uint32_t Start_In, uint32_t Start_Out,
+    hr_duration Elapsed)
+{
+    FileDecompFormatStats* stats = Get_Format_Stats(SessionPtr->File_Type);
+
+    if ( stats == nullptr )
+        return;
+
+    stats->bytes_in += SessionPtr->Total_In - Start_In;
+    stats->bytes_out += SessionPtr->Total_Out - Start_Out;
+
+    /* Carry the sub-microsecond remainder so short calls are not lost */
+    uint64_t& pending = Decomp_Ticks[SessionPtr->File_Type];
+    pending += TO_TICKS(Elapsed);
+
+    hr_duration d = hr_duration(pending);
+    long usecs = clock_usecs(TO_USECS(d));
+
+    if ( usecs > 0 )
+    {
+        stats->usecs += usecs;
+        hr_duration counted = TO_DURATION(d, clock_ticks(usecs));
+        pending -= TO_TICKS(counted);
+    }
+}
+
+/* Decompression bombs: give up on a file whose output has grown to more
+   than max_ratio times its input.  The caller keeps what was produced and
+   later calls see a completed session. */
+static bool Ratio_Exceeded(const fd_session_t* SessionPtr)
+{
+    unsigned max_ratio = File_Decomp_Get_Config()->max_ratio;
+
+    if ( !max_ratio or SessionPtr->Total_Out < RATIO_MIN_OUT )
+        return false;
+
+    return SessionPtr->Total_Out / max_ratio > SessionPtr->Total_In;
+}
+
+static fd_status_t Run_Decompression(fd_session_t* SessionPtr)
+{
+    fd_status_t Return_Code;
 
     /* STATE_NEW: Look for one of the configured file signatures. */
     if ( SessionPtr->State == STATE_READY )
@@ -339,6 +401,38 @@ fd_status_t File_Decomp(fd_session_t* SessionPtr)
         return( File_Decomp_Error );
 }
 
+/* Process Decompression.  The session Next_In, Avail_In, Next_Out, Avail_Out MUST have been
+   set by caller.
+*/
+fd_status_t File_Decomp(fd_session_t* SessionPtr)
+{
+    if ( (SessionPtr == nullptr) || (SessionPtr->State == STATE_NEW) ||
+        (SessionPtr->Next_In == nullptr) || (SessionPtr->Next_Out == nullptr) )
+        return( File_Decomp_Error );
+
+    const uint32_t Start_In = SessionPtr->Total_In;
+    const uint32_t Start_Out = SessionPtr->Total_Out;
+
+    Stopwatch<SnortClock> sw;
+    sw.start();
+
+    fd_status_t Return_Code = Run_Decompression(SessionPtr);
+
+    sw.stop();
+    Update_Stats(SessionPtr, Start_In, Start_Out, sw.get());
+
+    if ( (SessionPtr->State == STATE_ACTIVE) && (Return_Code >= File_Decomp_OK) &&
+        Ratio_Exceeded(SessionPtr) )
+    {
+        File_Decomp_End(SessionPtr);
+        SessionPtr->State = STATE_COMPLETE;
+        file_decomp_stats.ratio_limits++;
+        return( File_Decomp_Complete );
+    }
+
+    return( Return_Code );
+}
+
 fd_status_t File_Decomp_End(fd_session_t* SessionPtr)
 {
     if ( SessionPtr == nullptr )
@@ -417,6 +511,11 @@ void File_Decomp_Alert(fd_session_t* SessionPtr, int Event)
         (SessionPtr->Alert_Callback)(SessionPtr->Alert_Context, Event);
 }
 
+void File_Decomp_Thread_Term()
+{
+    File_Decomp_Pool_Term();
+}
+
 } // namespace snort
 
 //--------------------------------------------------------------------------
@@ -503,5 +602,156 @@ TEST_CASE("Process_Decompression-not_active", "[file_decomp]")
     REQUIRE((Process_Decompression(p_s) == File_Decomp_Error));
     File_Decomp_Free(p_s);
 }
+
+// build a zip local file entry holding data deflated without a header
+static void add_zip_entry(std::vector<uint8_t>& zip, const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> comp(compressBound(data.size()));
+    z_stream z_s;
+    memset(&z_s, 0, sizeof(z_s));
+    REQUIRE((deflateInit2(&z_s, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+        Z_DEFAULT_STRATEGY) == Z_OK));
+    z_s.next_in = const_cast<Bytef*>(data.data());
+    z_s.avail_in = data.size();
+    z_s.next_out = comp.data();
+    z_s.avail_out = comp.size();
+    REQUIRE((deflate(&z_s, Z_FINISH) == Z_STREAM_END));
+    uint32_t comp_size = z_s.total_out;
+    deflateEnd(&z_s);
+
+    const uint8_t header[] =
+    {
+        'P', 'K', 0x03, 0x04,                  // local header
+        0x14, 0x00, 0x00, 0x00,                // version, bitflag
+        0x08, 0x00,                            // method: deflate
+        0, 0, 0, 0, 0, 0, 0, 0,                // time, date, crc
+        (uint8_t)comp_size, (uint8_t)(comp_size >> 8),
+        (uint8_t)(comp_size >> 16), (uint8_t)(comp_size >> 24),
+        0, 0, 0, 0,                            // uncompressed size
+        0, 0, 0, 0                             // filename and extra lengths
+    };
+    zip.insert(zip.end(), header, header + sizeof(header));
+    zip.insert(zip.end(), comp.begin(), comp.begin() + comp_size);
+}
+
+static fd_session_t* new_zip_session()
+{
+    fd_session_t* p_s = File_Decomp_New();
+    p_s->Modes = FILE_ZIP_DEFL_BIT;
+    p_s->Alert_Callback = nullptr;
+    p_s->Alert_Context = nullptr;
+    p_s->Compr_Depth = 0;
+    p_s->Decompr_Depth = 0;
+    File_Decomp_Init(p_s);
+    return p_s;
+}
+
+static bool contains(const uint8_t* buf, size_t len, const std::vector<uint8_t>& data)
+{
+    return std::search(buf, buf + len, data.begin(), data.end()) != buf + len;
+}
+
+TEST_CASE("File_Decomp-zip_pooled_contexts", "[file_decomp]")
+{
+    std::vector<uint8_t> first(4000), second(6000), zip;
+
+    for ( unsigned i = 0; i < first.size(); ++i )
+        first[i] = 'a' + (i * 7) % 23;
+    for ( unsigned i = 0; i < second.size(); ++i )
+        second[i] = 'A' + (i * 11) % 19;
+
+    add_zip_entry(zip, first);
+    add_zip_entry(zip, second);
+
+    File_Decomp_Thread_Term();
+    PegCount created = file_decomp_stats.contexts_created;
+    PegCount reused = file_decomp_stats.contexts_reused;
+    PegCount bytes_in = file_decomp_stats.zip.bytes_in;
+
+    fd_session_t* p_s = new_zip_session();
+    std::vector<uint8_t> out(16384);
+
+    // split the input across two calls as if it arrived in two PDUs
+    size_t split = zip.size() / 3;
+    p_s->Next_In = zip.data();
+    p_s->Avail_In = split;
+    p_s->Next_Out = out.data();
+    p_s->Avail_Out = out.size();
+    REQUIRE((File_Decomp(p_s) >= File_Decomp_OK));
+
+    p_s->Next_In = zip.data() + split;
+    p_s->Avail_In = zip.size() - split;
+    REQUIRE((File_Decomp(p_s) >= File_Decomp_OK));
+
+    size_t len = p_s->Next_Out - out.data();
+    CHECK(contains(out.data(), len, first));
+    CHECK(contains(out.data(), len, second));
+
+    // the second entry is inflated with the context released by the first
+    CHECK((file_decomp_stats.contexts_created == created + 1));
+    CHECK((file_decomp_stats.contexts_reused == reused + 1));
+    CHECK((file_decomp_stats.zip.bytes_in == bytes_in + zip.size()));
+
+    File_Decomp_StopFree(p_s);
+    File_Decomp_Thread_Term();
+    CHECK((File_Decomp_Mem_In_Use() == 0));
+}
+
+TEST_CASE("File_Decomp-max_ratio", "[file_decomp]")
+{
+    FileDecompConfig* fdc = SnortConfig::get_conf()->file_decomp;
+    unsigned max_ratio = fdc->max_ratio;
+    fdc->max_ratio = 20;
+
+    std::vector<uint8_t> zeros(1024 * 1024), zip;
+    add_zip_entry(zip, zeros);
+
+    PegCount limits = file_decomp_stats.ratio_limits;
+    fd_session_t* p_s = new_zip_session();
+    std::vector<uint8_t> out(256 * 1024);
+
+    p_s->Next_In = zip.data();
+    p_s->Avail_In = zip.size();
+    p_s->Next_Out = out.data();
+    p_s->Avail_Out = out.size();
+
+    CHECK((File_Decomp(p_s) == File_Decomp_Complete));
+    CHECK((p_s->State == STATE_COMPLETE));
+    CHECK((file_decomp_stats.ratio_limits == limits + 1));
+
+    p_s->Next_In = zip.data();
+    p_s->Avail_In = zip.size();
+    CHECK((File_Decomp(p_s) == File_Decomp_Error));
+
+    File_Decomp_StopFree(p_s);
+    fdc->max_ratio = max_ratio;
+}
+
+TEST_CASE("File_Decomp-memcap", "[file_decomp]")
+{
+    FileDecompConfig* fdc = SnortConfig::get_conf()->file_decomp;
+    size_t memcap = fdc->memcap;
+    fdc->memcap = 1024;
+
+    std::vector<uint8_t> data(1000, 'x'), zip;
+    add_zip_entry(zip, data);
+
+    File_Decomp_Thread_Term();
+    PegCount failures = file_decomp_stats.memcap_failures;
+    fd_session_t* p_s = new_zip_session();
+    std::vector<uint8_t> out(4096);
+
+    p_s->Next_In = zip.data();
+    p_s->Avail_In = zip.size();
+    p_s->Next_Out = out.data();
+    p_s->Avail_Out = out.size();
+
+    CHECK((File_Decomp(p_s) == File_Decomp_Error));
+    CHECK((file_decomp_stats.memcap_failures > failures));
+
+    File_Decomp_StopFree(p_s);
+    CHECK((File_Decomp_Mem_In_Use() == 0));
+    fdc->memcap = memcap;
+}
 #endif
 
@@ -302,6 +302,9 @@ SO_PUBLIC void File_Decomp_Free(fd_session_t*);
 
 /* Call the error alerting call-back function */
 SO_PUBLIC void File_Decomp_Alert(fd_session_t*, int Event);
+
+/* Release the packet thread's pooled decompression contexts */
+void File_Decomp_Thread_Term();
 }
 #endif
 
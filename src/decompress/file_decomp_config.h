@@ -0,0 +1,43 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// global limits applied to all file decompression sessions
+
+#ifndef FILE_DECOMP_CONFIG_H
+#define FILE_DECOMP_CONFIG_H
+
+#include <cstddef>
+
+#define FILE_DECOMP_MAX_POOL_SIZE (64)
+#define DEFAULT_FILE_DECOMP_POOL_SIZE (8)
+
+struct FileDecompConfig
+{
+    // bytes of inflate / lzma working memory across all packet threads
+    size_t memcap = 0;
+
+    // stop decompressing a file once output exceeds this multiple of input
+    unsigned max_ratio = 0;
+
+    // idle contexts each packet thread keeps for reuse
+    unsigned pool_size = DEFAULT_FILE_DECOMP_POOL_SIZE;
+
+    constexpr FileDecompConfig() = default;
+};
+
+#endif
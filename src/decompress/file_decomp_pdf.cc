@@ -29,6 +29,8 @@
 #include "main/thread.h"
 #include "utils/util.h"
 
+#include "file_decomp_pool.h"
+
 #ifdef UNIT_TEST
 #include "catch/snort_catch.h"
 #endif
@@ -906,19 +908,10 @@ static fd_status_t Init_Stream(fd_session_t* SessionPtr)
     {
     case FILE_COMPRESSION_TYPE_DEFLATE:
     {
-        int z_ret;
-
-        z_stream* z_s = &(StPtr->PDF_Decomp_State.Deflate.StreamDeflate);
-
-        memset( (char*)z_s, 0, sizeof(z_stream));
-
-        z_s->zalloc = (alloc_func)nullptr;
-        z_s->zfree = (free_func)nullptr;
-        SYNC_IN(z_s)
-
-        z_ret = inflateInit2(z_s, 47);
+        /* 47 = 32 + 15 selects automatic zlib / gzip header detection */
+        StPtr->PDF_Decomp_State.Deflate.StreamDeflate = File_Decomp_Get_Inflate(47);
 
-        if ( z_ret != Z_OK )
+        if ( StPtr->PDF_Decomp_State.Deflate.StreamDeflate == nullptr )
         {
             File_Decomp_Alert(SessionPtr, FILE_DECOMP_ERR_PDF_DEFL_FAILURE);
             return( File_Decomp_Error );
@@ -949,7 +942,7 @@ static fd_status_t Decomp_Stream(fd_session_t* SessionPtr)
     case FILE_COMPRESSION_TYPE_DEFLATE:
     {
         int z_ret;
-        z_stream* z_s = &(StPtr->PDF_Decomp_State.Deflate.StreamDeflate);
+        z_stream* z_s = StPtr->PDF_Decomp_State.Deflate.StreamDeflate;
 
         SYNC_IN(z_s)
 
@@ -1008,15 +1001,12 @@ fd_status_t File_Decomp_End_PDF(fd_session_t* SessionPtr)
     {
     case FILE_COMPRESSION_TYPE_DEFLATE:
     {
-        int z_ret;
-        z_stream* z_s = &(StPtr->PDF_Decomp_State.Deflate.StreamDeflate);
-
-        z_ret = inflateEnd(z_s);
+        fd_PDF_Deflate_t* Deflate = &(StPtr->PDF_Decomp_State.Deflate);
 
-        if ( z_ret != Z_OK )
+        if ( Deflate->StreamDeflate != nullptr )
         {
-            File_Decomp_Alert(SessionPtr, FILE_DECOMP_ERR_PDF_DEFL_FAILURE);
-            return( File_Decomp_Error );
+            File_Decomp_Put_Inflate(Deflate->StreamDeflate);
+            Deflate->StreamDeflate = nullptr;
         }
 
         break;
@@ -0,0 +1,240 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// file_decomp_pool.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "file_decomp_pool.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+#include "main/snort_config.h"
+#include "main/thread.h"
+
+#include "decompress_module.h"
+#include "file_decomp_config.h"
+
+using namespace snort;
+
+// each allocation carries its size so frees can be accounted
+#define FILE_DECOMP_ALLOC_HDR (16)
+
+static std::atomic<size_t> decomp_mem_in_use { 0 };
+static const FileDecompConfig default_config;
+
+static THREAD_LOCAL z_stream* inflate_pool[FILE_DECOMP_MAX_POOL_SIZE];
+static THREAD_LOCAL unsigned inflate_pool_count = 0;
+
+#ifdef HAVE_LZMA
+static THREAD_LOCAL lzma_stream* lzma_pool[FILE_DECOMP_MAX_POOL_SIZE];
+static THREAD_LOCAL unsigned lzma_pool_count = 0;
+#endif
+
+//--------------------------------------------------------------------------
+// memcap accounting
+//--------------------------------------------------------------------------
+
+static void* decomp_alloc(size_t size)
+{
+    size_t memcap = File_Decomp_Get_Config()->memcap;
+    size_t total = size + FILE_DECOMP_ALLOC_HDR;
+    size_t in_use = decomp_mem_in_use.fetch_add(total, std::memory_order_relaxed) + total;
+
+    if ( memcap and in_use > memcap )
+    {
+        decomp_mem_in_use.fetch_sub(total, std::memory_order_relaxed);
+        file_decomp_stats.memcap_failures++;
+        return nullptr;
+    }
+
+    uint8_t* p = (uint8_t*)malloc(total);
+
+    if ( !p )
+    {
+        decomp_mem_in_use.fetch_sub(total, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    *(size_t*)p = total;
+    return p + FILE_DECOMP_ALLOC_HDR;
+}
+
+static void decomp_free(void* ptr)
+{
+    if ( !ptr )
+        return;
+
+    uint8_t* p = (uint8_t*)ptr - FILE_DECOMP_ALLOC_HDR;
+    decomp_mem_in_use.fetch_sub(*(size_t*)p, std::memory_order_relaxed);
+    free(p);
+}
+
+static voidpf zlib_alloc(voidpf, uInt items, uInt size)
+{ return decomp_alloc((size_t)items * size); }
+
+static void zlib_free(voidpf, voidpf address)
+{ decomp_free(address); }
+
+#ifdef HAVE_LZMA
+static void* lzma_alloc(void*, size_t nmemb, size_t size)
+{ return decomp_alloc(nmemb * size); }
+
+static void lzma_free(void*, void* ptr)
+{ decomp_free(ptr); }
+
+static const lzma_allocator lzma_pool_allocator = { lzma_alloc, lzma_free, nullptr };
+#endif
+
+// idle contexts are kept only while under the memcap so that pooled memory
+// never starves new sessions
+static bool pool_has_room(unsigned count)
+{
+    const FileDecompConfig* fdc = File_Decomp_Get_Config();
+
+    if ( count >= fdc->pool_size )
+        return false;
+
+    return !fdc->memcap or decomp_mem_in_use.load(std::memory_order_relaxed) <= fdc->memcap;
+}
+
+//--------------------------------------------------------------------------
+// api
+//--------------------------------------------------------------------------
+
+const FileDecompConfig* File_Decomp_Get_Config()
+{
+    const SnortConfig* sc = SnortConfig::get_conf();
+
+    if ( sc and sc->file_decomp )
+        return sc->file_decomp;
+
+    return &default_config;
+}
+
+z_stream* File_Decomp_Get_Inflate(int window_bits)
+{
+    while ( inflate_pool_count )
+    {
+        z_stream* z_s = inflate_pool[--inflate_pool_count];
+
+        if ( inflateReset2(z_s, window_bits) == Z_OK )
+        {
+            file_decomp_stats.contexts_reused++;
+            return z_s;
+        }
+        inflateEnd(z_s);
+        delete z_s;
+    }
+
+    z_stream* z_s = new z_stream;
+    memset(z_s, 0, sizeof(*z_s));
+
+    z_s->zalloc = zlib_alloc;
+    z_s->zfree = zlib_free;
+
+    if ( inflateInit2(z_s, window_bits) != Z_OK )
+    {
+        delete z_s;
+        return nullptr;
+    }
+
+    file_decomp_stats.contexts_created++;
+    return z_s;
+}
+
+void File_Decomp_Put_Inflate(z_stream* z_s)
+{
+    if ( pool_has_room(inflate_pool_count) )
+    {
+        inflate_pool[inflate_pool_count++] = z_s;
+        return;
+    }
+    inflateEnd(z_s);
+    delete z_s;
+}
+
+#ifdef HAVE_LZMA
+lzma_stream* File_Decomp_Get_LZMA()
+{
+    lzma_stream* l_s;
+    bool reused = lzma_pool_count > 0;
+
+    if ( reused )
+        l_s = lzma_pool[--lzma_pool_count];
+
+    else
+    {
+        l_s = new lzma_stream;
+        memset(l_s, 0, sizeof(*l_s));
+        l_s->allocator = &lzma_pool_allocator;
+    }
+
+    // an existing alone decoder is reinitialized in place, keeping its
+    // dictionary when the size matches
+    if ( lzma_alone_decoder(l_s, UINT64_MAX) != LZMA_OK )
+    {
+        lzma_end(l_s);
+        delete l_s;
+        return nullptr;
+    }
+
+    if ( reused )
+        file_decomp_stats.contexts_reused++;
+    else
+        file_decomp_stats.contexts_created++;
+
+    return l_s;
+}
+
+void File_Decomp_Put_LZMA(lzma_stream* l_s)
+{
+    if ( pool_has_room(lzma_pool_count) )
+    {
+        lzma_pool[lzma_pool_count++] = l_s;
+        return;
+    }
+    lzma_end(l_s);
+    delete l_s;
+}
+#endif
+
+size_t File_Decomp_Mem_In_Use()
+{ return decomp_mem_in_use.load(std::memory_order_relaxed); }
+
+void File_Decomp_Pool_Term()
+{
+    while ( inflate_pool_count )
+    {
+        z_stream* z_s = inflate_pool[--inflate_pool_count];
+        inflateEnd(z_s);
+        delete z_s;
+    }
+#ifdef HAVE_LZMA
+    while ( lzma_pool_count )
+    {
+        lzma_stream* l_s = lzma_pool[--lzma_pool_count];
+        lzma_end(l_s);
+        delete l_s;
+    }
+#endif
+}
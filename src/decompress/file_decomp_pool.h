@@ -0,0 +1,58 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// file_decomp_pool.h
+// inflate and lzma contexts shared by the file decompressors.  contexts
+// are allocated against a global memcap and, once released by a session,
+// kept in a small per-thread pool and reset rather than reinitialized
+// for the next stream.  this avoids reallocating the inflate window and
+// the lzma dictionary for every pdf stream, zip entry and swf file.
+
+#ifndef FILE_DECOMP_POOL_H
+#define FILE_DECOMP_POOL_H
+
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#include <zlib.h>
+
+#include <cstddef>
+
+struct FileDecompConfig;
+
+// current limits; never null
+const FileDecompConfig* File_Decomp_Get_Config();
+
+// returns an inflate context reset for window_bits or nullptr if the
+// memcap or allocator refused it
+z_stream* File_Decomp_Get_Inflate(int window_bits);
+void File_Decomp_Put_Inflate(z_stream*);
+
+#ifdef HAVE_LZMA
+// returns a context initialized with lzma_alone_decoder() or nullptr
+lzma_stream* File_Decomp_Get_LZMA();
+void File_Decomp_Put_LZMA(lzma_stream*);
+#endif
+
+// bytes currently held by decompression contexts across all threads
+size_t File_Decomp_Mem_In_Use();
+
+// free this thread's idle contexts
+void File_Decomp_Pool_Term();
+
+#endif
@@ -26,6 +26,8 @@
 
 #include "utils/util.h"
 
+#include "file_decomp_pool.h"
+
 #ifdef UNIT_TEST
 #include "catch/snort_catch.h"
 #endif
@@ -48,7 +50,7 @@ static fd_status_t File_Decomp_Process_LZMA_Header(fd_session_t* SessionPtr)
     int idx;
 
     lzma_ret l_ret;
-    lzma_stream* l_s = &(SessionPtr->SWF->StreamLZMA);
+    lzma_stream* l_s = SessionPtr->SWF->StreamLZMA;
 
     SWF_Uncomp_Len = 0;
     /* Read little-endian into value */
@@ -100,7 +102,7 @@ static fd_status_t Decomp(fd_session_t* SessionPtr)
     case FILE_COMPRESSION_TYPE_ZLIB:
     {
         int z_ret;
-        z_stream* z_s = &(SessionPtr->SWF->StreamZLIB);
+        z_stream* z_s = SessionPtr->SWF->StreamZLIB;
 
         SYNC_IN(z_s)
 
@@ -125,7 +127,7 @@ static fd_status_t Decomp(fd_session_t* SessionPtr)
     case FILE_COMPRESSION_TYPE_LZMA:
     {
         lzma_ret l_ret;
-        lzma_stream* l_s = &(SessionPtr->SWF->StreamLZMA);
+        lzma_stream* l_s = SessionPtr->SWF->StreamLZMA;
 
         SYNC_IN(l_s)
 
@@ -159,19 +161,16 @@ fd_status_t File_Decomp_End_SWF(fd_session_t* SessionPtr)
     if ( SessionPtr == nullptr )
         return( File_Decomp_Error );
 
+    /* Return the context to the pool.  This may be called again for an
+       already ended session. */
     switch ( SessionPtr->Decomp_Type )
     {
     case FILE_COMPRESSION_TYPE_ZLIB:
     {
-        int z_ret;
-        z_stream* z_s = &(SessionPtr->SWF->StreamZLIB);
-
-        z_ret = inflateEnd(z_s);
-
-        if ( z_ret != Z_OK )
+        if ( SessionPtr->SWF->StreamZLIB != nullptr )
         {
-            SessionPtr->Error_Event = FILE_DECOMP_ERR_SWF_ZLIB_FAILURE;
-            return( File_Decomp_DecompError );
+            File_Decomp_Put_Inflate(SessionPtr->SWF->StreamZLIB);
+            SessionPtr->SWF->StreamZLIB = nullptr;
         }
 
         break;
@@ -179,9 +178,11 @@ fd_status_t File_Decomp_End_SWF(fd_session_t* SessionPtr)
 #ifdef HAVE_LZMA
     case FILE_COMPRESSION_TYPE_LZMA:
     {
-        lzma_stream* l_s = &(SessionPtr->SWF->StreamLZMA);
-
-        lzma_end(l_s);
+        if ( SessionPtr->SWF->StreamLZMA != nullptr )
+        {
+            File_Decomp_Put_LZMA(SessionPtr->SWF->StreamLZMA);
+            SessionPtr->SWF->StreamLZMA = nullptr;
+        }
 
         break;
     }
@@ -209,23 +210,12 @@ fd_status_t File_Decomp_Init_SWF(fd_session_t* SessionPtr)
     {
     case FILE_COMPRESSION_TYPE_ZLIB:
     {
-        int z_ret;
-        z_stream* z_s;
-
         SessionPtr->SWF->Header_Len =
             SWF_VER_LEN + SWF_UCL_LEN;
 
-        z_s = &(SessionPtr->SWF->StreamZLIB);
+        SessionPtr->SWF->StreamZLIB = File_Decomp_Get_Inflate(MAX_WBITS);
 
-        memset( (char*)z_s, 0, sizeof(z_stream));
-
-        z_s->zalloc = (alloc_func)nullptr;
-        z_s->zfree = (free_func)nullptr;
-        SYNC_IN(z_s)
-
-        z_ret = inflateInit(z_s);
-
-        if ( z_ret != Z_OK )
+        if ( SessionPtr->SWF->StreamZLIB == nullptr )
         {
             SessionPtr->Error_Event = FILE_DECOMP_ERR_SWF_ZLIB_FAILURE;
             return( File_Decomp_DecompError );
@@ -236,21 +226,12 @@ fd_status_t File_Decomp_Init_SWF(fd_session_t* SessionPtr)
 #ifdef HAVE_LZMA
     case FILE_COMPRESSION_TYPE_LZMA:
     {
-        lzma_ret l_ret;
-        lzma_stream* l_s;
-
         SessionPtr->SWF->Header_Len =
             SWF_VER_LEN + SWF_UCL_LEN + SWF_LZMA_CML_LEN + SWF_LZMA_PRP_LEN;
 
-        l_s = &(SessionPtr->SWF->StreamLZMA);
-
-        memset( (char*)l_s, 0, sizeof(lzma_stream));
-
-        SYNC_IN(l_s)
-
-        l_ret = lzma_alone_decoder(l_s, UINT64_MAX);
+        SessionPtr->SWF->StreamLZMA = File_Decomp_Get_LZMA();
 
-        if ( l_ret != LZMA_OK )
+        if ( SessionPtr->SWF->StreamLZMA == nullptr )
         {
             SessionPtr->Error_Event = FILE_DECOMP_ERR_SWF_LZMA_FAILURE;
             return( File_Decomp_DecompError );
@@ -62,8 +62,8 @@ enum fd_ZIP_states
 
 struct fd_ZIP_t
 {
-    // zlib stream
-    z_stream Stream;
+    // zlib stream, pooled
+    z_stream* Stream;
 
     // decompression progress
     unsigned progress;
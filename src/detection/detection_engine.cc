@@ -29,6 +29,7 @@
 #include "filters/sfthreshold.h"
 #include "framework/endianness.h"
 #include "helpers/ring.h"
+#include "latency/flow_cost.h"
 #include "latency/packet_latency.h"
 #include "main/modules.h"
 #include "main/snort.h"
@@ -512,6 +513,7 @@ bool DetectionEngine::detect(Packet* p, bool offload_ok)
 {
     assert(p);
     Profile profile(detectPerfStats);
+    FlowCost::Phase cost(FC_DETECT);
 
     if ( !p->ptrs.ip_api.is_valid() )
         return false;
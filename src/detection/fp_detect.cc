@@ -44,6 +44,7 @@
 #include "filters/sfthreshold.h"
 #include "framework/cursor.h"
 #include "framework/mpse.h"
+#include "latency/latency_histogram.h"
 #include "latency/packet_latency.h"
 #include "latency/rule_latency.h"
 #include "log/messages.h"
@@ -72,6 +73,7 @@
 #include "fp_config.h"
 #include "fp_create.h"
 #include "ips_context.h"
+#include "match_queue.h"
 #include "pattern_match_data.h"
 #include "pcrm.h"
 #include "rules.h"
@@ -100,7 +102,7 @@ THREAD_LOCAL ProfileStats ruleNFPEvalPerfStats;
 static inline void init_match_info(OtnxMatchData* o)
 {
     for ( int i = 0; i < SnortConfig::get_conf()->num_rule_types; i++ )
-        o->matchInfo[i].iMatchCount = 0;
+        o->matchInfo[i].reset();
 
     o->have_match = false;
 }
@@ -265,31 +267,25 @@ int fpAddMatch(OtnxMatchData* omd_local, int /*pLen*/, const OptTreeNode* otn)
         pc.match_limit++;
         return 1;
     }
-    MatchInfo* pmi = &omd_local->matchInfo[evalIndex];
+    MatchQueue* pmq = &omd_local->matchInfo[evalIndex];
 
     /*
     **  If we hit the max number of unique events for any rule type alert,
     **  log or pass, then we don't add it to the list.
     */
-    if ( pmi->iMatchCount >= (int)SnortConfig::get_conf()->fast_pattern_config->get_max_queue_events() ||
-        pmi->iMatchCount >= MAX_EVENT_MATCH)
+    if ( pmq->size() >= SnortConfig::get_conf()->fast_pattern_config->get_max_queue_events() ||
+        pmq->size() >= MatchQueue::max_matches )
     {
         pc.match_limit++;
         return 1;
     }
 
-    // don't store the same otn again
-    for ( int i=0; i< pmi->iMatchCount; i++ )
-    {
-        if ( pmi->MatchArray[ i  ] == otn )
-            return 0;
-    }
+    // the same otn is only stored once
+    int order = SnortConfig::get_conf()->event_queue_config->order;
 
-    //  add the event to the appropriate list
-    pmi->MatchArray[ pmi->iMatchCount ] = otn;
+    if ( pmq->add(otn, MatchQueue::get_key(otn, order)) )
+        omd_local->have_match = true;
 
-    pmi->iMatchCount++;
-    omd_local->have_match = true;
     return 0;
 }
 
@@ -339,6 +335,7 @@ static int detection_option_tree_evaluate(detection_option_tree_root_t* root,
     if ( RuleLatency::suspended() )
         return 0;
 
+    LatencyHistograms::RuleTimer rule_histogram(root->otn);
     Cursor c(eval_data->p);
     int rval = 0;
 
@@ -452,62 +449,6 @@ static int rule_tree_match(
     return 0;
 }
 
-static int sortOrderByPriority(const void* e1, const void* e2)
-{
-    const OptTreeNode* otn1;
-    const OptTreeNode* otn2;
-
-    if (!e1 || !e2)
-        return 0;
-
-    otn1 = *(OptTreeNode* const*)e1;
-    otn2 = *(OptTreeNode* const*)e2;
-
-    if ( otn1->sigInfo.priority < otn2->sigInfo.priority )
-        return -1;
-
-    if ( otn1->sigInfo.priority > otn2->sigInfo.priority )
-        return +1;
-
-    /* This improves stability of repeated tests */
-    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
-        return -1;
-
-    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
-        return +1;
-
-    return 0;
-}
-
-// FIXIT-L pattern length is not a valid event sort criterion for
-// non-literals
-static int sortOrderByContentLength(const void* e1, const void* e2)
-{
-    const OptTreeNode* otn1;
-    const OptTreeNode* otn2;
-
-    if (!e1 || !e2)
-        return 0;
-
-    otn1 = *(OptTreeNode* const*)e1;
-    otn2 = *(OptTreeNode* const*)e2;
-
-    if (otn1->longestPatternLen < otn2->longestPatternLen)
-        return +1;
-
-    if (otn1->longestPatternLen > otn2->longestPatternLen)
-        return -1;
-
-    /* This improves stability of repeated tests */
-    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
-        return +1;
-
-    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
-        return -1;
-
-    return 0;
-}
-
 /*
 **  DESCRIPTION
 **    This function flags an alert per session.
@@ -627,27 +568,22 @@ static inline int fpFinalSelectEvent(OtnxMatchData* o, Packet* p)
     if ( !o->have_match )
         return 0;
 
-    int i;
-    int j;
-    int k;
-    const OptTreeNode* otn;
     unsigned tcnt = 0;
     EventQueueConfig* eq = SnortConfig::get_conf()->event_queue_config;
-    RuleTreeNode* rtn;
 
-    for ( i = 0; i < SnortConfig::get_conf()->num_rule_types; i++ )
+    for ( int i = 0; i < SnortConfig::get_conf()->num_rule_types; i++ )
     {
         /* bail if were not dumping events in all the action groups,
          * and we've already got some events */
         if (!SnortConfig::process_all_events() && (tcnt > 0))
             return 1;
 
-        if (o->matchInfo[i].iMatchCount)
+        if ( o->matchInfo[i].size() )
         {
             /*
-             * We must always sort so if we que 8 and log 3 and they are
-             * all from the same action group we want them sorted so we get
-             * the highest 3 in priority, priority and length sort do NOT
+             * We must always order so if we que 8 and log 3 and they are
+             * all from the same action group we want them ordered so we get
+             * the highest 3 in priority, priority and length order do NOT
              * take precedence over 'alert drop pass ...' ordering.  If
              * order is 'drop alert', and we log 3 for drop alerts do not
              * get logged.  IF order is 'alert drop', and we log 3 for
@@ -655,46 +591,24 @@ static inline int fpFinalSelectEvent(OtnxMatchData* o, Packet* p)
              * built in drop/block/reset comes before alert/pass/log as
              * part of the natural ordering....Jan '06..
              */
-            /* Sort the rules in this action group */
-            if (eq->order == SNORT_EVENTQ_PRIORITY)
-            {
-                qsort(o->matchInfo[i].MatchArray, o->matchInfo[i].iMatchCount,
-                    sizeof(void*), sortOrderByPriority);
-            }
-            else if (eq->order == SNORT_EVENTQ_CONTENT_LEN)
-            {
-                qsort(o->matchInfo[i].MatchArray, o->matchInfo[i].iMatchCount,
-                    sizeof(void*), sortOrderByContentLength);
-            }
-            else
-            {
-                FatalError("fpdetect: Order function for event queue is invalid.\n");
-            }
+            /* The queue orders the rules in this action group as they are popped */
+            MatchQueue& mq = o->matchInfo[i];
+            mq.select();
 
             /* Process each event in the action (alert,drop,log,...) groups */
-            for (j=0; j < o->matchInfo[i].iMatchCount; j++)
+            while ( const OptTreeNode* otn = mq.pop() )
             {
-                otn = o->matchInfo[i].MatchArray[j];
-                rtn = getRtnFromOtn(otn);
+                RuleTreeNode* rtn = getRtnFromOtn(otn);
 
-                if (otn && rtn && Actions::is_pass(rtn->action))
+                if (rtn && Actions::is_pass(rtn->action))
                 {
                     /* Already acted on rules, so just don't act on anymore */
                     if ( tcnt > 0 )
                         return 1;
                 }
 
-                //  Loop here so we don't log the same event multiple times.
-                for (k = 0; k < j; k++)
-                {
-                    if (o->matchInfo[i].MatchArray[k] == otn)
-                    {
-                        otn = nullptr;
-                        break;
-                    }
-                }
-
-                if ( otn && !fpSessionAlerted(p, otn) )
+                // the queue holds each otn once so the same event isn't logged twice
+                if ( !fpSessionAlerted(p, otn) )
                 {
                     if ( DetectionEngine::queue_event(otn) )
                         pc.queue_limit++;
@@ -718,7 +632,7 @@ static inline int fpFinalSelectEvent(OtnxMatchData* o, Packet* p)
                 }
 
                 /* only log/count one pass */
-                if ( otn && rtn && Actions::is_pass(rtn->action))
+                if ( rtn && Actions::is_pass(rtn->action))
                 {
                     p->packet_flags |= PKT_PASS_RULE;
                     return 1;
@@ -841,14 +755,14 @@ void fp_set_context(IpsContext& c)
 {
     c.stash = new MpseStash;
     c.otnx = (OtnxMatchData*)snort_calloc(sizeof(OtnxMatchData));
-    c.otnx->matchInfo = (MatchInfo*)snort_calloc(MAX_NUM_RULE_TYPES, sizeof(MatchInfo));
+    c.otnx->matchInfo = new MatchQueue[MAX_NUM_RULE_TYPES];
     c.context_num = 0;
 }
 
 void fp_clear_context(IpsContext& c)
 {
     delete c.stash;
-    snort_free(c.otnx->matchInfo);
+    delete[] c.otnx->matchInfo;
     snort_free(c.otnx);
 }
 
@@ -39,6 +39,7 @@ class IpsContext;
 struct Packet;
 struct ProfileStats;
 }
+class MatchQueue;
 struct PortGroup;
 struct OptTreeNode;
 
@@ -60,19 +61,6 @@ int fpEvalRTN(RuleTreeNode*, snort::Packet*, int check_ports);
 */
 #define MAX_EVENT_MATCH 100
 
-/*
-**  The events that are matched get held in this structure,
-**  and iMatchIndex gets set to the event that holds the
-**  highest priority.
-*/
-struct MatchInfo
-{
-    const OptTreeNode* MatchArray[MAX_EVENT_MATCH];
-    int iMatchCount;
-    int iMatchIndex;
-    int iMatchMaxLen;
-};
-
 /*
 **  This structure holds information that is
 **  referenced during setwise pattern matches.
@@ -85,7 +73,7 @@ struct OtnxMatchData
 {
     PortGroup* pg;
     snort::Packet* p;
-    MatchInfo* matchInfo;
+    MatchQueue* matchInfo;  // one per rule type; see match_queue.h
 
     int check_ports;
     bool have_match;
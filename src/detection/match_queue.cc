@@ -0,0 +1,354 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// match_queue.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "match_queue.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "events/event_queue.h"
+#include "log/messages.h"
+
+#include "treenodes.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
+using namespace snort;
+
+static_assert(MatchQueue::max_matches < 0xFF, "match positions must fit in a uint8_t");
+
+MatchQueue::MatchQueue()
+{
+    count = 0;
+    memset(index, 0, sizeof(index));
+    reset();
+}
+
+void MatchQueue::reset()
+{
+    // the hash is only dirty if something was added
+    if ( count )
+        memset(index, 0, sizeof(index));
+
+    memset(heads, none, sizeof(heads));
+    count = heap_size = bucket = 0;
+}
+
+uint64_t MatchQueue::get_key(const OptTreeNode* otn, int order)
+{
+    const SigInfo& si = otn->sigInfo;
+
+    if ( order == SNORT_EVENTQ_PRIORITY )
+        return ((uint64_t)si.priority << 32) | si.sid;
+
+    // FIXIT-L pattern length is not a valid event sort criterion for
+    // non-literals
+    if ( order == SNORT_EVENTQ_CONTENT_LEN )
+        return ((uint64_t)(UINT16_MAX - otn->longestPatternLen) << 32) | (UINT32_MAX - si.sid);
+
+    FatalError("fpdetect: Order function for event queue is invalid.\n");
+}
+
+unsigned MatchQueue::hash(const OptTreeNode* otn)
+{ return ((uint64_t)(uintptr_t)otn * 0x9E3779B97F4A7C15ull) >> 56; }
+
+bool MatchQueue::add(const OptTreeNode* otn, uint64_t key)
+{
+    assert(count < max_matches);
+    unsigned h = hash(otn);
+
+    while ( index[h] )
+    {
+        if ( otns[index[h] - 1] == otn )
+            return false;
+
+        h = (h + 1) % hash_size;
+    }
+    index[h] = count + 1;
+
+    uint64_t hi = key >> 32;
+    unsigned b = hi < num_buckets ? hi : num_buckets - 1;
+
+    keys[count] = key;
+    otns[count] = otn;
+    next[count] = heads[b];
+    heads[b] = count++;
+
+    return true;
+}
+
+void MatchQueue::select()
+{
+    heap_size = 0;
+    bucket = 0;
+}
+
+const OptTreeNode* MatchQueue::pop()
+{
+    auto later = [this](uint8_t a, uint8_t b) { return keys[a] > keys[b]; };
+
+    while ( !heap_size )
+    {
+        if ( bucket == num_buckets )
+            return nullptr;
+
+        for ( uint8_t i = heads[bucket]; i != none; i = next[i] )
+            heap[heap_size++] = i;
+
+        if ( heap_size > 1 )
+            std::make_heap(heap, heap + heap_size, later);
+
+        ++bucket;
+    }
+    std::pop_heap(heap, heap + heap_size, later);
+    return otns[heap[--heap_size]];
+}
+
+#if defined(UNIT_TEST) || defined(BENCHMARK_TEST)
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// the qsort comparators fpFinalSelectEvent used before MatchQueue
+static int sortOrderByPriority(const void* e1, const void* e2)
+{
+    const OptTreeNode* otn1 = *(OptTreeNode* const*)e1;
+    const OptTreeNode* otn2 = *(OptTreeNode* const*)e2;
+
+    if ( otn1->sigInfo.priority < otn2->sigInfo.priority )
+        return -1;
+
+    if ( otn1->sigInfo.priority > otn2->sigInfo.priority )
+        return +1;
+
+    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
+        return -1;
+
+    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
+        return +1;
+
+    return 0;
+}
+
+static int sortOrderByContentLength(const void* e1, const void* e2)
+{
+    const OptTreeNode* otn1 = *(OptTreeNode* const*)e1;
+    const OptTreeNode* otn2 = *(OptTreeNode* const*)e2;
+
+    if (otn1->longestPatternLen < otn2->longestPatternLen)
+        return +1;
+
+    if (otn1->longestPatternLen > otn2->longestPatternLen)
+        return -1;
+
+    if ( otn1->sigInfo.sid < otn2->sigInfo.sid )
+        return +1;
+
+    if ( otn1->sigInfo.sid > otn2->sigInfo.sid )
+        return -1;
+
+    return 0;
+}
+
+// the old fpAddMatch list with a linear duplicate check
+static unsigned add_match(const OptTreeNode** list, unsigned n, const OptTreeNode* otn)
+{
+    for ( unsigned i = 0; i < n; ++i )
+        if ( list[i] == otn )
+            return n;
+
+    list[n] = otn;
+    return n + 1;
+}
+
+static void make_rules(std::vector<OptTreeNode>& rules, unsigned num, std::mt19937& rng)
+{
+    rules.resize(num);
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        rules[i].sigInfo.gid = 1;
+        rules[i].sigInfo.sid = i + 1;
+        rules[i].sigInfo.priority = 1 + rng() % 12;
+        rules[i].longestPatternLen = rng() % 40;
+    }
+    std::shuffle(rules.begin(), rules.end(), rng);
+}
+
+#endif
+
+#ifdef UNIT_TEST
+
+TEST_CASE("match queue order", "[match_queue]")
+{
+    std::mt19937 rng(1);
+    std::vector<OptTreeNode> rules;
+    make_rules(rules, 500, rng);
+
+    MatchQueue mq;
+
+    for ( int order : { SNORT_EVENTQ_PRIORITY, SNORT_EVENTQ_CONTENT_LEN } )
+    {
+        auto cmp = order == SNORT_EVENTQ_PRIORITY ? sortOrderByPriority : sortOrderByContentLength;
+
+        for ( unsigned pkt = 0; pkt < 200; ++pkt )
+        {
+            const OptTreeNode* list[MatchQueue::max_matches];
+            unsigned n = 0;
+            unsigned num = 1 + rng() % MatchQueue::max_matches;
+
+            mq.reset();
+
+            // some rules match more than once
+            for ( unsigned i = 0; i < num; ++i )
+            {
+                const OptTreeNode* otn = &rules[rng() % (i % 4 ? rules.size() : 8)];
+                unsigned m = add_match(list, n, otn);
+                CHECK(mq.add(otn, MatchQueue::get_key(otn, order)) == (m > n));
+                n = m;
+            }
+            CHECK(mq.size() == n);
+            qsort(list, n, sizeof(void*), cmp);
+
+            mq.select();
+
+            for ( unsigned i = 0; i < n; ++i )
+                CHECK(mq.pop() == list[i]);
+
+            CHECK(mq.pop() == nullptr);
+        }
+    }
+}
+
+TEST_CASE("match queue reset", "[match_queue]")
+{
+    OptTreeNode otn[3];
+
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        otn[i].sigInfo.sid = 3 - i;
+        otn[i].sigInfo.priority = 2;
+    }
+
+    MatchQueue mq;
+    mq.select();
+    CHECK(mq.pop() == nullptr);
+
+    CHECK(mq.add(otn, MatchQueue::get_key(otn, SNORT_EVENTQ_PRIORITY)));
+    CHECK(!mq.add(otn, MatchQueue::get_key(otn, SNORT_EVENTQ_PRIORITY)));
+    CHECK(mq.size() == 1);
+
+    mq.reset();
+    CHECK(mq.size() == 0);
+
+    for ( unsigned i = 0; i < 3; ++i )
+        CHECK(mq.add(otn + i, MatchQueue::get_key(otn + i, SNORT_EVENTQ_PRIORITY)));
+
+    // sid breaks the tie
+    mq.select();
+    CHECK(mq.pop() == otn + 2);
+    CHECK(mq.pop() == otn + 1);
+    CHECK(mq.pop() == otn);
+    CHECK(mq.pop() == nullptr);
+}
+
+#endif
+
+#ifdef BENCHMARK_TEST
+
+#include <chrono>
+
+// events per packet for the old list + qsort and the queue when the first
+// max_events are taken from matches of 5000 rules
+TEST_CASE("match queue select", "[match_queue]")
+{
+    const unsigned num_pkts = 100000;
+    const unsigned max_events = 8;
+
+    std::mt19937 rng(2);
+    std::vector<OptTreeNode> rules;
+    make_rules(rules, 5000, rng);
+
+    for ( unsigned per_pkt : { 5u, 25u, 100u } )
+    {
+        std::vector<const OptTreeNode*> matches;
+
+        for ( unsigned i = 0; i < num_pkts * per_pkt; ++i )
+            matches.emplace_back(&rules[rng() % rules.size()]);
+
+        uintptr_t sum = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for ( unsigned pkt = 0; pkt < num_pkts; ++pkt )
+        {
+            const OptTreeNode* list[MatchQueue::max_matches];
+            unsigned n = 0;
+
+            for ( unsigned i = 0; i < per_pkt; ++i )
+                n = add_match(list, n, matches[pkt * per_pkt + i]);
+
+            qsort(list, n, sizeof(void*), sortOrderByPriority);
+
+            for ( unsigned i = 0; i < n and i < max_events; ++i )
+                sum += (uintptr_t)list[i];
+        }
+        std::chrono::duration<double, std::nano> old = std::chrono::steady_clock::now() - start;
+
+        MatchQueue mq;
+        start = std::chrono::steady_clock::now();
+
+        for ( unsigned pkt = 0; pkt < num_pkts; ++pkt )
+        {
+            mq.reset();
+
+            for ( unsigned i = 0; i < per_pkt; ++i )
+            {
+                const OptTreeNode* otn = matches[pkt * per_pkt + i];
+                mq.add(otn, MatchQueue::get_key(otn, SNORT_EVENTQ_PRIORITY));
+            }
+            mq.select();
+
+            for ( unsigned i = 0; i < max_events; ++i )
+            {
+                const OptTreeNode* otn = mq.pop();
+
+                if ( !otn )
+                    break;
+
+                sum -= (uintptr_t)otn;
+            }
+        }
+        std::chrono::duration<double, std::nano> now = std::chrono::steady_clock::now() - start;
+
+        CHECK(sum == 0);
+        printf("%3u matches: qsort %.1f ns, queue %.1f ns per packet\n",
+            per_pkt, old.count() / num_pkts, now.count() / num_pkts);
+    }
+}
+
+#endif
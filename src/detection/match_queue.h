@@ -0,0 +1,85 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// match_queue.h
+
+#ifndef MATCH_QUEUE_H
+#define MATCH_QUEUE_H
+
+// Holds the rules that matched a packet for one action group until
+// fpFinalSelectEvent() picks the events to queue.  Each match is ranked by a
+// 64 bit key so the selection order is the same as sorting with the
+// configured event_queue.order_events:
+//
+// priority:     priority ascending, then sid ascending
+// content_len:  longest pattern descending, then sid descending
+//
+// Matches go in one of a few buckets by the high half of the key, which is
+// the priority for the default order, in O(1).  Duplicates are found with
+// a small hash of the otn.  Selection takes the buckets in order and makes
+// each into a heap when it is reached so only the matches that are actually
+// popped are ordered.
+
+#include <cstdint>
+
+#include "detection/fp_detect.h"
+
+struct OptTreeNode;
+
+class MatchQueue
+{
+public:
+    static const unsigned max_matches = MAX_EVENT_MATCH;
+    static const unsigned num_buckets = 8;
+
+    MatchQueue();
+
+    void reset();
+
+    static uint64_t get_key(const OptTreeNode*, int order);
+
+    unsigned size() const
+    { return count; }
+
+    // returns false if otn was already added
+    bool add(const OptTreeNode*, uint64_t key);
+
+    // pop returns matches in key order after select
+    void select();
+    const OptTreeNode* pop();
+
+private:
+    static const uint8_t none = 0xFF;
+    static const unsigned hash_size = 256;
+
+    static unsigned hash(const OptTreeNode*);
+
+    uint64_t keys[max_matches];
+    const OptTreeNode* otns[max_matches];
+    uint8_t next[max_matches];
+
+    uint8_t heads[num_buckets];
+    uint8_t index[hash_size];  // 1 + position or 0
+    unsigned count;
+
+    uint8_t heap[max_matches];
+    unsigned heap_size;
+    unsigned bucket;
+};
+
+#endif
@@ -76,7 +76,8 @@ enum FileCaptureState
     FILE_CAPTURE_MIN,                 /*smaller than file capture min*/
     FILE_CAPTURE_MAX,                 /*larger than file capture max*/
     FILE_CAPTURE_MEMCAP,              /*memcap reached, no more file buffer*/
-    FILE_CAPTURE_FAIL                 /*Other file capture failures*/
+    FILE_CAPTURE_FAIL,                /*Other file capture failures*/
+    FILE_CAPTURE_BUSY                 /*writer queue is full, back off*/
 };
 
 enum FileSigState
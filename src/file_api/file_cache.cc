@@ -23,6 +23,10 @@
 
 #include "file_cache.h"
 
+#include <cstdlib>
+#include <new>
+
+#include "hash/hashfcn.h"
 #include "hash/xhash.h"
 #include "log/messages.h"
 #include "main/snort_config.h"
@@ -76,39 +80,109 @@ static int64_t time_elapsed_ms(struct timeval* now, struct timeval* expire_time,
     return lookup_timeout * 1000 + timersub_ms(now, expire_time);
 }
 
-FileCache::FileCache(int64_t max_files_cached)
+// shards are only worth it when each one still holds a useful number of
+// files; the count is a power of 2 so a shard is selected with a mask
+#define FILE_CACHE_MAX_SHARDS 64
+#define FILE_CACHE_MIN_FILES_PER_SHARD 1024
+
+static unsigned get_default_shards(int64_t max_files)
+{
+    unsigned n = 1;
+
+    while ( n < FILE_CACHE_MAX_SHARDS and
+        max_files / (2 * n) >= FILE_CACHE_MIN_FILES_PER_SHARD )
+        n <<= 1;
+
+    return n;
+}
+
+FileCache::FileCache(int64_t max_files_cached, unsigned shards_requested)
 {
     max_files = max_files_cached;
-    fileHash = xhash_new(max_files, sizeof(FileHashKey), sizeof(FileNode),
-        0, 1, file_cache_anr_free_func, file_cache_free_func, 1);
-    if (!fileHash)
-        FatalError("Failed to create the expected channel hash table.\n");
-    xhash_set_max_nodes(fileHash, max_files);
+
+    if ( !shards_requested )
+        num_shards = get_default_shards(max_files);
+    else
+    {
+        num_shards = 1;
+
+        while ( num_shards < shards_requested and num_shards < FILE_CACHE_MAX_SHARDS )
+            num_shards <<= 1;
+    }
+
+    int rows = max_files / num_shards;
+
+    // new[] need not honor the alignment before c++17
+    void* p = nullptr;
+
+    if ( posix_memalign(&p, alignof(Shard), num_shards * sizeof(Shard)) )
+        throw std::bad_alloc();
+
+    shards = (Shard*)p;
+
+    for ( unsigned i = 0; i < num_shards; ++i )
+        new(shards + i) Shard;
+
+    for ( unsigned i = 0; i < num_shards; ++i )
+    {
+        shards[i].fileHash = xhash_new(rows, sizeof(FileHashKey), sizeof(FileNode),
+            0, 1, file_cache_anr_free_func, file_cache_free_func, 1);
+        if (!shards[i].fileHash)
+            FatalError("Failed to create the expected channel hash table.\n");
+    }
+    set_shard_max_nodes();
 }
 
 FileCache::~FileCache()
 {
-    if (fileHash)
+    for ( unsigned i = 0; i < num_shards; ++i )
+    {
+        if (shards[i].fileHash)
+            xhash_delete(shards[i].fileHash);
+
+        shards[i].~Shard();
+    }
+    free(shards);
+}
+
+// caller must hold config_mutex
+void FileCache::set_shard_max_nodes()
+{
+    int64_t per_shard = max_files / num_shards;
+
+    if ( per_shard < 1 )
+        per_shard = 1;
+
+    for ( unsigned i = 0; i < num_shards; ++i )
     {
-        xhash_delete(fileHash);
+        std::lock_guard<std::mutex> lock(shards[i].shard_mutex);
+        xhash_set_max_nodes(shards[i].fileHash, per_shard);
     }
 }
 
+FileCache::Shard& FileCache::get_shard(const FileHashKey& hashKey)
+{
+    uint32_t a = (uint32_t)hashKey.file_id;
+    uint32_t b = (uint32_t)(hashKey.file_id >> 32);
+    uint32_t c = hashKey.sip.get_ip6_ptr()[3] ^ hashKey.dip.get_ip6_ptr()[3];
+
+    finalize(a, b, c);
+    return shards[c & (num_shards - 1)];
+}
+
 void FileCache::set_block_timeout(int64_t timeout)
 {
-    std::lock_guard<std::mutex> lock(cache_mutex);
     block_timeout = timeout;
 }
 
 void FileCache::set_lookup_timeout(int64_t timeout)
 {
-    std::lock_guard<std::mutex> lock(cache_mutex);
     lookup_timeout = timeout;
 }
 
 void FileCache::set_max_files(int64_t max)
 {
-    std::lock_guard<std::mutex> lock(cache_mutex);
+    std::lock_guard<std::mutex> lock(config_mutex);
 
     int64_t minimal_files = ThreadConfig::get_instance_max() + 1;
     if (max < minimal_files)
@@ -119,7 +193,7 @@ void FileCache::set_max_files(int64_t max)
     }
     else
         max_files = max;
-    xhash_set_max_nodes(fileHash, max_files);
+    set_shard_max_nodes();
 }
 
 FileContext* FileCache::add(const FileHashKey& hashKey, int64_t timeout)
@@ -139,9 +213,10 @@ FileContext* FileCache::add(const FileHashKey& hashKey, int64_t timeout)
 
     new_node.file = new FileContext;
 
-    std::lock_guard<std::mutex> lock(cache_mutex);
+    Shard& shard = get_shard(hashKey);
+    std::lock_guard<std::mutex> lock(shard.shard_mutex);
 
-    if (xhash_add(fileHash, (void*)&hashKey, &new_node) != XHASH_OK)
+    if (xhash_add(shard.fileHash, (void*)&hashKey, &new_node) != XHASH_OK)
     {
         /* Uh, shouldn't get here...
          * There is already a node or couldn't alloc space
@@ -152,20 +227,24 @@ FileContext* FileCache::add(const FileHashKey& hashKey, int64_t timeout)
         delete new_node.file;
         return nullptr;
     }
+    shard.count = xhash_count(shard.fileHash);
 
     return new_node.file;
 }
 
 FileContext* FileCache::find(const FileHashKey& hashKey, int64_t timeout)
 {
-    std::lock_guard<std::mutex> lock(cache_mutex);
+    Shard& shard = get_shard(hashKey);
 
-    if (!xhash_count(fileHash))
+    // most lookups are misses on an idle shard; skip the lock for those
+    if (!shard.count.load(std::memory_order_relaxed))
     {
         return nullptr;
     }
 
-    XHashNode* hash_node = xhash_find_node(fileHash, &hashKey);
+    std::lock_guard<std::mutex> lock(shard.shard_mutex);
+
+    XHashNode* hash_node = xhash_find_node(shard.fileHash, &hashKey);
 
     if (!hash_node)
         return nullptr;
@@ -173,7 +252,8 @@ FileContext* FileCache::find(const FileHashKey& hashKey, int64_t timeout)
     FileNode* node = (FileNode*)hash_node->data;
     if (!node)
     {
-        xhash_free_node(fileHash, hash_node);
+        xhash_free_node(shard.fileHash, hash_node);
+        shard.count = xhash_count(shard.fileHash);
         return nullptr;
     }
 
@@ -182,7 +262,8 @@ FileContext* FileCache::find(const FileHashKey& hashKey, int64_t timeout)
 
     if (timercmp(&node->cache_expire_time, &now, <))
     {
-        xhash_free_node(fileHash, hash_node);
+        xhash_free_node(shard.fileHash, hash_node);
+        shard.count = xhash_count(shard.fileHash);
         return nullptr;
     }
 
@@ -21,6 +21,7 @@
 #ifndef FILE_CACHE_H
 #define FILE_CACHE_H
 
+#include <atomic>
 #include <mutex>
 
 #include "sfip/sf_ip.h"
@@ -54,13 +55,16 @@ PADDING_GUARD_END
         snort::FileContext* file;
     };
 
-    FileCache(int64_t max_files_cached);
+    FileCache(int64_t max_files_cached, unsigned num_shards = 0);
     ~FileCache();
 
     void set_block_timeout(int64_t);
     void set_lookup_timeout(int64_t);
     void set_max_files(int64_t);
 
+    unsigned get_num_shards() const
+    { return num_shards; }
+
     snort::FileContext* get_file(snort::Flow*, uint64_t file_id, bool to_create);
     FileVerdict cached_verdict_lookup(snort::Packet*, snort::FileInfo*,
         snort::FilePolicyBase*);
@@ -68,18 +72,32 @@ PADDING_GUARD_END
         snort::FilePolicyBase*);
 
 private:
+    // each shard is an independent LRU hash with its own lock so packet
+    // threads working on different files do not serialize on one mutex;
+    // each is on its own cache lines so neighboring locks don't share one
+    struct alignas(64) Shard
+    {
+        snort::XHash* fileHash = nullptr;
+        std::atomic<unsigned> count { 0 };
+        std::mutex shard_mutex;
+    };
+
+    Shard& get_shard(const FileHashKey&);
+    void set_shard_max_nodes();
+
     snort::FileContext* add(const FileHashKey&, int64_t timeout);
     snort::FileContext* find(const FileHashKey&, int64_t);
     snort::FileContext* get_file(snort::Flow*, uint64_t file_id, bool to_create, int64_t timeout);
     FileVerdict check_verdict(snort::Packet*, snort::FileInfo*, snort::FilePolicyBase*);
     int store_verdict(snort::Flow*, snort::FileInfo*, int64_t timeout);
 
-    /* The hash table of expected files */
-    snort::XHash* fileHash = nullptr;
-    int64_t block_timeout = DEFAULT_FILE_BLOCK_TIMEOUT;
-    int64_t lookup_timeout = DEFAULT_FILE_LOOKUP_TIMEOUT;
+    /* The hash tables of expected files */
+    Shard* shards = nullptr;
+    unsigned num_shards = 1;
+    std::atomic<int64_t> block_timeout { DEFAULT_FILE_BLOCK_TIMEOUT };
+    std::atomic<int64_t> lookup_timeout { DEFAULT_FILE_LOOKUP_TIMEOUT };
     int64_t max_files = DEFAULT_MAX_FILES_CACHED;
-    std::mutex cache_mutex;
+    std::mutex config_mutex;
 };
 
 #endif
@@ -30,11 +30,16 @@
 
 #include "file_capture.h"
 
-#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <cassert>
 
 #include "log/messages.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
 #include "utils/stats.h"
 #include "utils/util.h"
 
@@ -52,17 +57,45 @@ int64_t FileCapture::capture_block_size = 0;
 
 std::mutex FileCapture::capture_mutex;
 std::condition_variable FileCapture::capture_cv;
-std::thread* FileCapture::file_storer = nullptr;
+std::vector<std::thread*> FileCapture::file_storers;
 std::queue<FileCapture*> FileCapture::files_waiting;
+size_t FileCapture::max_files_waiting = 0;
 bool FileCapture::running = true;
 
+// maximum number of file blocks handed to the kernel in one write
+#define FILE_CAPTURE_IOV_MAX 64
+
+// writer stats are updated by the writer threads, not the packet threads,
+// so they are global and reported along with the mempool usage
+struct FileWriterStats
+{
+    std::atomic<uint64_t> files_written { 0 };
+    std::atomic<uint64_t> bytes_written { 0 };
+    std::atomic<uint64_t> write_errors { 0 };
+    std::atomic<uint64_t> backoffs { 0 };
+    std::atomic<uint64_t> max_queue_depth { 0 };
+    std::atomic<uint64_t> total_write_usecs { 0 };
+    std::atomic<uint64_t> max_write_usecs { 0 };
+};
+
+static FileWriterStats writer_stats;
+
+static void update_max(std::atomic<uint64_t>& max, uint64_t val)
+{
+    uint64_t cur = max.load(std::memory_order_relaxed);
+
+    while ( cur < val and
+        !max.compare_exchange_weak(cur, val, std::memory_order_relaxed) )
+        ;
+}
+
 FileCaptureState FileCapture::error_capture(FileCaptureState state)
 {
     file_counts.file_reserve_failures++;
     return state;
 }
 
-// Only one writer thread supported
+// Any number of writer threads can serve the queue
 void FileCapture::writer_thread()
 {
     while (true)
@@ -81,7 +114,15 @@ void FileCapture::writer_thread()
         files_waiting.pop();
         lk.unlock();
 
+        Stopwatch<SnortClock> sw;
+        sw.start();
         file->store_file();
+        sw.stop();
+
+        uint64_t usecs = clock_usecs(TO_USECS(sw.get()));
+        writer_stats.total_write_usecs += usecs;
+        update_max(writer_stats.max_write_usecs, usecs);
+
         delete file;
     }
 }
@@ -131,11 +172,17 @@ FileCapture::~FileCapture()
         delete file_info;
 }
 
-void FileCapture::init(int64_t memcap, int64_t block_size)
+void FileCapture::init(int64_t memcap, int64_t block_size, int64_t writers,
+    int64_t queue_size)
 {
     capture_block_size = block_size;
+    max_files_waiting = queue_size;
     init_mempool(memcap, capture_block_size);
-    file_storer = new std::thread(writer_thread);
+
+    running = true;
+
+    for (int64_t i = 0; i < writers; i++)
+        file_storers.push_back(new std::thread(writer_thread));
 }
 
 /*
@@ -148,14 +195,14 @@ void FileCapture::exit()
         std::lock_guard<std::mutex> lk(capture_mutex);
         running = false;
     }
-    capture_cv.notify_one();
+    capture_cv.notify_all();
 
-    if (file_storer)
+    for (auto file_storer : file_storers)
     {
         file_storer->join();
         delete file_storer;
-        file_storer = nullptr;
     }
+    file_storers.clear();
 
     if (file_mempool)
     {
@@ -356,6 +403,13 @@ FileCaptureState FileCapture::reserve_file(const FileInfo* file)
         return error_capture(capture_state);
     }
 
+    // don't hold more mempool blocks for files the writers can't take
+    if (is_backlogged())
+    {
+        writer_stats.backoffs++;
+        return error_capture(FILE_CAPTURE_BUSY);
+    }
+
     FileCaptureBlock* fileBlock = head;
 
     /*
@@ -442,42 +496,91 @@ FileCaptureBlock* FileCapture::get_file_data(uint8_t** buff, int* size)
 }
 
 /*
- * writing file data to the disk.
+ * writing a batch of file blocks to the disk.
  *
- * In the case of interrupt errors, the write is retried, but only for a
- * finite number of times.
+ * In the case of interrupt errors or short writes, the rest of the batch is
+ * retried, but only for a finite number of times.
  */
-void FileCapture::write_file_data(uint8_t* buf, size_t buf_len, FILE* fh)
+static bool write_file_batch(int fd, struct iovec* iov, int iov_cnt, off_t offset,
+    size_t batch_len)
 {
     int max_retries = 3;
-    size_t bytes_written = 0;
-    int err;
 
-    /* Nothing to write or nothing to write to */
-    if ((buf == nullptr) || (fh == nullptr))
-        return;
-
-    /* writing several times */
-    do
+    while (batch_len)
     {
-        size_t bytes_left = buf_len - bytes_written;
+        ssize_t ret = pwritev(fd, iov, iov_cnt, offset);
+
+        if (ret <= 0)
+        {
+            int err = ret ? errno : EAGAIN;
+
+            if (((err != EINTR) && (err != EAGAIN)) || (--max_retries <= 0))
+            {
+                ErrorMessage("File inspect: disk writing error - %s!\n", get_error(err));
+                return false;
+            }
+            continue;
+        }
 
-        bytes_written += fwrite(buf + bytes_written, 1, bytes_left, fh);
+        writer_stats.bytes_written += ret;
+        offset += ret;
+        batch_len -= ret;
 
-        err = ferror(fh);
-        if (err && (err != EINTR) && (err != EAGAIN))
+        // skip the blocks written completely and trim the partial one
+        size_t done = ret;
+
+        while (iov_cnt and done >= iov->iov_len)
         {
-            break;
+            done -= iov->iov_len;
+            iov++;
+            iov_cnt--;
         }
 
-        max_retries--;
+        if (iov_cnt)
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
     }
-    while ((max_retries > 0) && (bytes_written < buf_len));
 
-    if (bytes_written < buf_len)
+    return true;
+}
+
+// Gather the file blocks into large vectored writes instead of one stdio
+// write per block
+bool FileCapture::write_file_blocks(int fd)
+{
+    struct iovec iov[FILE_CAPTURE_IOV_MAX];
+    FileCaptureBlock* block = current_block;
+    off_t offset = 0;
+
+    while (block)
     {
-        ErrorMessage("File inspect: disk writing error - %s!\n", get_error(err));
+        int iov_cnt = 0;
+        size_t batch_len = 0;
+
+        for (; block and iov_cnt < FILE_CAPTURE_IOV_MAX; block = block->next)
+        {
+            if (!block->length)
+                continue;
+
+            iov[iov_cnt].iov_base = (uint8_t*)block + sizeof(*block);
+            iov[iov_cnt].iov_len = block->length;
+            batch_len += block->length;
+            iov_cnt++;
+        }
+
+        if (!iov_cnt)
+            break;
+
+        if (!write_file_batch(fd, iov, iov_cnt, offset, batch_len))
+            return false;
+
+        offset += batch_len;
     }
+
+    current_block = nullptr;
+    return true;
 }
 
 // Store files on local disk
@@ -488,50 +591,32 @@ void FileCapture::store_file()
 
     std::string& file_full_name = file_info->get_file_name();
 
-    /*Check whether the file exists*/
-    struct stat buffer;
-    if (stat (file_full_name.c_str(), &buffer) == 0)
-    {
-        return;
-    }
-
-    FILE* fh = fopen(file_full_name.c_str(), "w");
-    if (!fh )
+    // O_EXCL skips files that already exist, and keeps two writers from
+    // storing the same file at once
+    int fd = open(file_full_name.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (fd < 0)
     {
         return;
     }
 
-    // Check the file buffer
-    uint8_t* buff = nullptr;
-    int size = 0;
-    void* file_mem;
-
-    do
-    {
-        file_mem = get_file_data(&buff, &size);
-        // Get file from file buffer
-        if (!buff || !size )
-        {
-            return;
-        }
-
-        write_file_data(buff, size, fh);
-    }
-    while (file_mem);
+    if (write_file_blocks(fd))
+        writer_stats.files_written++;
+    else
+        writer_stats.write_errors++;
 
-    fclose(fh);
+    ::close(fd);
 }
 
 // Queue files to be stored to disk
-void FileCapture::store_file_async()
+bool FileCapture::store_file_async()
 {
-    // send data to the writer thread
+    // send data to the writer threads
     if (!file_info)
-        return;
+        return false;
 
     uint8_t* sha = file_info->get_file_sig_sha256();
     if (!sha)
-        return;
+        return false;
 
     std::string file_name = file_info->sha_to_string(sha);
 
@@ -540,8 +625,26 @@ void FileCapture::store_file_async()
     file_info->set_file_name(file_full_name.c_str(), file_full_name.size());
 
     std::lock_guard<std::mutex> lk(capture_mutex);
+
+    if (max_files_waiting and files_waiting.size() >= max_files_waiting)
+    {
+        writer_stats.backoffs++;
+        return false;
+    }
+
     files_waiting.push(this);
+    update_max(writer_stats.max_queue_depth, files_waiting.size());
     capture_cv.notify_one();
+    return true;
+}
+
+bool FileCapture::is_backlogged()
+{
+    if (!max_files_waiting)
+        return false;
+
+    std::lock_guard<std::mutex> lk(capture_mutex);
+    return files_waiting.size() >= max_files_waiting;
 }
 
 /*Log file capture mempool usage*/
@@ -553,6 +656,18 @@ void FileCapture::print_mem_usage()
         LogCount("Buffers in use", file_mempool->allocated());
         LogCount("Buffers in free list", file_mempool->freed());
         LogCount("Buffers in release list", file_mempool->released());
+
+        uint64_t files_written = writer_stats.files_written;
+
+        LogCount("Capture writer threads", file_storers.size());
+        LogCount("Files written", files_written);
+        LogCount("Bytes written", writer_stats.bytes_written);
+        LogCount("File write errors", writer_stats.write_errors);
+        LogCount("Files not queued (backlog)", writer_stats.backoffs);
+        LogCount("Max write queue depth", writer_stats.max_queue_depth);
+        LogCount("Avg file write usecs",
+            files_written ? writer_stats.total_write_usecs / files_written : 0);
+        LogCount("Max file write usecs", writer_stats.max_write_usecs);
     }
 }
 
@@ -567,4 +682,42 @@ TEST_CASE ("Should not segfault when file mempool is not configured", "[file_cap
 
     CHECK(fc.process_buffer((const uint8_t*)"dummy", 5, SNORT_FILE_START) == FILE_CAPTURE_MEMCAP);
 }
+
+TEST_CASE ("Captured file spanning several write batches is stored intact", "[file_capture]")
+{
+    // small blocks so the file needs more than one vectored write
+    FileCapture::init(1, 16, 2, 4);
+    CHECK(!FileCapture::is_backlogged());
+
+    uint8_t data[16 * FILE_CAPTURE_IOV_MAX * 2 + 5];
+
+    for (unsigned i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t)i;
+
+    FileCapture* fc = new FileCapture(0, sizeof(data));
+    const int half = sizeof(data) / 2;
+
+    CHECK(fc->process_buffer(data, half, SNORT_FILE_START) == FILE_CAPTURE_SUCCESS);
+    fc->process_buffer(data + half, sizeof(data) - half, SNORT_FILE_END);
+
+    FileInfo info;
+    info.set_file_size(sizeof(data));
+    CHECK(fc->reserve_file(&info) == FILE_CAPTURE_SUCCESS);
+
+    std::string name = "/tmp/snort_file_capture_test." + std::to_string(getpid());
+    unlink(name.c_str());
+    fc->get_file_info()->set_file_name(name.c_str(), name.size());
+    fc->store_file();
+    delete fc;
+
+    uint8_t stored[sizeof(data) + 1];
+    FILE* fh = fopen(name.c_str(), "r");
+    REQUIRE(fh);
+    CHECK(fread(stored, 1, sizeof(stored), fh) == sizeof(data));
+    CHECK(!memcmp(stored, data, sizeof(data)));
+    fclose(fh);
+    unlink(name.c_str());
+
+    FileCapture::exit();
+}
 #endif
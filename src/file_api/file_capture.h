@@ -30,11 +30,17 @@
 //     data will stay in the mempool.
 // 3) Then file data can be read through file_capture_read()
 // 4) Finally, file data must be released from mempool file_capture_release()
+//
+// Reserved files are queued to a pool of writer threads.  Each writer pulls
+// a file off the shared queue and writes its blocks with vectored writes.
+// When the queue reaches its configured size, new files are not reserved so
+// the mempool is not drained by files that cannot be written in time.
 
 #include <condition_variable>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <vector>
 
 #include "file_api.h"
 
@@ -57,7 +63,8 @@ public:
     ~FileCapture();
 
     // this must be called during snort init
-    static void init(int64_t memcap, int64_t block_size);
+    static void init(int64_t memcap, int64_t block_size, int64_t writers = 1,
+        int64_t queue_size = 0);
 
     // Capture file data to local buffer
     // This is the main function call to enable file capture
@@ -78,7 +85,11 @@ public:
     void store_file();
 
     // Store file to disk asynchronously
-    void store_file_async();
+    // Returns false if the file was not queued; caller still owns it then
+    bool store_file_async();
+
+    // True when the writers can't keep up and new files should not be captured
+    static bool is_backlogged();
 
     // Log file capture mempool usage
     static void print_mem_usage();
@@ -104,14 +115,15 @@ private:
     inline FileCaptureBlock* create_file_buffer();
     inline FileCaptureState save_to_file_buffer(const uint8_t* file_data, int data_size,
         int64_t max_size);
-    void write_file_data(uint8_t* buf, size_t buf_len, FILE* fh);
+    bool write_file_blocks(int fd);
 
     static FileMemPool* file_mempool;
     static int64_t capture_block_size;
     static std::mutex capture_mutex;
     static std::condition_variable capture_cv;
-    static std::thread* file_storer;
+    static std::vector<std::thread*> file_storers;
     static std::queue<FileCapture*> files_waiting;
+    static size_t max_files_waiting;
     static bool running;
 
     uint64_t capture_size;
@@ -31,6 +31,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <unordered_map>
 
 #include "log/messages.h"
 #include "utils/util.h"
@@ -73,16 +74,24 @@ void FileIdentifier::init_merge_hash()
 }
 
 FileIdentifier::~FileIdentifier()
+{
+    release_trie();
+}
+
+void FileIdentifier::release_trie()
 {
     /*Release memory used for identifiers*/
     for (auto mem_block:id_memory_blocks)
     {
         snort_free(mem_block);
     }
+    id_memory_blocks.clear();
+    identifier_root = nullptr;
 
     if (identifier_merge_hash != nullptr)
     {
         ghash_delete(identifier_merge_hash);
+        identifier_merge_hash = nullptr;
     }
 }
 
@@ -286,6 +295,9 @@ void FileIdentifier::insert_file_rule(FileMagicRule& rule)
 {
     IdentifierNode* node;
 
+    /*rules can't be added once the trie has been compiled and released*/
+    assert(!compiled);
+
     if (!identifier_root)
     {
         identifier_root = (IdentifierNode*)calloc_mem(sizeof(*identifier_root));
@@ -310,9 +322,124 @@ void FileIdentifier::insert_file_rule(FileMagicRule& rule)
     update_trie(identifier_root, node);
 }
 
+/*
+ * Flatten the trie into the state array.  Shared trie nodes map to a single
+ * state.  For each state the most common next node becomes the default and
+ * only the bytes leading elsewhere are listed; states listing more than
+ * FILE_MAGIC_SPARSE_MAX bytes get a full row instead.
+ */
+#define FILE_MAGIC_SPARSE_MAX 16
+
+void FileIdentifier::compile()
+{
+    if (compiled)
+        return;
+
+    compiled = true;
+
+    if (!identifier_root)
+        return;
+
+    std::unordered_map<const IdentifierNode*, uint32_t> index;
+    std::vector<const IdentifierNode*> nodes;
+
+    index[identifier_root] = 0;
+    nodes.emplace_back(identifier_root);
+
+    /*number the nodes breadth first so early offsets are close together*/
+    for (unsigned n = 0; n < nodes.size(); n++)
+    {
+        for (auto next : nodes[n]->next)
+        {
+            if (next and index.find(next) == index.end())
+            {
+                index[next] = nodes.size();
+                nodes.emplace_back(next);
+            }
+        }
+    }
+
+    auto state_of = [&index](const IdentifierNode* node)
+    { return node ? index[node] : FILE_MAGIC_NO_STATE; };
+
+    states.resize(nodes.size());
+
+    for (unsigned n = 0; n < nodes.size(); n++)
+    {
+        const IdentifierNode* node = nodes[n];
+        FileMagicState& state = states[n];
+
+        state.offset = node->offset;
+        state.type_id = node->type_id;
+
+        /*the default is the most frequent next node*/
+        std::unordered_map<const IdentifierNode*, unsigned> freq;
+        const IdentifierNode* dflt = nullptr;
+        unsigned best = 0;
+
+        for (auto next : node->next)
+        {
+            unsigned f = ++freq[next];
+
+            if (f > best)
+            {
+                best = f;
+                dflt = next;
+            }
+        }
+
+        state.dflt = state_of(dflt);
+        unsigned count = MAX_BRANCH - best;
+
+        if (count > FILE_MAGIC_SPARSE_MAX)
+        {
+            state.count = FILE_MAGIC_DENSE;
+            state.next = dense_next.size();
+
+            for (auto next : node->next)
+                dense_next.emplace_back(state_of(next));
+        }
+        else
+        {
+            state.count = count;
+            state.next = sparse_bytes.size();
+
+            for (unsigned i = 0; i < MAX_BRANCH; i++)
+            {
+                if (node->next[i] != dflt)
+                {
+                    sparse_bytes.emplace_back(i);
+                    sparse_next.emplace_back(state_of(node->next[i]));
+                }
+            }
+        }
+    }
+
+    release_trie();
+
+    memory_used = states.size() * sizeof(FileMagicState) + sparse_bytes.size() +
+        (sparse_next.size() + dense_next.size()) * sizeof(uint32_t);
+}
+
+inline uint32_t FileIdentifier::next_state(const FileMagicState& state, uint8_t byte) const
+{
+    if (state.count == FILE_MAGIC_DENSE)
+        return dense_next[state.next + byte];
+
+    const uint8_t* bytes = &sparse_bytes[state.next];
+
+    for (unsigned i = 0; i < state.count; i++)
+    {
+        if (bytes[i] == byte)
+            return sparse_next[state.next + i];
+    }
+
+    return state.dflt;
+}
+
 /*
  * This is the main function to find file type
- * Find file type is to traverse the tries.
+ * Find file type is to walk the automaton.
  * Context is saved to continue file type identification as data becomes available
  */
 uint32_t FileIdentifier::find_file_type_id(const uint8_t* buf, int len, uint64_t file_offset,
@@ -325,25 +452,31 @@ uint32_t FileIdentifier::find_file_type_id(const uint8_t* buf, int len, uint64_t
     if ( !buf || len <= 0 )
         return SNORT_FILE_TYPE_CONTINUE;
 
-    if (!(*context))
-        *context = (void*)(identifier_root);
+    /*compiled when the config loads; packet threads only read it*/
+    assert(compiled);
 
-    IdentifierNode* current = (IdentifierNode*)(*context);
+    /*the context holds the state index + 1*/
+    uint32_t current = (*context) ? (uint32_t)((uintptr_t)(*context) - 1) : 0;
+
+    if (states.empty())
+        current = FILE_MAGIC_NO_STATE;
 
     uint64_t end = file_offset + len;
 
-    while (current &&  (current->offset >= file_offset))
+    while ((current != FILE_MAGIC_NO_STATE) && (states[current].offset >= file_offset))
     {
+        const FileMagicState& state = states[current];
+
         /*Found file id, save and continue*/
-        if (current->type_id)
+        if (state.type_id)
         {
-            file_type_id = current->type_id;
+            file_type_id = state.type_id;
         }
 
-        if ( current->offset >= end )
+        if ( state.offset >= end )
         {
             /* Save current state */
-            *context = current;
+            *context = (void*)((uintptr_t)current + 1);
             if (file_type_id)
                 return file_type_id;
             else
@@ -351,7 +484,7 @@ uint32_t FileIdentifier::find_file_type_id(const uint8_t* buf, int len, uint64_t
         }
 
         /*Move to the next level*/
-        current = current->next[buf[current->offset - file_offset ]];
+        current = next_state(state, buf[state.offset - file_offset]);
     }
 
     /*Either end of magics or passed the current offset*/
@@ -418,6 +551,7 @@ TEST_CASE ("FileIdRulePDF", "[FileMagic]")
     FileIdentifier rc;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDF";
 
@@ -442,6 +576,7 @@ TEST_CASE ("FileIdRuleUnknow", "[FileMagic]")
     FileIdentifier rc;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "DDF";
 
@@ -477,6 +612,7 @@ TEST_CASE ("FileIdRuleEXE", "[FileMagic]")
     rule.id = 3;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDFooo";
     void* context = nullptr;
@@ -510,6 +646,7 @@ TEST_CASE ("FileIdRulePDFEXE", "[FileMagic]")
     rule.id = 3;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDFEXE";
     void* context = nullptr;
@@ -544,11 +681,124 @@ TEST_CASE ("FileIdRuleFirst", "[FileMagic]")
     rule.id = 3;
 
     rc.insert_file_rule(rule);
+    rc.compile();
 
     const char* data = "PDF";
     void* context = nullptr;
 
     CHECK(rc.find_file_type_id((const uint8_t*)data, strlen(data), 0, &context) == 1);
 }
-#endif
 
+TEST_CASE ("FileIdRuleAcrossCalls", "[FileMagic]")
+{
+    FileMagicData magic;
+
+    magic.content = "PDF";
+    magic.offset = 0;
+
+    FileMagicRule rule;
+
+    rule.type = "exe";
+    rule.file_magics.emplace_back(magic);
+    rule.id = 1;
+
+    FileIdentifier rc;
+    rc.insert_file_rule(rule);
+
+    magic.clear();
+    magic.content = "EXE";
+    magic.offset = 3;
+
+    rule.clear();
+    rule.type = "exe";
+    rule.file_magics.emplace_back(magic);
+    rule.id = 3;
+
+    rc.insert_file_rule(rule);
+    rc.compile();
+
+    const char* data = "PDFEXE";
+    void* context = nullptr;
+
+    // the saved state picks up where the previous segment stopped
+    CHECK((rc.find_file_type_id((const uint8_t*)data, 2, 0, &context) ==
+        SNORT_FILE_TYPE_CONTINUE));
+    CHECK(context != nullptr);
+    CHECK((rc.find_file_type_id((const uint8_t*)data + 2, 2, 2, &context) == 1));
+    CHECK(context != nullptr);
+    CHECK((rc.find_file_type_id((const uint8_t*)data + 4, 2, 4, &context) == 3));
+}
+
+#ifdef BENCHMARK_TEST
+TEST_CASE ("FileIdHeaders", "[FileMagic]")
+{
+    static const struct { const char* content; unsigned len; unsigned offset; }
+    magics[] =
+    {
+        { "%PDF-", 5, 0 }, { "PK\x03\x04", 4, 0 }, { "MZ", 2, 0 }, { "GIF87a", 6, 0 },
+        { "GIF89a", 6, 0 }, { "\x89PNG\r\n\x1a\n", 8, 0 }, { "\xff\xd8\xff", 3, 0 },
+        { "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", 8, 0 }, { "\x7f" "ELF", 4, 0 },
+        { "Rar!\x1a\x07", 6, 0 }, { "7z\xbc\xaf\x27\x1c", 6, 0 }, { "\x1f\x8b\x08", 3, 0 },
+        { "BZh", 3, 0 }, { "ustar", 5, 257 }, { "CWS", 3, 0 }, { "FWS", 3, 0 },
+        { "ZWS", 3, 0 }, { "{\\rtf1", 6, 0 }, { "ftypisom", 8, 4 }, { "RIFF", 4, 0 },
+    };
+
+    FileIdentifier rc;
+    uint32_t id = 1;
+
+    for ( const auto& m : magics )
+    {
+        FileMagicRule rule;
+        FileMagicData magic;
+
+        magic.content.assign(m.content, m.len);
+        magic.offset = m.offset;
+        rule.type = "type";
+        rule.file_magics.emplace_back(magic);
+        rule.id = id++;
+        rc.insert_file_rule(rule);
+    }
+
+    // synthetic rules to grow the automaton toward a full rule set
+    for ( unsigned i = 0; i < 200; ++i )
+    {
+        FileMagicRule rule;
+        FileMagicData magic;
+
+        magic.content = "SYN";
+        magic.content += (char)('A' + i % 26);
+        magic.content += (char)('a' + i / 26);
+        magic.offset = (i % 4) * 8;
+        rule.type = "synthetic";
+        rule.file_magics.emplace_back(magic);
+        rule.id = id++;
+        rc.insert_file_rule(rule);
+    }
+    rc.compile();
+
+    std::vector<std::string> headers;
+
+    for ( const auto& m : magics )
+    {
+        std::string hdr(512, 'x');
+        hdr.replace(m.offset, m.len, m.content, m.len);
+        headers.emplace_back(hdr);
+    }
+    headers.emplace_back(std::string(512, '\0'));
+
+    uint32_t found = 0;
+
+    BENCHMARK("find_file_type_id")
+    {
+        found = 0;
+        for ( const auto& hdr : headers )
+        {
+            void* context = nullptr;
+            found += rc.find_file_type_id((const uint8_t*)hdr.data(), hdr.size(), 0, &context)
+                != SNORT_FILE_TYPE_UNKNOWN;
+        }
+    }
+    CHECK(found == sizeof(magics) / sizeof(magics[0]));
+}
+#endif
+#endif
@@ -25,6 +25,12 @@
 // File type identification is based on file magic. To improve the detection
 // performance, a trie is created to scan file data once. Currently, only the
 // most specific file type is returned.
+//
+// Once all rules are inserted the trie is compiled into a flat automaton:
+// one array of states indexed by position, with each state's transitions
+// stored either as a short list of bytes (most states branch on a few
+// bytes) or as a full 256 entry row.  The pointer trie is released after
+// compilation.
 
 #include <list>
 #include <vector>
@@ -81,12 +87,26 @@ struct IdentifierNode
 
 typedef std::list<void* >  IDMemoryBlocks;
 
+#define FILE_MAGIC_NO_STATE UINT32_MAX
+#define FILE_MAGIC_DENSE UINT16_MAX
+
+struct FileMagicState
+{
+    uint32_t offset;        /* offset from file start */
+    uint32_t type_id;
+    uint32_t next;          /* first sparse transition or dense row */
+    uint32_t dflt;          /* next state for bytes not in the sparse list */
+    uint16_t count;         /* sparse transitions or FILE_MAGIC_DENSE */
+};
+
 class FileIdentifier
 {
 public:
     ~FileIdentifier();
     uint32_t memory_usage() { return memory_used; }
     void insert_file_rule(FileMagicRule& rule);
+    // call once all rules are inserted and before find_file_type_id()
+    void compile();
     uint32_t find_file_type_id(const uint8_t* buf, int len, uint64_t offset, void** context);
     FileMagicRule* get_rule_from_id(uint32_t);
     void get_magic_rule_ids_from_type(const std::string&, const std::string&, snort::FileTypeBitSet&);
@@ -99,6 +119,8 @@ private:
     bool update_next(IdentifierNode* start, IdentifierNode** next_ptr, IdentifierNode* append);
     IdentifierNode* create_trie_from_magic(FileMagicRule& rule, uint32_t type_id);
     void update_trie(IdentifierNode* start, IdentifierNode* append);
+    void release_trie();
+    uint32_t next_state(const FileMagicState&, uint8_t) const;
 
     /*properties*/
     IdentifierNode* identifier_root = nullptr; /*Root of magic tries*/
@@ -106,6 +128,13 @@ private:
     snort::GHash* identifier_merge_hash = nullptr;
     FileMagicRule file_magic_rules[FILE_ID_MAX + 1];
     IDMemoryBlocks id_memory_blocks;
+
+    /*compiled automaton, state 0 is the root*/
+    bool compiled = false;
+    std::vector<FileMagicState> states;
+    std::vector<uint8_t> sparse_bytes;
+    std::vector<uint32_t> sparse_next;
+    std::vector<uint32_t> dense_next;
 };
 
 #endif
@@ -149,6 +149,12 @@ static const Parameter file_id_params[] =
     { "capture_block_size", Parameter::PT_INT, "8:max53", "32768",
       "file capture block size in bytes" },
 
+    { "capture_writers", Parameter::PT_INT, "1:32", "1",
+      "number of threads writing captured files to disk" },
+
+    { "capture_queue_size", Parameter::PT_INT, "0:max32", "1024",
+      "maximum number of captured files waiting to be written (0 is unlimited)" },
+
     { "max_files_cached", Parameter::PT_INT, "8:max53", "65536",
       "maximal number of files cached in memory" },
 
@@ -247,6 +253,12 @@ bool FileIdModule::set(const char*, Value& v, SnortConfig*)
     else if ( v.is("capture_block_size") )
         fc->capture_block_size = v.get_int64();
 
+    else if ( v.is("capture_writers") )
+        fc->capture_writers = v.get_int64();
+
+    else if ( v.is("capture_queue_size") )
+        fc->capture_queue_size = v.get_int64();
+
     else if ( v.is("max_files_cached") )
         fc->max_files_cached = v.get_int64();
 
@@ -423,6 +435,7 @@ void FileIdModule::load_config(FileConfig*& dst)
 
     if (fc)
     {
+        fc->compile_file_magics();
         fc->get_file_policy().load();
         fc = nullptr;
     }
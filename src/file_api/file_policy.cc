@@ -175,9 +175,8 @@ FileVerdict FilePolicy::signature_lookup(Packet*, FileInfo* file)
     {
         FileCapture* captured = nullptr;
 
-        if (file->reserve_file(captured) == FILE_CAPTURE_SUCCESS)
-            captured->store_file_async();
-        else
+        if (file->reserve_file(captured) != FILE_CAPTURE_SUCCESS or
+            !captured->store_file_async())
             delete captured;
     }
 
@@ -51,6 +51,8 @@ FileCache* FileService::file_cache = nullptr;
 static int64_t max_files_cached = 0;
 static int64_t capture_memcap = 0;
 static int64_t capture_block_size = 0;
+static int64_t capture_writers = 0;
+static int64_t capture_queue_size = 0;
 
 void FileService::init()
 {
@@ -73,9 +75,12 @@ void FileService::post_init()
 
     if (file_capture_enabled)
     {
-        FileCapture::init(conf->capture_memcap, conf->capture_block_size);
+        FileCapture::init(conf->capture_memcap, conf->capture_block_size,
+            conf->capture_writers, conf->capture_queue_size);
         capture_memcap = conf->capture_memcap;
         capture_block_size = conf->capture_block_size;
+        capture_writers = conf->capture_writers;
+        capture_queue_size = conf->capture_queue_size;
     }
 }
 
@@ -95,6 +100,10 @@ void FileService::verify_reload(SnortConfig* sc)
             ReloadError("Changing file_id:capture_memcap requires a restart\n");
         if (capture_block_size != conf->capture_block_size)
             ReloadError("Changing file_id:capture_block_size requires a restart\n");
+        if (capture_writers != conf->capture_writers)
+            ReloadError("Changing file_id:capture_writers requires a restart\n");
+        if (capture_queue_size != conf->capture_queue_size)
+            ReloadError("Changing file_id:capture_queue_size requires a restart\n");
     }
 }
 
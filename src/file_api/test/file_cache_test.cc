@@ -0,0 +1,313 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// file_cache_test.cc
+// unit tests and contention benchmarks for the sharded file cache
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "file_api/file_cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "file_api/file_flows.h"
+#include "file_api/file_lib.h"
+#include "file_api/file_stats.h"
+#include "flow/flow.h"
+#include "main/snort_config.h"
+#include "main/thread_config.h"
+#include "packet_io/active.h"
+#include "packet_tracer/packet_tracer.h"
+#include "time/packet_time.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+using namespace snort;
+
+// Stubs whose sole purpose is to make the test code link
+static std::atomic<int> contexts_alive { 0 };
+static struct timeval s_now = { 1000, 0 };
+static bool s_clock_running = false;
+static std::atomic<time_t> s_ticks { 0 };
+
+THREAD_LOCAL FileCounts file_counts;
+
+namespace snort
+{
+SnortConfig* SnortConfig::get_conf() { return nullptr; }
+FileInfo::~FileInfo() = default;
+FileInfo& FileInfo::operator=(const FileInfo&) { return *this; }
+uint64_t FileInfo::get_file_id() const { return file_id; }
+uint8_t* FileInfo::get_file_sig_sha256() const { return sha256; }
+FileContext::FileContext() { contexts_alive++; }
+FileContext::~FileContext() { contexts_alive--; }
+Flow::Flow() = default;
+FileFlows* FileFlows::get_file_flows(Flow*) { return nullptr; }
+void FileFlows::add_pending_file(uint64_t) { }
+void Active::set_delayed_action(ActiveAction, bool) { }
+THREAD_LOCAL PacketTracer* s_pkt_trace = nullptr;
+void PacketTracer::log(const char*, ...) { }
+void ErrorMessage(const char*, ...) { }
+[[noreturn]] void FatalError(const char*, ...) { exit(-1); }
+int64_t timersub_ms(const struct timeval*, const struct timeval*) { return 0; }
+char* snort_strdup(const char* s) { return strdup(s); }
+}
+
+unsigned ThreadConfig::get_instance_max() { return 32; }
+FileConfig* get_file_config(SnortConfig*) { return nullptr; }
+void packet_gettimeofday(struct timeval* tv)
+{
+    *tv = s_now;
+
+    // every call sees a later second so zero timeout entries expire at once
+    if ( s_clock_running )
+        tv->tv_sec += ++s_ticks;
+}
+
+static void set_flow(Flow& flow, uint32_t client, uint32_t server)
+{
+    flow.client_ip.set(&client, AF_INET);
+    flow.server_ip.set(&server, AF_INET);
+}
+
+TEST_GROUP(file_cache)
+{
+    void setup() override
+    {
+        s_now = { 1000, 0 };
+        file_counts.cache_add_fails = 0;
+    }
+
+    void teardown() override
+    {
+        CHECK(contexts_alive == 0);
+    }
+};
+
+TEST(file_cache, default_shards)
+{
+    FileCache small(8);
+    CHECK(small.get_num_shards() == 1);
+
+    FileCache dflt(DEFAULT_MAX_FILES_CACHED);
+    CHECK(dflt.get_num_shards() > 1);
+    CHECK((dflt.get_num_shards() & (dflt.get_num_shards() - 1)) == 0);
+
+    FileCache asked(65536, 5);
+    CHECK(asked.get_num_shards() == 8);
+}
+
+TEST(file_cache, add_find)
+{
+    FileCache cache(4096);
+    Flow flow;
+    set_flow(flow, 0x0a000001, 0x0a000002);
+
+    CHECK(cache.get_file(&flow, 1, false) == nullptr);
+
+    FileContext* ctx = cache.get_file(&flow, 1, true);
+    CHECK(ctx != nullptr);
+    CHECK(cache.get_file(&flow, 1, false) == ctx);
+    CHECK(cache.get_file(&flow, 1, true) == ctx);
+    CHECK(cache.get_file(&flow, 2, false) == nullptr);
+
+    set_flow(flow, 0x0a000003, 0x0a000002);
+    CHECK(cache.get_file(&flow, 1, false) == nullptr);
+}
+
+TEST(file_cache, expire)
+{
+    FileCache cache(4096);
+    cache.set_lookup_timeout(2);
+
+    Flow flow;
+    set_flow(flow, 0x0a000001, 0x0a000002);
+
+    CHECK(cache.get_file(&flow, 7, true) != nullptr);
+
+    s_now.tv_sec += 1;
+    CHECK(cache.get_file(&flow, 7, false) != nullptr);
+
+    // the lookup above refreshed the timer
+    s_now.tv_sec += 2;
+    CHECK(cache.get_file(&flow, 7, false) != nullptr);
+
+    s_now.tv_sec += 3;
+    CHECK(cache.get_file(&flow, 7, false) == nullptr);
+}
+
+TEST(file_cache, recycle_expired)
+{
+    FileCache cache(16, 1);
+    cache.set_lookup_timeout(1);
+
+    Flow flow;
+    set_flow(flow, 0x0a000001, 0x0a000002);
+
+    for ( uint64_t id = 1; id <= 16; ++id )
+        CHECK(cache.get_file(&flow, id, true) != nullptr);
+
+    // full of live files
+    CHECK(cache.get_file(&flow, 17, true) == nullptr);
+    CHECK(file_counts.cache_add_fails == 1);
+
+    // expired nodes are reclaimed when the shard is full
+    s_now.tv_sec += 5;
+
+    for ( uint64_t id = 101; id <= 116; ++id )
+        CHECK(cache.get_file(&flow, id, true) != nullptr);
+
+    CHECK(file_counts.cache_add_fails == 1);
+    CHECK(contexts_alive == 16);
+}
+
+TEST(file_cache, shard_capacity)
+{
+    FileCache cache(64, 4);
+    Flow flow;
+    set_flow(flow, 0x0a000001, 0x0a000002);
+
+    for ( uint64_t id = 1; id <= 256; ++id )
+        cache.get_file(&flow, id, true);
+
+    // the total across shards never exceeds the configured maximum
+    CHECK(contexts_alive <= 64);
+    CHECK(file_counts.cache_add_fails >= 256 - 64);
+}
+
+TEST(file_cache, concurrent)
+{
+    const unsigned num_threads = 32;
+    const uint64_t files_per_thread = 256;
+    FileCache cache(num_threads * files_per_thread * 2);
+    std::atomic<unsigned> misses { 0 };
+    std::vector<std::thread> threads;
+
+    for ( unsigned t = 0; t < num_threads; ++t )
+    {
+        threads.emplace_back([&cache, &misses, t, files_per_thread]()
+        {
+            Flow flow;
+            set_flow(flow, 0x0a000000 + t, 0x0b000001);
+
+            for ( uint64_t id = 1; id <= files_per_thread; ++id )
+                cache.get_file(&flow, id, true);
+
+            for ( uint64_t id = 1; id <= files_per_thread; ++id )
+                if ( !cache.get_file(&flow, id, false) )
+                    misses++;
+        });
+    }
+    for ( auto& th : threads )
+        th.join();
+
+    CHECK(misses == 0);
+}
+
+#ifdef BENCHMARK_TEST
+// lookups per second with 32 threads hammering one cache; compare against
+// a single shard to see what the old single lock design cost
+static double run_contention(unsigned shards, unsigned num_threads, unsigned ops)
+{
+    FileCache cache(65536, shards);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned t = 0; t < num_threads; ++t )
+    {
+        threads.emplace_back([&cache, t, ops]()
+        {
+            Flow flow;
+            set_flow(flow, 0x0a000000 + t, 0x0b000001);
+
+            for ( uint64_t id = 1; id <= 512; ++id )
+                cache.get_file(&flow, id, true);
+
+            for ( unsigned i = 0; i < ops; ++i )
+                cache.get_file(&flow, (i % 1024) + 1, false);
+        });
+    }
+    for ( auto& th : threads )
+        th.join();
+
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return (double)num_threads * ops / secs.count();
+}
+
+// adds with a short timeout into a full cache so every add recycles an
+// expired node
+static double run_expiry(unsigned shards, unsigned num_threads, unsigned ops)
+{
+    FileCache cache(4096, shards);
+    cache.set_lookup_timeout(0);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned t = 0; t < num_threads; ++t )
+    {
+        threads.emplace_back([&cache, t, ops]()
+        {
+            Flow flow;
+            set_flow(flow, 0x0a000000 + t, 0x0b000001);
+
+            for ( unsigned i = 0; i < ops; ++i )
+                cache.get_file(&flow, i + 1, true);
+        });
+    }
+    for ( auto& th : threads )
+        th.join();
+
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return (double)num_threads * ops / secs.count();
+}
+
+TEST_GROUP(file_cache_benchmark)
+{ };
+
+TEST(file_cache_benchmark, contention_32_threads)
+{
+    double single = run_contention(1, 32, 100000);
+    double sharded = run_contention(0, 32, 100000);
+    printf("\nfile_cache lookups/sec: 1 shard %.0f, sharded %.0f\n", single, sharded);
+}
+
+TEST(file_cache_benchmark, expiry_32_threads)
+{
+    s_clock_running = true;
+    double single = run_expiry(1, 32, 20000);
+    double sharded = run_expiry(0, 32, 20000);
+    s_clock_running = false;
+    printf("\nfile_cache expiring adds/sec: 1 shard %.0f, sharded %.0f\n", single, sharded);
+    CHECK(contexts_alive == 0);
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    // the leak detector is not thread safe and several tests run 32 threads
+    MemoryLeakWarningPlugin::turnOffNewDeleteOverloads();
+
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
+
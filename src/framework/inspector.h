@@ -38,7 +38,7 @@ struct SnortConfig;
 struct Packet;
 
 // this is the current version of the api
-#define INSAPI_VERSION ((BASE_API_VERSION << 16) | 0)
+#define INSAPI_VERSION ((BASE_API_VERSION << 16) | 1)
 
 struct InspectionBuffer
 {
@@ -108,6 +108,10 @@ public:
 
     SnortProtocolId get_service() { return snort_protocol_id; }
 
+    // for latency histograms
+    void set_latency_id(unsigned id) { latency_id = id; }
+    unsigned get_latency_id() { return latency_id; }
+
     // for well known buffers
     // well known buffers may be included among generic below,
     // but they must be accessible from here
@@ -148,6 +152,7 @@ private:
     const InspectApi* api;
     std::atomic_uint* ref_count;
     SnortProtocolId snort_protocol_id;
+    unsigned latency_id = 0;
 };
 
 template <typename T>
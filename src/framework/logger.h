@@ -33,7 +33,7 @@ namespace snort
 struct Packet;
 
 // this is the current version of the api
-#define LOGAPI_VERSION ((BASE_API_VERSION << 16) | 0)
+#define LOGAPI_VERSION ((BASE_API_VERSION << 16) | 2)
 
 #define OUTPUT_TYPE_FLAG__NONE  0x0
 #define OUTPUT_TYPE_FLAG__ALERT 0x1
@@ -56,9 +56,25 @@ public:
     virtual void close() { }
     virtual void reset() { }
 
+    // called on the packet thread when there is no traffic; write out
+    // anything buffered
+    virtual void idle() { }
+
+    // called on the packet thread after each packet; check anything that
+    // must be written within some time even if no further event arrives
+    virtual void tick() { }
+
     virtual void alert(Packet*, const char*, const Event&) { }
     virtual void log(Packet*, const char*, Event*) { }
 
+    // true if alert() and log() only use the event and the packet itself
+    // (headers, payload, file data, flow key and service) plus LogAppID()
+    // and not other stream or inspector state.  then they may be called on
+    // a logger thread that is opened and closed separately from the packet
+    // thread.
+    virtual bool can_run_async() const
+    { return false; }
+
     void set_api(const LogApi* p)
     { api = p; }
 
@@ -26,6 +26,7 @@
 #include <cassert>
 
 #include "profiler/profiler_defs.h"
+#include "latency/latency_histogram.h"
 #include "search_engines/pat_stats.h"
 #include "managers/mpse_manager.h"
 #include "managers/module_manager.h"
@@ -49,6 +50,7 @@ Mpse::Mpse(const char* m)
     method = m;
     verbose = 0;
     api = nullptr;
+    latency_id = LatencyHistograms::get_id(("search." + method).c_str());
 }
 
 int Mpse::search(
@@ -56,6 +58,7 @@ int Mpse::search(
     void* context, int* current_state)
 {
     DeepProfile profile(mpsePerfStats);
+    LatencyHistograms::Timer latency(latency_id);
     pmqs.matched_bytes += n;
     return _search(T, n, match, context, current_state);
 }
@@ -65,6 +68,7 @@ int Mpse::search_all(
     void* context, int* current_state)
 {
     DeepProfile profile(mpsePerfStats);
+    LatencyHistograms::Timer latency(latency_id);
     pmqs.matched_bytes += n;
     return _search(T, n, match, context, current_state);
 }
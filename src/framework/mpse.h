@@ -38,7 +38,7 @@
 namespace snort
 {
 // this is the current version of the api
-#define SEAPI_VERSION ((BASE_API_VERSION << 16) | 0)
+#define SEAPI_VERSION ((BASE_API_VERSION << 16) | 1)
 
 struct SnortConfig;
 class Mpse;
@@ -117,6 +117,7 @@ private:
     std::string method;
     int verbose;
     const MpseApi* api;
+    unsigned latency_id;
 };
 
 extern THREAD_LOCAL ProfileStats mpsePerfStats;
@@ -0,0 +1,432 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+// thread_counts.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "thread_counts.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+using namespace snort;
+
+//-------------------------------------------------------------------------
+// block
+//-------------------------------------------------------------------------
+
+void CounterBlock::publish(const PegCount* src)
+{
+    std::atomic<PegCount>* c = counts();
+    begin_update();
+
+    for ( unsigned i = 0; i < num_counts; ++i )
+        c[i].store(src[i], std::memory_order_relaxed);
+
+    end_update();
+}
+
+bool CounterBlock::read(PegCount* dst, unsigned max_tries) const
+{
+    const std::atomic<PegCount>* c = counts();
+
+    for ( unsigned t = 0; t < max_tries; ++t )
+    {
+        uint64_t s = seq.load(std::memory_order_acquire);
+
+        if ( s & 1 )
+            continue;
+
+        for ( unsigned i = 0; i < num_counts; ++i )
+            dst[i] = c[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if ( seq.load(std::memory_order_relaxed) == s )
+            return true;
+    }
+    // dst has the last (possibly mixed) copy
+    return false;
+}
+
+//-------------------------------------------------------------------------
+// set
+//-------------------------------------------------------------------------
+
+CounterSet::CounterSet(const PegInfo* p) : pegs(p)
+{
+    num_counts = 0;
+
+    while ( pegs[num_counts].name )
+        ++num_counts;
+
+    retired.resize(num_counts, 0);
+}
+
+CounterSet::~CounterSet()
+{
+    for ( auto b : blocks )
+        free(b);
+}
+
+CounterBlock* CounterSet::attach()
+{
+    // the counts are padded to whole lines so neighboring blocks don't
+    // share a line either
+    const unsigned line = CounterBlock::LINE_SIZE;
+    size_t size = line + (num_counts * sizeof(PegCount) + line - 1) / line * line;
+    void* p = nullptr;
+
+    if ( posix_memalign(&p, line, size) )
+        throw std::bad_alloc();
+
+    CounterBlock* b = new(p) CounterBlock(num_counts);
+    std::atomic<PegCount>* c = b->counts();
+
+    for ( unsigned i = 0; i < num_counts; ++i )
+        new(c + i) std::atomic<PegCount>(0);
+
+    std::lock_guard<std::mutex> hold(lock);
+    blocks.emplace_back(b);
+    return b;
+}
+
+void CounterSet::detach(CounterBlock* b)
+{
+    std::vector<PegCount> tmp(num_counts);
+    b->read(tmp.data());
+
+    std::lock_guard<std::mutex> hold(lock);
+
+    for ( unsigned i = 0; i < num_counts; ++i )
+    {
+        if ( pegs[i].type == CountType::SUM )
+            retired[i] += tmp[i];
+
+        else if ( pegs[i].type == CountType::MAX and tmp[i] > retired[i] )
+            retired[i] = tmp[i];
+    }
+
+    for ( auto it = blocks.begin(); it != blocks.end(); ++it )
+    {
+        if ( *it == b )
+        {
+            blocks.erase(it);
+            break;
+        }
+    }
+    free(b);
+}
+
+void CounterSet::read(PegCount* dst) const
+{
+    std::vector<PegCount> tmp(num_counts);
+    std::lock_guard<std::mutex> hold(lock);
+
+    for ( unsigned i = 0; i < num_counts; ++i )
+        dst[i] = (pegs[i].type == CountType::NOW) ? 0 : retired[i];
+
+    for ( auto b : blocks )
+    {
+        b->read(tmp.data());
+
+        for ( unsigned i = 0; i < num_counts; ++i )
+        {
+            if ( pegs[i].type != CountType::MAX )
+                dst[i] += tmp[i];
+
+            else if ( tmp[i] > dst[i] )
+                dst[i] = tmp[i];
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+// rate
+//-------------------------------------------------------------------------
+
+CounterRate::CounterRate(const PegInfo* p) : pegs(p)
+{
+    unsigned n = 0;
+
+    while ( pegs[n].name )
+        ++n;
+
+    last.resize(n, 0);
+}
+
+void CounterRate::update(const PegCount* now, std::vector<double>& rates)
+{
+    auto t = std::chrono::steady_clock::now();
+    std::chrono::duration<double> secs = t - last_time;
+
+    rates.assign(last.size(), 0.0);
+
+    for ( unsigned i = 0; i < last.size(); ++i )
+    {
+        // SUM counts are zeroed on reset
+        if ( have_last and pegs[i].type == CountType::SUM and now[i] >= last[i] and
+            secs.count() > 0.0 )
+            rates[i] = (now[i] - last[i]) / secs.count();
+
+        last[i] = now[i];
+    }
+    last_time = t;
+    have_last = true;
+}
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#if defined(UNIT_TEST) || defined(BENCHMARK_TEST)
+#include <chrono>
+#include <thread>
+
+#include "catch/snort_catch.h"
+#include "main/thread.h"
+
+static const PegInfo test_pegs[] =
+{
+    { CountType::SUM, "sum", "test sum" },
+    { CountType::NOW, "now", "test now" },
+    { CountType::MAX, "max", "test max" },
+    { CountType::SUM, "a", "test a" },
+    { CountType::SUM, "b", "test b" },
+    { CountType::SUM, "c", "test c" },
+    { CountType::SUM, "d", "test d" },
+    { CountType::SUM, "e", "test e" },
+    { CountType::END, nullptr, nullptr }
+};
+
+static const unsigned num_test_pegs = array_size(test_pegs) - 1;
+#endif
+
+#ifdef UNIT_TEST
+TEST_CASE("counter set totals", "[thread_counts]")
+{
+    CounterSet set(test_pegs);
+    CHECK(set.get_num_counts() == num_test_pegs);
+
+    CounterBlock* b1 = set.attach();
+    CounterBlock* b2 = set.attach();
+
+    // blocks are aligned and don't share lines
+    CHECK(((uintptr_t)b1 & 63) == 0);
+    CHECK(((uintptr_t)b2 & 63) == 0);
+
+    b1->add(0, 5);
+    b1->set(1, 2);
+    b1->set(2, 7);
+    b2->add(0, 3);
+    b2->set(1, 4);
+    b2->set(2, 9);
+
+    PegCount c[num_test_pegs];
+    set.read(c);
+    CHECK(c[0] == 8);
+    CHECK(c[1] == 6);
+    CHECK(c[2] == 9);
+
+    // sums and maxes of exited threads are kept, current values aren't
+    set.detach(b2);
+    set.read(c);
+    CHECK(c[0] == 8);
+    CHECK(c[1] == 2);
+    CHECK(c[2] == 9);
+
+    set.detach(b1);
+    set.read(c);
+    CHECK(c[0] == 8);
+    CHECK(c[1] == 0);
+    CHECK(c[2] == 9);
+}
+
+TEST_CASE("counter block publish", "[thread_counts]")
+{
+    CounterSet set(test_pegs);
+    CounterBlock* b = set.attach();
+
+    PegCount src[num_test_pegs];
+    PegCount dst[num_test_pegs];
+
+    for ( unsigned i = 0; i < num_test_pegs; ++i )
+        src[i] = i * 10;
+
+    b->publish(src);
+    CHECK(b->read(dst));
+
+    for ( unsigned i = 0; i < num_test_pegs; ++i )
+        CHECK(dst[i] == src[i]);
+
+    set.detach(b);
+}
+
+TEST_CASE("counter block snapshots are consistent", "[thread_counts]")
+{
+    CounterSet set(test_pegs);
+    CounterBlock* b = set.attach();
+    std::atomic<bool> done(false);
+
+    // every update sets all counts to the same value
+    std::thread writer([&]()
+    {
+        for ( PegCount v = 1; !done; ++v )
+        {
+            b->begin_update();
+            for ( unsigned i = 0; i < num_test_pegs; ++i )
+                b->set(i, v);
+            b->end_update();
+        }
+    });
+
+    unsigned torn = 0, reads = 0;
+    PegCount c[num_test_pegs];
+    auto stop = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+
+    while ( std::chrono::steady_clock::now() < stop )
+    {
+        if ( !b->read(c) )
+            continue;
+
+        ++reads;
+
+        for ( unsigned i = 1; i < num_test_pegs; ++i )
+        {
+            if ( c[i] != c[0] )
+            {
+                ++torn;
+                break;
+            }
+        }
+    }
+    done = true;
+    writer.join();
+
+    CHECK(reads > 0);
+    CHECK(torn == 0);
+    set.detach(b);
+}
+
+TEST_CASE("counter rate", "[thread_counts]")
+{
+    CounterRate rate(test_pegs);
+    std::vector<double> r;
+    PegCount c[num_test_pegs] = { };
+
+    rate.update(c, r);
+    REQUIRE(r.size() == num_test_pegs);
+    CHECK(r[0] == 0.0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    c[0] = 1000;
+    c[1] = 1000;
+    rate.update(c, r);
+
+    // 1000 in no more than 10 ms
+    CHECK(r[0] > 0.0);
+    CHECK(r[0] <= 100000.0);
+    CHECK(r[1] == 0.0);
+}
+#endif
+
+#ifdef BENCHMARK_TEST
+// cost per count for a packet thread with and without a reader polling
+// snapshots as fast as it can.  the plain thread local increment is what
+// modules do now; publish is that plus a copy to the block every 1024.
+static THREAD_LOCAL PegCount tl_counts[num_test_pegs];
+
+static double run_writer(CounterBlock* b, unsigned mode, uint64_t n)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    for ( uint64_t k = 0; k < n; ++k )
+    {
+        unsigned i = k % num_test_pegs;
+
+        switch ( mode )
+        {
+        case 0:
+            tl_counts[i]++;
+            // keep the loop from being folded into a multiply
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            break;
+        case 1:
+            b->add(i);
+            break;
+        case 2:
+            b->begin_update();
+            b->add(i);
+            b->end_update();
+            break;
+        case 3:
+            tl_counts[i]++;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            if ( !(k & 1023) )
+                b->publish(tl_counts);
+            break;
+        }
+    }
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+    return ns.count() / n;
+}
+
+TEST_CASE("counter overhead", "[thread_counts]")
+{
+    static const char* const modes[] =
+    { "thread local", "block add", "bracketed add", "publish / 1024" };
+
+    const uint64_t n = 100000000;
+    CounterSet set(test_pegs);
+
+    for ( unsigned m = 0; m < 4; ++m )
+    {
+        CounterBlock* b = set.attach();
+        double alone = run_writer(b, m, n);
+
+        std::atomic<bool> done(false);
+        uint64_t snaps = 0;
+
+        std::thread reader([&]()
+        {
+            PegCount c[num_test_pegs];
+
+            while ( !done )
+            {
+                set.read(c);
+                ++snaps;
+            }
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        double polled = run_writer(b, m, n);
+        std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+
+        done = true;
+        reader.join();
+        set.detach(b);
+
+        printf("%-16s %.2f ns/count alone, %.2f ns/count with %.0f snapshots/sec\n",
+            modes[m], alone, polled, snaps / secs.count());
+    }
+}
+#endif
+
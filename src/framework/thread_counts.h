@@ -0,0 +1,138 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+// thread_counts.h
+
+#ifndef THREAD_COUNTS_H
+#define THREAD_COUNTS_H
+
+// Counters that packet threads write and any thread can read while they
+// run.  Each thread gets its own cache line aligned block with a sequence
+// number so a reader gets a consistent copy of all of a thread's counters
+// without locking or stopping the writer:
+//
+// writer: seq odd, store counts, seq even
+// reader: load seq, load counts, reload seq, retry if odd or changed
+//
+// The writer never waits.  Blocks are only added and removed under a lock
+// taken by attach(), detach(), and readers.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "framework/counts.h"
+#include "main/snort_types.h"
+
+namespace snort
+{
+class SO_PUBLIC CounterBlock
+{
+public:
+    // single writer only; each count is exact but a snapshot may see some
+    // of several adds unless they are bracketed with begin / end_update
+    void add(unsigned i, PegCount n = 1)
+    {
+        std::atomic<PegCount>& c = counts()[i];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void set(unsigned i, PegCount n)
+    { counts()[i].store(n, std::memory_order_relaxed); }
+
+    void begin_update()
+    {
+        seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void end_update()
+    { seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // copy all counts from the writer's own (thread local) array
+    void publish(const PegCount*);
+
+    // any thread; returns false only if the writer kept updating
+    bool read(PegCount*, unsigned max_tries = 1000) const;
+
+    unsigned get_num_counts() const
+    { return num_counts; }
+
+private:
+    friend class CounterSet;
+    CounterBlock(unsigned n) : seq(0), num_counts(n) { }
+
+    std::atomic<PegCount>* counts() const
+    { return (std::atomic<PegCount>*)((uint8_t*)this + LINE_SIZE); }
+
+private:
+    static const unsigned LINE_SIZE = 64;
+
+    // the sequence is alone on the first line and the counts start on the
+    // next so readers polling seq don't pull the counts from the writer
+    std::atomic<uint64_t> seq;
+    unsigned num_counts;
+};
+
+class SO_PUBLIC CounterSet
+{
+public:
+    CounterSet(const PegInfo*);
+    ~CounterSet();
+
+    // called by each writer thread at start and end
+    CounterBlock* attach();
+    void detach(CounterBlock*);
+
+    // SUM and NOW are totaled across threads, MAX is the largest.  counts
+    // of detached blocks are kept except for NOW.
+    void read(PegCount*) const;
+
+    unsigned get_num_counts() const
+    { return num_counts; }
+
+    const PegInfo* get_pegs() const
+    { return pegs; }
+
+private:
+    const PegInfo* pegs;
+    unsigned num_counts;
+
+    mutable std::mutex lock;
+    std::vector<CounterBlock*> blocks;
+    std::vector<PegCount> retired;
+};
+
+// per second rate of SUM counts between successive calls to update()
+class SO_PUBLIC CounterRate
+{
+public:
+    CounterRate(const PegInfo*);
+
+    // rates are 0 on the first update and for other count types
+    void update(const PegCount*, std::vector<double>& rates);
+
+private:
+    const PegInfo* pegs;
+    std::vector<PegCount> last;
+    std::chrono::steady_clock::time_point last_time;
+    bool have_last = false;
+};
+}
+#endif
+
@@ -0,0 +1,760 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_cost.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "flow_cost.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+
+#include "flow/flow.h"
+#include "flow/flow_key.h"
+#include "main/snort_config.h"
+#include "network_inspectors/appid/appid_api.h"
+#include "protocols/packet.h"
+#include "sfip/sf_ip.h"
+
+#include "latency_config.h"
+#include "latency_histogram.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
+using namespace snort;
+
+//-------------------------------------------------------------------------
+// top k tables
+//-------------------------------------------------------------------------
+
+// flows are keyed by FlowKey and names are truncated to the same size
+#define FC_KEY_SIZE sizeof(FlowKey)
+
+static_assert(FC_KEY_SIZE % 8 == 0, "key_hash() reads 8 bytes at a time");
+
+struct CostSlot
+{
+    uint64_t hash;
+    uint64_t samples;
+    uint64_t total;
+    uint64_t error;
+    uint64_t ticks[FC_PHASES];
+    uint8_t key[FC_KEY_SIZE];
+};
+
+static inline uint64_t key_hash(const uint8_t* key)
+{
+    uint64_t h = 0;
+
+    for ( unsigned i = 0; i < FC_KEY_SIZE; i += 8 )
+    {
+        uint64_t w;
+        memcpy(&w, key + i, sizeof(w));
+        h = (h ^ w) * 0x9E3779B97F4A7C15ull;
+    }
+    return h ^ (h >> 29);
+}
+
+class CostTable
+{
+public:
+    void init(unsigned n)
+    { slots.resize(n); }
+
+    void add(const uint8_t* key, const uint64_t* ticks, uint64_t total);
+
+    const CostSlot* begin() const
+    { return slots.data(); }
+
+    const CostSlot* end() const
+    { return slots.data() + used; }
+
+private:
+    std::vector<CostSlot> slots;
+    unsigned used = 0;
+};
+
+// space saving: a key that misses takes over the cheapest slot and starts
+// with its total so a key that is really in the top k is never dropped
+void CostTable::add(const uint8_t* key, const uint64_t* ticks, uint64_t total)
+{
+    uint64_t h = key_hash(key);
+    CostSlot* s = nullptr;
+
+    for ( unsigned i = 0; i < used; ++i )
+    {
+        if ( slots[i].hash == h and !memcmp(slots[i].key, key, FC_KEY_SIZE) )
+        {
+            s = &slots[i];
+            break;
+        }
+    }
+
+    if ( !s )
+    {
+        uint64_t error = 0;
+
+        if ( used < slots.size() )
+            s = &slots[used++];
+
+        else
+        {
+            s = &*std::min_element(slots.begin(), slots.end(),
+                [](const CostSlot& a, const CostSlot& b) { return a.total < b.total; });
+
+            error = s->total;
+        }
+        s->hash = h;
+        memcpy(s->key, key, FC_KEY_SIZE);
+        s->samples = 0;
+        s->total = s->error = error;
+        memset(s->ticks, 0, sizeof(s->ticks));
+    }
+
+    s->samples++;
+    s->total += total;
+
+    for ( unsigned i = 0; i < FC_PHASES; ++i )
+        s->ticks[i] += ticks[i];
+}
+
+static void set_name(uint8_t* key, const char* name)
+{
+    memset(key, 0, FC_KEY_SIZE);
+    strncpy((char*)key, name ? name : "unknown", FC_KEY_SIZE - 1);
+}
+
+static std::string get_name(FlowCostTable table, const uint8_t* key)
+{
+    if ( table != FC_FLOWS )
+        return std::string((const char*)key);
+
+    FlowKey fk;
+    memcpy(&fk, key, sizeof(fk));
+
+    SfIp lo, hi;
+    lo.set(fk.ip_l);
+    hi.set(fk.ip_h);
+
+    SfIpString los, his;
+    char buf[2 * sizeof(SfIpString) + 64];
+
+    int n = snprintf(buf, sizeof(buf), "%s:%u %s:%u proto %u",
+        lo.ntop(los), fk.port_l, hi.ntop(his), fk.port_h, fk.ip_protocol);
+
+    if ( fk.vlan_tag and n > 0 and (unsigned)n < sizeof(buf) )
+        snprintf(buf + n, sizeof(buf) - n, " vlan %u", fk.vlan_tag);
+
+    return buf;
+}
+
+//-------------------------------------------------------------------------
+// per thread tables
+//-------------------------------------------------------------------------
+
+struct ThreadCost
+{
+    ThreadCost(unsigned interval, unsigned max, unsigned seed) :
+        interval(interval), max_entries(max), rng(seed ? seed : 1)
+    {
+        for ( auto& t : tables )
+            t.init(max);
+    }
+
+    // next countdown is 1 to 2N - 1 so the average is N and periodic
+    // traffic does not alias with the sampling
+    unsigned next_skip()
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return 1 + rng % (2 * interval - 1);
+    }
+
+    // taken by the writer once per sample and by readers
+    std::mutex mutex;
+
+    CostTable tables[FC_TABLES];
+    uint64_t samples = 0;
+    uint64_t total = 0;
+
+    const unsigned interval;
+    const unsigned max_entries;
+    uint32_t rng;
+
+    // the packet being sampled
+    hr_time mark;
+    FlowCostPhase phase = FC_OTHER;
+    uint64_t ticks[FC_PHASES];
+};
+
+THREAD_LOCAL bool FlowCost::sampling = false;
+THREAD_LOCAL unsigned FlowCost::countdown = 0;
+
+static THREAD_LOCAL ThreadCost* s_thread = nullptr;
+
+// guards everything below
+static std::mutex s_mutex;
+
+static std::vector<ThreadCost*> s_threads;
+
+// totals from threads that have exited
+static std::map<std::string, FlowCostEntry> s_retired[FC_TABLES];
+static uint64_t s_retired_samples = 0;
+static uint64_t s_retired_total = 0;
+
+static void merge_entry(std::map<std::string, FlowCostEntry>& m, const FlowCostEntry& e)
+{
+    auto it = m.find(e.name);
+
+    if ( it == m.end() )
+    {
+        m.emplace(e.name, e);
+        return;
+    }
+    FlowCostEntry& sum = it->second;
+    sum.samples += e.samples;
+    sum.total += e.total;
+    sum.error += e.error;
+
+    for ( unsigned i = 0; i < FC_PHASES; ++i )
+        sum.ticks[i] += e.ticks[i];
+}
+
+// keep only the most costly so threads that come and go don't grow these
+static void trim_retired(unsigned max)
+{
+    for ( auto& m : s_retired )
+    {
+        if ( m.size() <= max )
+            continue;
+
+        std::vector<uint64_t> totals;
+
+        for ( auto& it : m )
+            totals.emplace_back(it.second.total);
+
+        std::nth_element(totals.begin(), totals.begin() + max - 1, totals.end(),
+            std::greater<uint64_t>());
+
+        uint64_t min = totals[max - 1];
+
+        for ( auto it = m.begin(); it != m.end(); )
+        {
+            if ( it->second.total < min )
+                it = m.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+// the slots are copied under the lock and named after so a sampled packet
+// never waits on formatting
+static void get_entries(ThreadCost* t, FlowCostTable table, std::vector<FlowCostEntry>& v)
+{
+    std::vector<CostSlot> slots;
+    {
+        std::lock_guard<std::mutex> lock(t->mutex);
+        slots.assign(t->tables[table].begin(), t->tables[table].end());
+    }
+
+    for ( const CostSlot& s : slots )
+    {
+        FlowCostEntry e;
+        e.name = get_name(table, s.key);
+        e.samples = s.samples;
+        e.total = s.total;
+        e.error = s.error;
+        memcpy(e.ticks, s.ticks, sizeof(e.ticks));
+        v.emplace_back(std::move(e));
+    }
+}
+
+static void sort_entries(std::vector<FlowCostEntry>& v)
+{
+    std::sort(v.begin(), v.end(),
+        [](const FlowCostEntry& a, const FlowCostEntry& b) { return a.total > b.total; });
+}
+
+static void append_entry(std::string& s, const FlowCostEntry& e, uint64_t total)
+{
+    char buf[512];
+
+    snprintf(buf, sizeof(buf),
+        "    %s: %.1f%%, samples " STDu64 ", usecs " STDu64 " (error " STDu64 "), stream "
+        STDu64 ", inspect " STDu64 ", detect " STDu64 ", other " STDu64 "\n",
+        e.name.c_str(), total ? 100.0 * e.total / total : 0.0, e.samples,
+        LatencyHistograms::to_nsecs(e.total) / 1000,
+        LatencyHistograms::to_nsecs(e.error) / 1000,
+        LatencyHistograms::to_nsecs(e.ticks[FC_STREAM]) / 1000,
+        LatencyHistograms::to_nsecs(e.ticks[FC_INSPECT]) / 1000,
+        LatencyHistograms::to_nsecs(e.ticks[FC_DETECT]) / 1000,
+        LatencyHistograms::to_nsecs(e.ticks[FC_OTHER]) / 1000);
+
+    s += buf;
+}
+
+//-------------------------------------------------------------------------
+// sampling
+//-------------------------------------------------------------------------
+
+void FlowCost::tinit()
+{
+    const LatencyConfig* config = SnortConfig::get_conf()->latency;
+
+    if ( config->flow_cost_interval )
+        tinit(config->flow_cost_interval, config->flow_cost_top, get_instance_id() + 1);
+}
+
+void FlowCost::tinit(unsigned interval, unsigned max_entries, unsigned seed)
+{
+    assert(interval and max_entries);
+
+    s_thread = new ThreadCost(interval, max_entries, seed);
+    countdown = s_thread->next_skip();
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_threads.emplace_back(s_thread);
+}
+
+void FlowCost::tterm()
+{
+    if ( !s_thread )
+        return;
+
+    sampling = false;
+    countdown = 0;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_threads.erase(std::find(s_threads.begin(), s_threads.end(), s_thread));
+
+    for ( unsigned t = 0; t < FC_TABLES; ++t )
+    {
+        std::vector<FlowCostEntry> v;
+        get_entries(s_thread, (FlowCostTable)t, v);
+
+        for ( auto& e : v )
+            merge_entry(s_retired[t], e);
+    }
+    s_retired_samples += s_thread->samples;
+    s_retired_total += s_thread->total;
+    trim_retired(4 * s_thread->max_entries);
+
+    delete s_thread;
+    s_thread = nullptr;
+}
+
+void FlowCost::begin()
+{
+    ThreadCost* t = s_thread;
+
+    countdown = t->next_skip();
+    sampling = true;
+
+    t->phase = FC_OTHER;
+    memset(t->ticks, 0, sizeof(t->ticks));
+    t->mark = SnortClock::now();
+}
+
+FlowCostPhase FlowCost::enter(FlowCostPhase ph)
+{
+    ThreadCost* t = s_thread;
+    hr_time now = SnortClock::now();
+    hr_duration d = now - t->mark;
+
+    t->ticks[t->phase] += TO_TICKS(d);
+    t->mark = now;
+
+    FlowCostPhase prev = t->phase;
+    t->phase = ph;
+    return prev;
+}
+
+void FlowCost::end(const Packet* p)
+{
+    enter(FC_OTHER);
+    sampling = false;
+
+    Flow* flow = p->flow;
+
+    if ( !flow or !flow->key )
+    {
+        record(nullptr, nullptr, nullptr, s_thread->ticks);
+        return;
+    }
+
+    const char* app = appid_api.get_application_name(*flow, p->is_from_client());
+    record(flow->key, flow->service, app, s_thread->ticks);
+}
+
+void FlowCost::record(
+    const FlowKey* fk, const char* service, const char* app, const uint64_t* ticks)
+{
+    ThreadCost* t = s_thread;
+    assert(t);
+
+    // each sample stands for interval packets on average
+    uint64_t scaled[FC_PHASES];
+    uint64_t total = 0;
+
+    for ( unsigned i = 0; i < FC_PHASES; ++i )
+    {
+        scaled[i] = ticks[i] * t->interval;
+        total += scaled[i];
+    }
+
+    std::lock_guard<std::mutex> lock(t->mutex);
+    t->samples++;
+    t->total += total;
+
+    // packets without a flow are only in the totals
+    if ( !fk )
+        return;
+
+    uint8_t key[FC_KEY_SIZE];
+
+    memcpy(key, fk, sizeof(*fk));
+    t->tables[FC_FLOWS].add(key, scaled, total);
+
+    set_name(key, service);
+    t->tables[FC_SERVICES].add(key, scaled, total);
+
+    set_name(key, app);
+    t->tables[FC_APPS].add(key, scaled, total);
+}
+
+//-------------------------------------------------------------------------
+// readers
+//-------------------------------------------------------------------------
+
+unsigned FlowCost::get_top(FlowCostTable table, std::vector<FlowCostEntry>& v)
+{
+    v.clear();
+
+    if ( s_thread )
+    {
+        get_entries(s_thread, table, v);
+        sort_entries(v);
+    }
+    return v.size();
+}
+
+unsigned FlowCost::get_max_entries()
+{ return s_thread ? s_thread->max_entries : 0; }
+
+uint64_t FlowCost::get_total()
+{
+    if ( !s_thread )
+        return 0;
+
+    std::lock_guard<std::mutex> lock(s_thread->mutex);
+    return s_thread->total;
+}
+
+uint64_t FlowCost::get_samples()
+{
+    if ( !s_thread )
+        return 0;
+
+    std::lock_guard<std::mutex> lock(s_thread->mutex);
+    return s_thread->samples;
+}
+
+const char* FlowCost::get_table_name(FlowCostTable t)
+{
+    static const char* const names[FC_TABLES] = { "flow", "service", "app" };
+    return t < FC_TABLES ? names[t] : "";
+}
+
+const char* FlowCost::get_phase_name(FlowCostPhase ph)
+{
+    static const char* const names[FC_PHASES] = { "other", "stream", "inspect", "detect" };
+    return ph < FC_PHASES ? names[ph] : "";
+}
+
+void FlowCost::show(std::string& s, const char* filter)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    if ( s_threads.empty() and !s_retired_samples )
+        return;
+
+    uint64_t samples = s_retired_samples;
+    uint64_t total = s_retired_total;
+    unsigned max_entries = 0;
+
+    for ( auto t : s_threads )
+    {
+        std::lock_guard<std::mutex> tlock(t->mutex);
+        samples += t->samples;
+        total += t->total;
+        max_entries = std::max(max_entries, t->max_entries);
+    }
+
+    char buf[256];
+    snprintf(buf, sizeof(buf), "== flow cost: " STDu64 " samples, " STDu64 " usecs\n",
+        samples, LatencyHistograms::to_nsecs(total) / 1000);
+    s += buf;
+
+    for ( unsigned t = 0; t < FC_TABLES; ++t )
+    {
+        const char* name = get_table_name((FlowCostTable)t);
+
+        if ( filter and *filter and strcmp(filter, name) )
+            continue;
+
+        std::map<std::string, FlowCostEntry> sum(s_retired[t]);
+
+        for ( auto tc : s_threads )
+        {
+            std::vector<FlowCostEntry> v;
+            get_entries(tc, (FlowCostTable)t, v);
+
+            for ( auto& e : v )
+                merge_entry(sum, e);
+        }
+
+        std::vector<FlowCostEntry> top;
+
+        for ( auto& it : sum )
+            top.emplace_back(it.second);
+
+        sort_entries(top);
+
+        // a key in the top of one thread may not be in the top of another
+        // so show a few more than each thread keeps
+        if ( max_entries and top.size() > 2 * max_entries )
+            top.resize(2 * max_entries);
+
+        s += name;
+        s += ":\n";
+
+        for ( auto& e : top )
+            append_entry(s, e, total);
+    }
+}
+
+#ifdef UNIT_TEST
+
+static FlowKey make_key(uint16_t port)
+{
+    FlowKey fk;
+    memset(&fk, 0, sizeof(fk));
+
+    fk.ip_l[2] = htonl(0xFFFF);
+    fk.ip_l[3] = htonl(0x0A000001);
+    fk.ip_h[2] = htonl(0xFFFF);
+    fk.ip_h[3] = htonl(0x0A000002);
+    fk.port_l = port;
+    fk.port_h = 80;
+    fk.ip_protocol = 6;
+    fk.version = 4;
+    return fk;
+}
+
+static void spin()
+{
+    hr_time start = SnortClock::now();
+    while ( SnortClock::now() == start );
+}
+
+TEST_CASE("flow cost sampling", "[flow_cost]")
+{
+    SECTION("phases")
+    {
+        FlowCost::tinit(1, 4);
+        Packet p(false);
+
+        FlowCost::start();
+        CHECK(FlowCost::is_sampling());
+        {
+            FlowCost::Phase stream(FC_STREAM);
+            spin();
+            FlowCost::Phase detect(FC_DETECT);
+            spin();
+        }
+        FlowCost::stop(&p);
+
+        CHECK(!FlowCost::is_sampling());
+        CHECK(FlowCost::get_samples() == 1);
+        CHECK(FlowCost::get_total() > 0);
+
+        // packets without a flow are not in the tables
+        std::vector<FlowCostEntry> v;
+        CHECK(FlowCost::get_top(FC_FLOWS, v) == 0);
+
+        // phases do nothing when not sampling
+        {
+            FlowCost::Phase stream(FC_STREAM);
+        }
+        CHECK(FlowCost::get_samples() == 1);
+        FlowCost::tterm();
+    }
+
+    SECTION("interval")
+    {
+        const unsigned num = 64000;
+        FlowCost::tinit(64, 4, 7);
+        Packet p(false);
+
+        for ( unsigned i = 0; i < num; ++i )
+        {
+            FlowCost::start();
+            FlowCost::stop(&p);
+        }
+        CHECK(FlowCost::get_samples() > 900);
+        CHECK(FlowCost::get_samples() < 1100);
+        FlowCost::tterm();
+    }
+}
+
+TEST_CASE("flow cost top k", "[flow_cost]")
+{
+    FlowCost::tinit(2, 4);
+
+    FlowKey heavy[3] = { make_key(1001), make_key(1002), make_key(1003) };
+    uint64_t light_ticks[FC_PHASES] = { 1, 2, 3, 4 };
+    uint64_t heavy_ticks[FC_PHASES] = { 10, 20, 30, 40 };
+
+    // many light flows interleaved with a few heavy ones that each cost
+    // more than a quarter of the total
+    for ( unsigned i = 0; i < 1000; ++i )
+    {
+        FlowKey light = make_key(2000 + i);
+        FlowCost::record(&light, "dns", nullptr, light_ticks);
+
+        if ( i % 2 == 0 )
+            FlowCost::record(heavy + i % 3, "http", "Facebook", heavy_ticks);
+    }
+
+    std::vector<FlowCostEntry> v;
+    REQUIRE(FlowCost::get_top(FC_FLOWS, v) == 4);
+
+    // scaled by the interval
+    CHECK(v[0].total == v[0].error + 200 * v[0].samples);
+
+    // the heavy flows are never dropped
+    unsigned found = 0;
+
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        std::string name = "10.0.0.1:" + std::to_string(1001 + i) + " 10.0.0.2:80 proto 6";
+
+        for ( auto& e : v )
+        {
+            if ( e.name == name )
+            {
+                CHECK(e.ticks[FC_DETECT] == 80 * e.samples);
+                CHECK(e.ticks[FC_OTHER] == 20 * e.samples);
+                ++found;
+            }
+        }
+    }
+    CHECK(found == 3);
+
+    REQUIRE(FlowCost::get_top(FC_SERVICES, v) == 2);
+    CHECK(v[0].name == "http");
+    CHECK(v[0].samples == 500);
+    CHECK(v[1].name == "dns");
+    CHECK(v[1].samples == 1000);
+
+    REQUIRE(FlowCost::get_top(FC_APPS, v) == 2);
+    CHECK(v[0].name == "Facebook");
+    CHECK(v[1].name == "unknown");
+
+    std::string s;
+    FlowCost::show(s, "service");
+    // other tests may have left samples from exited threads
+    CHECK(s.find("== flow cost: ") == 0);
+    CHECK(s.find("service:\n    http: ") != std::string::npos);
+    CHECK(s.find(", samples 500, usecs ") != std::string::npos);
+    CHECK(s.find("flow:") == std::string::npos);
+
+    // exited threads are still shown
+    FlowCost::tterm();
+
+    s.clear();
+    FlowCost::show(s, "app");
+    CHECK(s.find("    Facebook: ") != std::string::npos);
+    CHECK(s.find(", samples 1000, usecs ") != std::string::npos);
+}
+
+#endif
+
+#ifdef BENCHMARK_TEST
+
+#include <chrono>
+#include <functional>
+
+TEST_CASE("flow cost overhead", "[flow_cost]")
+{
+    const unsigned num = 10000000;
+    FlowCost::tinit(64, 16);
+    Packet p(false);
+
+    FlowKey keys[1024];
+
+    for ( unsigned i = 0; i < 1024; ++i )
+        keys[i] = make_key(i);
+
+    auto run = [](const char* what, std::function<void(unsigned)> f)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for ( unsigned i = 0; i < num; ++i )
+            f(i);
+
+        std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+        printf("%-28s %.2f ns\n", what, ns.count() / num);
+    };
+
+    // per packet with 1 in 64 sampled and 3 phases
+    run("packet", [&p](unsigned)
+        {
+            FlowCost::start();
+            {
+                FlowCost::Phase stream(FC_STREAM);
+                FlowCost::Phase inspect(FC_INSPECT);
+                FlowCost::Phase detect(FC_DETECT);
+            }
+            FlowCost::stop(&p);
+        });
+
+    // per sample with 1024 flows competing for 16 slots
+    uint64_t ticks[FC_PHASES] = { 100, 200, 300, 400 };
+
+    run("record 1024 flows", [&keys, &ticks](unsigned i)
+        {
+            unsigned k = (i * 2654435761u) >> 22;
+            FlowCost::record(keys + k, "http", "Facebook", ticks);
+        });
+
+    FlowCost::tterm();
+}
+
+#endif
@@ -0,0 +1,147 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_cost.h
+
+#ifndef FLOW_COST_H
+#define FLOW_COST_H
+
+// Sampled cost accounting by flow, service, and application.  Each packet
+// thread times a random 1 in N packets from decode through detection and
+// splits the time into stream, inspector, detection, and other (decode,
+// flow lookup, etc.) phases.  Each phase is charged only the time spent
+// outside the phases nested in it.  The sampled time is scaled by N and
+// added to the flow's 5-tuple, service, and appid in top K tables (space
+// saving) so only the most costly keys are kept.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "main/snort_types.h"
+#include "main/thread.h"
+#include "time/clock_defs.h"
+
+namespace snort
+{
+struct FlowKey;
+struct Packet;
+}
+
+enum FlowCostPhase
+{
+    FC_OTHER,
+    FC_STREAM,
+    FC_INSPECT,
+    FC_DETECT,
+    FC_PHASES
+};
+
+enum FlowCostTable
+{
+    FC_FLOWS,
+    FC_SERVICES,
+    FC_APPS,
+    FC_TABLES
+};
+
+// ticks are estimates; total may include up to error ticks of other keys
+// that held the slot before this one
+struct FlowCostEntry
+{
+    std::string name;
+    uint64_t samples;
+    uint64_t total;
+    uint64_t error;
+    uint64_t ticks[FC_PHASES];
+};
+
+class SO_PUBLIC FlowCost
+{
+public:
+    // packet threads; tinit(interval, max) is for testing
+    static void tinit();
+    static void tinit(unsigned interval, unsigned max_entries, unsigned seed = 1);
+    static void tterm();
+
+    static bool is_sampling()
+    { return sampling; }
+
+    // bracket each packet from the daq
+    static void start()
+    {
+        if ( countdown and !--countdown )
+            begin();
+    }
+
+    static void stop(const snort::Packet* p)
+    {
+        if ( sampling )
+            end(p);
+    }
+
+    // add a sample of ticks by phase to the flow's keys; the key is null
+    // for packets without a flow
+    static void record(const snort::FlowKey*, const char* service, const char* app,
+        const uint64_t* ticks);
+
+    // this thread's entries, most costly first
+    static unsigned get_top(FlowCostTable, std::vector<FlowCostEntry>&);
+    static unsigned get_max_entries();
+
+    // estimated ticks and samples of all packets on this thread
+    static uint64_t get_total();
+    static uint64_t get_samples();
+
+    // all threads including those that have exited; filter is a table name
+    // (flow, service, or app)
+    static void show(std::string&, const char* filter = nullptr);
+
+    static const char* get_table_name(FlowCostTable);
+    static const char* get_phase_name(FlowCostPhase);
+
+    class Phase
+    {
+    public:
+        Phase(FlowCostPhase ph)
+        {
+            if ( (active = sampling) )
+                prev = enter(ph);
+        }
+
+        ~Phase()
+        {
+            if ( active )
+                enter(prev);
+        }
+
+    private:
+        FlowCostPhase prev = FC_OTHER;
+        bool active;
+    };
+
+private:
+    static void begin();
+    static void end(const snort::Packet*);
+    static FlowCostPhase enter(FlowCostPhase);
+
+    static THREAD_LOCAL bool sampling;
+    static THREAD_LOCAL unsigned countdown;
+};
+
+#endif
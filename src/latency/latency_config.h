@@ -28,6 +28,12 @@ struct LatencyConfig
 {
     PacketLatencyConfig packet_latency;
     RuleLatencyConfig rule_latency;
+
+    bool histograms = true;
+    unsigned histogram_rules = 16;
+
+    unsigned flow_cost_interval = 64;
+    unsigned flow_cost_top = 16;
 };
 
 #endif
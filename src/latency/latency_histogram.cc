@@ -0,0 +1,880 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// latency_histogram.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "detection/treenodes.h"
+#include "main/snort_config.h"
+
+#include "latency_config.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
+//-------------------------------------------------------------------------
+// histogram
+//-------------------------------------------------------------------------
+
+LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& rhs)
+{
+    for ( unsigned i = 0; i < LH_BUCKETS; ++i )
+        buckets[i].store(rhs.buckets[i].load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+
+    sum.store(rhs.get_sum(), std::memory_order_relaxed);
+    return *this;
+}
+
+void LatencyHistogram::reset()
+{
+    for ( auto& b : buckets )
+        b.store(0, std::memory_order_relaxed);
+
+    sum.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::add(const LatencyHistogram& rhs)
+{
+    for ( unsigned i = 0; i < LH_BUCKETS; ++i )
+        bump(buckets[i], rhs.buckets[i].load(std::memory_order_relaxed));
+
+    bump(sum, rhs.get_sum());
+}
+
+// rhs is an earlier copy of this one
+void LatencyHistogram::subtract(const LatencyHistogram& rhs)
+{
+    for ( unsigned i = 0; i < LH_BUCKETS; ++i )
+    {
+        uint64_t a = buckets[i].load(std::memory_order_relaxed);
+        uint64_t b = rhs.buckets[i].load(std::memory_order_relaxed);
+        buckets[i].store(a > b ? a - b : 0, std::memory_order_relaxed);
+    }
+    uint64_t a = get_sum();
+    uint64_t b = rhs.get_sum();
+    sum.store(a > b ? a - b : 0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::get_count() const
+{
+    uint64_t n = 0;
+
+    for ( auto& b : buckets )
+        n += b.load(std::memory_order_relaxed);
+
+    return n;
+}
+
+uint64_t LatencyHistogram::get_percentile(double p) const
+{
+    uint64_t n = get_count();
+
+    if ( !n )
+        return 0;
+
+    uint64_t rank = (uint64_t)std::ceil(p * n);
+
+    if ( !rank )
+        rank = 1;
+
+    else if ( rank > n )
+        rank = n;
+
+    uint64_t seen = 0;
+
+    for ( unsigned i = 0; i < LH_BUCKETS; ++i )
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+
+        if ( seen >= rank )
+            return (lower(i) + upper(i)) / 2;
+    }
+    return upper(LH_BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::get_max() const
+{
+    for ( unsigned i = LH_BUCKETS; i > 0; --i )
+    {
+        if ( buckets[i - 1].load(std::memory_order_relaxed) )
+            return upper(i - 1);
+    }
+    return 0;
+}
+
+uint64_t LatencyHistogram::lower(unsigned idx)
+{
+    if ( idx < (1 << LH_SUB_BITS) )
+        return idx;
+
+    idx -= (1 << LH_SUB_BITS);
+    unsigned shift = idx / LH_SUB_COUNT + 1;
+    return (uint64_t)(LH_SUB_COUNT + idx % LH_SUB_COUNT) << shift;
+}
+
+uint64_t LatencyHistogram::upper(unsigned idx)
+{
+    if ( idx < (1 << LH_SUB_BITS) )
+        return idx;
+
+    unsigned shift = (idx - (1 << LH_SUB_BITS)) / LH_SUB_COUNT + 1;
+    return lower(idx) + ((uint64_t)1 << shift) - 1;
+}
+
+//-------------------------------------------------------------------------
+// per thread histograms
+//-------------------------------------------------------------------------
+
+#define LH_RULE_HINTS  256   // must be 2^8; see rule_hint()
+#define LH_CANDIDATES 1024
+
+// the writer brackets changing the rule with seq like a CounterBlock
+struct RuleSlot
+{
+    std::atomic<unsigned> seq { 0 };
+    std::atomic<uint32_t> gid { 0 };
+    std::atomic<uint32_t> sid { 0 };
+    std::atomic<uint32_t> rev { 0 };
+    std::atomic<uint64_t> total { 0 };
+    LatencyHistogram hist;
+
+    const OptTreeNode* otn = nullptr;  // writer only
+};
+
+struct RuleCandidate
+{
+    const OptTreeNode* otn;
+    uint64_t total;
+};
+
+struct ThreadHistograms
+{
+    ThreadHistograms(unsigned n) : max_rules(n)
+    {
+        for ( auto& h : hists )
+            h.store(nullptr, std::memory_order_relaxed);
+
+        rules = n ? new RuleSlot[n] : nullptr;
+        memset(hints, 0, sizeof(hints));
+        memset(cands, 0, sizeof(cands));
+    }
+
+    ~ThreadHistograms()
+    {
+        for ( auto& h : hists )
+            delete h.load(std::memory_order_relaxed);
+
+        delete[] rules;
+    }
+
+    std::atomic<LatencyHistogram*> hists[LH_MAX_IDS];
+
+    RuleSlot* rules;
+    const unsigned max_rules;
+    std::atomic<unsigned> num_rules { 0 };
+
+    // no tracked rule has cost less than this
+    uint64_t min_total = 0;
+
+    uint8_t hints[LH_RULE_HINTS];
+    RuleCandidate cands[LH_CANDIDATES];
+};
+
+THREAD_LOCAL bool LatencyHistograms::enabled = false;
+
+static THREAD_LOCAL ThreadHistograms* s_thread = nullptr;
+
+// guards everything below
+static std::mutex s_mutex;
+
+static std::vector<std::string> s_names { "", "packet" };
+static std::vector<ThreadHistograms*> s_threads;
+
+// totals from threads that have exited
+static LatencyHistogram* s_retired[LH_MAX_IDS];
+static std::map<uint64_t, LatencyRule> s_retired_rules;
+
+static inline uint64_t rule_hash(const OptTreeNode* otn)
+{ return (uint64_t)(uintptr_t)otn * 0x9E3779B97F4A7C15ull; }
+
+static inline unsigned rule_hint(uint64_t h)
+{ return h >> 56; }
+
+static inline unsigned rule_candidate(uint64_t h)
+{ return (h >> 40) & (LH_CANDIDATES - 1); }
+
+static inline uint64_t rule_key(uint32_t gid, uint32_t sid)
+{ return ((uint64_t)gid << 32) | sid; }
+
+static inline bool same_rule(const RuleSlot& r, const OptTreeNode* otn)
+{
+    // the sid check catches an otn freed by reload and its memory reused
+    return r.otn == otn and r.sid.load(std::memory_order_relaxed) == otn->sigInfo.sid;
+}
+
+static void take_slot(RuleSlot& r, const OptTreeNode* otn, uint64_t total)
+{
+    r.seq.store(r.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    r.otn = otn;
+    r.gid.store(otn->sigInfo.gid, std::memory_order_relaxed);
+    r.sid.store(otn->sigInfo.sid, std::memory_order_relaxed);
+    r.rev.store(otn->sigInfo.rev, std::memory_order_relaxed);
+    r.total.store(total, std::memory_order_relaxed);
+    r.hist.reset();
+
+    r.seq.store(r.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+static bool read_slot(const RuleSlot& r, LatencyRule& lr)
+{
+    for ( unsigned tries = 0; tries < 1000; ++tries )
+    {
+        unsigned seq = r.seq.load(std::memory_order_acquire);
+
+        if ( seq & 1 )
+            continue;
+
+        lr.gid = r.gid.load(std::memory_order_relaxed);
+        lr.sid = r.sid.load(std::memory_order_relaxed);
+        lr.rev = r.rev.load(std::memory_order_relaxed);
+        lr.total = r.total.load(std::memory_order_relaxed);
+        lr.hist = r.hist;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if ( r.seq.load(std::memory_order_relaxed) == seq )
+            return true;
+    }
+    return false;
+}
+
+// the first max_rules rules get a slot.  after that, rules that miss
+// compete for a candidate entry (Misra-Gries) and a candidate takes over
+// the slot of the cheapest tracked rule when it has cost more (space
+// saving) so the top rules settle quickly and the histograms of the others
+// are reset only when the top changes.
+static RuleSlot* find_rule(
+    ThreadHistograms* t, const OptTreeNode* otn, uint64_t h, uint64_t ticks)
+{
+    unsigned n = t->num_rules.load(std::memory_order_relaxed);
+
+    for ( unsigned i = 0; i < n; ++i )
+    {
+        if ( same_rule(t->rules[i], otn) )
+        {
+            t->hints[rule_hint(h)] = i;
+            return t->rules + i;
+        }
+    }
+
+    if ( n < t->max_rules )
+    {
+        take_slot(t->rules[n], otn, 0);
+        t->num_rules.store(n + 1, std::memory_order_release);
+        t->hints[rule_hint(h)] = n;
+        return t->rules + n;
+    }
+
+    RuleCandidate& c = t->cands[rule_candidate(h)];
+
+    if ( c.otn == otn )
+        c.total += ticks;
+
+    else if ( c.total > ticks )
+    {
+        c.total -= ticks;
+        return nullptr;
+    }
+    else
+    {
+        c.otn = otn;
+        c.total = ticks - c.total;
+    }
+
+    if ( c.total <= t->min_total )
+        return nullptr;
+
+    // totals only grow so min_total is stale but never too high
+    unsigned m = 0;
+
+    for ( unsigned i = 1; i < n; ++i )
+    {
+        if ( t->rules[i].total.load(std::memory_order_relaxed) <
+            t->rules[m].total.load(std::memory_order_relaxed) )
+            m = i;
+    }
+    t->min_total = t->rules[m].total.load(std::memory_order_relaxed);
+
+    if ( c.total <= t->min_total )
+        return nullptr;
+
+    // this eval is added back by the caller
+    take_slot(t->rules[m], otn, c.total > ticks ? c.total - ticks : 0);
+    t->hints[rule_hint(h)] = m;
+
+    c.otn = nullptr;
+    c.total = 0;
+
+    return t->rules + m;
+}
+
+static void merge_rule(std::map<uint64_t, LatencyRule>& rules, const LatencyRule& lr)
+{
+    auto it = rules.find(rule_key(lr.gid, lr.sid));
+
+    if ( it == rules.end() )
+    {
+        rules.emplace(rule_key(lr.gid, lr.sid), lr);
+        return;
+    }
+    it->second.rev = lr.rev;
+    it->second.total += lr.total;
+    it->second.hist.add(lr.hist);
+}
+
+static void append_stats(
+    std::string& s, const char* name, const LatencyHistogram& h, const uint64_t* total = nullptr)
+{
+    uint64_t n = h.get_count();
+
+    if ( !n )
+        return;
+
+    char buf[256];
+
+    snprintf(buf, sizeof(buf),
+        "%s: count " STDu64 " avg " STDu64 " p50 " STDu64 " p90 " STDu64 " p99 " STDu64
+        " p999 " STDu64 " max " STDu64 " nsecs", name, n,
+        LatencyHistograms::to_nsecs(h.get_sum() / n),
+        LatencyHistograms::to_nsecs(h.get_percentile(0.50)),
+        LatencyHistograms::to_nsecs(h.get_percentile(0.90)),
+        LatencyHistograms::to_nsecs(h.get_percentile(0.99)),
+        LatencyHistograms::to_nsecs(h.get_percentile(0.999)),
+        LatencyHistograms::to_nsecs(h.get_max()));
+
+    s += buf;
+
+    if ( total )
+    {
+        snprintf(buf, sizeof(buf), ", total " STDu64 " usecs",
+            LatencyHistograms::to_nsecs(*total) / 1000);
+        s += buf;
+    }
+    s += "\n";
+}
+
+//-------------------------------------------------------------------------
+// registry
+//-------------------------------------------------------------------------
+
+unsigned LatencyHistograms::get_id(const char* name)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    for ( unsigned id = 1; id < s_names.size(); ++id )
+    {
+        if ( s_names[id] == name )
+            return id;
+    }
+
+    if ( s_names.size() >= LH_MAX_IDS )
+        return 0;
+
+    s_names.emplace_back(name);
+    return s_names.size() - 1;
+}
+
+std::string LatencyHistograms::get_name(unsigned id)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return id < s_names.size() ? s_names[id] : std::string();
+}
+
+unsigned LatencyHistograms::get_num_ids()
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_names.size();
+}
+
+void LatencyHistograms::tinit()
+{
+    const LatencyConfig* config = snort::SnortConfig::get_conf()->latency;
+
+    if ( config->histograms )
+        tinit(config->histogram_rules);
+}
+
+void LatencyHistograms::tinit(unsigned max_rules)
+{
+    s_thread = new ThreadHistograms(max_rules);
+    enabled = true;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_threads.emplace_back(s_thread);
+}
+
+void LatencyHistograms::tterm()
+{
+    if ( !s_thread )
+        return;
+
+    enabled = false;
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_threads.erase(std::find(s_threads.begin(), s_threads.end(), s_thread));
+
+    for ( unsigned id = 1; id < LH_MAX_IDS; ++id )
+    {
+        const LatencyHistogram* h = s_thread->hists[id].load(std::memory_order_relaxed);
+
+        if ( !h )
+            continue;
+
+        if ( !s_retired[id] )
+            s_retired[id] = new LatencyHistogram;
+
+        s_retired[id]->add(*h);
+    }
+
+    std::vector<LatencyRule> rules;
+    get_rules(rules);
+
+    for ( auto& lr : rules )
+        merge_rule(s_retired_rules, lr);
+
+    delete s_thread;
+    s_thread = nullptr;
+}
+
+void LatencyHistograms::record(unsigned id, hr_duration d)
+{
+    assert(s_thread);
+
+    if ( !id or id >= LH_MAX_IDS )
+        return;
+
+    LatencyHistogram* h = s_thread->hists[id].load(std::memory_order_relaxed);
+
+    if ( !h )
+    {
+        h = new LatencyHistogram;
+        s_thread->hists[id].store(h, std::memory_order_release);
+    }
+    h->record(TO_TICKS(d));
+}
+
+void LatencyHistograms::record(const OptTreeNode* otn, hr_duration d)
+{
+    ThreadHistograms* t = s_thread;
+    assert(t);
+
+    if ( !t->max_rules )
+        return;
+
+    uint64_t ticks = TO_TICKS(d);
+    uint64_t h = rule_hash(otn);
+    RuleSlot* r = t->rules + t->hints[rule_hint(h)];
+
+    if ( !same_rule(*r, otn) )
+    {
+        r = find_rule(t, otn, h, ticks);
+
+        if ( !r )
+            return;
+    }
+    r->hist.record(ticks);
+    r->total.store(r->total.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+}
+
+const LatencyHistogram* LatencyHistograms::get_histogram(unsigned id)
+{
+    if ( !s_thread or id >= LH_MAX_IDS )
+        return nullptr;
+
+    return s_thread->hists[id].load(std::memory_order_relaxed);
+}
+
+unsigned LatencyHistograms::get_rules(std::vector<LatencyRule>& rules)
+{
+    rules.clear();
+
+    if ( !s_thread )
+        return 0;
+
+    // the writer is this thread so no retries are needed
+    unsigned n = s_thread->num_rules.load(std::memory_order_relaxed);
+    rules.resize(n);
+
+    for ( unsigned i = 0; i < n; ++i )
+        read_slot(s_thread->rules[i], rules[i]);
+
+    return n;
+}
+
+unsigned LatencyHistograms::get_max_rules()
+{ return s_thread ? s_thread->max_rules : 0; }
+
+void LatencyHistograms::show(std::string& s, const char* filter)
+{
+    size_t len = filter ? strlen(filter) : 0;
+    std::lock_guard<std::mutex> lock(s_mutex);
+
+    for ( unsigned id = 1; id < s_names.size(); ++id )
+    {
+        if ( len and s_names[id].compare(0, len, filter) )
+            continue;
+
+        LatencyHistogram sum;
+
+        if ( s_retired[id] )
+            sum.add(*s_retired[id]);
+
+        for ( auto t : s_threads )
+        {
+            if ( const LatencyHistogram* h = t->hists[id].load(std::memory_order_acquire) )
+                sum.add(*h);
+        }
+        append_stats(s, s_names[id].c_str(), sum);
+    }
+
+    if ( len and strncmp(filter, "rule", std::min(len, (size_t)4)) )
+        return;
+
+    std::map<uint64_t, LatencyRule> rules(s_retired_rules);
+
+    for ( auto t : s_threads )
+    {
+        unsigned n = t->num_rules.load(std::memory_order_acquire);
+
+        for ( unsigned i = 0; i < n; ++i )
+        {
+            LatencyRule lr;
+
+            if ( read_slot(t->rules[i], lr) )
+                merge_rule(rules, lr);
+        }
+    }
+
+    std::vector<const LatencyRule*> top;
+
+    for ( auto& it : rules )
+        top.emplace_back(&it.second);
+
+    std::sort(top.begin(), top.end(),
+        [](const LatencyRule* a, const LatencyRule* b) { return a->total > b->total; });
+
+    for ( auto lr : top )
+    {
+        std::string name = "rule " + std::to_string(lr->gid) + ":" +
+            std::to_string(lr->sid) + ":" + std::to_string(lr->rev);
+
+        append_stats(s, name.c_str(), lr->hist, &lr->total);
+    }
+}
+
+uint64_t LatencyHistograms::to_nsecs(uint64_t ticks)
+{
+#ifdef USE_TSC_CLOCK
+    return (uint64_t)(ticks * 1000.0 / clock_scale());
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(hr_duration(ticks)).count();
+#endif
+}
+
+//-------------------------------------------------------------------------
+// tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+
+TEST_CASE("latency histogram buckets", "[latency]")
+{
+    for ( uint64_t v = 0; v < (1 << LH_SUB_BITS); ++v )
+    {
+        CHECK(LatencyHistogram::index(v) == v);
+        CHECK(LatencyHistogram::lower(v) == v);
+        CHECK(LatencyHistogram::upper(v) == v);
+    }
+
+    for ( unsigned bit = LH_SUB_BITS; bit < LH_MAX_BITS; ++bit )
+    {
+        for ( uint64_t off : { 0ul, 1ul, 3ul, 1000ul, 123456789ul } )
+        {
+            uint64_t base = (uint64_t)1 << bit;
+            uint64_t v = base + (off % base);
+            unsigned i = LatencyHistogram::index(v);
+
+            CHECK(i < LH_BUCKETS);
+            CHECK(LatencyHistogram::lower(i) <= v);
+            CHECK(v <= LatencyHistogram::upper(i));
+
+            // bucket width is within 1 / LH_SUB_COUNT of the value
+            uint64_t width = LatencyHistogram::upper(i) - LatencyHistogram::lower(i) + 1;
+            CHECK(width * LH_SUB_COUNT <= LatencyHistogram::lower(i));
+        }
+        // buckets are contiguous
+        unsigned i = LatencyHistogram::index((uint64_t)1 << bit);
+        CHECK(LatencyHistogram::upper(i - 1) + 1 == LatencyHistogram::lower(i));
+    }
+    CHECK(LatencyHistogram::index((uint64_t)1 << LH_MAX_BITS) == LH_BUCKETS - 1);
+    CHECK(LatencyHistogram::index(UINT64_MAX) == LH_BUCKETS - 1);
+    CHECK(LatencyHistogram::index(((uint64_t)1 << LH_MAX_BITS) - 1) == LH_BUCKETS - 1);
+}
+
+static bool close_to(uint64_t v, uint64_t expected)
+{
+    double d = (double)v - expected;
+    return std::fabs(d) <= expected / (double)LH_SUB_COUNT;
+}
+
+TEST_CASE("latency histogram percentiles", "[latency]")
+{
+    LatencyHistogram h;
+    CHECK(h.get_count() == 0);
+    CHECK(h.get_percentile(0.99) == 0);
+    CHECK(h.get_max() == 0);
+
+    for ( uint64_t v = 1; v <= 100000; ++v )
+        h.record(v);
+
+    CHECK(h.get_count() == 100000);
+    CHECK(h.get_sum() == 5000050000ull);
+
+    CHECK(close_to(h.get_percentile(0.5), 50000));
+    CHECK(close_to(h.get_percentile(0.9), 90000));
+    CHECK(close_to(h.get_percentile(0.99), 99000));
+    CHECK(close_to(h.get_percentile(0.999), 99900));
+    CHECK(h.get_percentile(0.0) == 1);
+
+    CHECK(h.get_max() >= 100000);
+    CHECK(close_to(h.get_max(), 100000));
+
+    // one outlier shows up in p999 only when it is more than 0.1%
+    LatencyHistogram t;
+
+    for ( unsigned i = 0; i < 999; ++i )
+        t.record(100);
+
+    t.record(1000000);
+    CHECK(close_to(t.get_percentile(0.999), 100));
+    CHECK(close_to(t.get_max(), 1000000));
+
+    t.record(1000000);
+    CHECK(close_to(t.get_percentile(0.999), 1000000));
+}
+
+TEST_CASE("latency histogram merge", "[latency]")
+{
+    LatencyHistogram a, b;
+
+    for ( uint64_t v = 1; v <= 1000; ++v )
+    {
+        a.record(v);
+        b.record(v + 1000);
+    }
+
+    LatencyHistogram c(a);
+    c.add(b);
+
+    CHECK(c.get_count() == 2000);
+    CHECK(c.get_sum() == a.get_sum() + b.get_sum());
+    CHECK(close_to(c.get_percentile(0.5), 1000));
+    CHECK(c.get_max() == b.get_max());
+
+    // an interval is the difference of two snapshots
+    c.subtract(a);
+    CHECK(c.get_count() == b.get_count());
+    CHECK(c.get_sum() == b.get_sum());
+    CHECK(c.get_percentile(0.5) == b.get_percentile(0.5));
+    CHECK(c.get_percentile(0.999) == b.get_percentile(0.999));
+
+    c.reset();
+    CHECK(c.get_count() == 0);
+    CHECK(c.get_sum() == 0);
+}
+
+TEST_CASE("latency histogram ids", "[latency]")
+{
+    CHECK(LatencyHistograms::get_name(LH_PACKET) == "packet");
+    CHECK(LatencyHistograms::get_id("packet") == LH_PACKET);
+
+    unsigned id = LatencyHistograms::get_id("inspector.test");
+    CHECK(id > LH_PACKET);
+    CHECK(LatencyHistograms::get_id("inspector.test") == id);
+    CHECK(LatencyHistograms::get_name(id) == "inspector.test");
+    CHECK(LatencyHistograms::get_num_ids() > id);
+    CHECK(LatencyHistograms::get_name(LH_MAX_IDS).empty());
+}
+
+static const LatencyRule* find_sid(const std::vector<LatencyRule>& rules, uint32_t sid)
+{
+    for ( auto& lr : rules )
+        if ( lr.sid == sid )
+            return &lr;
+
+    return nullptr;
+}
+
+TEST_CASE("latency histogram threads", "[latency]")
+{
+    unsigned id = LatencyHistograms::get_id("search.test");
+    LatencyHistograms::tinit(4);
+
+    OptTreeNode otn[8];
+
+    for ( unsigned i = 0; i < 8; ++i )
+    {
+        otn[i].sigInfo.gid = 1;
+        otn[i].sigInfo.sid = 1000 + i;
+        otn[i].sigInfo.rev = 1;
+    }
+
+    SECTION("histograms")
+    {
+        CHECK(LatencyHistograms::get_histogram(id) == nullptr);
+
+        for ( unsigned i = 1; i <= 100; ++i )
+            LatencyHistograms::record(id, hr_duration(i));
+
+        const LatencyHistogram* h = LatencyHistograms::get_histogram(id);
+        REQUIRE(h != nullptr);
+        CHECK(h->get_count() == 100);
+
+        // ids that were never handed out are ignored
+        unsigned none = 0;
+        LatencyHistograms::record(none, hr_duration(1));
+        LatencyHistograms::record(LH_MAX_IDS, hr_duration(1));
+        CHECK(LatencyHistograms::get_histogram(0) == nullptr);
+
+        std::string s;
+        LatencyHistograms::show(s, "search.test");
+        CHECK(s.find("search.test: count 100 ") == 0);
+    }
+
+    SECTION("top rules")
+    {
+        // the first 4 rules get the slots
+        for ( unsigned i = 0; i < 4; ++i )
+            for ( unsigned n = 0; n <= i; ++n )
+                LatencyHistograms::record(otn + i, hr_duration(100));
+
+        std::vector<LatencyRule> rules;
+        CHECK(LatencyHistograms::get_rules(rules) == 4);
+        CHECK(find_sid(rules, 1000)->hist.get_count() == 1);
+        CHECK(find_sid(rules, 1003)->hist.get_count() == 4);
+        CHECK(find_sid(rules, 1003)->total == 400);
+
+        // a cheap rule does not displace any of them
+        for ( unsigned n = 0; n < 10; ++n )
+            LatencyHistograms::record(otn + 4, hr_duration(5));
+
+        LatencyHistograms::get_rules(rules);
+        CHECK(find_sid(rules, 1004) == nullptr);
+
+        // a costly rule takes over the slot of the cheapest
+        for ( unsigned n = 0; n < 10; ++n )
+            LatencyHistograms::record(otn + 5, hr_duration(1000));
+
+        LatencyHistograms::get_rules(rules);
+        CHECK(rules.size() == 4);
+        CHECK(find_sid(rules, 1000) == nullptr);
+        REQUIRE(find_sid(rules, 1005) != nullptr);
+        CHECK(find_sid(rules, 1005)->hist.get_count() > 0);
+        CHECK(find_sid(rules, 1005)->total == 10000);
+        CHECK(find_sid(rules, 1001) != nullptr);
+
+        std::string s;
+        LatencyHistograms::show(s, "rule");
+        CHECK(s.find("rule 1:1005:1: count ") == 0);
+        CHECK(s.find("packet") == std::string::npos);
+    }
+
+    LatencyHistograms::tterm();
+    CHECK(LatencyHistograms::get_histogram(id) == nullptr);
+
+    // the totals remain after the thread exits
+    std::string s;
+    LatencyHistograms::show(s);
+    CHECK(!s.empty());
+}
+
+#endif
+
+#ifdef BENCHMARK_TEST
+
+#include <chrono>
+#include <functional>
+
+TEST_CASE("latency histogram overhead", "[latency]")
+{
+    const unsigned num = 10000000;
+    unsigned id = LatencyHistograms::get_id("inspector.bench");
+    LatencyHistograms::tinit(16);
+
+    OptTreeNode otn[1024];
+
+    for ( unsigned i = 0; i < 1024; ++i )
+        otn[i].sigInfo.sid = i + 1;
+
+    auto run = [](const char* what, std::function<void(unsigned)> f)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        for ( unsigned i = 0; i < num; ++i )
+            f(i);
+
+        std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+        printf("%-28s %.2f ns\n", what, ns.count() / num);
+    };
+
+    run("record", [id](unsigned i)
+        { LatencyHistograms::record(id, hr_duration(i & 0xFFFF)); });
+
+    run("timer", [id](unsigned)
+        { LatencyHistograms::Timer t(id); });
+
+    // 16 rules fit the slots; 1024 rules mostly miss with a skewed cost
+    run("record 16 rules", [&otn](unsigned i)
+        { LatencyHistograms::record(otn + (i & 15), hr_duration(i & 0xFFF)); });
+
+    run("record 1024 rules", [&otn](unsigned i)
+        {
+            unsigned r = (i * 2654435761u) >> 22;
+            LatencyHistograms::record(otn + r, hr_duration((1024 - r) * 8));
+        });
+
+    LatencyHistograms::tterm();
+}
+
+#endif
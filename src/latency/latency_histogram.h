@@ -0,0 +1,198 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// latency_histogram.h
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+// Always on latency histograms for whole packets, inspectors, searches, and
+// the most expensive rule trees.  Each packet thread records into its own
+// histograms without locking; readers merge the threads while they run.
+// Values are recorded in clock ticks and converted to nsecs for output.
+//
+// Buckets are log linear: values below 2^LH_SUB_BITS are exact and each
+// power of 2 above that is split into LH_SUB_COUNT buckets, so a percentile
+// is within 1/LH_SUB_COUNT of the recorded values.  Values of 2^LH_MAX_BITS
+// ticks or more go in the last bucket.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "main/snort_types.h"
+#include "main/thread.h"
+#include "time/clock_defs.h"
+
+struct OptTreeNode;
+
+#define LH_SUB_BITS  5
+#define LH_SUB_COUNT (1 << (LH_SUB_BITS - 1))
+#define LH_MAX_BITS  40
+#define LH_BUCKETS   ((1 << LH_SUB_BITS) + (LH_MAX_BITS - LH_SUB_BITS) * LH_SUB_COUNT)
+
+#define LH_MAX_IDS   256  // packet, inspectors, and searches
+
+#define LH_PACKET    1    // id 0 is not used
+
+class SO_PUBLIC LatencyHistogram
+{
+public:
+    LatencyHistogram()
+    { reset(); }
+
+    LatencyHistogram(const LatencyHistogram& rhs)
+    { *this = rhs; }
+
+    LatencyHistogram& operator=(const LatencyHistogram&);
+
+    // single writer only
+    void record(uint64_t v)
+    {
+        bump(buckets[index(v)], 1);
+        bump(sum, v);
+    }
+
+    void reset();
+
+    void add(const LatencyHistogram&);
+    void subtract(const LatencyHistogram&);
+
+    uint64_t get_count() const;
+    uint64_t get_sum() const
+    { return sum.load(std::memory_order_relaxed); }
+
+    // p is 0.0 to 1.0; returns the middle of the bucket
+    uint64_t get_percentile(double p) const;
+
+    // the upper bound of the highest bucket used
+    uint64_t get_max() const;
+
+    static unsigned index(uint64_t v)
+    {
+        if ( v < (1 << LH_SUB_BITS) )
+            return v;
+
+        unsigned msb = 63 - __builtin_clzll(v);
+
+        if ( msb >= LH_MAX_BITS )
+            return LH_BUCKETS - 1;
+
+        return (1 << LH_SUB_BITS) + (msb - LH_SUB_BITS) * LH_SUB_COUNT +
+            (unsigned)(v >> (msb - LH_SUB_BITS + 1)) - LH_SUB_COUNT;
+    }
+
+    static uint64_t lower(unsigned idx);
+    static uint64_t upper(unsigned idx);
+
+private:
+    static void bump(std::atomic<uint64_t>& c, uint64_t n)
+    { c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    std::atomic<uint64_t> buckets[LH_BUCKETS];
+    std::atomic<uint64_t> sum;
+};
+
+struct LatencyRule
+{
+    uint32_t gid;
+    uint32_t sid;
+    uint32_t rev;
+    uint64_t total;   // ticks including time before the rule was tracked
+    LatencyHistogram hist;
+};
+
+class SO_PUBLIC LatencyHistograms
+{
+public:
+    // main thread; names are like inspector.stream_tcp.  the same name
+    // always gets the same id.  returns 0 when all ids are taken.
+    static unsigned get_id(const char* name);
+    static std::string get_name(unsigned id);
+    static unsigned get_num_ids();
+
+    // packet threads; tinit(max_rules) is for testing
+    static void tinit();
+    static void tinit(unsigned max_rules);
+    static void tterm();
+
+    static bool is_enabled()
+    { return enabled; }
+
+    static void record(unsigned id, hr_duration);
+    static void record(const OptTreeNode*, hr_duration);
+
+    // this thread's histogram or null if nothing was recorded
+    static const LatencyHistogram* get_histogram(unsigned id);
+
+    // this thread's rule slots; a slot may be taken over by a costlier rule
+    static unsigned get_rules(std::vector<LatencyRule>&);
+    static unsigned get_max_rules();
+
+    // all threads including those that have exited; filter is a name prefix
+    // (packet, inspector, search, or rule)
+    static void show(std::string&, const char* filter = nullptr);
+
+    static uint64_t to_nsecs(uint64_t ticks);
+
+    class Timer
+    {
+    public:
+        Timer(unsigned id) : id(id)
+        {
+            if ( enabled )
+                start = SnortClock::now();
+        }
+
+        ~Timer()
+        {
+            if ( enabled )
+                record(id, SnortClock::now() - start);
+        }
+
+    private:
+        unsigned id;
+        hr_time start;
+    };
+
+    class RuleTimer
+    {
+    public:
+        RuleTimer(const OptTreeNode* otn) : otn(otn)
+        {
+            if ( enabled )
+                start = SnortClock::now();
+        }
+
+        ~RuleTimer()
+        {
+            if ( enabled )
+                record(otn, SnortClock::now() - start);
+        }
+
+    private:
+        const OptTreeNode* otn;
+        hr_time start;
+    };
+
+private:
+    static THREAD_LOCAL bool enabled;
+};
+
+#endif
@@ -86,6 +86,18 @@ static const Parameter s_params[] =
     { "rule", Parameter::PT_TABLE, s_rule_params, nullptr,
       "rule latency" },
 
+    { "histograms", Parameter::PT_BOOL, nullptr, "true",
+      "record latency histograms for packets, inspectors, searches, and rules" },
+
+    { "histogram_rules", Parameter::PT_INT, "0:64", "16",
+      "number of most costly rule trees to keep histograms for per thread" },
+
+    { "flow_cost_interval", Parameter::PT_INT, "0:max32", "64",
+      "time 1 in this many packets on average for flow cost; 0 disables" },
+
+    { "flow_cost_top", Parameter::PT_INT, "1:256", "16",
+      "number of most costly flows, services, and apps to keep per thread" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -177,7 +189,22 @@ bool LatencyModule::set(const char* fqn, Value& v, SnortConfig* sc)
     else if ( !strncmp(fqn, slr, strlen(slr)) )
         return latency_set(v, sc->latency->rule_latency);
 
-    return false;
+    else if ( v.is("histograms") )
+        sc->latency->histograms = v.get_bool();
+
+    else if ( v.is("histogram_rules") )
+        sc->latency->histogram_rules = v.get_uint32();
+
+    else if ( v.is("flow_cost_interval") )
+        sc->latency->flow_cost_interval = v.get_uint32();
+
+    else if ( v.is("flow_cost_top") )
+        sc->latency->flow_cost_top = v.get_uint32();
+
+    else
+        return false;
+
+    return true;
 }
 
 const RuleMap* LatencyModule::get_rules() const
@@ -0,0 +1,509 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// async_log.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "async_log.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+#include "detection/ips_context.h"
+#include "events/event.h"
+#include "flow/flow.h"
+#include "flow/flow_key.h"
+#include "main/snort_config.h"
+#include "network_inspectors/appid/appid_api.h"
+#include "packet_io/active.h"
+#include "packet_io/sfdaq.h"
+#include "protocols/layer.h"
+#include "protocols/packet.h"
+
+#include "obfuscator.h"
+
+using namespace snort;
+
+THREAD_LOCAL AsyncLogStats async_log_stats;
+
+const PegInfo async_log_pegs[] =
+{
+    { CountType::SUM, "queued", "events queued for the logger thread" },
+    { CountType::SUM, "dropped", "events dropped because the ring was full" },
+    { CountType::SUM, "blocked", "events that waited for ring space" },
+    { CountType::NOW, "ring_depth", "bytes queued for the logger thread" },
+    { CountType::MAX, "max_ring_depth", "maximum bytes queued for the logger thread" },
+    { CountType::NOW, "lag", "usecs from queuing the last logged event to logging it" },
+    { CountType::MAX, "max_lag", "maximum usecs from queuing an event to logging it" },
+    { CountType::END, nullptr, nullptr }
+};
+
+// how long the logger thread sleeps when the ring is empty
+static const unsigned idle_usecs = 100;
+
+// set by the logger thread while it replays a record
+static THREAD_LOCAL const char* s_app_name = nullptr;
+
+// the event and packet fields loggers use; pointers into the packet are
+// rebased on the copy of pkt by the logger thread
+struct LogRecord
+{
+    uint64_t queued;
+    SnortConfig* conf;
+    OutputSet* outputs;
+    const char* message;
+    Event event;
+    uint64_t packet_number;
+
+    DAQ_PktHdr_t pkth;
+    const uint8_t* pkt;
+    const uint8_t* data;
+    DecodeData ptrs;
+    Active active;
+    FlowKey key;
+    const char* service;
+
+    uint32_t packet_flags;
+    uint32_t xtradata_mask;
+    uint32_t proto_bits;
+    uint32_t iplist_id;
+    uint32_t user_inspection_policy_id;
+    uint32_t user_ips_policy_id;
+    uint32_t user_network_policy_id;
+    PseudoPacketType pseudo_type;
+    IpProtocol ip_proto_next;
+    uint16_t alt_dsize;
+    uint16_t dsize;
+    uint8_t num_layers;
+    uint8_t vlan_idx;
+    uint8_t ts_packet_flags;
+
+    bool alert;
+    bool has_event;
+    bool has_flow;
+
+    uint32_t num_blocks;
+    uint32_t pkt_len;    // bytes of pkt
+    uint32_t data_len;   // bytes of data when it isn't in pkt
+    uint32_t file_len;   // bytes of file data
+    uint32_t app_len;    // bytes of the appid name with its null
+
+    // followed by layers, obfuscator blocks, pkt, data, file data, and the
+    // appid name
+};
+
+static uint64_t now_usecs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline bool contains(const uint8_t* base, uint32_t len, const void* p)
+{
+    uintptr_t b = (uintptr_t)base;
+    uintptr_t a = (uintptr_t)p;
+    return base and a >= b and a < b + len;
+}
+
+template<typename T>
+static inline const T* rebase(const T* p, const uint8_t* from, uint32_t len, uint8_t* to)
+{
+    if ( !contains(from, len, p) )
+        return nullptr;
+
+    return (const T*)(to + ((const uint8_t*)p - from));
+}
+
+// pseudo packets have their headers encoded into pkt without a caplen
+static uint32_t packet_span(const Packet* p)
+{
+    if ( !p->pkt )
+        return 0;
+
+    uint32_t span = p->pkth ? p->pkth->caplen : 0;
+
+    for ( unsigned i = 0; i < p->num_layers; ++i )
+    {
+        const Layer& lyr = p->layers[i];
+
+        if ( contains(p->pkt, IpsContext::buf_size, lyr.start) )
+            span = std::max(span, (uint32_t)(lyr.start - p->pkt) + lyr.length);
+    }
+    return std::min(span, IpsContext::buf_size);
+}
+
+static void rebase_ip(ip::IpApi& api, const ip::IpApi& orig,
+    const uint8_t* from, uint32_t len, uint8_t* to)
+{
+    if ( orig.is_ip4() )
+    {
+        if ( auto h = rebase(orig.get_ip4h(), from, len, to) )
+        {
+            api.set(h);
+            api.update(*orig.get_src(), *orig.get_dst());
+            return;
+        }
+    }
+    else if ( orig.is_ip6() )
+    {
+        if ( auto h = rebase(orig.get_ip6h(), from, len, to) )
+        {
+            api.set(h);
+            api.update(*orig.get_src(), *orig.get_dst());
+            return;
+        }
+    }
+    if ( orig.is_valid() )
+        api.set(*orig.get_src(), *orig.get_dst());
+    else
+        api.reset();
+}
+
+//-------------------------------------------------------------------------
+// packet thread
+//-------------------------------------------------------------------------
+
+AsyncLog::AsyncLog(SnortConfig* sc, OpenFunc o, OpenFunc c, CallFunc f) :
+    ring(sc->async_log_size, (LogRing::Overflow)sc->async_log_overflow)
+{
+    open = o;
+    close = c;
+    call = f;
+
+    conf = sc;
+    daq = SFDAQ::get_local_instance();
+    instance_id = get_instance_id();
+    run_num = get_run_num();
+
+    thread = new std::thread(&AsyncLog::worker, this);
+}
+
+AsyncLog::~AsyncLog()
+{
+    go.store(false, std::memory_order_release);
+    thread->join();
+    delete thread;
+}
+
+void AsyncLog::put(
+    OutputSet* set, Packet* p, const char* msg, const Event* event, bool alert)
+{
+    uint32_t pkt_len = packet_span(p);
+
+    bool data_in_pkt = contains(p->pkt, pkt_len, p->data) and
+        (uint32_t)(p->data - p->pkt) + p->dsize <= pkt_len;
+
+    uint32_t data_len = (p->data and !data_in_pkt) ? p->dsize : 0;
+
+    const DataPointer* file = p->context ? &p->context->file_data : nullptr;
+    uint32_t file_len = (file and file->data) ? file->len : 0;
+
+    uint32_t num_blocks = p->obfuscator ?
+        std::distance(p->obfuscator->begin(), p->obfuscator->end()) : 0;
+
+    // appid keeps this in its flow data which the logger thread can't see
+    const char* app_name = p->flow ?
+        appid_api.get_application_name(*p->flow, p->is_from_client()) : nullptr;
+
+    uint32_t app_len = app_name ? strlen(app_name) + 1 : 0;
+
+    uint32_t len = sizeof(LogRecord) + p->num_layers * sizeof(Layer) +
+        num_blocks * sizeof(ObfuscatorBlock) + pkt_len + data_len + file_len + app_len;
+
+    uint8_t* space = ring.reserve(len);
+
+    if ( space )
+    {
+        LogRecord* r = new(space) LogRecord;
+
+        r->queued = now_usecs();
+        r->conf = p->context ? p->context->conf : SnortConfig::get_conf();
+        r->outputs = set;
+        r->message = msg;
+        r->alert = alert;
+        r->has_event = event != nullptr;
+
+        if ( event )
+            r->event = *event;
+
+        r->packet_number = p->context ? p->context->packet_number : 0;
+
+        if ( p->pkth )
+            r->pkth = *p->pkth;
+        else
+            memset(&r->pkth, 0, sizeof(r->pkth));
+
+        r->pkt = p->pkt;
+        r->data = p->data;
+        r->ptrs = p->ptrs;
+        r->active = *p->active;
+
+        r->has_flow = p->flow != nullptr;
+
+        if ( p->flow )
+        {
+            if ( p->flow->key )
+                r->key = *p->flow->key;
+            else
+                memset(&r->key, 0, sizeof(r->key));
+
+            r->service = p->flow->service;
+        }
+
+        r->packet_flags = p->packet_flags;
+        r->xtradata_mask = p->xtradata_mask;
+        r->proto_bits = p->proto_bits;
+        r->iplist_id = p->iplist_id;
+        r->user_inspection_policy_id = p->user_inspection_policy_id;
+        r->user_ips_policy_id = p->user_ips_policy_id;
+        r->user_network_policy_id = p->user_network_policy_id;
+        r->pseudo_type = p->pseudo_type;
+        r->ip_proto_next = p->ip_proto_next;
+        r->alt_dsize = p->alt_dsize;
+        r->dsize = p->dsize;
+        r->num_layers = p->num_layers;
+        r->vlan_idx = p->vlan_idx;
+        r->ts_packet_flags = p->ts_packet_flags;
+
+        r->num_blocks = num_blocks;
+        r->pkt_len = pkt_len;
+        r->data_len = data_len;
+        r->file_len = file_len;
+        r->app_len = app_len;
+
+        uint8_t* var = space + sizeof(*r);
+
+        memcpy(var, p->layers, p->num_layers * sizeof(Layer));
+        var += p->num_layers * sizeof(Layer);
+
+        if ( num_blocks )
+        {
+            ObfuscatorBlock* b = (ObfuscatorBlock*)var;
+
+            for ( const auto& ob : *p->obfuscator )
+                *b++ = ob;
+
+            var = (uint8_t*)b;
+        }
+        memcpy(var, p->pkt, pkt_len);
+        var += pkt_len;
+
+        memcpy(var, p->data, data_len);
+        var += data_len;
+
+        if ( file_len )
+            memcpy(var, file->data, file_len);
+
+        var += file_len;
+
+        if ( app_len )
+            memcpy(var, app_name, app_len);
+
+        ring.commit();
+        ++queued;
+        ++async_log_stats.queued;
+    }
+
+    async_log_stats.dropped += ring.get_dropped() + ring.get_evicted() - dropped_seen;
+    dropped_seen = ring.get_dropped() + ring.get_evicted();
+
+    async_log_stats.blocked += ring.get_blocked() - blocked_seen;
+    blocked_seen = ring.get_blocked();
+
+    async_log_stats.depth = ring.depth();
+
+    if ( async_log_stats.depth > async_log_stats.max_depth )
+        async_log_stats.max_depth = async_log_stats.depth;
+
+    async_log_stats.lag = lag.load(std::memory_order_relaxed);
+
+    if ( async_log_stats.lag > async_log_stats.max_lag )
+        async_log_stats.max_lag = async_log_stats.lag;
+}
+
+const char* AsyncLog::get_app_name()
+{ return s_app_name; }
+
+void AsyncLog::sync()
+{
+    // each record is either logged or evicted by a later put
+    while ( logged.load(std::memory_order_acquire) + ring.get_evicted() < queued )
+        std::this_thread::yield();
+}
+
+//-------------------------------------------------------------------------
+// logger thread
+//-------------------------------------------------------------------------
+
+void AsyncLog::worker()
+{
+    set_instance_id(instance_id);
+    set_run_num(run_num);
+    set_thread_type(STHREAD_TYPE_PACKET);
+
+    SnortConfig::set_conf(conf);
+    SFDAQ::set_local_instance(daq);
+
+    context = new IpsContext;
+    key = new FlowKey;
+    flow = new Flow;
+    flow->key = key;
+
+    open();
+
+    std::vector<uint8_t> rec;
+
+    while ( true )
+    {
+        // anything queued before stop is seen by the pop that follows
+        bool running = go.load(std::memory_order_acquire);
+
+        if ( ring.pop(rec) )
+        {
+            if ( rec.size() >= sizeof(LogRecord) )
+                replay(rec);
+
+            logged.fetch_add(1, std::memory_order_release);
+        }
+        else if ( !running )
+            break;
+
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(idle_usecs));
+    }
+    close();
+
+    delete flow;
+    delete key;
+    delete context;
+}
+
+void AsyncLog::replay(const std::vector<uint8_t>& rec)
+{
+    const LogRecord* r = (const LogRecord*)rec.data();
+    const uint8_t* var = rec.data() + sizeof(*r);
+
+    const Layer* layers = (const Layer*)var;
+    var += r->num_layers * sizeof(Layer);
+
+    const ObfuscatorBlock* blocks = (const ObfuscatorBlock*)var;
+    var += r->num_blocks * sizeof(ObfuscatorBlock);
+
+    const uint8_t* pkt = var;
+    var += r->pkt_len;
+
+    const uint8_t* data = var;
+    var += r->data_len;
+
+    const uint8_t* file = var;
+    var += r->file_len;
+
+    // loggers consult the config for obfuscation, dump formats, etc.
+    if ( r->conf != SnortConfig::get_conf() )
+        SnortConfig::set_conf(r->conf);
+
+    IpsContext* c = context;
+    Packet* p = c->packet;
+
+    memcpy(c->buf, pkt, r->pkt_len);
+    *c->pkth = r->pkth;
+    c->conf = r->conf;
+    c->packet_number = r->packet_number;
+    c->file_data.data = r->file_len ? file : nullptr;
+    c->file_data.len = r->file_len;
+
+    p->pkth = c->pkth;
+    p->pkt = c->buf;
+
+    p->packet_flags = r->packet_flags;
+    p->xtradata_mask = r->xtradata_mask;
+    p->proto_bits = r->proto_bits;
+    p->iplist_id = r->iplist_id;
+    p->user_inspection_policy_id = r->user_inspection_policy_id;
+    p->user_ips_policy_id = r->user_ips_policy_id;
+    p->user_network_policy_id = r->user_network_policy_id;
+    p->pseudo_type = r->pseudo_type;
+    p->ip_proto_next = r->ip_proto_next;
+    p->alt_dsize = r->alt_dsize;
+    p->vlan_idx = r->vlan_idx;
+    p->ts_packet_flags = r->ts_packet_flags;
+
+    p->ptrs = r->ptrs;
+    p->ptrs.tcph = rebase(r->ptrs.tcph, r->pkt, r->pkt_len, c->buf);
+    p->ptrs.udph = rebase(r->ptrs.udph, r->pkt, r->pkt_len, c->buf);
+    p->ptrs.icmph = rebase(r->ptrs.icmph, r->pkt, r->pkt_len, c->buf);
+    rebase_ip(p->ptrs.ip_api, r->ptrs.ip_api, r->pkt, r->pkt_len, c->buf);
+
+    p->num_layers = r->num_layers;
+
+    for ( unsigned i = 0; i < r->num_layers; ++i )
+    {
+        p->layers[i] = layers[i];
+        p->layers[i].start = rebase(layers[i].start, r->pkt, r->pkt_len, c->buf);
+
+        if ( !p->layers[i].start )
+            p->layers[i].length = 0;
+    }
+
+    if ( r->data_len )
+        p->data = data;
+    else
+        p->data = rebase(r->data, r->pkt, r->pkt_len, c->buf);
+
+    p->dsize = p->data ? r->dsize : 0;
+
+    if ( r->num_blocks )
+    {
+        p->obfuscator = new Obfuscator;
+
+        for ( unsigned i = 0; i < r->num_blocks; ++i )
+            p->obfuscator->push(blocks[i].offset, blocks[i].length);
+    }
+
+    p->active = p->active_inst;
+    *p->active = r->active;
+
+    if ( r->has_flow )
+    {
+        *key = r->key;
+        flow->service = r->service;
+        p->flow = flow;
+    }
+    else
+        p->flow = nullptr;
+
+    layer::set_packet_pointer(p);
+
+    s_app_name = r->app_len ? (const char*)var : nullptr;
+
+    Event event = r->event;
+    call(r->outputs, p, r->message, r->has_event ? &event : nullptr, r->alert);
+
+    s_app_name = nullptr;
+
+    p->release_helpers();
+
+    lag.store(now_usecs() - r->queued, std::memory_order_relaxed);
+}
+
@@ -0,0 +1,126 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// async_log.h
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+// AsyncLog moves Logger::alert() and log() calls for loggers that can run
+// async off of a packet thread.  The packet thread copies the event and the
+// packet (headers, payload, decode pointers, flow key, service and appid
+// name) into a LogRing and a logger thread rebuilds the packet and calls the
+// loggers.
+// There is one logger thread per packet thread so each logger still sees
+// one thread's events in order and keeps its per instance files.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "framework/counts.h"
+#include "main/thread.h"
+
+#include "log_ring.h"
+
+struct Event;
+struct OutputSet;
+
+namespace snort
+{
+class Flow;
+class IpsContext;
+class SFDAQInstance;
+struct FlowKey;
+struct Packet;
+struct SnortConfig;
+}
+
+struct AsyncLogStats
+{
+    PegCount queued;
+    PegCount dropped;
+    PegCount blocked;
+    PegCount depth;
+    PegCount max_depth;
+    PegCount lag;
+    PegCount max_lag;
+};
+
+extern const PegInfo async_log_pegs[];
+extern THREAD_LOCAL AsyncLogStats async_log_stats;
+
+class AsyncLog
+{
+public:
+    // these are called on the logger thread
+    typedef void (* OpenFunc)();
+    typedef void (* CallFunc)(OutputSet*, snort::Packet*, const char* msg, Event*, bool alert);
+
+    // start the logger thread for the calling packet thread; open and
+    // close run there when it starts and stops
+    AsyncLog(snort::SnortConfig*, OpenFunc open, OpenFunc close, CallFunc);
+
+    // drain the ring and join
+    ~AsyncLog();
+
+    void put(OutputSet*, snort::Packet*, const char* msg, const Event*, bool alert);
+
+    // wait until everything queued so far has been logged
+    void sync();
+
+    // the appid name queued with the event being logged on this logger
+    // thread or nullptr; the rebuilt flow has no appid session to ask
+    static const char* get_app_name();
+
+private:
+    void worker();
+    void replay(const std::vector<uint8_t>&);
+
+private:
+    LogRing ring;
+    std::thread* thread;
+    std::atomic<bool> go { true };
+
+    OpenFunc open;
+    OpenFunc close;
+    CallFunc call;
+
+    // the packet thread's
+    snort::SnortConfig* conf;
+    snort::SFDAQInstance* daq;
+    unsigned instance_id;
+    uint16_t run_num;
+
+    // producer only
+    uint64_t queued = 0;
+    uint64_t dropped_seen = 0;
+    uint64_t blocked_seen = 0;
+
+    // consumer only
+    snort::IpsContext* context = nullptr;
+    snort::Flow* flow = nullptr;
+    snort::FlowKey* key = nullptr;
+
+    // consumer to producer
+    std::atomic<uint64_t> logged { 0 };
+    std::atomic<uint64_t> lag { 0 };
+};
+
+#endif
+
@@ -0,0 +1,179 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// log_ring.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "log_ring.h"
+
+#include <cassert>
+#include <cstring>
+#include <thread>
+
+// each record starts with its length in an 8 byte header
+static const uint32_t hdr_size = 8;
+static const uint32_t wrap_mark = UINT32_MAX;
+
+static inline uint64_t rec_size(uint64_t len)
+{ return (hdr_size + len + 7) & ~(uint64_t)7; }
+
+LogRing::LogRing(size_t n, Overflow o)
+{
+    size = 4096;
+
+    while ( size < n )
+        size <<= 1;
+
+    mask = size - 1;
+    overflow = o;
+    buf = new uint8_t[size];
+}
+
+LogRing::~LogRing()
+{ delete[] buf; }
+
+// advance tail past the oldest record; false if the consumer got there
+// first (the caller just checks for space again)
+bool LogRing::drop_oldest()
+{
+    uint64_t t = tail.load(std::memory_order_acquire);
+
+    if ( t == head.load(std::memory_order_relaxed) )
+        return false;
+
+    uint64_t off = t & mask;
+    uint32_t len;
+    memcpy(&len, buf + off, sizeof(len));
+
+    uint64_t next = (len == wrap_mark) ? t + size - off : t + rec_size(len);
+
+    if ( !tail.compare_exchange_strong(t, next, std::memory_order_acq_rel) )
+        return false;
+
+    if ( len != wrap_mark )
+        ++evicted;
+
+    return true;
+}
+
+uint8_t* LogRing::reserve(uint32_t len)
+{
+    uint64_t need = rec_size(len);
+
+    if ( need > size / 2 )
+    {
+        ++dropped;
+        return nullptr;
+    }
+
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t off = h & mask;
+    uint64_t wrap = (off + need > size) ? size - off : 0;
+    bool waited = false;
+
+    while ( h + wrap + need - tail_cache > size )
+    {
+        tail_cache = tail.load(std::memory_order_acquire);
+
+        if ( h + wrap + need - tail_cache <= size )
+            break;
+
+        switch ( overflow )
+        {
+        case DROP:
+            ++dropped;
+            return nullptr;
+
+        case DROP_OLDEST:
+            drop_oldest();
+            break;
+
+        case BLOCK:
+            if ( !waited )
+            {
+                ++blocked;
+                waited = true;
+            }
+            std::this_thread::yield();
+            break;
+        }
+    }
+
+    if ( wrap )
+    {
+        memcpy(buf + off, &wrap_mark, sizeof(wrap_mark));
+        h += wrap;
+        off = 0;
+    }
+
+    memcpy(buf + off, &len, sizeof(len));
+    pending = h + need;
+
+    return buf + off + hdr_size;
+}
+
+void LogRing::commit()
+{
+    assert(pending);
+    head.store(pending, std::memory_order_release);
+}
+
+bool LogRing::pop(std::vector<uint8_t>& out)
+{
+    while ( true )
+    {
+        uint64_t t = tail.load(std::memory_order_acquire);
+
+        if ( t == head.load(std::memory_order_acquire) )
+            return false;
+
+        uint64_t off = t & mask;
+        uint32_t len;
+        memcpy(&len, buf + off, sizeof(len));
+
+        uint64_t next;
+
+        if ( len == wrap_mark )
+            next = t + size - off;
+
+        else
+        {
+            // with drop oldest this may have been overwritten already; if so
+            // the length is junk and the exchange below fails so just stay
+            // inside the buffer
+            if ( off + rec_size(len) > size )
+                len = 0;
+
+            out.assign(buf + off + hdr_size, buf + off + hdr_size + len);
+            next = t + rec_size(len);
+        }
+
+        if ( overflow != DROP_OLDEST )
+            tail.store(next, std::memory_order_release);
+
+        else if ( !tail.compare_exchange_strong(t, next, std::memory_order_acq_rel) )
+            continue;
+
+        if ( len != wrap_mark )
+            return true;
+    }
+}
+
@@ -0,0 +1,108 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// log_ring.h
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+// LogRing is a single producer / single consumer queue of variable length
+// records used to hand events from a packet thread to its logger thread.
+// Records are 8 byte aligned and never split; one that won't fit before
+// the end of the buffer is preceded by a wrap marker.
+//
+// Head and tail are free running byte counts.  The producer owns head and
+// the consumer owns tail except with DROP_OLDEST, where the producer may
+// also move tail past the oldest record.  So the consumer copies a record
+// out and keeps it only if it can still move tail past it.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class LogRing
+{
+public:
+    // what reserve() does when the ring is full
+    enum Overflow { BLOCK, DROP_OLDEST, DROP };
+
+    // size is rounded up to a power of 2
+    LogRing(size_t size, Overflow);
+    ~LogRing();
+
+    LogRing(const LogRing&) = delete;
+    LogRing& operator=(const LogRing&) = delete;
+
+    // producer: get space for len bytes or nullptr if the new record is
+    // dropped; commit() makes it visible to the consumer.  records larger
+    // than half the ring are always dropped.
+    uint8_t* reserve(uint32_t len);
+    void commit();
+
+    // consumer: copy the oldest record to buf or return false if empty
+    bool pop(std::vector<uint8_t>& buf);
+
+    size_t depth() const
+    { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+
+    bool empty() const
+    { return depth() == 0; }
+
+    size_t get_size() const
+    { return size; }
+
+    Overflow get_overflow() const
+    { return overflow; }
+
+    // producer counts of new records dropped and old records evicted
+    uint64_t get_dropped() const
+    { return dropped; }
+
+    uint64_t get_evicted() const
+    { return evicted; }
+
+    uint64_t get_blocked() const
+    { return blocked; }
+
+private:
+    bool drop_oldest();
+
+private:
+    uint8_t* buf;
+    size_t size;
+    size_t mask;
+    Overflow overflow;
+
+    // producer only
+    uint64_t pending = 0;
+    uint64_t tail_cache = 0;
+    uint64_t dropped = 0;
+    uint64_t evicted = 0;
+    uint64_t blocked = 0;
+
+    // each index on its own cache line
+    char pad0[64];
+    std::atomic<uint64_t> head { 0 };
+    char pad1[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail { 0 };
+    char pad2[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+#endif
+
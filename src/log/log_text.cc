@@ -45,6 +45,7 @@
 #include "utils/util.h"
 #include "utils/util_net.h"
 
+#include "async_log.h"
 #include "log.h"
 #include "messages.h"
 #include "obfuscator.h"
@@ -92,6 +93,10 @@ bool LogAppID(TextLog* log, Packet* p)
     {
         const char* app_name = appid_api.get_application_name(*p->flow, p->is_from_client());
 
+        // async loggers get the name queued with the event
+        if ( !app_name )
+            app_name = AsyncLog::get_app_name();
+
         if ( app_name )
         {
             TextLog_Print(log, "[AppID: %s] ", app_name);
@@ -0,0 +1,367 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// pcap_writer.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "pcap_writer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "log/messages.h"
+#include "utils/util.h"
+
+using namespace snort;
+
+#define PCAP_MAGIC 0xa1b2c3d4
+
+// the on disk headers have 32 bit times unlike struct pcap_pkthdr
+struct PcapFileHdr
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct PcapRecHdr
+{
+    uint32_t sec;
+    uint32_t usec;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+PcapWriter::PcapWriter(int dlt, uint32_t snaplen, size_t window) :
+    dlt(dlt), snaplen(snaplen)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    if ( window < page )
+        window = page;
+
+    this->window = (window + page - 1) / page * page;
+}
+
+PcapWriter::~PcapWriter()
+{ close(); }
+
+bool PcapWriter::open(const char* path)
+{
+    close();
+
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if ( fd < 0 )
+    {
+        ErrorMessage("Can't create pcap file %s: %s\n", path, get_error(errno));
+        return false;
+    }
+
+    win_off = 0;
+    pos = synced = 0;
+
+    if ( !map(0) )
+    {
+        ErrorMessage("Can't map pcap file %s: %s\n", path, get_error(errno));
+        close();
+        return false;
+    }
+
+    PcapFileHdr hdr;
+    hdr.magic = PCAP_MAGIC;
+    hdr.version_major = 2;
+    hdr.version_minor = 4;
+    hdr.thiszone = 0;
+    hdr.sigfigs = 0;
+    hdr.snaplen = snaplen;
+    hdr.linktype = dlt;
+
+    put(&hdr, sizeof(hdr));
+    return true;
+}
+
+void PcapWriter::close()
+{
+    if ( fd < 0 )
+        return;
+
+    uint64_t len = size();
+    unmap();
+
+    // drop the unused part of the last window
+    if ( ftruncate(fd, len) )
+        ErrorMessage("Can't truncate pcap file: %s\n", get_error(errno));
+
+    ::close(fd);
+    fd = -1;
+}
+
+void PcapWriter::write(
+    const struct timeval& ts, uint32_t caplen, uint32_t pktlen, const uint8_t* data)
+{
+    if ( caplen > snaplen )
+        caplen = snaplen;
+
+    PcapRecHdr hdr;
+    hdr.sec = (uint32_t)ts.tv_sec;
+    hdr.usec = (uint32_t)ts.tv_usec;
+    hdr.caplen = caplen;
+    hdr.len = pktlen;
+
+    put(&hdr, sizeof(hdr));
+    put(data, caplen);
+}
+
+void PcapWriter::flush()
+{
+    if ( base and pos > synced )
+        writeback(pos);
+}
+
+void PcapWriter::put(const void* p, size_t len)
+{
+    const uint8_t* src = (const uint8_t*)p;
+
+    while ( len and base )
+    {
+        if ( pos == window and !map(win_off + window) )
+        {
+            ErrorMessage("Can't map pcap file: %s\n", get_error(errno));
+            return;
+        }
+
+        size_t n = window - pos;
+
+        if ( n > len )
+            n = len;
+
+        memcpy(base + pos, src, n);
+        pos += n;
+        src += n;
+        len -= n;
+    }
+}
+
+// the next window is allocated before it is mapped so running out of space
+// is an error here rather than a SIGBUS on a later copy
+bool PcapWriter::map(off_t off)
+{
+    unmap();
+
+    int err = posix_fallocate(fd, off, window);
+
+    if ( err == EOPNOTSUPP or err == EINVAL )
+        err = ftruncate(fd, off + window) ? errno : 0;
+
+    if ( err )
+    {
+        errno = err;
+        return false;
+    }
+
+#ifdef MAP_POPULATE
+    // fault the whole window in now rather than a page at a time
+    int flags = MAP_SHARED | MAP_POPULATE;
+#else
+    int flags = MAP_SHARED;
+#endif
+
+    void* p = mmap(nullptr, window, PROT_READ | PROT_WRITE, flags, fd, off);
+
+    if ( p == MAP_FAILED )
+        return false;
+
+    madvise(p, window, MADV_SEQUENTIAL);
+
+    base = (uint8_t*)p;
+    win_off = off;
+    pos = synced = 0;
+    return true;
+}
+
+void PcapWriter::unmap()
+{
+    if ( !base )
+        return;
+
+    // the whole window is written back at once
+    if ( pos > synced )
+        writeback(pos);
+
+    munmap(base, window);
+    base = nullptr;
+
+    // size() stays correct until the next window is mapped
+}
+
+void PcapWriter::writeback(size_t end)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(fd, win_off + synced, end - synced, SYNC_FILE_RANGE_WRITE);
+#else
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = synced / page * page;
+    msync(base + start, end - start, MS_ASYNC);
+#endif
+    synced = end;
+}
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#if defined(UNIT_TEST) || defined(BENCHMARK_TEST)
+#include <pcap.h>
+
+#include <chrono>
+#include <string>
+
+#include "catch/snort_catch.h"
+
+static std::string test_file(const char* name)
+{
+    const char* dir = getenv("TMPDIR");
+    return std::string(dir ? dir : "/tmp") + "/" + name + "." + std::to_string(getpid());
+}
+#endif
+
+#ifdef UNIT_TEST
+TEST_CASE("pcap writer read back", "[pcap_writer]")
+{
+    std::string file = test_file("pcap_writer");
+    uint8_t data[1500];
+
+    for ( unsigned i = 0; i < sizeof(data); ++i )
+        data[i] = (uint8_t)i;
+
+    // a one page window so records span windows
+    PcapWriter writer(DLT_EN10MB, 1000, 4096);
+    REQUIRE(writer.open(file.c_str()));
+
+    const unsigned num = 100;
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        struct timeval tv = { 1546300800 + i, i };
+        unsigned len = 60 + i * 14;
+        writer.write(tv, len, len, data);
+    }
+    uint64_t size = writer.size();
+    writer.close();
+
+    FILE* fp = fopen(file.c_str(), "rb");
+    REQUIRE(fp);
+
+    PcapFileHdr fh;
+    REQUIRE(fread(&fh, sizeof(fh), 1, fp) == 1);
+
+    CHECK(fh.magic == PCAP_MAGIC);
+    CHECK(fh.linktype == DLT_EN10MB);
+    CHECK(fh.snaplen == 1000);
+
+    PcapRecHdr hdr;
+    uint8_t pkt[1500];
+    unsigned i = 0;
+
+    while ( fread(&hdr, sizeof(hdr), 1, fp) == 1 )
+    {
+        unsigned len = 60 + i * 14;
+        CHECK(hdr.sec == 1546300800 + i);
+        CHECK(hdr.usec == i);
+        CHECK(hdr.len == len);
+        REQUIRE(hdr.caplen == (len > 1000 ? 1000 : len));
+        REQUIRE(fread(pkt, hdr.caplen, 1, fp) == 1);
+        CHECK(!memcmp(pkt, data, hdr.caplen));
+        ++i;
+    }
+    CHECK(i == num);
+
+    // the preallocated tail is gone
+    CHECK((uint64_t)ftell(fp) == size);
+    fclose(fp);
+
+    unlink(file.c_str());
+}
+#endif
+
+#ifdef BENCHMARK_TEST
+// packets per second writing the same packets with pcap_dump() and a flush
+// per packet as log_pcap and packet_capture do, and with the mapped writer
+TEST_CASE("pcap writer throughput", "[pcap_writer]")
+{
+    const unsigned num = 2000000;
+    const unsigned sizes[] = { 64, 590, 1514 };
+
+    std::string file = test_file("pcap_writer_bench");
+    uint8_t data[1514] = { };
+    uint64_t bytes = 0;
+
+    pcap_t* pcap = pcap_open_dead(DLT_EN10MB, 65535);
+    pcap_dumper_t* dumper = pcap_dump_open(pcap, file.c_str());
+    REQUIRE(dumper);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        struct pcap_pkthdr hdr;
+        hdr.ts = { 1546300800, (suseconds_t)(i % 1000000) };
+        hdr.caplen = hdr.len = sizes[i % 3];
+        pcap_dump((u_char*)dumper, &hdr, data);
+        pcap_dump_flush(dumper);
+        bytes += 16 + hdr.caplen;
+    }
+    pcap_dump_close(dumper);
+    pcap_close(pcap);
+
+    std::chrono::duration<double> old_secs = std::chrono::steady_clock::now() - start;
+    unlink(file.c_str());
+
+    PcapWriter writer(DLT_EN10MB, 65535);
+    REQUIRE(writer.open(file.c_str()));
+
+    start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < num; ++i )
+    {
+        struct timeval tv = { 1546300800, (suseconds_t)(i % 1000000) };
+        writer.write(tv, sizes[i % 3], sizes[i % 3], data);
+    }
+    CHECK(writer.size() == bytes + 24);
+    writer.close();
+
+    std::chrono::duration<double> new_secs = std::chrono::steady_clock::now() - start;
+    unlink(file.c_str());
+
+    printf("pcap_dump %.0f pkts/sec %.0f MB/sec, mapped %.0f pkts/sec %.0f MB/sec\n",
+        num / old_secs.count(), bytes / old_secs.count() / 1e6,
+        num / new_secs.count(), bytes / new_secs.count() / 1e6);
+}
+#endif
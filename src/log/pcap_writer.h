@@ -0,0 +1,94 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// pcap_writer.h
+
+#ifndef PCAP_WRITER_H
+#define PCAP_WRITER_H
+
+// PcapWriter appends packets to a pcap file through a memory mapped
+// window of the file instead of stdio.  Each window is preallocated and
+// faulted in when it is mapped and writeback of the whole window is started
+// when it is unmapped, so a packet is one or two memcpy()s.  Records may
+// span windows.
+//
+// The file is only truncated to what was written by close(); until then
+// it ends with the zeroed remainder of the current window.  Rotation by
+// size or time is left to the caller which can check size() and reopen.
+
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "main/snort_types.h"
+
+namespace snort
+{
+class SO_PUBLIC PcapWriter
+{
+public:
+    // snaplen goes in the file header and longer packets are truncated;
+    // window is rounded up to a multiple of the page size
+    PcapWriter(int dlt, uint32_t snaplen, size_t window = 8 * 1024 * 1024);
+    ~PcapWriter();
+
+    PcapWriter(const PcapWriter&) = delete;
+    PcapWriter& operator=(const PcapWriter&) = delete;
+
+    // create path and write the file header
+    bool open(const char* path);
+    void close();
+
+    // caplen is truncated to snaplen
+    void write(const struct timeval&, uint32_t caplen, uint32_t pktlen, const uint8_t* data);
+
+    // start writeback of everything written so far
+    void flush();
+
+    bool is_open() const
+    { return fd >= 0; }
+
+    // file size with what has been written
+    uint64_t size() const
+    { return win_off + pos; }
+
+    uint32_t get_snaplen() const
+    { return snaplen; }
+
+private:
+    void put(const void*, size_t);
+    bool map(off_t);
+    void unmap();
+    void writeback(size_t end);
+
+private:
+    int fd = -1;
+    int dlt;
+    uint32_t snaplen;
+
+    size_t window;
+    uint8_t* base = nullptr;
+    off_t win_off = 0;
+    size_t pos = 0;
+    size_t synced = 0;
+};
+}
+#endif
+
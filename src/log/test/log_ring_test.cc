@@ -0,0 +1,238 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// log_ring_test.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../log_ring.h"
+
+#include <CppUTest/CommandLineTestRunner.h>
+#include <CppUTest/TestHarness.h>
+
+// records are a sequence number followed by len - 8 copies of its low byte
+// so a torn copy shows up as a mismatch
+static uint32_t rec_len(uint64_t seq)
+{ return 8 + (seq * 37) % 500; }
+
+static bool put(LogRing& ring, uint64_t seq)
+{
+    uint32_t len = rec_len(seq);
+    uint8_t* p = ring.reserve(len);
+
+    if ( !p )
+        return false;
+
+    memcpy(p, &seq, 8);
+    memset(p + 8, (uint8_t)seq, len - 8);
+    ring.commit();
+    return true;
+}
+
+static bool check(const std::vector<uint8_t>& rec, uint64_t& seq)
+{
+    if ( rec.size() < 8 )
+        return false;
+
+    memcpy(&seq, rec.data(), 8);
+
+    if ( rec.size() != rec_len(seq) )
+        return false;
+
+    for ( unsigned i = 8; i < rec.size(); ++i )
+        if ( rec[i] != (uint8_t)seq )
+            return false;
+
+    return true;
+}
+
+TEST_GROUP(log_ring)
+{ };
+
+TEST(log_ring, size)
+{
+    LogRing a(1000, LogRing::DROP);
+    CHECK(a.get_size() == 4096);
+
+    LogRing b(70000, LogRing::DROP);
+    CHECK(b.get_size() == 131072);
+}
+
+TEST(log_ring, fifo_with_wrap)
+{
+    LogRing ring(4096, LogRing::DROP);
+    std::vector<uint8_t> rec;
+    uint64_t next = 0, seq;
+
+    // stay under half full so nothing drops and every offset gets used
+    for ( uint64_t i = 0; i < 1000; ++i )
+    {
+        CHECK(put(ring, i));
+
+        if ( ring.depth() > 1024 )
+        {
+            while ( ring.pop(rec) )
+            {
+                CHECK(check(rec, seq));
+                CHECK(seq == next++);
+            }
+        }
+    }
+    while ( ring.pop(rec) )
+    {
+        CHECK(check(rec, seq));
+        CHECK(seq == next++);
+    }
+    CHECK(next == 1000);
+    CHECK(ring.empty());
+    CHECK(ring.get_dropped() == 0);
+    CHECK(!ring.pop(rec));
+}
+
+TEST(log_ring, drop_new)
+{
+    LogRing ring(4096, LogRing::DROP);
+    uint64_t seq = 0;
+
+    while ( put(ring, seq) )
+        ++seq;
+
+    CHECK(seq > 0);
+    CHECK(ring.get_dropped() == 1);
+
+    std::vector<uint8_t> rec;
+    uint64_t n = 0, s;
+
+    while ( ring.pop(rec) )
+    {
+        CHECK(check(rec, s));
+        CHECK(s == n++);
+    }
+    CHECK(n == seq);
+    CHECK(put(ring, seq));
+}
+
+TEST(log_ring, drop_oldest)
+{
+    LogRing ring(4096, LogRing::DROP_OLDEST);
+    const uint64_t num = 200;
+
+    for ( uint64_t i = 0; i < num; ++i )
+        CHECK(put(ring, i));
+
+    std::vector<uint8_t> rec;
+    uint64_t popped = 0, last = 0, seq;
+
+    while ( ring.pop(rec) )
+    {
+        CHECK(check(rec, seq));
+        CHECK(!popped or seq == last + 1);
+        last = seq;
+        ++popped;
+    }
+    // the newest are kept
+    CHECK(last == num - 1);
+    CHECK(popped + ring.get_evicted() == num);
+    CHECK(ring.get_dropped() == 0);
+}
+
+TEST(log_ring, too_big)
+{
+    LogRing ring(4096, LogRing::BLOCK);
+    CHECK(ring.reserve(2048) == nullptr);
+    CHECK(ring.get_dropped() == 1);
+    CHECK(ring.reserve(2000) != nullptr);
+}
+
+static void run_threads(LogRing::Overflow overflow, uint64_t& popped, uint64_t& lost)
+{
+    LogRing ring(16384, overflow);
+    const uint64_t num = 200000;
+    std::atomic<bool> done { false };
+    uint64_t queued = 0;
+
+    std::thread producer([&]()
+    {
+        for ( uint64_t i = 0; i < num; ++i )
+            if ( put(ring, i) )
+                ++queued;
+
+        done = true;
+    });
+
+    std::vector<uint8_t> rec;
+    uint64_t last = 0, seq;
+    bool ok = true;
+    popped = 0;
+
+    while ( true )
+    {
+        bool finished = done;
+
+        if ( ring.pop(rec) )
+        {
+            if ( !check(rec, seq) or (popped and seq <= last) )
+                ok = false;
+            last = seq;
+            ++popped;
+        }
+        else if ( finished )
+            break;
+    }
+    producer.join();
+
+    CHECK(ok);
+    lost = ring.get_dropped() + ring.get_evicted();
+
+    if ( overflow == LogRing::DROP_OLDEST )
+        CHECK(popped + ring.get_evicted() == num);
+    else
+        CHECK(popped == queued and queued + lost == num);
+}
+
+TEST(log_ring, threads_block)
+{
+    uint64_t popped, lost;
+    run_threads(LogRing::BLOCK, popped, lost);
+    CHECK(popped == 200000);
+    CHECK(lost == 0);
+}
+
+TEST(log_ring, threads_drop)
+{
+    uint64_t popped, lost;
+    run_threads(LogRing::DROP, popped, lost);
+}
+
+TEST(log_ring, threads_drop_oldest)
+{
+    uint64_t popped, lost;
+    run_threads(LogRing::DROP_OLDEST, popped, lost);
+}
+
+int main(int argc, char* argv[])
+{
+    return CommandLineTestRunner::RunAllTests(argc, argv);
+}
+
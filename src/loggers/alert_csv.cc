@@ -559,6 +559,9 @@ public:
 
     void alert(Packet*, const char* msg, const Event&) override;
 
+    bool can_run_async() const override
+    { return true; }
+
 public:
     string file;
     unsigned long limit;
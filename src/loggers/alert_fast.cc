@@ -159,6 +159,9 @@ public:
 
     void alert(Packet*, const char* msg, const Event&) override;
 
+    bool can_run_async() const override
+    { return !packet; }
+
 private:
     void log_data(Packet*, const Event&);
 
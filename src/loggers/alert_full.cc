@@ -126,6 +126,9 @@ public:
 
     void alert(Packet*, const char* msg, const Event&) override;
 
+    bool can_run_async() const override
+    { return true; }
+
 private:
     string file;
     unsigned long limit;
@@ -48,41 +48,262 @@
 #include "protocols/udp.h"
 #include "protocols/vlan.h"
 #include "utils/stats.h"
+#include "utils/util.h"
 
 using namespace snort;
 using namespace std;
 
 #define LOG_BUFFER (4*K_BYTES)
 
-static THREAD_LOCAL TextLog* json_log;
+// must be less than LOG_BUFFER so each part fits in one TextLog_Write()
+#define JSON_BUFFER (2*K_BYTES)
 
 #define S_NAME "alert_json"
 #define F_NAME S_NAME ".txt"
 
+//-------------------------------------------------------------------------
+// output buffer
+//-------------------------------------------------------------------------
+
+// events are formatted here without printf and copied to the text log with
+// one write.  the escaping and number formats match what TextLog_Quote()
+// and TextLog_Print() produced before so the output is unchanged.
+
+class JsonBuffer
+{
+public:
+    JsonBuffer(TextLog* log) : log(log) { }
+
+    void put(const char* s, unsigned n)
+    {
+        while ( n > JSON_BUFFER - pos )
+        {
+            unsigned k = JSON_BUFFER - pos;
+            memcpy(buf + pos, s, k);
+            pos += k;
+            s += k;
+            n -= k;
+            spill();
+        }
+        memcpy(buf + pos, s, n);
+        pos += n;
+    }
+
+    void put(const char* s)
+    { put(s, strlen(s)); }
+
+    void put_char(char c)
+    {
+        if ( pos == JSON_BUFFER )
+            spill();
+        buf[pos++] = c;
+    }
+
+    // "%u" and STDu64
+    void put_uint(uint64_t u)
+    {
+        char tmp[20];
+        char* end = tmp + sizeof(tmp);
+        char* s = end;
+
+        while ( u >= 100 )
+        {
+            unsigned d = (u % 100) * 2;
+            u /= 100;
+            *--s = digits[d + 1];
+            *--s = digits[d];
+        }
+        if ( u >= 10 )
+        {
+            *--s = digits[u * 2 + 1];
+            *--s = digits[u * 2];
+        }
+        else
+            *--s = '0' + u;
+
+        put(s, end - s);
+    }
+
+    // "%0<width>X"
+    void put_hex(uint32_t u, unsigned width)
+    {
+        static const char* const hex = "0123456789ABCDEF";
+        char tmp[8];
+        char* end = tmp + sizeof(tmp);
+        char* s = end;
+
+        do
+        {
+            *--s = hex[u & 0xF];
+            u >>= 4;
+        }
+        while ( u or (unsigned)(end - s) < width );
+
+        put(s, end - s);
+    }
+
+    // quote s escaping only '"' and '\\' like TextLog_Quote(); the
+    // backslash is always stored and kept only when needed
+    void put_quoted(const char* s)
+    {
+        put_char('"');
+
+        while ( *s )
+        {
+            if ( JSON_BUFFER - pos < 2 )
+                spill();
+
+            char* out = buf + pos;
+            const char* end = buf + JSON_BUFFER - 1;
+
+            while ( *s and out < end )
+            {
+                char c = *s++;
+                unsigned esc = (c == '"') | (c == '\\');
+                out[0] = '\\';
+                out[esc] = c;
+                out += esc + 1;
+            }
+            pos = out - buf;
+        }
+        put_char('"');
+    }
+
+    // the date and time to the second only changes once per second
+    void put_timestamp(const struct timeval& tv)
+    {
+        if ( tv.tv_sec != ts_sec or !ts_len )
+        {
+            char ts[TIMEBUF_SIZE];
+            ts_print(&tv, ts);
+
+            const char* dot = strchr(ts, '.');
+
+            if ( !dot )
+            {
+                ts_len = 0;
+                put(ts);
+                return;
+            }
+            ts_len = dot - ts + 1;
+            memcpy(ts_prefix, ts, ts_len);
+            ts_sec = tv.tv_sec;
+        }
+        put(ts_prefix, ts_len);
+
+        // "%06u"
+        uint32_t usec = tv.tv_usec;
+
+        for ( uint32_t d = 100000; d > 1 and usec < d; d /= 10 )
+            put_char('0');
+
+        put_uint(usec);
+    }
+
+    // write the event to the log
+    void flush()
+    {
+        spill();
+        TextLog_Flush(log);
+    }
+
+    const char* data() const
+    { return buf; }
+
+    unsigned size() const
+    { return pos; }
+
+    void clear()
+    { pos = 0; }
+
+private:
+    void spill()
+    {
+        if ( pos )
+            TextLog_Write(log, buf, pos);
+        pos = 0;
+    }
+
+private:
+    static const char digits[201];
+
+    TextLog* log;
+    unsigned pos = 0;
+    unsigned ts_len = 0;
+    time_t ts_sec = 0;
+    char ts_prefix[TIMEBUF_SIZE];
+    char buf[JSON_BUFFER];
+};
+
+const char JsonBuffer::digits[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static THREAD_LOCAL TextLog* json_log;
+static THREAD_LOCAL JsonBuffer* json_out;
+
 //-------------------------------------------------------------------------
 // field formatting functions
 //-------------------------------------------------------------------------
 
+struct Args;
+typedef bool (*JsonFunc)(Args&);
+
+// a configured field with its key already quoted and separated from the
+// previous field
+struct JsonField
+{
+    JsonFunc func;
+    string key;
+};
+
 struct Args
 {
     Packet* pkt;
     const char* msg;
     const Event& event;
-    bool comma;
+    const JsonField* field;
 };
 
-static void print_label(Args& a, const char* label)
+static void print_label(Args& a)
 {
-    if ( a.comma )
-        TextLog_Print(json_log, ",");
+    json_out->put(a.field->key.c_str(), a.field->key.size());
+}
 
-    TextLog_Print(json_log, " \"%s\" : ", label);
+static void print_ap(const char* addr, unsigned port)
+{
+    json_out->put_char('"');
+    json_out->put(addr);
+    json_out->put_char(':');
+    json_out->put_uint(port);
+    json_out->put_char('"');
+}
+
+static void print_mac(const uint8_t* mac)
+{
+    json_out->put_char('"');
+
+    for ( unsigned i = 0; i < 6; ++i )
+    {
+        if ( i )
+            json_out->put_char(':');
+        json_out->put_hex(mac[i], 2);
+    }
+    json_out->put_char('"');
 }
 
 static bool ff_action(Args& a)
 {
-    print_label(a, "action");
-    TextLog_Quote(json_log, a.pkt->active->get_action_string());
+    print_label(a);
+    json_out->put_quoted(a.pkt->active->get_action_string());
     return true;
 }
 
@@ -93,8 +314,8 @@ static bool ff_class(Args& a)
     if ( a.event.sig_info->class_type and a.event.sig_info->class_type->name )
         cls = a.event.sig_info->class_type->name;
 
-    print_label(a, "class");
-    TextLog_Quote(json_log, cls);
+    print_label(a);
+    json_out->put_quoted(cls);
     return true;
 }
 
@@ -110,21 +331,21 @@ static bool ff_b64_data(Args& a)
     unsigned nin = 0;
     Base64Encoder b64;
 
-    print_label(a, "b64_data");
-    TextLog_Putc(json_log, '"');
+    print_label(a);
+    json_out->put_char('"');
 
     while ( nin < a.pkt->dsize )
     {
         unsigned kin = min(a.pkt->dsize-nin, block_size);
         unsigned kout = b64.encode(in+nin, kin, out);
-        TextLog_Write(json_log, out, kout);
+        json_out->put(out, kout);
         nin += kin;
     }
 
     if ( unsigned kout = b64.finish(out) )
-        TextLog_Write(json_log, out, kout);
+        json_out->put(out, kout);
 
-    TextLog_Putc(json_log, '"');
+    json_out->put_char('"');
     return true;
 }
 
@@ -139,8 +360,8 @@ static bool ff_dir(Args& a)
     else
         dir = "UNK";
 
-    print_label(a, "dir");
-    TextLog_Quote(json_log, dir);
+    print_label(a);
+    json_out->put_quoted(dir);
     return true;
 }
 
@@ -149,8 +370,8 @@ static bool ff_dst_addr(Args& a)
     if ( a.pkt->has_ip() or a.pkt->is_data() )
     {
         SfIpString ip_str;
-        print_label(a, "dst_addr");
-        TextLog_Quote(json_log, a.pkt->ptrs.ip_api.get_dst()->ntop(ip_str));
+        print_label(a);
+        json_out->put_quoted(a.pkt->ptrs.ip_api.get_dst()->ntop(ip_str));
         return true;
     }
     return false;
@@ -167,8 +388,8 @@ static bool ff_dst_ap(Args& a)
     if ( a.pkt->proto_bits & (PROTO_BIT__TCP|PROTO_BIT__UDP) )
         port = a.pkt->ptrs.dp;
 
-    print_label(a, "dst_ap");
-    TextLog_Print(json_log, "\"%s:%u\"", addr, port);
+    print_label(a);
+    print_ap(addr, port);
     return true;
 }
 
@@ -176,8 +397,8 @@ static bool ff_dst_port(Args& a)
 {
     if ( a.pkt->proto_bits & (PROTO_BIT__TCP|PROTO_BIT__UDP) )
     {
-        print_label(a, "dst_port");
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.dp);
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.dp);
         return true;
     }
     return false;
@@ -188,13 +409,10 @@ static bool ff_eth_dst(Args& a)
     if ( !(a.pkt->proto_bits & PROTO_BIT__ETH) )
         return false;
 
-    print_label(a, "eth_dst");
+    print_label(a);
     const eth::EtherHdr* eh = layer::get_eth_layer(a.pkt);
 
-    TextLog_Print(json_log, "\"%02X:%02X:%02X:%02X:%02X:%02X\"", eh->ether_dst[0],
-        eh->ether_dst[1], eh->ether_dst[2], eh->ether_dst[3],
-        eh->ether_dst[4], eh->ether_dst[5]);
-
+    print_mac(eh->ether_dst);
     return true;
 }
 
@@ -203,8 +421,8 @@ static bool ff_eth_len(Args& a)
     if ( !(a.pkt->proto_bits & PROTO_BIT__ETH) )
         return false;
 
-    print_label(a, "eth_len");
-    TextLog_Print(json_log, "%u", a.pkt->pkth->pktlen);
+    print_label(a);
+    json_out->put_uint(a.pkt->pkth->pktlen);
     return true;
 }
 
@@ -213,12 +431,10 @@ static bool ff_eth_src(Args& a)
     if ( !(a.pkt->proto_bits & PROTO_BIT__ETH) )
         return false;
 
-    print_label(a, "eth_src");
+    print_label(a);
     const eth::EtherHdr* eh = layer::get_eth_layer(a.pkt);
 
-    TextLog_Print(json_log, "\"%02X:%02X:%02X:%02X:%02X:%02X\"", eh->ether_src[0],
-        eh->ether_src[1], eh->ether_src[2], eh->ether_src[3],
-        eh->ether_src[4], eh->ether_src[5]);
+    print_mac(eh->ether_src);
     return true;
 }
 
@@ -229,15 +445,17 @@ static bool ff_eth_type(Args& a)
 
     const eth::EtherHdr* eh = layer::get_eth_layer(a.pkt);
 
-    print_label(a, "eth_type");
-    TextLog_Print(json_log, "\"0x%X\"", ntohs(eh->ether_type));
+    print_label(a);
+    json_out->put("\"0x", 3);
+    json_out->put_hex(ntohs(eh->ether_type), 1);
+    json_out->put_char('"');
     return true;
 }
 
 static bool ff_gid(Args& a)
 {
-    print_label(a, "gid");
-    TextLog_Print(json_log, "%u",  a.event.sig_info->gid);
+    print_label(a);
+    json_out->put_uint(a.event.sig_info->gid);
     return true;
 }
 
@@ -245,8 +463,8 @@ static bool ff_icmp_code(Args& a)
 {
     if (a.pkt->ptrs.icmph )
     {
-        print_label(a, "icmp_code");
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.icmph->code);
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.icmph->code);
         return true;
     }
     return false;
@@ -256,8 +474,8 @@ static bool ff_icmp_id(Args& a)
 {
     if (a.pkt->ptrs.icmph )
     {
-        print_label(a, "icmp_id");
-        TextLog_Print(json_log, "%u", ntohs(a.pkt->ptrs.icmph->s_icmp_id));
+        print_label(a);
+        json_out->put_uint(ntohs(a.pkt->ptrs.icmph->s_icmp_id));
         return true;
     }
     return false;
@@ -267,8 +485,8 @@ static bool ff_icmp_seq(Args& a)
 {
     if (a.pkt->ptrs.icmph )
     {
-        print_label(a, "icmp_seq");
-        TextLog_Print(json_log, "%u", ntohs(a.pkt->ptrs.icmph->s_icmp_seq));
+        print_label(a);
+        json_out->put_uint(ntohs(a.pkt->ptrs.icmph->s_icmp_seq));
         return true;
     }
     return false;
@@ -278,8 +496,8 @@ static bool ff_icmp_type(Args& a)
 {
     if (a.pkt->ptrs.icmph )
     {
-        print_label(a, "icmp_type");
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.icmph->type);
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.icmph->type);
         return true;
     }
     return false;
@@ -287,8 +505,8 @@ static bool ff_icmp_type(Args& a)
 
 static bool ff_iface(Args& a)
 {
-    print_label(a, "iface");
-    TextLog_Quote(json_log, SFDAQ::get_interface_spec());
+    print_label(a);
+    json_out->put_quoted(SFDAQ::get_interface_spec());
     return true;
 }
 
@@ -296,8 +514,8 @@ static bool ff_ip_id(Args& a)
 {
     if (a.pkt->has_ip())
     {
-        print_label(a, "ip_id");
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.ip_api.id());
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.ip_api.id());
         return true;
     }
     return false;
@@ -307,8 +525,8 @@ static bool ff_ip_len(Args& a)
 {
     if (a.pkt->has_ip())
     {
-        print_label(a, "ip_len");
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.ip_api.pay_len());
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.ip_api.pay_len());
         return true;
     }
     return false;
@@ -316,8 +534,8 @@ static bool ff_ip_len(Args& a)
 
 static bool ff_msg(Args& a)
 {
-    print_label(a, "msg");
-    TextLog_Puts(json_log, a.msg);
+    print_label(a);
+    json_out->put(a.msg);
     return true;
 }
 
@@ -334,72 +552,77 @@ static bool ff_mpls(Args& a)
     else
         return false;
 
-    print_label(a, "mpls");
-    TextLog_Print(json_log, "%u", ntohl(mpls));
+    print_label(a);
+    json_out->put_uint(ntohl(mpls));
     return true;
 }
 
 static bool ff_pkt_gen(Args& a)
 {
-    print_label(a, "pkt_gen");
-    TextLog_Quote(json_log, a.pkt->get_pseudo_type());
+    print_label(a);
+    json_out->put_quoted(a.pkt->get_pseudo_type());
     return true;
 }
 
 static bool ff_pkt_len(Args& a)
 {
-    print_label(a, "pkt_len");
+    print_label(a);
 
     if (a.pkt->has_ip())
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.ip_api.dgram_len());
+        json_out->put_uint(a.pkt->ptrs.ip_api.dgram_len());
     else
-        TextLog_Print(json_log, "%u", a.pkt->dsize);
+        json_out->put_uint(a.pkt->dsize);
 
     return true;
 }
 
 static bool ff_pkt_num(Args& a)
 {
-    print_label(a, "pkt_num");
-    TextLog_Print(json_log, STDu64, a.pkt->context->packet_number);
+    print_label(a);
+    json_out->put_uint(a.pkt->context->packet_number);
     return true;
 }
 
 static bool ff_priority(Args& a)
 {
-    print_label(a, "priority");
-    TextLog_Print(json_log, "%u", a.event.sig_info->priority);
+    print_label(a);
+    json_out->put_uint(a.event.sig_info->priority);
     return true;
 }
 
 static bool ff_proto(Args& a)
 {
-    print_label(a, "proto");
-    TextLog_Quote(json_log, a.pkt->get_type());
+    print_label(a);
+    json_out->put_quoted(a.pkt->get_type());
     return true;
 }
 
 static bool ff_rev(Args& a)
 {
-    print_label(a, "rev");
-    TextLog_Print(json_log, "%u",  a.event.sig_info->rev);
+    print_label(a);
+    json_out->put_uint(a.event.sig_info->rev);
     return true;
 }
 
 static bool ff_rule(Args& a)
 {
-    print_label(a, "rule");
+    print_label(a);
 
-    TextLog_Print(json_log, "\"%u:%u:%u\"",
-        a.event.sig_info->gid, a.event.sig_info->sid, a.event.sig_info->rev);
+    json_out->put_char('"');
+    json_out->put_uint(a.event.sig_info->gid);
+    json_out->put_char(':');
+    json_out->put_uint(a.event.sig_info->sid);
+    json_out->put_char(':');
+    json_out->put_uint(a.event.sig_info->rev);
+    json_out->put_char('"');
 
     return true;
 }
 
 static bool ff_seconds(Args& a)
 {
-    print_label(a, "seconds");
-    TextLog_Print(json_log, "%u",  a.pkt->pkth->ts.tv_sec);
+    print_label(a);
+    json_out->put_uint((uint32_t)a.pkt->pkth->ts.tv_sec);
     return true;
 }
 
@@ -410,15 +633,15 @@ static bool ff_service(Args& a)
     if ( a.pkt->flow and a.pkt->flow->service )
         svc = a.pkt->flow->service;
 
-    print_label(a, "service");
-    TextLog_Quote(json_log, svc);
+    print_label(a);
+    json_out->put_quoted(svc);
     return true;
 }
 
 static bool ff_sid(Args& a)
 {
-    print_label(a, "sid");
-    TextLog_Print(json_log, "%u",  a.event.sig_info->sid);
+    print_label(a);
+    json_out->put_uint(a.event.sig_info->sid);
     return true;
 }
 
@@ -427,8 +650,8 @@ static bool ff_src_addr(Args& a)
     if ( a.pkt->has_ip() or a.pkt->is_data() )
     {
         SfIpString ip_str;
-        print_label(a, "src_addr");
-        TextLog_Quote(json_log, a.pkt->ptrs.ip_api.get_src()->ntop(ip_str));
+        print_label(a);
+        json_out->put_quoted(a.pkt->ptrs.ip_api.get_src()->ntop(ip_str));
         return true;
     }
     return false;
@@ -445,8 +668,8 @@ static bool ff_src_ap(Args& a)
     if ( a.pkt->proto_bits & (PROTO_BIT__TCP|PROTO_BIT__UDP) )
         port = a.pkt->ptrs.sp;
 
-    print_label(a, "src_ap");
-    TextLog_Print(json_log, "\"%s:%u\"", addr, port);
+    print_label(a);
+    print_ap(addr, port);
     return true;
 }
 
@@ -454,8 +677,8 @@ static bool ff_src_port(Args& a)
 {
     if ( a.pkt->proto_bits & (PROTO_BIT__TCP|PROTO_BIT__UDP) )
     {
-        print_label(a, "src_port");
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.sp);
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.sp);
         return true;
     }
     return false;
@@ -474,8 +697,8 @@ static bool ff_target(Args& a)
     else
         return false;
 
-    print_label(a, "target");
-    TextLog_Quote(json_log, addr);
+    print_label(a);
+    json_out->put_quoted(addr);
     return true;
 }
 
@@ -483,8 +706,8 @@ static bool ff_tcp_ack(Args& a)
 {
     if (a.pkt->ptrs.tcph )
     {
-        print_label(a, "tcp_ack");
-        TextLog_Print(json_log, "%u", ntohl(a.pkt->ptrs.tcph->th_ack));
+        print_label(a);
+        json_out->put_uint(ntohl(a.pkt->ptrs.tcph->th_ack));
         return true;
     }
     return false;
@@ -497,8 +720,8 @@ static bool ff_tcp_flags(Args& a)
         char tcpFlags[9];
         CreateTCPFlagString(a.pkt->ptrs.tcph, tcpFlags);
 
-        print_label(a, "tcp_flags");
-        TextLog_Quote(json_log, tcpFlags);
+        print_label(a);
+        json_out->put_quoted(tcpFlags);
         return true;
     }
     return false;
@@ -508,8 +731,8 @@ static bool ff_tcp_len(Args& a)
 {
     if (a.pkt->ptrs.tcph )
     {
-        print_label(a, "tcp_len");
-        TextLog_Print(json_log, "%u", (a.pkt->ptrs.tcph->off()));
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.tcph->off());
         return true;
     }
     return false;
@@ -519,8 +742,8 @@ static bool ff_tcp_seq(Args& a)
 {
     if (a.pkt->ptrs.tcph )
     {
-        print_label(a, "tcp_seq");
-        TextLog_Print(json_log, "%u", ntohl(a.pkt->ptrs.tcph->th_seq));
+        print_label(a);
+        json_out->put_uint(ntohl(a.pkt->ptrs.tcph->th_seq));
         return true;
     }
     return false;
@@ -530,8 +753,8 @@ static bool ff_tcp_win(Args& a)
 {
     if (a.pkt->ptrs.tcph )
     {
-        print_label(a, "tcp_win");
-        TextLog_Print(json_log, "%u", ntohs(a.pkt->ptrs.tcph->th_win));
+        print_label(a);
+        json_out->put_uint(ntohs(a.pkt->ptrs.tcph->th_win));
         return true;
     }
     return false;
@@ -539,10 +762,10 @@ static bool ff_tcp_win(Args& a)
 
 static bool ff_timestamp(Args& a)
 {
-    print_label(a, "timestamp");
-    TextLog_Putc(json_log, '"');
-    LogTimeStamp(json_log, a.pkt);
-    TextLog_Putc(json_log, '"');
+    print_label(a);
+    json_out->put_char('"');
+    json_out->put_timestamp(a.pkt->pkth->ts);
+    json_out->put_char('"');
     return true;
 }
 
@@ -550,8 +773,8 @@ static bool ff_tos(Args& a)
 {
     if (a.pkt->has_ip())
     {
-        print_label(a, "tos");
-        TextLog_Print(json_log, "%u", a.pkt->ptrs.ip_api.tos());
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.ip_api.tos());
         return true;
     }
     return false;
@@ -561,8 +784,8 @@ static bool ff_ttl(Args& a)
 {
     if (a.pkt->has_ip())
     {
-        print_label(a, "ttl");
-        TextLog_Print(json_log, "%u",a.pkt->ptrs.ip_api.ttl());
+        print_label(a);
+        json_out->put_uint(a.pkt->ptrs.ip_api.ttl());
         return true;
     }
     return false;
@@ -572,8 +795,8 @@ static bool ff_udp_len(Args& a)
 {
     if (a.pkt->ptrs.udph )
     {
-        print_label(a, "udp_len");
-        TextLog_Print(json_log, "%u", ntohs(a.pkt->ptrs.udph->uh_len));
+        print_label(a);
+        json_out->put_uint(ntohs(a.pkt->ptrs.udph->uh_len));
         return true;
     }
     return false;
@@ -592,8 +815,8 @@ static bool ff_vlan(Args& a)
     else
         return false;
 
-    print_label(a, "vlan");
-    TextLog_Print(json_log, "%hu", vid);
+    print_label(a);
+    json_out->put_uint(vid);
     return true;
 }
 
@@ -601,8 +824,6 @@ static bool ff_vlan(Args& a)
 // module stuff
 //-------------------------------------------------------------------------
 
-typedef bool (*JsonFunc)(Args&);
-
 static const JsonFunc json_func[] =
 {
     ff_action, ff_class, ff_b64_data, ff_dir, ff_dst_addr, ff_dst_ap,
@@ -661,9 +882,21 @@ public:
     bool file;
     size_t limit;
     string sep;
-    vector<JsonFunc> fields;
+    vector<JsonField> fields;
+
+private:
+    void add_field(const string&);
 };
 
+void JsonModule::add_field(const string& name)
+{
+    // the separator is added by the logger for all but the first field
+    JsonField f;
+    f.func = json_func[Parameter::index(json_range, name.c_str())];
+    f.key = " \"" + name + "\" : ";
+    fields.emplace_back(std::move(f));
+}
+
 bool JsonModule::set(const char*, Value& v, SnortConfig*)
 {
     if ( v.is("file") )
@@ -676,7 +909,7 @@ bool JsonModule::set(const char*, Value& v, SnortConfig*)
         fields.clear();
 
         while ( v.get_next_token(tok) )
-            fields.emplace_back(json_func[Parameter::index(json_range, tok.c_str())]);
+            add_field(tok);
     }
 
     else if ( v.is("limit") )
@@ -704,7 +937,7 @@ bool JsonModule::begin(const char*, int, SnortConfig*)
         v.set_first_token();
 
         while ( v.get_next_token(tok) )
-            fields.emplace_back(json_func[Parameter::index(json_range, tok.c_str())]);
+            add_field(tok);
     }
     return true;
 }
@@ -723,10 +956,16 @@ public:
 
     void alert(Packet*, const char* msg, const Event&) override;
 
+    bool can_run_async() const override
+    { return true; }
+
+    // the event as alert() writes it, left in json_out
+    void format(Packet*, const char* msg, const Event&);
+
 public:
     string file;
     unsigned long limit;
-    vector<JsonFunc> fields;
+    vector<JsonField> fields;
     string sep;
 };
 
@@ -736,32 +975,44 @@ JsonLogger::JsonLogger(JsonModule* m)
     limit = m->limit;
     sep = m->sep;
     fields = std::move(m->fields);
+
+    for ( unsigned i = 1; i < fields.size(); ++i )
+        fields[i].key.insert(0, ",");
 }
 
 void JsonLogger::open()
 {
     json_log = TextLog_Init(file.c_str(), LOG_BUFFER, limit);
+    json_out = new JsonBuffer(json_log);
 }
 
 void JsonLogger::close()
 {
+    delete json_out;
+    json_out = nullptr;
+
     if ( json_log )
         TextLog_Term(json_log);
 }
 
-void JsonLogger::alert(Packet* p, const char* msg, const Event& event)
+void JsonLogger::format(Packet* p, const char* msg, const Event& event)
 {
-    Args a = { p, msg, event, false };
-    TextLog_Putc(json_log, '{');
+    Args a = { p, msg, event, nullptr };
+    json_out->put_char('{');
 
-    for ( JsonFunc f : fields )
+    for ( const JsonField& f : fields )
     {
-        f(a);
-        a.comma = true;
+        a.field = &f;
+        f.func(a);
     }
 
-    TextLog_Print(json_log, " }\n");
-    TextLog_Flush(json_log);
+    json_out->put(" }\n", 3);
+}
+
+void JsonLogger::alert(Packet* p, const char* msg, const Event& event)
+{
+    format(p, msg, event);
+    json_out->flush();
 }
 
 //-------------------------------------------------------------------------
@@ -809,3 +1060,311 @@ const BaseApi* alert_json[] =
     nullptr
 };
 
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+
+#include "protocols/layer.h"
+
+static string test_str(const JsonBuffer& out)
+{ return string(out.data(), out.size()); }
+
+// an ethernet, IPv4 and TCP frame from the client with a short payload
+static const uint8_t test_frame[] =
+{
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0x08, 0x00,
+
+    0x45, 0x10, 0x00, 0x30, 0x12, 0x34, 0x40, 0x00, 0x40, 0x06, 0x00, 0x00,
+    192, 168, 1, 100, 10, 1, 2, 3,
+
+    0xC8, 0x22, 0x01, 0xBB, 0x01, 0x02, 0x03, 0x04, 0x0A, 0x0B, 0x0C, 0x0D,
+    0x50, 0x18, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00,
+
+    'G', 'E', 'T', ' ', '"', '/', '"', '\n'
+};
+
+static void test_packet(Packet& p, DAQ_PktHdr_t& pkth)
+{
+    pkth.ts = { 1546300800, 5123 };
+    pkth.caplen = pkth.pktlen = sizeof(test_frame);
+
+    p.pkth = &pkth;
+    p.pkt = test_frame;
+    p.active = p.active_inst;
+
+    p.num_layers = 3;
+    p.layers[0] = { test_frame, ProtocolId::ETHERNET_802_3, 14 };
+    p.layers[1] = { test_frame + 14, ProtocolId::ETHERTYPE_IPV4, 20 };
+    p.layers[2] = { test_frame + 34, ProtocolId::TCP, 20 };
+
+    p.ptrs.ip_api.set((const ip::IP4Hdr*)(test_frame + 14));
+    p.ptrs.tcph = (const tcp::TCPHdr*)(test_frame + 34);
+    p.ptrs.sp = 51234;
+    p.ptrs.dp = 443;
+    p.ptrs.set_pkt_type(PktType::TCP);
+
+    p.proto_bits = PROTO_BIT__ETH | PROTO_BIT__IP | PROTO_BIT__TCP;
+    p.packet_flags = PKT_FROM_CLIENT;
+    p.data = test_frame + 54;
+    p.dsize = 8;
+}
+
+TEST_CASE("json numbers", "[alert_json]")
+{
+    JsonBuffer* out = new JsonBuffer(nullptr);
+    char ref[32];
+
+    const uint64_t nums[] =
+    { 0, 7, 9, 10, 42, 99, 100, 101, 999, 1000, 65535, 99999, 100000, 4294967295,
+      4294967296, 18446744073709551615ull };
+
+    for ( auto u : nums )
+    {
+        out->clear();
+        out->put_uint(u);
+        snprintf(ref, sizeof(ref), STDu64, u);
+        CHECK(test_str(*out) == ref);
+    }
+
+    const uint32_t hexes[] = { 0, 0x5, 0xA, 0x3F, 0xFF, 0x800, 0x86DD, 0xFFFFFFFF };
+
+    for ( auto u : hexes )
+    {
+        out->clear();
+        out->put_hex(u, 1);
+        snprintf(ref, sizeof(ref), "%X", u);
+        CHECK(test_str(*out) == ref);
+
+        out->clear();
+        out->put_hex(u, 2);
+        snprintf(ref, sizeof(ref), "%02X", u);
+        CHECK(test_str(*out) == ref);
+    }
+    delete out;
+}
+
+TEST_CASE("json quoting", "[alert_json]")
+{
+    JsonBuffer* out = new JsonBuffer(nullptr);
+
+    const char* strs[] = { "", "abc", "\"", "\\", "a\"b\\c\"", "\\\\\"\"", "tab\tok" };
+
+    for ( auto s : strs )
+    {
+        // what TextLog_Quote() does
+        string ref = "\"";
+
+        for ( const char* p = s; *p; ++p )
+        {
+            if ( *p == '"' or *p == '\\' )
+                ref += '\\';
+            ref += *p;
+        }
+        ref += '"';
+
+        out->clear();
+        out->put_quoted(s);
+        CHECK(test_str(*out) == ref);
+    }
+    delete out;
+}
+
+TEST_CASE("json timestamp", "[alert_json]")
+{
+    JsonBuffer* out = new JsonBuffer(nullptr);
+
+    const struct timeval tvs[] =
+    { { 1546300800, 0 }, { 1546300800, 5 }, { 1546300800, 999999 }, { 1546300801, 120 },
+      { 1546300801, 12345 }, { 0, 1 } };
+
+    for ( auto& tv : tvs )
+    {
+        char ref[TIMEBUF_SIZE];
+        ts_print(&tv, ref);
+
+        out->clear();
+        out->put_timestamp(tv);
+        CHECK(test_str(*out) == ref);
+    }
+    delete out;
+}
+
+TEST_CASE("json event", "[alert_json]")
+{
+    // all but the timestamp, which depends on the time zone and year options
+    const char* fields =
+        "proto pkt_gen pkt_len dir src_ap dst_ap rule action msg class priority seconds "
+        "service src_addr dst_addr src_port dst_port gid sid rev eth_src eth_dst eth_type "
+        "eth_len ip_id ip_len ttl tos tcp_flags tcp_seq tcp_ack tcp_win tcp_len b64_data";
+
+    // written by the printf version of this logger for the same packet and event
+    const char* expected =
+        "{ \"proto\" : \"TCP\", \"pkt_gen\" : \"raw\", \"pkt_len\" : 48, \"dir\" : \"C2S\", "
+        "\"src_ap\" : \"192.168.1.100:51234\", \"dst_ap\" : \"10.1.2.3:443\", "
+        "\"rule\" : \"1:2019401:3\", \"action\" : \"allow\", \"msg\" : \"test \\\"event\\\"\", "
+        "\"class\" : \"none\", \"priority\" : 2, \"seconds\" : 1546300800, "
+        "\"service\" : \"unknown\", \"src_addr\" : \"192.168.1.100\", "
+        "\"dst_addr\" : \"10.1.2.3\", \"src_port\" : 51234, \"dst_port\" : 443, \"gid\" : 1, "
+        "\"sid\" : 2019401, \"rev\" : 3, \"eth_src\" : \"66:77:88:99:AA:BB\", "
+        "\"eth_dst\" : \"00:11:22:33:44:55\", \"eth_type\" : \"0x800\", \"eth_len\" : 62, "
+        "\"ip_id\" : 4660, \"ip_len\" : 28, \"ttl\" : 64, \"tos\" : 16, "
+        "\"tcp_flags\" : \"***AP***\", \"tcp_seq\" : 16909060, \"tcp_ack\" : 168496141, "
+        "\"tcp_win\" : 65535, \"tcp_len\" : 20, \"b64_data\" : \"R0VUICIvIgo=\" }\n";
+
+    JsonModule mod;
+    mod.begin(nullptr, 0, nullptr);
+
+    Value v(fields);
+    v.set(&s_params[1]);
+    CHECK(mod.set(nullptr, v, nullptr));
+
+    JsonLogger logger(&mod);
+
+    Packet p(false);
+    DAQ_PktHdr_t pkth { };
+    test_packet(p, pkth);
+
+    SigInfo si;
+    si.gid = 1;
+    si.sid = 2019401;
+    si.rev = 3;
+    si.priority = 2;
+    Event event(si);
+
+    json_out = new JsonBuffer(nullptr);
+    logger.format(&p, "\"test \\\"event\\\"\"", event);
+    CHECK(test_str(*json_out) == expected);
+
+    // a field that isn't there adds nothing
+    const char* icmp = "proto icmp_type icmp_code";
+    Value w(icmp);
+    w.set(&s_params[1]);
+    CHECK(mod.set(nullptr, w, nullptr));
+
+    JsonLogger icmp_logger(&mod);
+    json_out->clear();
+    icmp_logger.format(&p, "", event);
+    CHECK(test_str(*json_out) == "{ \"proto\" : \"TCP\" }\n");
+
+    delete json_out;
+    json_out = nullptr;
+}
+#endif
+
+#ifdef BENCHMARK_TEST
+#include <chrono>
+
+#include "catch/snort_catch.h"
+
+// the field values of a typical event with the default fields
+struct TestEvent
+{
+    struct timeval ts;
+    uint64_t pkt_num;
+    const char* proto;
+    const char* pkt_gen;
+    unsigned pkt_len;
+    const char* dir;
+    const char* src;
+    unsigned sp;
+    const char* dst;
+    unsigned dp;
+    uint32_t gid, sid, rev;
+    const char* action;
+};
+
+static const TestEvent test_event =
+{
+    { 1546300800, 123456 }, 987654321, "TCP", "raw", 1500, "C2S",
+    "192.168.1.100", 51234, "10.1.2.3", 443, 1, 2019401, 3, "allow"
+};
+
+// the way TextLog_Print() and TextLog_Quote() formatted it
+static unsigned old_format(const TestEvent& e, char* buf, unsigned len)
+{
+    char ts[TIMEBUF_SIZE];
+    ts_print(&e.ts, ts);
+
+    return snprintf(buf, len,
+        "{ \"timestamp\" : \"%s\", \"pkt_num\" : " STDu64 ", \"proto\" : \"%s\", "
+        "\"pkt_gen\" : \"%s\", \"pkt_len\" : %u, \"dir\" : \"%s\", "
+        "\"src_ap\" : \"%s:%u\", \"dst_ap\" : \"%s:%u\", \"rule\" : \"%u:%u:%u\", "
+        "\"action\" : \"%s\" }\n",
+        ts, e.pkt_num, e.proto, e.pkt_gen, e.pkt_len, e.dir, e.src, e.sp, e.dst, e.dp,
+        e.gid, e.sid, e.rev, e.action);
+}
+
+static void new_format(const TestEvent& e, JsonBuffer& out)
+{
+    out.put("{ \"timestamp\" : \"");
+    out.put_timestamp(e.ts);
+    out.put("\", \"pkt_num\" : ");
+    out.put_uint(e.pkt_num);
+    out.put(", \"proto\" : ");
+    out.put_quoted(e.proto);
+    out.put(", \"pkt_gen\" : ");
+    out.put_quoted(e.pkt_gen);
+    out.put(", \"pkt_len\" : ");
+    out.put_uint(e.pkt_len);
+    out.put(", \"dir\" : ");
+    out.put_quoted(e.dir);
+    out.put(", \"src_ap\" : \"");
+    out.put(e.src);
+    out.put_char(':');
+    out.put_uint(e.sp);
+    out.put("\", \"dst_ap\" : \"");
+    out.put(e.dst);
+    out.put_char(':');
+    out.put_uint(e.dp);
+    out.put("\", \"rule\" : \"");
+    out.put_uint(e.gid);
+    out.put_char(':');
+    out.put_uint(e.sid);
+    out.put_char(':');
+    out.put_uint(e.rev);
+    out.put("\", \"action\" : ");
+    out.put_quoted(e.action);
+    out.put(" }\n", 3);
+}
+
+// events formatted per second with printf and with the json buffer
+TEST_CASE("json event rate", "[alert_json]")
+{
+    const unsigned num_events = 1000000;
+    JsonBuffer* out = new JsonBuffer(nullptr);
+    TestEvent e = test_event;
+    char buf[512];
+    unsigned bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < num_events; ++i )
+    {
+        e.ts.tv_usec = i % 1000000;
+        e.pkt_num = i;
+        bytes += old_format(e, buf, sizeof(buf));
+    }
+    std::chrono::duration<double> old_secs = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < num_events; ++i )
+    {
+        e.ts.tv_usec = i % 1000000;
+        e.pkt_num = i;
+        out->clear();
+        new_format(e, *out);
+        bytes -= out->size();
+    }
+    std::chrono::duration<double> new_secs = std::chrono::steady_clock::now() - start;
+
+    printf("printf %.0f events/sec, json buffer %.0f events/sec\n",
+        num_events / old_secs.count(), num_events / new_secs.count());
+
+    CHECK(bytes == 0);
+    delete out;
+}
+#endif
@@ -27,6 +27,7 @@
 #include "framework/logger.h"
 #include "framework/module.h"
 #include "log/messages.h"
+#include "log/pcap_writer.h"
 #include "main/snort_config.h"
 #include "protocols/packet.h"
 #include "packet_io/sfdaq.h"
@@ -50,12 +51,16 @@ struct LtdConfig
 {
     string file;
     size_t limit;
+    uint32_t interval;
+    uint32_t snaplen;
+    bool mmap;
 };
 
 struct LtdContext
 {
     char* file;
     pcap_dumper_t* dumpd;
+    PcapWriter* writer;
     time_t lastTime;
     size_t size;
     int log_cnt;
@@ -77,6 +82,15 @@ static const Parameter s_params[] =
     { "limit", Parameter::PT_INT, "0:maxSZ", "0",
       "set maximum size in MB before rollover (0 is unlimited)" },
 
+    { "interval", Parameter::PT_INT, "0:max32", "0",
+      "set maximum seconds before rollover (0 is unlimited)" },
+
+    { "mmap", Parameter::PT_BOOL, nullptr, "false",
+      "write through memory mapped windows of the file instead of libpcap" },
+
+    { "snaplen", Parameter::PT_INT, "0:65535", "0",
+      "truncate logged packets to this many bytes (0 logs whole packets)" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -96,6 +110,9 @@ public:
 
 public:
     size_t limit;
+    uint32_t interval;
+    uint32_t snaplen;
+    bool mmap;
 };
 
 bool TcpdumpModule::set(const char*, Value& v, SnortConfig*)
@@ -103,6 +120,15 @@ bool TcpdumpModule::set(const char*, Value& v, SnortConfig*)
     if ( v.is("limit") )
         limit = v.get_size() * 1024 * 1024;
 
+    else if ( v.is("interval") )
+        interval = v.get_uint32();
+
+    else if ( v.is("mmap") )
+        mmap = v.get_bool();
+
+    else if ( v.is("snaplen") )
+        snaplen = v.get_uint32();
+
     else
         return false;
 
@@ -112,6 +138,9 @@ bool TcpdumpModule::set(const char*, Value& v, SnortConfig*)
 bool TcpdumpModule::begin(const char*, int, SnortConfig*)
 {
     limit = 0;
+    interval = 0;
+    snaplen = 0;
+    mmap = false;
     return true;
 }
 
@@ -119,22 +148,37 @@ bool TcpdumpModule::begin(const char*, int, SnortConfig*)
 // api stuff
 //-------------------------------------------------------------------------
 
-static inline size_t SizeOf(const DAQ_PktHdr_t* pkth)
+static inline uint32_t CapLen(LtdConfig* data, const DAQ_PktHdr_t* pkth)
 {
-    return PCAP_PKT_HDR_SZ + pkth->caplen;
+    if ( data->snaplen && pkth->caplen > data->snaplen )
+        return data->snaplen;
+
+    return pkth->caplen;
 }
 
 static void LogTcpdumpSingle(
     LtdConfig* data, Packet* p, const char*, Event*)
 {
-    size_t dumpSize = SizeOf(p->pkth);
+    uint32_t caplen = CapLen(data, p->pkth);
+    size_t dumpSize = PCAP_PKT_HDR_SZ + caplen;
 
     if ( data->limit && (context.size + dumpSize > data->limit) )
         TcpdumpRollLogFile(data);
 
+    else if ( data->interval && (time(nullptr) - context.lastTime >= data->interval) )
+        TcpdumpRollLogFile(data);
+
+    if ( context.writer )
+    {
+        // mapped pages are visible to readers without a flush
+        context.writer->write(p->pkth->ts, caplen, p->pkth->pktlen, p->pkt);
+        context.size += dumpSize;
+        return;
+    }
+
     struct pcap_pkthdr pcaphdr;
     pcaphdr.ts = p->pkth->ts;
-    pcaphdr.caplen = p->pkth->caplen;
+    pcaphdr.caplen = caplen;
     pcaphdr.len = p->pkth->pktlen;
     pcap_dump((uint8_t*)context.dumpd, &pcaphdr, p->pkt);
     context.size += dumpSize;
@@ -152,7 +196,7 @@ static void LogTcpdumpStream(
 // (take original packet headers and append reassembled data)
 }
 
-static void TcpdumpInitLogFile(LtdConfig*, bool no_timestamp)
+static void TcpdumpInitLogFile(LtdConfig* data, bool no_timestamp)
 {
     string file;
     string filename = F_NAME;
@@ -176,8 +220,25 @@ static void TcpdumpInitLogFile(LtdConfig*, bool no_timestamp)
     if ( dlt == DLT_IPV4 || dlt == DLT_IPV6 )
         dlt = DLT_RAW;
 
+    uint32_t snaplen = SFDAQ::get_snap_len();
+
+    if ( data->snaplen && data->snaplen < snaplen )
+        snaplen = data->snaplen;
+
+    if ( data->mmap )
+    {
+        context.writer = new PcapWriter(dlt, snaplen);
+
+        if ( !context.writer->open(file.c_str()) )
+            FatalError("%s: can't open %s\n", S_NAME, file.c_str());
+
+        context.file = snort_strdup(file.c_str());
+        context.size = PCAP_FILE_HDR_SZ;
+        return;
+    }
+
     pcap_t* pcap;
-    pcap = pcap_open_dead(dlt, SFDAQ::get_snap_len());
+    pcap = pcap_open_dead(dlt, snaplen);
 
     if ( !pcap )
         FatalError("%s: can't get pcap context\n", S_NAME);
@@ -206,10 +267,14 @@ static void TcpdumpRollLogFile(LtdConfig* data)
         return;
 
     /* close the output file */
-    if ( context.dumpd != nullptr )
+    if ( context.dumpd != nullptr or context.writer != nullptr )
     {
-        pcap_dump_close(context.dumpd);
+        if ( context.dumpd )
+            pcap_dump_close(context.dumpd);
+
+        delete context.writer;
         context.dumpd = nullptr;
+        context.writer = nullptr;
         context.size = 0;
         snort_free(context.file);
         context.file = nullptr;
@@ -262,6 +327,9 @@ PcapLogger::PcapLogger(TcpdumpModule* m)
 {
     config = new LtdConfig;
     config->limit = m->limit;
+    config->interval = m->interval;
+    config->snaplen = m->snaplen;
+    config->mmap = m->mmap;
 }
 
 PcapLogger::~PcapLogger()
@@ -283,13 +351,16 @@ void PcapLogger::close()
         pcap_dump_close(context.dumpd);
         context.dumpd = nullptr;
     }
+    delete context.writer;
+    context.writer = nullptr;
+
     if ( context.file )
         snort_free(context.file);
 }
 
 void PcapLogger::log(Packet* p, const char* msg, Event* event)
 {
-    if(!context.dumpd)
+    if(!context.dumpd and !context.writer)
         open();
 
     context.log_cnt++;
@@ -301,7 +372,7 @@ void PcapLogger::log(Packet* p, const char* msg, Event* event)
 
 void PcapLogger::reset()
 {
-    if(!context.dumpd)
+    if(!context.dumpd and !context.writer)
         open();
     else
         TcpdumpRollLogFile(config);
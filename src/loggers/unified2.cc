@@ -65,6 +65,8 @@ struct Unified2Config
     size_t limit;
     int nostamp;
     bool legacy_events;
+    uint32_t batch_size;
+    uint32_t flush_interval;
 };
 
 struct U2
@@ -74,6 +76,11 @@ struct U2
     int base_proto;
     uint32_t timestamp;
     char filepath[STD_BUF];
+
+    // whole records waiting to be written when batching
+    uint8_t* batch;
+    uint32_t batch_len;
+    time_t last_flush;
 };
 
 /* -------------------- Global Variables ----------------------*/
@@ -94,7 +101,8 @@ static THREAD_LOCAL uint8_t* write_pkt_buffer = nullptr;
 /* This buffer is used in lieu of the underlying default stream buf to
  * prevent flushing in the middle of a record.  Every write is force
  * flushed to disk immediately after the entire record is written so
- * spoolers get an entire record */
+ * spoolers get an entire record.  When batching, the batch holds only
+ * whole records and is written unbuffered instead. */
 
 /* use the size of the buffer we copy record data into */
 static THREAD_LOCAL char* io_buffer = nullptr;
@@ -102,6 +110,7 @@ static THREAD_LOCAL char* io_buffer = nullptr;
 /* -------------------- Local Functions -----------------------*/
 
 static void Unified2Write(uint8_t*, uint32_t, Unified2Config*);
+static void Unified2WriteFile(uint8_t*, uint32_t, Unified2Config*);
 
 static void Unified2InitFile(Unified2Config* config)
 {
@@ -132,22 +141,97 @@ static void Unified2InitFile(Unified2Config* config)
         FatalError("unified2 could not open %s: %s\n", fname_ptr, get_error(errno));
     }
 
-    /* Set buffer to size of record buffer so the system doesn't flush
-     * part of a record if it's greater than BUFSIZ */
-    if (setvbuf(u2.stream, io_buffer, _IOFBF, u2_buf_sz) != 0)
+    /* Batches are already whole records so each is written directly with
+     * one write.  Otherwise set buffer to size of record buffer so the
+     * system doesn't flush part of a record if it's greater than BUFSIZ */
+    if ( config->batch_size )
+        setvbuf(u2.stream, nullptr, _IONBF, 0);
+
+    else if (setvbuf(u2.stream, io_buffer, _IOFBF, u2_buf_sz) != 0)
     {
         ErrorMessage("unified2 could not set I/O buffer: %s. "
             "Using system default.\n", get_error(errno));
     }
 }
 
-static inline void Unified2RotateFile(Unified2Config* config)
+static inline void Unified2ReopenFile(Unified2Config* config)
 {
     fclose(u2.stream);
     u2.current = 0;
     Unified2InitFile(config);
 }
 
+/* Batched records are written before closing so a record never spans two
+ * files and every closed file is complete. */
+static void Unified2Flush(Unified2Config* config)
+{
+    u2.last_flush = time(nullptr);
+
+    if ( !u2.batch_len )
+        return;
+
+    uint32_t len = u2.batch_len;
+    u2.batch_len = 0;
+
+    Unified2WriteFile(u2.batch, len, config);
+}
+
+/* The interval is checked on each write and after each packet so records
+ * held in a partial batch are written even if no further alert arrives. */
+static void Unified2CheckFlush(Unified2Config* config)
+{
+    if ( config->flush_interval && u2.batch_len &&
+        (time(nullptr) - u2.last_flush) >= (time_t)config->flush_interval )
+        Unified2Flush(config);
+}
+
+static inline void Unified2RotateFile(Unified2Config* config)
+{
+    Unified2Flush(config);
+    Unified2ReopenFile(config);
+}
+
+/* u2.current is what has been written to the current file; the limit also
+ * counts batched records since they will be written there */
+static inline void Unified2CheckLimit(Unified2Config* config, uint32_t write_len)
+{
+    if ( config->limit && (u2.current + u2.batch_len + write_len) > config->limit )
+        Unified2RotateFile(config);
+}
+
+static void Unified2Open(Unified2Config* config)
+{
+    write_pkt_buffer = new uint8_t[u2_buf_sz];
+    io_buffer = new char[u2_buf_sz];
+
+    if ( config->batch_size )
+        u2.batch = new uint8_t[config->batch_size];
+
+    u2.batch_len = 0;
+    u2.current = 0;
+
+    Unified2InitFile(config);
+    u2.last_flush = time(nullptr);
+}
+
+static void Unified2Close(Unified2Config* config)
+{
+    if ( u2.stream )
+    {
+        Unified2Flush(config);
+        fclose(u2.stream);
+        u2.stream = nullptr;
+    }
+
+    delete[] write_pkt_buffer;
+    delete[] io_buffer;
+    delete[] u2.batch;
+
+    write_pkt_buffer = nullptr;
+    io_buffer = nullptr;
+    u2.batch = nullptr;
+}
+
 static inline unsigned get_version(const SfIp& addr)
 {
     uint16_t family = addr.get_family();
@@ -229,8 +313,7 @@ static void alert_event(Packet* p, const char*, Unified2Config* config, const Ev
     Serial_Unified2_Header hdr;
     uint32_t write_len = sizeof(hdr) + sizeof(u2_event);
 
-    if ( config->limit && (u2.current + write_len) > config->limit )
-        Unified2RotateFile(config);
+    Unified2CheckLimit(config, write_len);
 
     hdr.length = htonl(sizeof(Unified2Event));
     hdr.type = htonl(UNIFIED2_EVENT3);
@@ -275,8 +358,7 @@ static void _WriteExtraData(Unified2Config* config,
     if (write_len > sizeof(write_buffer))
         return;
 
-    if ( config->limit && (u2.current + write_len) > config->limit )
-        Unified2RotateFile(config);
+    Unified2CheckLimit(config, write_len);
 
     hdr.length = htonl(write_len - sizeof(hdr));
     hdr.type = htonl(UNIFIED2_EXTRA_DATA);
@@ -370,8 +452,7 @@ static void _Unified2LogPacketAlert(
         logheader.packet_length = 0;
     }
 
-    if ( config->limit && (u2.current + write_len) > config->limit )
-        Unified2RotateFile(config);
+    Unified2CheckLimit(config, write_len);
 
     hdr.length = htonl(sizeof(Serial_Unified2Packet) - 4 + pkt_length + u2h_len);
     hdr.type = htonl(u2_type);
@@ -444,7 +525,7 @@ static void _Unified2LogPacketAlert(
  * Returns: None
  *
  ******************************************************************************/
-static void Unified2Write(uint8_t* buf, uint32_t buf_len, Unified2Config* config)
+static void Unified2WriteFile(uint8_t* buf, uint32_t buf_len, Unified2Config* config)
 {
     size_t fwcount = 0;
     int ffstatus = 0;
@@ -518,7 +599,7 @@ static void Unified2Write(uint8_t* buf, uint32_t buf_len, Unified2Config* config
                 ErrorMessage("unified2 file is possibly corrupt. "
                     "Closing this unified2 file and creating a new one.\n");
 
-                Unified2RotateFile(config);
+                Unified2ReopenFile(config);
 
                 if (config->nostamp)
                 {
@@ -578,6 +659,38 @@ static void Unified2Write(uint8_t* buf, uint32_t buf_len, Unified2Config* config
     u2.current += buf_len;
 }
 
+/* With batching, whole records are copied into the batch which is written
+ * when full, when the flush interval has passed since the oldest record was
+ * held, on rotation, when the packet thread is idle, and on close. */
+static void Unified2Write(uint8_t* buf, uint32_t buf_len, Unified2Config* config)
+{
+    if ( !config->batch_size )
+    {
+        Unified2WriteFile(buf, buf_len, config);
+        return;
+    }
+
+    if ( (buf == nullptr) || (u2.stream == nullptr) )
+        return;
+
+    if ( u2.batch_len + buf_len > config->batch_size )
+        Unified2Flush(config);
+
+    if ( buf_len > config->batch_size )
+        Unified2WriteFile(buf, buf_len, config);
+
+    else
+    {
+        if ( !u2.batch_len )
+            u2.last_flush = time(nullptr);
+
+        memcpy(u2.batch + u2.batch_len, buf, buf_len);
+        u2.batch_len += buf_len;
+    }
+
+    Unified2CheckFlush(config);
+}
+
 //--------------------------------------------------------------------------
 // legacy event support
 // FIXIT-L encode pseudo packets for buffers and extra data for out of date
@@ -681,8 +794,7 @@ static void _AlertIP4_v2(Packet* p, const char*, Unified2Config* config, const E
                 app_name, strlen(app_name) + 1);
     }
 
-    if ( config->limit && (u2.current + write_len) > config->limit )
-        Unified2RotateFile(config);
+    Unified2CheckLimit(config, write_len);
 
     hdr.length = htonl(sizeof(alertdata));
     hdr.type = htonl(UNIFIED2_IDS_EVENT_VLAN);
@@ -769,8 +881,7 @@ static void _AlertIP6_v2(Packet* p, const char*, Unified2Config* config, const E
                 app_name, strlen(app_name) + 1);
     }
 
-    if ( config->limit && (u2.current + write_len) > config->limit )
-        Unified2RotateFile(config);
+    Unified2CheckLimit(config, write_len);
 
     hdr.length = htonl(sizeof(Unified2IDSEventIPv6));
     hdr.type = htonl(UNIFIED2_IDS_EVENT_IPV6_VLAN);
@@ -799,6 +910,12 @@ static const Parameter s_params[] =
     { "nostamp", Parameter::PT_BOOL, nullptr, "true",
       "append file creation time to name (in Unix Epoch format)" },
 
+    { "batch_size", Parameter::PT_INT, "0:max32", "0",
+      "bytes of records buffered per packet thread between writes (0 writes each record)" },
+
+    { "flush_interval", Parameter::PT_INT, "0:max32", "1",
+      "maximum seconds a batched record is held before it is written (0 is until full)" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -820,6 +937,8 @@ public:
     size_t limit;
     bool nostamp;
     bool legacy_events;
+    uint32_t batch_size;
+    uint32_t flush_interval;
 };
 
 bool U2Module::set(const char*, Value& v, SnortConfig*)
@@ -833,6 +952,12 @@ bool U2Module::set(const char*, Value& v, SnortConfig*)
     else if ( v.is("legacy_events") )
         legacy_events = v.get_bool();
 
+    else if ( v.is("batch_size") )
+        batch_size = v.get_uint32();
+
+    else if ( v.is("flush_interval") )
+        flush_interval = v.get_uint32();
+
     else
         return false;
 
@@ -844,6 +969,8 @@ bool U2Module::begin(const char*, int, SnortConfig*)
     limit = 0;
     nostamp = SnortConfig::output_no_timestamp();
     legacy_events = false;
+    batch_size = 0;
+    flush_interval = 1;
     return true;
 }
 
@@ -858,6 +985,8 @@ public:
 
     void open() override;
     void close() override;
+    void idle() override;
+    void tick() override;
 
     void alert(Packet*, const char* msg, const Event&) override;
     void log(Packet*, const char* msg, Event*) override;
@@ -875,6 +1004,8 @@ U2Logger::U2Logger(U2Module* m)
     config.limit = m->limit;
     config.nostamp = m->nostamp;
     config.legacy_events = m->legacy_events;
+    config.batch_size = m->batch_size;
+    config.flush_interval = m->flush_interval;
 }
 
 
@@ -894,24 +1025,25 @@ void U2Logger::open()
     }
     u2.base_proto = htonl(SFDAQ::get_base_protocol());
 
-    write_pkt_buffer = new uint8_t[u2_buf_sz];
-    io_buffer = new char[u2_buf_sz];
-
-    Unified2InitFile(&config);
+    Unified2Open(&config);
 
     Stream::reg_xtra_data_log(AlertExtraData, &config);
 }
 
 void U2Logger::close()
 {
-    if ( u2.stream )
-        fclose(u2.stream);
+    Unified2Close(&config);
+}
 
-    delete[] write_pkt_buffer;
-    delete[] io_buffer;
+void U2Logger::idle()
+{
+    if ( u2.batch_len )
+        Unified2Flush(&config);
+}
 
-    write_pkt_buffer = nullptr;
-    io_buffer = nullptr;
+void U2Logger::tick()
+{
+    Unified2CheckFlush(&config);
 }
 
 void U2Logger::alert_legacy(Packet* p, const char* msg, const Event& event)
@@ -1041,3 +1173,186 @@ const BaseApi* eh_unified2[] =
     nullptr
 };
 
+
+//-------------------------------------------------------------------------
+// unit tests
+//-------------------------------------------------------------------------
+
+#if defined(UNIT_TEST) || defined(BENCHMARK_TEST)
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "catch/snort_catch.h"
+
+static void u2_test_open(Unified2Config& config, uint32_t batch_size, uint32_t flush_interval)
+{
+    const char* dir = getenv("TMPDIR");
+    snprintf(u2.filepath, sizeof(u2.filepath), "%s/u2_test.%d", dir ? dir : "/tmp", (int)getpid());
+
+    config.limit = 0;
+    config.nostamp = 1;
+    config.legacy_events = false;
+    config.batch_size = batch_size;
+    config.flush_interval = flush_interval;
+
+    Unified2Open(&config);
+}
+
+static off_t u2_test_size()
+{
+    struct stat st;
+    return stat(u2.filepath, &st) ? -1 : st.st_size;
+}
+#endif
+
+#ifdef UNIT_TEST
+TEST_CASE("unified2 batch", "[unified2]")
+{
+    Unified2Config config;
+    u2_test_open(config, 1000, 0);
+
+    uint8_t rec[300] = { };
+
+    // only whole records are written
+    for ( unsigned i = 0; i < 3; ++i )
+        Unified2Write(rec, sizeof(rec), &config);
+
+    CHECK(u2_test_size() == 0);
+
+    Unified2Write(rec, sizeof(rec), &config);
+    CHECK(u2_test_size() == 900);
+
+    // bigger than the batch is written through after what is held
+    uint8_t big[1200] = { };
+    Unified2Write(big, sizeof(big), &config);
+    CHECK(u2_test_size() == 2400);
+
+    Unified2Write(rec, sizeof(rec), &config);
+    CHECK(u2_test_size() == 2400);
+
+    Unified2Flush(&config);
+    CHECK(u2_test_size() == 2700);
+    CHECK(u2.current == 2700);
+
+    Unified2Write(rec, sizeof(rec), &config);
+    Unified2Close(&config);
+    CHECK(u2_test_size() == 3000);
+
+    unlink(u2.filepath);
+}
+
+TEST_CASE("unified2 batch limit", "[unified2]")
+{
+    Unified2Config config;
+    u2_test_open(config, 1000, 0);
+    config.limit = 1000;
+
+    uint8_t rec[300] = { };
+
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        Unified2CheckLimit(&config, sizeof(rec));
+        Unified2Write(rec, sizeof(rec), &config);
+    }
+    CHECK(u2.current == 0);
+    CHECK(u2.batch_len == 900);
+
+    // held records are written before rotating so the new file (the same
+    // one here with nostamp) only gets the new record
+    Unified2CheckLimit(&config, sizeof(rec));
+    Unified2Write(rec, sizeof(rec), &config);
+
+    CHECK(u2.current == 0);
+    CHECK(u2.batch_len == 300);
+
+    Unified2Close(&config);
+    CHECK(u2_test_size() == 300);
+
+    unlink(u2.filepath);
+}
+
+TEST_CASE("unified2 flush interval", "[unified2]")
+{
+    Unified2Config config;
+    u2_test_open(config, 1000, 2);
+
+    uint8_t rec[300] = { };
+
+    Unified2Write(rec, sizeof(rec), &config);
+    Unified2Write(rec, sizeof(rec), &config);
+    CHECK(u2.batch_len == 600);
+
+    // packets keep coming but no further alerts
+    Unified2CheckFlush(&config);
+    CHECK(u2_test_size() == 0);
+
+    // the oldest held record is now past the interval
+    u2.last_flush -= 2;
+    Unified2CheckFlush(&config);
+    CHECK(u2_test_size() == 600);
+    CHECK(u2.batch_len == 0);
+
+    // nothing held, nothing to do
+    u2.last_flush -= 2;
+    Unified2CheckFlush(&config);
+    CHECK(u2_test_size() == 600);
+
+    Unified2Close(&config);
+    unlink(u2.filepath);
+}
+
+TEST_CASE("unified2 no flush interval", "[unified2]")
+{
+    Unified2Config config;
+    u2_test_open(config, 1000, 0);
+
+    uint8_t rec[300] = { };
+
+    Unified2Write(rec, sizeof(rec), &config);
+    u2.last_flush -= 10;
+    Unified2CheckFlush(&config);
+    CHECK(u2_test_size() == 0);
+
+    Unified2Close(&config);
+    CHECK(u2_test_size() == 300);
+
+    unlink(u2.filepath);
+}
+#endif
+
+#ifdef BENCHMARK_TEST
+// alerts per second with the record per write writer and with batches; an
+// alert here is an event record and a packet record as alert() writes them
+TEST_CASE("unified2 alert rate", "[unified2]")
+{
+    const unsigned num_alerts = 1000000;
+    const uint32_t batches[] = { 0, 65536, 1048576 };
+
+    uint8_t event[sizeof(Serial_Unified2_Header) + sizeof(Unified2Event)] = { };
+    uint8_t packet[sizeof(Serial_Unified2_Header) + sizeof(Serial_Unified2Packet) + 150] = { };
+
+    for ( auto batch_size : batches )
+    {
+        Unified2Config config;
+        u2_test_open(config, batch_size, 1);
+
+        auto start = std::chrono::steady_clock::now();
+
+        for ( unsigned i = 0; i < num_alerts; ++i )
+        {
+            Unified2Write(event, sizeof(event), &config);
+            Unified2Write(packet, sizeof(packet), &config);
+        }
+        Unified2Close(&config);
+
+        std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+
+        printf("batch_size %7u: %.0f alerts/sec\n", batch_size, num_alerts / secs.count());
+
+        CHECK(u2_test_size() == (off_t)num_alerts * (sizeof(event) + sizeof(packet)));
+        unlink(u2.filepath);
+    }
+}
+#endif
@@ -29,6 +29,8 @@
 #include "framework/module.h"
 #include "helpers/process.h"
 #include "helpers/ring.h"
+#include "latency/flow_cost.h"
+#include "latency/latency_histogram.h"
 #include "log/messages.h"
 #include "lua/lua.h"
 #include "main/analyzer.h"
@@ -297,6 +299,69 @@ int main_dump_stats(lua_State* L)
     return 0;
 }
 
+int main_show_counts(lua_State* L)
+{
+    const char* name = nullptr;
+
+    if ( L )
+    {
+        Lua::ManageStack(L, 1);
+        name = luaL_optstring(L, 1, nullptr);
+    }
+
+    // counts are read while packet threads run; rates are since the last call
+    std::string s;
+    ModuleManager::show_counts(s, name);
+
+    if ( s.empty() )
+        s = "== no counts\n";
+
+    current_request->respond(s.c_str());
+    return 0;
+}
+
+int main_show_latency(lua_State* L)
+{
+    const char* name = nullptr;
+
+    if ( L )
+    {
+        Lua::ManageStack(L, 1);
+        name = luaL_optstring(L, 1, nullptr);
+    }
+
+    // histograms are merged while packet threads run
+    std::string s;
+    LatencyHistograms::show(s, name);
+
+    if ( s.empty() )
+        s = "== no latency histograms\n";
+
+    current_request->respond(s.c_str());
+    return 0;
+}
+
+int main_show_flow_cost(lua_State* L)
+{
+    const char* name = nullptr;
+
+    if ( L )
+    {
+        Lua::ManageStack(L, 1);
+        name = luaL_optstring(L, 1, nullptr);
+    }
+
+    // the top tables are merged while packet threads run
+    std::string s;
+    FlowCost::show(s, name);
+
+    if ( s.empty() )
+        s = "== flow cost is disabled\n";
+
+    current_request->respond(s.c_str());
+    return 0;
+}
+
 int main_rotate_stats(lua_State* L)
 {
     bool from_shell = ( L != nullptr );
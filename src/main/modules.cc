@@ -27,6 +27,7 @@
 #include <regex>
 
 #include "codecs/codec_module.h"
+#include "decompress/decompress_module.h"
 #include "detection/fp_config.h"
 #include "filters/detection_filter.h"
 #include "filters/rate_filter.h"
@@ -38,6 +39,7 @@
 #include "host_tracker/host_tracker_module.h"
 #include "host_tracker/host_cache_module.h"
 #include "latency/latency_module.h"
+#include "log/async_log.h"
 #include "log/messages.h"
 #include "managers/module_manager.h"
 #include "managers/plugin_manager.h"
@@ -766,8 +768,25 @@ static const Parameter output_event_trace_params[] =
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
+static const Parameter output_async_params[] =
+{
+    { "enable", Parameter::PT_BOOL, nullptr, "false",
+      "run loggers that support it on a logger thread for each packet thread" },
+
+    { "ring_size", Parameter::PT_INT, "65536:max32", "4194304",
+      "bytes of queued events and packets per packet thread" },
+
+    { "overflow", Parameter::PT_ENUM, "block | drop_oldest | drop", "drop",
+      "when the ring is full, wait for space or drop the oldest or newest event" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
 static const Parameter output_params[] =
 {
+    { "async", Parameter::PT_TABLE, output_async_params, nullptr,
+      "queue events to logger threads instead of logging on packet threads" },
+
     { "dump_chars_only", Parameter::PT_BOOL, nullptr, "false",
       "turns on character dumps (same as -C)" },
 
@@ -817,6 +836,12 @@ public:
     OutputModule() : Module("output", output_help, output_params) { }
     bool set(const char*, Value&, SnortConfig*) override;
 
+    const PegInfo* get_pegs() const override
+    { return async_log_pegs; }
+
+    PegCount* get_counts() const override
+    { return (PegCount*)&async_log_stats; }
+
     Usage get_usage() const override
     { return GLOBAL; }
 };
@@ -856,6 +881,15 @@ bool OutputModule::set(const char*, Value& v, SnortConfig* sc)
     else if ( v.is("obfuscate") )
         v.update_mask(sc->output_flags, OUTPUT_FLAG__OBFUSCATE);
 
+    else if ( v.is("enable") )
+        sc->async_log = v.get_bool();
+
+    else if ( v.is("ring_size") )
+        sc->async_log_size = v.get_uint32();
+
+    else if ( v.is("overflow") )
+        sc->async_log_overflow = v.get_uint8();
+
     else
         return false;
 
@@ -1944,6 +1978,7 @@ void module_init()
     // these modules are not policy specific
     ModuleManager::add_module(new ClassificationsModule);
     ModuleManager::add_module(new CodecModule);
+    ModuleManager::add_module(new DecompressModule);
     ModuleManager::add_module(new DetectionModule);
     ModuleManager::add_module(new MemoryModule);
     ModuleManager::add_module(new PacketTracerModule);
@@ -50,6 +50,8 @@
 #include "host_tracker/host_cache.h"
 #include "ips_options/ips_flowbits.h"
 #include "ips_options/ips_options.h"
+#include "latency/flow_cost.h"
+#include "latency/latency_histogram.h"
 #include "latency/packet_latency.h"
 #include "latency/rule_latency.h"
 #include "log/log.h"
@@ -769,6 +771,8 @@ void Snort::thread_idle()
     else
         Stream::timeout_flows(time(nullptr));
     aux_counts.idle++;
+    EventManager::idle_outputs();
+    ModuleManager::publish_counts();
     HighAvailabilityManager::process_receive();
 }
 
@@ -833,8 +837,11 @@ void Snort::thread_init_unprivileged()
     FileService::thread_init();
     SideChannelManager::thread_init();
     HighAvailabilityManager::thread_init(); // must be before InspectorManager::thread_init();
+    LatencyHistograms::tinit(); // must be before InspectorManager::thread_init();
+    FlowCost::tinit();          // must be before InspectorManager::thread_init();
     InspectorManager::thread_init(SnortConfig::get_conf());
     PacketTracer::thread_init();
+    ModuleManager::thread_init();
 
     // in case there are HA messages waiting, process them first
     HighAvailabilityManager::process_receive();
@@ -843,6 +850,7 @@ void Snort::thread_init_unprivileged()
 
 void Snort::thread_reinit(SnortConfig* sc)
 {
+    EventManager::sync_outputs();
     InspectorManager::thread_reinit(sc);
     ActionManager::thread_reinit(sc);
 }
@@ -857,6 +865,7 @@ void Snort::thread_term()
     DetectionEngine::idle();
     InspectorManager::thread_stop(SnortConfig::get_conf());
     ModuleManager::accumulate(SnortConfig::get_conf());
+    ModuleManager::thread_term();
     InspectorManager::thread_term(SnortConfig::get_conf());
     ActionManager::thread_term(SnortConfig::get_conf());
 
@@ -876,6 +885,8 @@ void Snort::thread_term()
 
     PacketLatency::tterm();
     RuleLatency::tterm();
+    LatencyHistograms::tterm();
+    FlowCost::tterm();
 
     Profiler::consolidate_stats();
 
@@ -884,6 +895,7 @@ void Snort::thread_term()
     EventTrace_Term();
     CleanupTag();
     FileService::thread_term();
+    File_Decomp_Thread_Term();
     PacketTracer::thread_term();
     PacketManager::thread_term();
 
@@ -1016,6 +1028,7 @@ DAQ_Verdict Snort::packet_callback(
 {
     set_default_policy();
     Profile profile(totalPerfStats);
+    LatencyHistograms::Timer latency(LH_PACKET);
 
     pc.total_from_daq++;
     packet_time_update(&pkthdr->ts);
@@ -1032,8 +1045,12 @@ DAQ_Verdict Snort::packet_callback(
     sfthreshold_reset();
     ActionManager::reset_queue(s_packet);
 
+    FlowCost::start();
     DAQ_Verdict verdict = process_packet(s_packet, pkthdr, pkt);
+    FlowCost::stop(s_packet);
+
     ActionManager::execute(s_packet);
+    EventManager::tick_outputs();
 
     int inject = 0;
     verdict = update_verdict(s_packet, verdict, inject);
@@ -1055,6 +1072,9 @@ DAQ_Verdict Snort::packet_callback(
 
     s_packet->pkth = nullptr;  // no longer avail upon sig segv
 
+    if ( !(pc.total_from_daq & 1023) )
+        ModuleManager::publish_counts();
+
     if ( SnortConfig::get_conf()->pkt_cnt && pc.total_from_daq >= SnortConfig::get_conf()->pkt_cnt )
         SFDAQ::break_loop(-1);
 
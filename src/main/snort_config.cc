@@ -27,6 +27,7 @@
 #include <pwd.h>
 #include <syslog.h>
 
+#include "decompress/file_decomp_config.h"
 #include "detection/detect.h"
 #include "detection/detection_engine.h"
 #include "detection/fp_config.h"
@@ -199,6 +200,7 @@ void SnortConfig::init(const SnortConfig* const other_conf, ProtocolReference* p
         profiler = new ProfilerConfig;
         latency = new LatencyConfig();
         memory = new MemoryConfig();
+        file_decomp = new FileDecompConfig();
         policy_map = new PolicyMap;
         thread_config = new ThreadConfig();
 
@@ -305,6 +307,7 @@ SnortConfig::~SnortConfig()
     delete profiler;
     delete latency;
     delete memory;
+    delete file_decomp;
     delete daq_config;
     delete proto_ref;
 
@@ -120,6 +120,7 @@ struct ClassType;
 struct srmm_table_t;
 struct sopg_table_t;
 
+struct FileDecompConfig;
 struct MemoryConfig;
 struct LatencyConfig;
 struct PORT_RULE_MAP;
@@ -195,6 +196,10 @@ public:
     uint32_t tagged_packet_limit = 256;
     uint16_t event_trace_max = 0;
 
+    bool async_log = false;
+    uint8_t async_log_overflow = 2;     // LogRing::Overflow
+    uint32_t async_log_size = 4194304;
+
     std::string log_dir;
 
     //------------------------------------------------------
@@ -366,6 +371,7 @@ public:
     std::string remote_control_socket;
 
     MemoryConfig* memory = nullptr;
+    FileDecompConfig* file_decomp = nullptr;
     //------------------------------------------------------
 
     std::vector<void *>* state = nullptr;
@@ -77,6 +77,30 @@ static const Parameter s_module[] =
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
+static const Parameter s_counts[] =
+{
+    { "module", Parameter::PT_STRING, nullptr, nullptr,
+      "show counts for modules with this prefix" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
+static const Parameter s_latency[] =
+{
+    { "name", Parameter::PT_STRING, nullptr, nullptr,
+      "show histograms with this prefix (packet, inspector, search, or rule)" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
+static const Parameter s_flow_cost[] =
+{
+    { "table", Parameter::PT_STRING, nullptr, nullptr,
+      "show only this table (flow, service, or app)" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
 static const Parameter s_pktnum[] =
 {
     { "pkt_num", Parameter::PT_INT, "1:max53", nullptr,
@@ -93,6 +117,12 @@ static const Command snort_cmds[] =
       "delete an inspector from the default policy" },
 
     { "dump_stats", main_dump_stats, nullptr, "show summary statistics" },
+    { "show_counts", main_show_counts, s_counts,
+      "show current counts and rates without stopping packet threads" },
+    { "show_latency", main_show_latency, s_latency,
+      "show latency percentiles without stopping packet threads" },
+    { "show_flow_cost", main_show_flow_cost, s_flow_cost,
+      "show the most costly flows, services, and apps without stopping packet threads" },
     { "rotate_stats", main_rotate_stats, nullptr, "roll perfmonitor log files" },
     { "reload_config", main_reload_config, s_reload, "load new configuration" },
     { "reload_policy", main_reload_policy, s_reload, "reload part or all of the default policy" },
@@ -27,6 +27,7 @@
 #include <list>
 
 #include "framework/logger.h"
+#include "log/async_log.h"
 #include "log/messages.h"
 #include "main/snort_config.h"
 
@@ -59,6 +60,9 @@ struct OutputSet
 
 static OutputSet s_loggers;
 
+// loggers that can run async are only called on this thread's logger thread
+static THREAD_LOCAL AsyncLog* s_async = nullptr;
+
 bool EventManager::alert_enabled = true;
 bool EventManager::log_enabled = true;
 
@@ -219,42 +223,120 @@ void EventManager::instantiate(
 //-------------------------------------------------------------------------
 // execution
 
+static inline bool is_async(const Logger* p)
+{ return s_async and p->can_run_async(); }
+
+static void open_async()
+{
+    for ( auto p : s_loggers.outputs )
+        if ( p->can_run_async() )
+            p->open();
+}
+
+static void close_async()
+{
+    for ( auto p : s_loggers.outputs )
+        if ( p->can_run_async() )
+            p->close();
+}
+
+static void call_async(OutputSet* set, Packet* pkt, const char* message, Event* event, bool alert)
+{
+    for ( auto p : set->outputs )
+    {
+        if ( !p->can_run_async() )
+            continue;
+
+        if ( alert )
+            p->alert(pkt, message, *event);
+        else
+            p->log(pkt, message, event);
+    }
+}
+
 void EventManager::open_outputs()
 {
+    SnortConfig* sc = SnortConfig::get_conf();
+
+    if ( sc->async_log )
+    {
+        for ( auto p : s_loggers.outputs )
+        {
+            if ( p->can_run_async() )
+            {
+                s_async = new AsyncLog(sc, open_async, close_async, call_async);
+                break;
+            }
+        }
+    }
+
     for ( auto p : s_loggers.outputs )
-        p->open();
+        if ( !is_async(p) )
+            p->open();
 }
 
 void EventManager::close_outputs()
 {
     for ( auto p : s_loggers.outputs )
-        p->close();
+        if ( !is_async(p) )
+            p->close();
+
+    delete s_async;
+    s_async = nullptr;
+}
+
+void EventManager::sync_outputs()
+{
+    if ( s_async )
+        s_async->sync();
+}
+
+void EventManager::idle_outputs()
+{
+    for ( auto p : s_loggers.outputs )
+        if ( !is_async(p) )
+            p->idle();
+}
+
+void EventManager::tick_outputs()
+{
+    for ( auto p : s_loggers.outputs )
+        if ( !is_async(p) )
+            p->tick();
 }
 
 void EventManager::call_alerters(
     OutputSet* idx, Packet* pkt, const char* message, const Event& event)
 {
-    if ( idx )
+    OutputSet* set = idx ? idx : &s_loggers;
+    bool queue = false;
+
+    for ( auto p : set->outputs )
     {
-        for ( auto p : idx->outputs )
+        if ( is_async(p) )
+            queue = true;
+        else
             p->alert(pkt, message, event);
-        return;
     }
-    for ( auto p : s_loggers.outputs )
-        p->alert(pkt, message, event);
+    if ( queue )
+        s_async->put(set, pkt, message, &event, true);
 }
 
 void EventManager::call_loggers(
     OutputSet* idx, Packet* pkt, const char* message, Event* event)
 {
-    if ( idx )
+    OutputSet* set = idx ? idx : &s_loggers;
+    bool queue = false;
+
+    for ( auto p : set->outputs )
     {
-        for ( auto p : idx->outputs )
+        if ( is_async(p) )
+            queue = true;
+        else
             p->log(pkt, message, event);
-        return;
     }
-    for ( auto p : s_loggers.outputs )
-        p->log(pkt, message, event);
+    if ( queue )
+        s_async->put(set, pkt, message, event, false);
 }
 
 #ifdef PIGLET
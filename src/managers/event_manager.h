@@ -78,6 +78,15 @@ public:
     static void open_outputs();
     static void close_outputs();
 
+    // wait for queued events that may refer to the config being replaced
+    static void sync_outputs();
+
+    // let loggers write anything they are holding while traffic is idle
+    static void idle_outputs();
+
+    // let loggers write anything held too long while traffic continues
+    static void tick_outputs();
+
     static void call_alerters(OutputSet*, snort::Packet*, const char* message, const Event&);
     static void call_loggers(OutputSet*, snort::Packet*, const char* message, Event*);
 
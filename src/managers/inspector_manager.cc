@@ -31,6 +31,8 @@
 #include "detection/detection_engine.h"
 #include "flow/flow.h"
 #include "flow/session.h"
+#include "latency/flow_cost.h"
+#include "latency/latency_histogram.h"
 #include "log/messages.h"
 #include "main/snort.h"
 #include "main/snort_config.h"
@@ -139,6 +141,10 @@ PHInstance::PHInstance(PHClass& p, SnortConfig* sc, Module* mod) : pp_class(p)
         handler->set_api(&p.api);
         handler->add_ref();
 
+        std::string name = "inspector.";
+        name += p.api.base.name;
+        handler->set_latency_id(LatencyHistograms::get_id(name.c_str()));
+
         if ( p.api.service )
             handler->set_service(sc->proto_ref->add(p.api.service));
     }
@@ -971,6 +977,14 @@ void InspectorManager::print_config(SnortConfig* sc)
 // packet handling
 //-------------------------------------------------------------------------
 
+// times include any inspectors called from this one
+static inline void timed_eval(Inspector* ins, Packet* p)
+{
+    LatencyHistograms::Timer latency(ins->get_latency_id());
+    FlowCost::Phase cost(ins->get_api()->type == IT_STREAM ? FC_STREAM : FC_INSPECT);
+    ins->eval(p);
+}
+
 static inline void execute(
     Packet* p, PHInstance** prep, unsigned num)
 {
@@ -992,10 +1006,10 @@ static inline void execute(
         if ( p->type() == PktType::NONE )
         {
             if ( p->proto_bits & ppc.api.proto_bits )
-                (*prep)->handler->eval(p);
+                timed_eval((*prep)->handler, p);
         }
         else if ( BIT((unsigned)p->type()) & ppc.api.proto_bits )
-            (*prep)->handler->eval(p);
+            timed_eval((*prep)->handler, p);
     }
 }
 
@@ -1027,7 +1041,7 @@ void InspectorManager::full_inspection(Packet* p)
 
     else if ( flow->gadget && flow->gadget->likes(p) )
     {
-        flow->gadget->eval(p);
+        timed_eval(flow->gadget, p);
         s_clear = true;
     }
 }
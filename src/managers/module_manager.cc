@@ -30,16 +30,19 @@
 #include <iostream>
 #include <mutex>
 #include <regex>
+#include <sstream>
 #include <string>
 
 #include "framework/base_api.h"
 #include "framework/module.h"
+#include "framework/thread_counts.h"
 #include "helpers/markup.h"
 #include "log/messages.h"
 #include "main/modules.h"
 #include "main/shell.h"
 #include "main/snort.h"
 #include "main/snort_config.h"
+#include "main/thread.h"
 #include "parser/parse_conf.h"
 #include "parser/parser.h"
 #include "parser/vars.h"
@@ -61,6 +64,11 @@ struct ModHook
     const BaseApi* api;
     luaL_Reg* reg;
 
+    // thread local counts are published here for live reads
+    CounterSet* counters;
+    CounterRate* rate;
+    unsigned slot;
+
     ModHook(Module*, const BaseApi*);
     ~ModHook();
 
@@ -82,6 +90,10 @@ static SnortConfig* s_config = nullptr;
 
 static std::mutex stats_mutex;
 
+// each packet thread's blocks indexed by ModHook::slot
+static unsigned s_num_slots = 0;
+static THREAD_LOCAL CounterBlock** s_blocks = nullptr;
+
 // forward decls
 extern "C"
 {
@@ -116,6 +128,9 @@ ModHook::ModHook(Module* m, const BaseApi* b)
     mod = m;
     api = b;
     reg = nullptr;
+    counters = nullptr;
+    rate = nullptr;
+    slot = 0;
     init();
 }
 
@@ -124,6 +139,9 @@ ModHook::~ModHook()
     if ( reg )
         delete[] reg;
 
+    delete counters;
+    delete rate;
+
     if ( api && api->mod_dtor )
         api->mod_dtor(mod);
     else
@@ -132,6 +150,18 @@ ModHook::~ModHook()
 
 void ModHook::init()
 {
+    if ( const PegInfo* pegs = mod->get_pegs() )
+    {
+        rate = new CounterRate(pegs);
+
+        // global counts can already be read directly
+        if ( !mod->global_stats() )
+        {
+            counters = new CounterSet(pegs);
+            slot = s_num_slots++;
+        }
+    }
+
     const Command* c = mod->get_commands();
 
     if ( !c )
@@ -1423,6 +1453,12 @@ void ModuleManager::dump_stats(SnortConfig*, const char* skip, bool dynamic)
     }
 }
 
+static void publish(ModHook* p)
+{
+    if ( PegCount* c = p->mod->get_counts() )
+        s_blocks[p->slot]->publish(c);
+}
+
 void ModuleManager::accumulate(SnortConfig*)
 {
     for ( auto p : s_modules )
@@ -1430,6 +1466,11 @@ void ModuleManager::accumulate(SnortConfig*)
         std::lock_guard<std::mutex> lock(stats_mutex);
         p->mod->prep_counts();
         p->mod->sum_stats(true);
+
+        // sums just moved to the module so they must leave the block
+        // before a reader can see both
+        if ( s_blocks and p->counters )
+            publish(p);
     }
     std::lock_guard<std::mutex> lock(stats_mutex);
 }
@@ -1455,3 +1496,114 @@ void ModuleManager::reset_stats(SnortConfig*)
     }
 }
 
+//-------------------------------------------------------------------------
+// live counts
+//-------------------------------------------------------------------------
+
+void ModuleManager::thread_init()
+{
+    s_blocks = new CounterBlock*[s_num_slots];
+
+    for ( auto p : s_modules )
+    {
+        if ( p->counters )
+            s_blocks[p->slot] = p->counters->attach();
+    }
+}
+
+void ModuleManager::thread_term()
+{
+    if ( !s_blocks )
+        return;
+
+    for ( auto p : s_modules )
+    {
+        if ( p->counters )
+            p->counters->detach(s_blocks[p->slot]);
+    }
+    delete[] s_blocks;
+    s_blocks = nullptr;
+}
+
+void ModuleManager::publish_counts()
+{
+    if ( !s_blocks )
+        return;
+
+    // counts that need prep are published by accumulate() only
+    for ( auto p : s_modules )
+    {
+        if ( p->counters and !p->mod->counts_need_prep() )
+            publish(p);
+    }
+}
+
+void ModuleManager::show_counts(std::string& out, const char* pfx)
+{
+    // no sorting here; packet threads may be walking the list
+    ostringstream ss;
+    vector<PegCount> c;
+    vector<double> rates;
+
+    for ( auto p : s_modules )
+    {
+        Module* m = p->mod;
+
+        if ( !p->rate or !selected(m, pfx, false) )
+            continue;
+
+        const PegInfo* pegs = m->get_pegs();
+        unsigned n = 0;
+
+        while ( pegs[n].name )
+            ++n;
+
+        c.assign(n, 0);
+
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+
+            if ( !p->counters )
+            {
+                // global counts
+                const PegCount* g = m->get_counts();
+
+                if ( !g )
+                    continue;
+
+                for ( unsigned i = 0; i < n; ++i )
+                    c[i] = g[i];
+            }
+            else
+            {
+                // threads hold what was counted since their last accumulate
+                p->counters->read(c.data());
+
+                for ( int i = 0; i < m->num_counts and i < (int)n; ++i )
+                {
+                    if ( pegs[i].type == CountType::SUM )
+                        c[i] += m->counts[i];
+
+                    else if ( pegs[i].type == CountType::MAX and m->counts[i] > c[i] )
+                        c[i] = m->counts[i];
+                }
+            }
+        }
+        p->rate->update(c.data(), rates);
+
+        for ( unsigned i = 0; i < n; ++i )
+        {
+            if ( !c[i] )
+                continue;
+
+            ss << m->get_name() << "." << pegs[i].name << ": " << c[i];
+
+            if ( rates[i] > 0.0 )
+                ss << " (" << (uint64_t)rates[i] << "/sec)";
+
+            ss << "\n";
+        }
+    }
+    out = ss.str();
+}
+
@@ -26,6 +26,7 @@
 #include <cstdint>
 #include <set>
 #include <list>
+#include <string>
 
 #include "main/snort_types.h"
 
@@ -85,6 +86,13 @@ public:
     static void accumulate_offload(const char* name);
     static void reset_stats(SnortConfig*);
 
+    // packet threads publish their counts for show_counts() which can be
+    // called from the main thread at any time without stopping them
+    static void thread_init();
+    static void thread_term();
+    static void publish_counts();
+    static void show_counts(std::string&, const char* pfx = nullptr);
+
     static std::set<uint32_t> gids;
 };
 }
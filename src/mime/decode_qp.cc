@@ -26,11 +26,18 @@
 
 #include <cctype>
 #include <cstdlib>
+#include <cstring>
 
 #include "utils/util_unfold.h"
 
 #include "decode_buffer.h"
 
+#ifdef UNIT_TEST
+#include <string>
+
+#include "catch/snort_catch.h"
+#endif
+
 void QPDecode::reset_decode_state()
 {
     reset_decoded_bytes();
@@ -97,6 +104,65 @@ QPDecode::~QPDecode()
         delete buffer;
 }
 
+// byte classes for sf_qpdecode, built with the same ctype tests the decoder
+// always used so the output does not change
+enum QPByteClass : uint8_t
+{
+    QP_DROP,     // skipped
+    QP_COPY,     // copied as is
+    QP_ESCAPE    // '=' soft break or hex escape
+};
+
+struct QPTables
+{
+    uint8_t cls[256];
+    int8_t hex[256];
+
+    QPTables()
+    {
+        for ( unsigned i = 0; i < 256; ++i )
+        {
+            char ch = (char)i;
+
+            if ( ch == '=' )
+                cls[i] = QP_ESCAPE;
+            else if ( isprint(ch) || isblank(ch) || ch == '\r' || ch == '\n' )
+                cls[i] = QP_COPY;
+            else
+                cls[i] = QP_DROP;
+
+            if ( ch >= '0' && ch <= '9' )
+                hex[i] = ch - '0';
+            else if ( ch >= 'a' && ch <= 'f' )
+                hex[i] = ch - 'a' + 10;
+            else if ( ch >= 'A' && ch <= 'F' )
+                hex[i] = ch - 'A' + 10;
+            else
+                hex[i] = -1;
+        }
+    }
+};
+
+static const QPTables qp_tables;
+
+// true if all 8 bytes are in ' '..'~' and none is '='; those are copied
+// without looking at each byte
+static inline bool qp_plain8(const uint8_t* p)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t x;
+
+    memcpy(&x, p, sizeof(x));
+
+    uint64_t eq = x ^ (ones * '=');
+    uint64_t has_eq = (eq - ones) & ~eq & highs;
+    uint64_t has_low = (x - ones * ' ') & ~x & highs;
+    uint64_t has_high = ((x + ones * (127 - '~')) | x) & highs;
+
+    return !(has_eq | has_low | has_high);
+}
+
 int sf_qpdecode(const char* src, uint32_t slen, char* dst, uint32_t dlen, uint32_t* bytes_read,
     uint32_t* bytes_copied)
 {
@@ -106,54 +172,63 @@ int sf_qpdecode(const char* src, uint32_t slen, char* dst, uint32_t dlen, uint32
     *bytes_read = 0;
     *bytes_copied = 0;
 
+    const uint8_t* usrc = (const uint8_t*)src;
+
     while ( (*bytes_read < slen) && (*bytes_copied < dlen))
     {
-        char ch = src[*bytes_read];
+        /* copy the run of plain characters ahead in one go */
+        uint32_t limit = slen - *bytes_read;
+        uint32_t run = 0;
+
+        if ( dlen - *bytes_copied < limit )
+            limit = dlen - *bytes_copied;
+
+        while ( (run + 8 <= limit) && qp_plain8(usrc + *bytes_read + run) )
+            run += 8;
+
+        while ( (run < limit) && (qp_tables.cls[usrc[*bytes_read + run]] == QP_COPY) )
+            run++;
+
+        if ( run )
+        {
+            memcpy(dst + *bytes_copied, src + *bytes_read, run);
+            *bytes_read += run;
+            *bytes_copied += run;
+            continue;
+        }
+
+        uint8_t ch = usrc[*bytes_read];
         *bytes_read += 1;
 
-        if ( ch == '=' )
+        if ( qp_tables.cls[ch] != QP_ESCAPE )
+            continue;
+
+        if ( (*bytes_read < slen))
         {
-            if ( (*bytes_read < slen))
+            if (src[*bytes_read] == '\n')
+            {
+                *bytes_read += 1;
+                continue;
+            }
+            else if ( *bytes_read < (slen - 1) )
             {
-                if (src[*bytes_read] == '\n')
+                uint8_t ch1 = usrc[*bytes_read];
+                uint8_t ch2 = usrc[*bytes_read + 1];
+                if ( ch1 == '\r' && ch2 == '\n')
                 {
-                    *bytes_read += 1;
+                    *bytes_read += 2;
                     continue;
                 }
-                else if ( *bytes_read < (slen - 1) )
+                if ( (qp_tables.hex[ch1] >= 0) && (qp_tables.hex[ch2] >= 0) )
                 {
-                    char ch1 = src[*bytes_read];
-                    char ch2 = src[*bytes_read + 1];
-                    if ( ch1 == '\r' && ch2 == '\n')
-                    {
-                        *bytes_read += 2;
-                        continue;
-                    }
-                    if (isxdigit((int)ch1) && isxdigit((int)ch2))
-                    {
-                        char hexBuf[3];
-                        char* eptr;
-                        hexBuf[0] = ch1;
-                        hexBuf[1] = ch2;
-                        hexBuf[2] = '\0';
-                        dst[*bytes_copied]= (char)strtoul(hexBuf, &eptr, 16);
-                        if ((*eptr != '\0'))
-                        {
-                            return -1;
-                        }
-                        *bytes_read += 2;
-                        *bytes_copied +=1;
-                        continue;
-                    }
-                    dst[*bytes_copied] = ch;
+                    dst[*bytes_copied] = (char)((qp_tables.hex[ch1] << 4) | qp_tables.hex[ch2]);
+                    *bytes_read += 2;
                     *bytes_copied +=1;
                     continue;
                 }
-                else
-                {
-                    *bytes_read -= 1;
-                    return 0;
-                }
+                dst[*bytes_copied] = (char)ch;
+                *bytes_copied +=1;
+                continue;
             }
             else
             {
@@ -161,13 +236,77 @@ int sf_qpdecode(const char* src, uint32_t slen, char* dst, uint32_t dlen, uint32
                 return 0;
             }
         }
-        else if ( isprint(ch) || isblank(ch) || ch == '\r' || ch == '\n' )
+        else
         {
-            dst[*bytes_copied] = ch;
-            *bytes_copied +=1;
+            *bytes_read -= 1;
+            return 0;
         }
     }
 
     return 0;
 }
 
+//--------------------------------------------------------------------------
+// unit tests
+//--------------------------------------------------------------------------
+
+#ifdef UNIT_TEST
+static std::string qp_decode(const std::string& in, uint32_t out_size, uint32_t& bytes_read)
+{
+    std::string out(out_size, '\0');
+    uint32_t n = 0;
+    bytes_read = 0;
+    sf_qpdecode(in.data(), in.size(), &out[0], out_size, &bytes_read, &n);
+    out.resize(n);
+    return out;
+}
+
+TEST_CASE("quoted-printable escapes and soft breaks", "[mime_decode]")
+{
+    uint32_t used;
+
+    CHECK(qp_decode("plain text, nothing to do here", 100, used) ==
+        "plain text, nothing to do here");
+    CHECK(qp_decode("caf=C3=A9 =3d=3D", 100, used) == "caf\xc3\xa9 ==");
+    CHECK(qp_decode("soft=\r\nbreak=\nagain", 100, used) == "softbreakagain");
+    CHECK(qp_decode("bad =ZZ escape", 100, used) == "bad =ZZ escape");
+
+    // control and 8 bit bytes are dropped, line breaks and tabs kept
+    CHECK(qp_decode("a\x01" "b\x80" "c\td\r\n", 100, used) == "abc\td\r\n");
+
+    // a trailing escape is left for the next buffer
+    CHECK(qp_decode("abcdefghij=4", 100, used) == "abcdefghij");
+    CHECK(used == 10);
+    CHECK(qp_decode("abcdefghij=", 100, used) == "abcdefghij");
+    CHECK(used == 10);
+}
+
+TEST_CASE("quoted-printable output limit", "[mime_decode]")
+{
+    uint32_t used;
+
+    CHECK(qp_decode("0123456789abcdefghij", 12, used) == "0123456789ab");
+    CHECK(used == 12);
+    CHECK(qp_decode("=41=42=43=44", 3, used) == "ABC");
+    CHECK(used == 9);
+}
+
+#ifdef BENCHMARK_TEST
+TEST_CASE("quoted-printable decode 4 MB attachment", "[mime_decode]")
+{
+    std::string in;
+
+    while ( in.size() < (4 << 20) )
+        in += "The quick brown fox jumps over the lazy dog =E2=80=94 caf=C3=A9 tab\there=\r\n";
+
+    std::string out;
+    uint32_t used;
+
+    BENCHMARK("sf_qpdecode")
+    {
+        out = qp_decode(in, in.size(), used);
+    }
+    CHECK(used == in.size());
+}
+#endif
+#endif
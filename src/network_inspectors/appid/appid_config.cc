@@ -42,6 +42,7 @@
 #include "main/snort_config.h"
 #include "log/messages.h"
 #include "lua_detector_module.h"
+#include "service_state.h"
 #include "utils/util.h"
 #include "service_plugins/service_ssl.h"
 #include "detector_plugins/detector_dns.h"
@@ -751,9 +752,12 @@ bool AppIdConfig::init_appid(SnortConfig* sc)
     // Handle the if condition in AppIdConfig::init_appid
     static bool once = false;
     if (!once)
-    {   
+    {
+        // pattern sets are only built here so the method can't change on reload
+        set_appid_search_method(mod_config->search_method.c_str());
         AppIdConfig::app_info_mgr.init_appid_info_table(mod_config, sc);
         HostPortCache::initialize();
+        AppIdServiceVerdicts::initialize(mod_config->service_verdicts);
         HttpPatternMatchers* http_matchers = HttpPatternMatchers::get_instance();
         AppIdDiscovery::initialize_plugins();
         init_length_app_cache();
@@ -772,6 +776,11 @@ bool AppIdConfig::init_appid(SnortConfig* sc)
 #endif
         once = true;
     }
+    else if ( mod_config->search_method != appid_search_method_name() )
+    {
+        WarningMessage("appid.search_method %s takes effect on restart; %s is still in use\n",
+            mod_config->search_method.c_str(), appid_search_method());
+    }
 #ifdef USE_RNA_CONFIG
     load_analysis_config(mod_config->conf_file, 0, mod_config->instance_id);
 #endif
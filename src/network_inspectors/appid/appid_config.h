@@ -26,6 +26,7 @@
 #include <string>
 
 #include "application_ids.h"
+#include "appid_utils/appid_search_tool.h"
 #include "framework/decode_data.h"
 #include "main/snort_config.h"
 #include "protocols/ipv6.h"
@@ -85,6 +86,9 @@ public:
     bool debug = false;
     bool dump_ports = false;
     bool log_all_sessions = false;
+    bool share_lua_detectors = false;
+    uint32_t service_verdicts = 0;
+    std::string search_method = APPID_DEFAULT_SEARCH_METHOD;
 
     bool safe_search_enabled = true;
     bool dns_host_reporting = true;
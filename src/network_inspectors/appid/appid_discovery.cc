@@ -38,6 +38,7 @@
 #include "appid_http_session.h"
 #include "appid_inspector.h"
 #include "appid_session.h"
+#include "appid_utils/appid_search_tool.h"
 #include "appid_utils/ip_funcs.h"
 #include "appid_utils/network_set.h"
 #include "client_plugins/client_discovery.h"
@@ -54,8 +55,8 @@ using namespace snort;
 
 AppIdDiscovery::AppIdDiscovery()
 {
-    tcp_patterns = new SearchTool("ac_full", true);
-    udp_patterns = new SearchTool("ac_full", true);
+    tcp_patterns = new SearchTool(appid_search_method(), true);
+    udp_patterns = new SearchTool(appid_search_method(), true);
 }
 
 AppIdDiscovery::~AppIdDiscovery()
@@ -929,6 +930,10 @@ bool AppIdDiscovery::do_discovery(Packet* p, AppIdSession& asd, IpProtocol proto
         asd.set_session_flags(APPID_SESSION_ADDITIONAL_PACKET);
     }
 
+    if ( asd.service_disco_state == APPID_DISCO_STATE_FINISHED and
+        asd.client_disco_state == APPID_DISCO_STATE_FINISHED )
+        asd.free_detector_state();
+
     service_id = asd.pick_service_app_id();
 
     // Length-based service detection if no service is found yet
@@ -30,12 +30,14 @@
 
 #include "log/messages.h"
 #include "main/analyzer_command.h"
+#include "managers/plugin_manager.h"
 #include "profiler/profiler.h"
 #include "utils/util.h"
 
 #include "app_info_table.h"
 #include "appid_debug.h"
 #include "appid_peg_counts.h"
+#include "appid_utils/appid_search_tool.h"
 
 using namespace snort;
 using namespace std;
@@ -49,6 +51,9 @@ Trace TRACE_NAME(appid_module);
 THREAD_LOCAL ProfileStats appid_perf_stats;
 THREAD_LOCAL AppIdStats appid_stats;
 
+static function<const char*()> get_search_methods = []()
+{ return PluginManager::get_available_plugins(PT_SEARCH_ENGINE); };
+
 static const Parameter s_params[] =
 {
 #ifdef USE_RNA_CONFIG
@@ -88,6 +93,12 @@ static const Parameter s_params[] =
       "print third party configuration on startup" },
     { "log_all_sessions", Parameter::PT_BOOL, nullptr, "false",
       "enable logging of all appid sessions" },
+    { "search_method", Parameter::PT_DYNAMIC, (void*)&get_search_methods, "ac_full",
+      "search engine used to build appid pattern sets (e.g. hyperscan)" },
+    { "share_lua_detectors", Parameter::PT_BOOL, nullptr, "false",
+      "compile lua detectors once and load packet threads from the shared bytecode" },
+    { "service_verdicts", Parameter::PT_INT, "0:max32", "0",
+      "max servers with service detectors shared by packet threads (0 disables)" },
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
@@ -191,6 +202,13 @@ static const PegInfo appid_pegs[] =
     { CountType::SUM, "ignored_packets", "count of packets ignored" },
     { CountType::SUM, "total_sessions", "count of sessions created" },
     { CountType::SUM, "appid_unknown", "count of sessions where appid could not be determined" },
+    { CountType::SUM, "service_cache_hits", "new flows started with a shared service verdict" },
+    { CountType::SUM, "service_cache_misses", "new flows with no shared service verdict" },
+    { CountType::SUM, "service_cache_invalidations",
+        "shared service verdicts dropped when their detector failed" },
+    { CountType::SUM, "service_validates", "count of service detector validate calls" },
+    { CountType::SUM, "service_validates_saved",
+        "validate calls avoided by shared service verdicts, estimated from the original search" },
     { CountType::END, nullptr, nullptr},
 };
 
@@ -258,6 +276,12 @@ bool AppIdModule::set(const char* fqn, Value& v, SnortConfig* c)
         config->dump_ports = v.get_bool();
     else if ( v.is("log_all_sessions") )
         config->log_all_sessions = v.get_bool();
+    else if ( v.is("search_method") )
+        config->search_method = v.get_string();
+    else if ( v.is("share_lua_detectors") )
+        config->share_lua_detectors = v.get_bool();
+    else if ( v.is("service_verdicts") )
+        config->service_verdicts = v.get_uint32();
     else
         return Module::set(fqn, v, c);
 
@@ -42,6 +42,11 @@ struct AppIdStats
     PegCount ignored_packets;
     PegCount total_sessions;
     PegCount appid_unknown;  
+    PegCount service_cache_hits;
+    PegCount service_cache_misses;
+    PegCount service_cache_invalidations;
+    PegCount service_validates;
+    PegCount service_validates_saved;
 };
 
 extern THREAD_LOCAL AppIdStats appid_stats;
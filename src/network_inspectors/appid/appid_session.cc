@@ -30,6 +30,7 @@
 #include "log/messages.h"
 #include "main/snort_config.h"
 #include "managers/inspector_manager.h"
+#include "memory/memory_cap.h"
 #include "profiler/profiler.h"
 #include "protocols/packet.h"
 #include "protocols/tcp.h"
@@ -575,69 +576,129 @@ void AppIdSession::delete_session_data()
     delete dsession;
 }
 
+// sessions rarely hold more than a few detector states so the list is walked
+// rather than hashed; the nodes are contiguous in the arena.  the arena is
+// counted against the memcap but does not prune since this flow may be the
+// one pruned.
+void AppIdSession::update_arena_bytes()
+{
+    size_t n = detector_arena.size();
+
+    if ( n > arena_bytes )
+        memory::MemoryCap::update_allocations(n - arena_bytes);
+    else if ( n < arena_bytes )
+        memory::MemoryCap::update_deallocations(arena_bytes - n);
+
+    arena_bytes = n;
+}
+
 int AppIdSession::add_flow_data(void* data, unsigned id, AppIdFreeFCN fcn)
 {
-    AppIdFlowDataIter it = flow_data.find(id);
-    if ( it != flow_data.end() )
-        return -1;
+    for ( AppIdFlowData* fd = flow_data; fd; fd = fd->next )
+        if ( fd->fd_id == id )
+            return -1;
 
-    AppIdFlowData* fd = new AppIdFlowData(data, id, fcn);
-    flow_data[id] = fd;
+    AppIdFlowData* fd = detector_arena.create<AppIdFlowData>(data, id, fcn);
+    fd->next = flow_data;
+    flow_data = fd;
+    update_arena_bytes();
     return 0;
 }
 
 void* AppIdSession::get_flow_data(unsigned id)
 {
-    AppIdFlowDataIter it = flow_data.find(id);
-    if ( it != flow_data.end() )
-        return it->second->fd_data;
+    for ( AppIdFlowData* fd = flow_data; fd; fd = fd->next )
+        if ( fd->fd_id == id )
+            return fd->fd_data;
+
+    return nullptr;
+}
+
+void AppIdSession::unlink_flow_data(AppIdFlowData* prev, AppIdFlowData* fd)
+{
+    if ( prev )
+        prev->next = fd->next;
     else
-        return nullptr;
+        flow_data = fd->next;
+
+    detector_arena.destroy(fd);
+
+    if ( !flow_data )
+    {
+        detector_arena.release();
+        update_arena_bytes();
+    }
 }
 
 void* AppIdSession::remove_flow_data(unsigned id)
 {
-    void* data = nullptr;
+    AppIdFlowData* prev = nullptr;
 
-    AppIdFlowDataIter it = flow_data.find(id);
-    if ( it != flow_data.end() )
+    for ( AppIdFlowData* fd = flow_data; fd; prev = fd, fd = fd->next )
     {
-        data = it->second->fd_data;
-        delete it->second;
-        flow_data.erase(it);
+        if ( fd->fd_id == id )
+        {
+            // the caller owns the data now
+            void* data = fd->fd_data;
+            fd->fd_data = nullptr;
+            unlink_flow_data(prev, fd);
+            return data;
+        }
     }
 
-    return data;
+    return nullptr;
 }
 
 void AppIdSession::free_flow_data()
 {
-    for ( AppIdFlowDataIter it = flow_data.cbegin(); it != flow_data.cend(); ++it )
-        delete it->second;
-
-    flow_data.clear();
+    free_flow_data_by_mask(0);
 }
 
 void AppIdSession::free_flow_data_by_id(unsigned id)
 {
-    AppIdFlowDataIter it = flow_data.find(id);
-    if ( it != flow_data.end() )
+    AppIdFlowData* prev = nullptr;
+
+    for ( AppIdFlowData* fd = flow_data; fd; prev = fd, fd = fd->next )
     {
-        delete it->second;
-        flow_data.erase(it);
+        if ( fd->fd_id == id )
+        {
+            unlink_flow_data(prev, fd);
+            return;
+        }
     }
 }
 
 void AppIdSession::free_flow_data_by_mask(unsigned mask)
 {
-    for ( AppIdFlowDataIter it = flow_data.cbegin(); it != flow_data.cend(); )
-        if ( !mask || ( it->second->fd_id & mask ) )
+    AppIdFlowData* prev = nullptr;
+    AppIdFlowData* fd = flow_data;
+
+    while ( fd )
+    {
+        AppIdFlowData* next = fd->next;
+
+        if ( !mask || ( fd->fd_id & mask ) )
         {
-            delete it->second;
-            it = flow_data.erase(it);
+            // unlinking the last node releases the arena
+            unlink_flow_data(prev, fd);
+
+            if ( !flow_data )
+                return;
         }
         else
-            ++it;
+            prev = fd;
+
+        fd = next;
+    }
+}
+
+// service and client detectors keep nothing once both sides are finished;
+// data left for the session api (dhcp, smb) keeps the arena until it is taken
+void AppIdSession::free_detector_state()
+{
+    if ( flow_data )
+        free_flow_data_by_mask(APPID_SESSION_DATA_SERVICE_MODSTATE_BIT |
+            APPID_SESSION_DATA_CLIENT_MODSTATE_BIT | APPID_SESSION_DATA_DETECTOR_MODSTATE_BIT);
 }
 
 int AppIdSession::add_flow_data_id(uint16_t port, ServiceDetector* service)
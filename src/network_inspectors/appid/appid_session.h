@@ -32,6 +32,7 @@
 #include "appid_api.h"
 #include "appid_app_descriptor.h"
 #include "appid_types.h"
+#include "appid_utils/appid_arena.h"
 #include "application_ids.h"
 #include "detector_plugins/http_url_patterns.h"
 #include "length_app_cache.h"
@@ -108,8 +109,8 @@ public:
     void* fd_data;
     unsigned fd_id;
     AppIdFreeFCN fd_free;
+    AppIdFlowData* next = nullptr;
 };
-typedef std::unordered_map<unsigned, AppIdFlowData*>::const_iterator AppIdFlowDataIter;
 
 struct CommonAppIdData
 {
@@ -197,54 +198,31 @@ public:
     size_t size_of() override
     { return sizeof(*this); }
 
-    uint32_t session_id = 0;
+    // Members are ordered by how often they are touched.  The first block is
+    // read or written on every packet; the rest is only used while a
+    // detector is working on the flow or when the results are logged.
     snort::Flow* flow = nullptr;
     AppIdConfig* config;
-    std::unordered_map<unsigned, AppIdFlowData*> flow_data;
-    AppInfoManager* app_info_mgr = nullptr;
     CommonAppIdData common;
     uint16_t session_packet_count = 0;
-
-    snort::SfIp service_ip;
     uint16_t service_port = 0;
     IpProtocol protocol = IpProtocol::PROTO_NOT_SET;
     uint8_t previous_tcp_flags = 0;
-
-    // AppId matching service side
+    bool is_http2 = false;
+    bool in_expected_cache = false;
+    unsigned scan_flags = 0;
     APPID_DISCOVERY_STATE service_disco_state = APPID_DISCO_STATE_NONE;
+    APPID_DISCOVERY_STATE client_disco_state = APPID_DISCO_STATE_NONE;
     SESSION_SERVICE_SEARCH_STATE service_search_state = SESSION_SERVICE_SEARCH_STATE::START;
+    snort::SEARCH_SUPPORT_TYPE search_support_type = snort::UNKNOWN_SEARCH_ENGINE;
     ServiceDetector* service_detector = nullptr;
-    snort::AppIdServiceSubtype* subtype = nullptr;
-    std::vector<ServiceDetector*> service_candidates;
-    ServiceAppDescriptor service;
-    ClientAppDescriptor client;
-    PayloadAppDescriptor payload;
-
-    // AppId matching client side
-    APPID_DISCOVERY_STATE client_disco_state = APPID_DISCO_STATE_NONE;
-    AppId client_inferred_service_id = APP_ID_NONE;
     ClientDetector* client_detector = nullptr;
-    std::map<std::string, ClientDetector*> client_candidates;
-    bool tried_reverse_service = false;
-
-    AppId referred_payload_app_id = APP_ID_NONE;
-    AppId misc_app_id = APP_ID_NONE;
-
-
-    // FIXIT-RC netbios_name is never set to a valid value; set when netbios_domain is set?
-    char* netbios_name = nullptr;
-    char* netbios_domain = nullptr;
-
-    TlsSession* tsession = nullptr;
-    unsigned scan_flags = 0;
     ThirdPartyAppIDSession* tpsession = nullptr;
     uint16_t init_tpPackets = 0;
     uint16_t resp_tpPackets = 0;
-    bool tp_reinspect_by_initiator = false;
     SnortProtocolId snort_protocol_id = UNKNOWN_PROTOCOL_ID;
-
-    /* Length-based detectors. */
-    LengthKey length_sequence;
+    bool tp_reinspect_by_initiator = false;
+    bool tried_reverse_service = false;
 
     struct
     {
@@ -254,6 +232,29 @@ public:
         uint64_t responder_bytes;
     } stats = { 0, 0, 0, 0 };
 
+    /* Length-based detectors. */
+    LengthKey length_sequence;
+
+    ServiceAppDescriptor service;
+    ClientAppDescriptor client;
+    PayloadAppDescriptor payload;
+
+    // detection state
+    uint32_t session_id = 0;
+    uint16_t service_validates = 0;     // validate() calls made finding the service
+    snort::SfIp service_ip;
+    AppInfoManager* app_info_mgr = nullptr;
+    AppIdFlowData* flow_data = nullptr; // detector state, allocated from detector_arena
+    std::vector<ServiceDetector*> service_candidates;
+    std::map<std::string, ClientDetector*> client_candidates;
+    snort::AppIdServiceSubtype* subtype = nullptr;
+
+    AppId client_inferred_service_id = APP_ID_NONE;
+    AppId referred_payload_app_id = APP_ID_NONE;
+    AppId misc_app_id = APP_ID_NONE;
+    AppId past_indicator = APP_ID_NONE;
+    AppId past_forecast = APP_ID_NONE;
+
     //appIds picked from encrypted session.
     struct
     {
@@ -264,13 +265,13 @@ public:
         AppId referred_id;
     } encrypted = { APP_ID_NONE, APP_ID_NONE, APP_ID_NONE, APP_ID_NONE, APP_ID_NONE };
 
+    // FIXIT-RC netbios_name is never set to a valid value; set when netbios_domain is set?
+    char* netbios_name = nullptr;
+    char* netbios_domain = nullptr;
+
+    TlsSession* tsession = nullptr;
     void* firewall_early_data = nullptr;
-    AppId past_indicator = APP_ID_NONE;
-    AppId past_forecast = APP_ID_NONE;
 
-    bool is_http2 = false;
-    snort::SEARCH_SUPPORT_TYPE search_support_type = snort::UNKNOWN_SEARCH_ENGINE;
-    bool in_expected_cache = false;
     static unsigned inspector_id;
     static void init() { inspector_id = FlowData::create_flow_data_id(); }
 
@@ -291,6 +292,7 @@ public:
     void free_flow_data_by_mask(unsigned mask);
     void free_tls_session_data();
     void free_flow_data();
+    void free_detector_state();
 
     AppId pick_service_app_id();
     AppId pick_only_service_app_id();
@@ -357,6 +359,14 @@ private:
     AppIdHttpSession* hsession = nullptr;
     AppIdDnsSession* dsession = nullptr;
 
+    // the list nodes for flow_data; freed nodes are reused and the arena is
+    // released in one step once the list is empty so a finished session
+    // holds no detector memory
+    AppIdArena detector_arena;
+    size_t arena_bytes = 0;
+
+    void unlink_flow_data(AppIdFlowData* prev, AppIdFlowData* fd);
+    void update_arena_bytes();
     void reinit_session_data(AppidChangeBits& change_bits);
     void delete_session_data();
 
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// appid_arena.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "appid_arena.h"
+
+#include "utils/util.h"
+
+static const size_t arena_align = alignof(std::max_align_t);
+
+static inline size_t align_up(size_t n)
+{ return (n + arena_align - 1) & ~(arena_align - 1); }
+
+static_assert(sizeof(void*) + sizeof(size_t) <= arena_align,
+    "arena blocks must hold a free block");
+
+void* AppIdArena::allocate(size_t n)
+{
+    const size_t hdr = align_up(sizeof(Chunk));
+    n = align_up(n ? n : 1);
+
+    // sessions free only a few sizes so the list is short
+    for ( FreeBlock** pb = &free_list; *pb; pb = &(*pb)->next )
+    {
+        if ( (*pb)->size == n )
+        {
+            FreeBlock* b = *pb;
+            *pb = b->next;
+            return b;
+        }
+    }
+
+    if ( !chunks or chunks->used + n > chunks->size )
+    {
+        // oversized requests get a chunk of their own
+        size_t size = hdr + n > APPID_ARENA_CHUNK_SIZE ? hdr + n : APPID_ARENA_CHUNK_SIZE;
+        Chunk* c = (Chunk*)snort_alloc(size);
+        c->size = size;
+        c->used = hdr;
+        c->next = chunks;
+        chunks = c;
+    }
+
+    void* p = (uint8_t*)chunks + chunks->used;
+    chunks->used += n;
+    return p;
+}
+
+void AppIdArena::deallocate(void* p, size_t n)
+{
+    if ( !p )
+        return;
+
+    // aligned sizes are never smaller than a free block
+    FreeBlock* b = (FreeBlock*)p;
+    b->size = align_up(n ? n : 1);
+    b->next = free_list;
+    free_list = b;
+}
+
+size_t AppIdArena::size() const
+{
+    size_t n = 0;
+
+    for ( const Chunk* c = chunks; c; c = c->next )
+        n += c->size;
+
+    return n;
+}
+
+void AppIdArena::release()
+{
+    free_list = nullptr;
+
+    while ( chunks )
+    {
+        Chunk* c = chunks;
+        chunks = c->next;
+        snort_free(c);
+    }
+}
+
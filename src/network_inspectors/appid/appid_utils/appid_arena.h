@@ -0,0 +1,89 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// appid_arena.h
+
+#ifndef APPID_ARENA_H
+#define APPID_ARENA_H
+
+// Bump allocator for short lived per session objects.  Memory is carved
+// from a short list of chunks and only goes back to the heap when the whole
+// arena is released.  Freed blocks are kept on a free list and reused by the
+// next request of the same aligned size, so an arena that is never emptied
+// grows only to the most it held at once.  An empty arena is two pointers.
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#define APPID_ARENA_CHUNK_SIZE 256
+
+class AppIdArena
+{
+public:
+    AppIdArena() = default;
+    ~AppIdArena()
+    { release(); }
+
+    AppIdArena(const AppIdArena&) = delete;
+    AppIdArena& operator=(const AppIdArena&) = delete;
+
+    void* allocate(size_t);
+    void deallocate(void*, size_t);
+
+    template<typename T, typename... Args>
+    T* create(Args&&... args)
+    { return new (allocate(sizeof(T))) T(std::forward<Args>(args)...); }
+
+    template<typename T>
+    void destroy(T* obj)
+    {
+        obj->~T();
+        deallocate(obj, sizeof(T));
+    }
+
+    // heap bytes held, including chunk headers
+    size_t size() const;
+
+    bool empty() const
+    { return chunks == nullptr; }
+
+    void release();
+
+private:
+    struct Chunk
+    {
+        Chunk* next;
+        uint32_t size;
+        uint32_t used;
+    };
+
+    // overlays a freed block
+    struct FreeBlock
+    {
+        FreeBlock* next;
+        size_t size;
+    };
+
+    Chunk* chunks = nullptr;
+    FreeBlock* free_list = nullptr;
+};
+
+#endif
+
@@ -0,0 +1,440 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// appid_arena_test.cc
+// arena and session flow data tests and a flow memory benchmark comparing
+// per session detector state kept in a hash map of heap nodes against a
+// list in an arena.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "catch/snort_catch.h"
+
+#include "appid_arena.h"
+#include "appid_inspector.h"
+#include "appid_module.h"
+#include "appid_session.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+struct Counted
+{
+    Counted(unsigned& n) : count(n)
+    { ++count; }
+
+    ~Counted()
+    { --count; }
+
+    unsigned& count;
+};
+
+TEST_CASE("appid arena allocate", "[appid_arena]")
+{
+    AppIdArena arena;
+    CHECK(arena.empty());
+    CHECK(arena.size() == 0);
+
+    std::vector<uint8_t*> blocks;
+
+    for ( unsigned i = 1; i <= 32; ++i )
+    {
+        uint8_t* p = (uint8_t*)arena.allocate(i);
+        CHECK(((uintptr_t)p % alignof(std::max_align_t)) == 0);
+        memset(p, i, i);
+        blocks.push_back(p);
+    }
+
+    // nothing written later overlaps an earlier block
+    for ( unsigned i = 1; i <= 32; ++i )
+        for ( unsigned j = 0; j < i; ++j )
+            CHECK(blocks[i - 1][j] == i);
+
+    CHECK(!arena.empty());
+    CHECK(arena.size() >= APPID_ARENA_CHUNK_SIZE);
+
+    arena.release();
+    CHECK(arena.empty());
+    CHECK(arena.size() == 0);
+}
+
+TEST_CASE("appid arena oversize", "[appid_arena]")
+{
+    AppIdArena arena;
+    arena.allocate(8);
+    size_t small = arena.size();
+
+    void* p = arena.allocate(4 * APPID_ARENA_CHUNK_SIZE);
+    memset(p, 0, 4 * APPID_ARENA_CHUNK_SIZE);
+    CHECK(arena.size() > small + 4 * APPID_ARENA_CHUNK_SIZE);
+}
+
+TEST_CASE("appid arena objects", "[appid_arena]")
+{
+    unsigned live = 0;
+    AppIdArena arena;
+
+    Counted* a = arena.create<Counted>(live);
+    Counted* b = arena.create<Counted>(live);
+    CHECK(live == 2);
+    CHECK(a != b);
+
+    arena.destroy(a);
+    arena.destroy(b);
+    CHECK(live == 0);
+}
+
+TEST_CASE("appid arena reuse", "[appid_arena]")
+{
+    AppIdArena arena;
+    void* keep = arena.allocate(24);
+    void* a = arena.allocate(24);
+    void* b = arena.allocate(48);
+    size_t held = arena.size();
+
+    // freed blocks go to the next request of the same aligned size
+    arena.deallocate(a, 24);
+    arena.deallocate(b, 48);
+    CHECK(arena.allocate(48) == b);
+    CHECK(arena.allocate(20) == a);
+    CHECK(arena.size() == held);
+
+    for ( unsigned i = 0; i < 1000; ++i )
+    {
+        void* p = arena.allocate(24);
+        memset(p, 0, 24);
+        arena.deallocate(p, 24);
+    }
+    CHECK(arena.size() == held);
+    CHECK(keep != a);
+
+    arena.release();
+    CHECK(arena.empty());
+
+    // nothing freed before the release is handed out again
+    void* c = arena.allocate(24);
+    memset(c, 0, 24);
+    CHECK(arena.size() == APPID_ARENA_CHUNK_SIZE);
+}
+
+//-------------------------------------------------------------------------
+// session flow data is allocated from the session's arena and freed through
+// the session; each free function counts into the data it is given
+
+#define TEST_SERVICE_STATE (APPID_SESSION_DATA_SERVICE_MODSTATE_BIT | 1)
+#define TEST_CLIENT_STATE (APPID_SESSION_DATA_CLIENT_MODSTATE_BIT | 2)
+#define TEST_DETECTOR_STATE (APPID_SESSION_DATA_DETECTOR_MODSTATE_BIT | 3)
+
+static void count_free(void* data)
+{ ++*(unsigned*)data; }
+
+// the flow data id is normally set when the inspector is first instantiated
+static void session_test_init()
+{
+    if ( !AppIdSession::inspector_id )
+        AppIdSession::init();
+}
+
+static unsigned flow_data_count(const AppIdSession& asd)
+{
+    unsigned n = 0;
+
+    for ( AppIdFlowData* fd = asd.flow_data; fd; fd = fd->next )
+        ++n;
+
+    return n;
+}
+
+TEST_CASE("appid session flow data", "[appid_arena]")
+{
+    session_test_init();
+
+    AppIdModule mod;
+    AppIdInspector inspector(mod);
+
+    snort::SfIp ip;
+    ip.set("10.1.1.1");
+
+    unsigned freed[4] = { };
+    {
+        AppIdSession asd(IpProtocol::TCP, &ip, 1066, inspector);
+
+        // no config to report stats to on delete
+        asd.in_expected_cache = true;
+
+        CHECK(asd.add_flow_data(&freed[0], TEST_SERVICE_STATE, count_free) == 0);
+        CHECK(asd.add_flow_data(&freed[1], TEST_CLIENT_STATE, count_free) == 0);
+        CHECK(asd.add_flow_data(&freed[2], TEST_DETECTOR_STATE, count_free) == 0);
+        CHECK(asd.add_flow_data(&freed[3], APPID_SESSION_DATA_DHCP_INFO, count_free) == 0);
+        CHECK(asd.add_flow_data(&freed[0], TEST_SERVICE_STATE, count_free) == -1);
+        CHECK(flow_data_count(asd) == 4);
+
+        CHECK(asd.get_flow_data(TEST_SERVICE_STATE) == &freed[0]);
+        CHECK(asd.get_flow_data(TEST_DETECTOR_STATE) == &freed[2]);
+        CHECK(asd.get_flow_data(APPID_SESSION_DATA_SMB_DATA) == nullptr);
+
+        // the caller owns removed data
+        CHECK(asd.remove_flow_data(APPID_SESSION_DATA_DHCP_INFO) == &freed[3]);
+        CHECK(asd.remove_flow_data(APPID_SESSION_DATA_DHCP_INFO) == nullptr);
+        CHECK(freed[3] == 0);
+
+        asd.free_flow_data_by_mask(APPID_SESSION_DATA_SERVICE_MODSTATE_BIT);
+        CHECK(freed[0] == 1);
+        CHECK(asd.get_flow_data(TEST_SERVICE_STATE) == nullptr);
+        CHECK(asd.get_flow_data(TEST_CLIENT_STATE) == &freed[1]);
+        CHECK(flow_data_count(asd) == 2);
+
+        asd.free_flow_data_by_id(TEST_CLIENT_STATE);
+        CHECK(freed[1] == 1);
+        CHECK(flow_data_count(asd) == 1);
+
+        // freeing the last node releases the arena
+        asd.free_flow_data_by_mask(0);
+        CHECK(freed[2] == 1);
+        CHECK(asd.flow_data == nullptr);
+
+        // and it is used again for the next state
+        CHECK(asd.add_flow_data(&freed[0], TEST_SERVICE_STATE, count_free) == 0);
+        CHECK(asd.add_flow_data(&freed[1], TEST_CLIENT_STATE, count_free) == 0);
+        CHECK(asd.get_flow_data(TEST_CLIENT_STATE) == &freed[1]);
+    }
+    // whatever is left is freed with the session
+    CHECK(freed[0] == 2);
+    CHECK(freed[1] == 2);
+    CHECK(freed[2] == 1);
+    CHECK(freed[3] == 0);
+}
+
+TEST_CASE("appid session free detector state", "[appid_arena]")
+{
+    session_test_init();
+
+    AppIdModule mod;
+    AppIdInspector inspector(mod);
+
+    snort::SfIp ip;
+    ip.set("10.1.1.1");
+
+    unsigned freed[5] = { };
+    {
+        AppIdSession asd(IpProtocol::UDP, &ip, 68, inspector);
+        asd.in_expected_cache = true;
+
+        // nothing held
+        asd.free_detector_state();
+        CHECK(asd.flow_data == nullptr);
+
+        asd.add_flow_data(&freed[0], TEST_SERVICE_STATE, count_free);
+        asd.add_flow_data(&freed[1], APPID_SESSION_DATA_DHCP_FP_DATA, count_free);
+        asd.add_flow_data(&freed[2], TEST_CLIENT_STATE, count_free);
+        asd.add_flow_data(&freed[3], APPID_SESSION_DATA_SMB_DATA, count_free);
+        asd.add_flow_data(&freed[4], TEST_DETECTOR_STATE, count_free);
+
+        // data left for the session api stays until it is taken
+        asd.free_detector_state();
+        CHECK(freed[0] == 1);
+        CHECK(freed[2] == 1);
+        CHECK(freed[4] == 1);
+        CHECK(flow_data_count(asd) == 2);
+
+        CHECK(asd.remove_flow_data(APPID_SESSION_DATA_SMB_DATA) == &freed[3]);
+        CHECK(asd.get_flow_data(APPID_SESSION_DATA_DHCP_FP_DATA) == &freed[1]);
+        CHECK(asd.remove_flow_data(APPID_SESSION_DATA_DHCP_FP_DATA) == &freed[1]);
+        CHECK(asd.flow_data == nullptr);
+        CHECK(freed[1] == 0);
+        CHECK(freed[3] == 0);
+
+        // detector state added after the arena was released
+        asd.add_flow_data(&freed[4], TEST_DETECTOR_STATE, count_free);
+        asd.free_detector_state();
+        CHECK(freed[4] == 2);
+        CHECK(asd.flow_data == nullptr);
+
+        asd.add_flow_data(&freed[1], APPID_SESSION_DATA_DHCP_FP_DATA, count_free);
+    }
+    CHECK(freed[1] == 1);
+}
+
+TEST_CASE("appid session flow data reuse", "[appid_arena]")
+{
+    session_test_init();
+
+    AppIdModule mod;
+    AppIdInspector inspector(mod);
+
+    snort::SfIp ip;
+    ip.set("10.1.1.1");
+
+    unsigned freed[3] = { };
+    {
+        AppIdSession asd(IpProtocol::UDP, &ip, 68, inspector);
+        asd.in_expected_cache = true;
+
+        // data kept for the session api holds the arena for the life of the flow
+        asd.add_flow_data(&freed[0], APPID_SESSION_DATA_DHCP_INFO, count_free);
+        asd.add_flow_data(&freed[1], TEST_SERVICE_STATE, count_free);
+        asd.add_flow_data(&freed[2], TEST_CLIENT_STATE, count_free);
+
+        AppIdFlowData* client = asd.flow_data;
+        AppIdFlowData* service = client->next;
+        unsigned reused = 0;
+
+        // the nodes freed with the detector state are the ones added next
+        for ( unsigned i = 0; i < 1000; ++i )
+        {
+            asd.free_detector_state();
+            asd.add_flow_data(&freed[1], TEST_SERVICE_STATE, count_free);
+            asd.add_flow_data(&freed[2], TEST_CLIENT_STATE, count_free);
+
+            AppIdFlowData* fd = asd.flow_data;
+
+            if ( (fd == client or fd == service) and
+                (fd->next == client or fd->next == service) )
+                ++reused;
+        }
+        CHECK(reused == 1000);
+        CHECK(flow_data_count(asd) == 3);
+        CHECK(freed[1] == 1000);
+        CHECK(freed[2] == 1000);
+    }
+    CHECK(freed[0] == 1);
+}
+
+#ifdef BENCHMARK_TEST
+//-------------------------------------------------------------------------
+// each flow holds a few detector states and each packet looks one of them
+// up; the map version is what AppIdSession used before the arena
+
+static const unsigned num_flows = 100000;
+static const unsigned states_per_flow = 3;
+static const unsigned lookups = 10000000;
+
+static void free_nothing(void*) { }
+
+struct MapFlow
+{
+    std::unordered_map<unsigned, AppIdFlowData*> flow_data;
+
+    ~MapFlow()
+    {
+        for ( auto& it : flow_data )
+            delete it.second;
+    }
+
+    void add(void* data, unsigned id)
+    { flow_data[id] = new AppIdFlowData(data, id, free_nothing); }
+
+    void* get(unsigned id)
+    {
+        auto it = flow_data.find(id);
+        return it != flow_data.end() ? it->second->fd_data : nullptr;
+    }
+
+    size_t bytes() const
+    {
+        // node is next pointer, cached hash and value
+        return sizeof(flow_data) + flow_data.bucket_count() * sizeof(void*) +
+            flow_data.size() * (3 * sizeof(void*) + sizeof(std::pair<unsigned, void*>) +
+            sizeof(AppIdFlowData));
+    }
+};
+
+struct ArenaFlow
+{
+    AppIdFlowData* flow_data = nullptr;
+    AppIdArena arena;
+
+    void add(void* data, unsigned id)
+    {
+        AppIdFlowData* fd = arena.create<AppIdFlowData>(data, id, free_nothing);
+        fd->next = flow_data;
+        flow_data = fd;
+    }
+
+    void* get(unsigned id)
+    {
+        for ( AppIdFlowData* fd = flow_data; fd; fd = fd->next )
+            if ( fd->fd_id == id )
+                return fd->fd_data;
+        return nullptr;
+    }
+
+    size_t bytes() const
+    { return sizeof(flow_data) + sizeof(arena) + arena.size(); }
+};
+
+template<typename Flow>
+static void run_flows(const char* name)
+{
+    std::vector<Flow*> flows;
+    size_t bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned f = 0; f < num_flows; ++f )
+    {
+        Flow* flow = new Flow;
+
+        for ( unsigned s = 0; s < states_per_flow; ++s )
+            flow->add(flow, s | APPID_SESSION_DATA_SERVICE_MODSTATE_BIT);
+
+        bytes += flow->bytes();
+        flows.push_back(flow);
+    }
+
+    std::chrono::duration<double> setup = std::chrono::steady_clock::now() - start;
+    unsigned found = 0;
+    start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < lookups; ++i )
+    {
+        // stride across flows so each lookup is a likely cache miss
+        Flow* flow = flows[(i * 2654435761u) % num_flows];
+
+        if ( flow->get((i % states_per_flow) | APPID_SESSION_DATA_SERVICE_MODSTATE_BIT) )
+            ++found;
+    }
+
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+
+    for ( auto flow : flows )
+        delete flow;
+
+    std::chrono::duration<double> teardown = std::chrono::steady_clock::now() - start;
+
+    printf("%-6s %zu bytes/flow, setup %.3fs, %.1f ns/lookup, teardown %.3fs\n", name,
+        bytes / num_flows, setup.count(), 1e9 * secs.count() / lookups, teardown.count());
+
+    CHECK(found == lookups);
+}
+
+TEST_CASE("appid flow memory", "[appid_arena]")
+{
+    printf("AppIdSession size_of %zu bytes\n", sizeof(AppIdSession));
+    run_flows<MapFlow>("map");
+    run_flows<ArenaFlow>("arena");
+}
+#endif
+
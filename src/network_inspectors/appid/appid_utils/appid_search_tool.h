@@ -0,0 +1,49 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// appid_search_tool.h
+
+#ifndef APPID_SEARCH_TOOL_H
+#define APPID_SEARCH_TOOL_H
+
+// All appid pattern sets (host, url, user agent, ssl, dns, port patterns
+// and the multi level matchers) are built with the search engine named
+// here.  It is set from appid.search_method before any detector is loaded;
+// any registered search engine plugin such as hyperscan may be used.  The
+// engines keep their own per packet thread state; hyperscan's scratch is
+// sized for every live database, including these, and cloned for each
+// thread in SnortConfig::post_setup() whenever a config is loaded.
+
+#include <string>
+
+#define APPID_DEFAULT_SEARCH_METHOD "ac_full"
+
+inline std::string& appid_search_method_name()
+{
+    static std::string method = APPID_DEFAULT_SEARCH_METHOD;
+    return method;
+}
+
+inline const char* appid_search_method()
+{ return appid_search_method_name().c_str(); }
+
+inline void set_appid_search_method(const char* method)
+{ appid_search_method_name() = method ? method : APPID_DEFAULT_SEARCH_METHOD; }
+
+#endif
+
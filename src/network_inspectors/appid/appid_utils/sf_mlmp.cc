@@ -25,14 +25,23 @@
 
 #include "sf_mlmp.h"
 
+#include <cctype>
+
 #include "search_engines/search_tool.h"
 #include "utils/util.h"
 
+#include "appid_search_tool.h"
+
+struct tPatternPrimaryNode;
+
 struct tPatternNode
 {
     tMlmpPattern pattern;
     void* userData;             /*client/service info */
 
+    /*primary node one level up whose next level matcher holds this node */
+    tPatternPrimaryNode* parent;
+
     /**part number. Should start from 1. Ordering of parts does not matter in the sense
      * part 1 may appear after part 2 in payload.*/
     uint32_t partNum;
@@ -73,6 +82,17 @@ struct tMatchedPatternList
     tMatchedPatternList* next;
 };
 
+/*Matches from one scan of a tree's matcher, split by the part of the input they fall in. */
+struct tMatchState
+{
+    tMatchedPatternList* matches;       /*this level, within the first part */
+    tMatchedPatternList* nextMatches;   /*next level, within the second part */
+    tMatchedPatternList* early;         /*next level, first seen before the second part */
+    uint32_t level;
+    size_t boundary;                    /*end of the first part */
+    size_t offset;                      /*of the scanned buffer from the first part */
+};
+
 static int compareMlmpPatterns(const void* p1, const void* p2);
 static int createTreesRecusively(tMlmpTree* root);
 static void destroyTreesRecursively(tMlmpTree* root);
@@ -86,6 +106,9 @@ static void* mlmpMatchPatternCustom(tMlmpTree* root, tMlmpPattern* inputPatternL
     tPatternNode* (*callback)(const tMatchedPatternList*, const uint8_t*));
 static int patternMatcherCallback(void* id, void* unused_tree, int match_end_pos, void* data,
     void* unused_neg);
+static void addMatchedPattern(tMatchedPatternList** matchList, tPatternNode* target,
+    size_t match_start_pos);
+static void freeMatchedPatterns(tMatchedPatternList* matchList);
 
 static uint32_t gPatternId = 1;
 
@@ -102,14 +125,10 @@ int mlmpAddPattern(tMlmpTree* root, const tMlmpPattern* inputPatternList, void*
     return addPatternRecursively(root, inputPatternList, metaData, 0);
 }
 
+/*on failure the tree is left for the caller to destroy */
 int mlmpProcessPatterns(tMlmpTree* root)
 {
-    int rvalue;
-
-    rvalue = createTreesRecusively(root);
-    if (rvalue)
-        destroyTreesRecursively(root);
-    return rvalue;
+    return createTreesRecusively(root);
 }
 
 void* mlmpMatchPatternUrl(tMlmpTree* root, tMlmpPattern* inputPatternList)
@@ -132,39 +151,144 @@ static inline bool match_is_domain_pattern(const tMatchedPatternList* mp, const
            payload[mp->match_start_pos-1] == '.';
 }
 
+static bool hasMatchedPattern(const tMatchedPatternList* matchList, const tPatternNode* target)
+{
+    for (; matchList; matchList = matchList->next)
+        if (matchList->patternNode == target)
+            return true;
+
+    return false;
+}
+
+/*patterns are added without case */
+static bool findPattern(const uint8_t* data, size_t size, const tMlmpPattern* pattern,
+    size_t* pos)
+{
+    for (size_t i = 0; i + pattern->patternSize <= size; i++)
+    {
+        size_t j = 0;
+
+        while (j < pattern->patternSize &&
+            toupper(data[i+j]) == toupper(pattern->pattern[j]))
+            j++;
+
+        if (j == pattern->patternSize)
+        {
+            *pos = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*the first two parts of the input are matched with one scan of the tree's matcher, which
+  holds this level and the next; the parts are scanned as one buffer when they are adjacent
+  as they are in a url. */
 static void* mlmpMatchPatternCustom(tMlmpTree* rootNode, tMlmpPattern* inputPatternList,
     tPatternNode* (*callback)(const tMatchedPatternList*, const uint8_t*))
 {
-    tMatchedPatternList* mp = nullptr;
+    tMatchState state = { };
     void* data = nullptr;
-    void* tmpData = nullptr;
     tPatternPrimaryNode* primaryNode;
     tMlmpPattern* pattern = inputPatternList;
+    tMlmpPattern* nextPattern;
 
-    if (!rootNode || !pattern || !pattern->pattern)
+    if (!rootNode || !rootNode->patternTree || !pattern || !pattern->pattern)
         return nullptr;
 
-    rootNode->patternTree->find_all((const char*)pattern->pattern, pattern->patternSize,
-        patternMatcherCallback, false, (void*)&mp);
+    nextPattern = pattern + 1;
+    if (!nextPattern->pattern)
+        nextPattern = nullptr;
 
-    primaryNode = (tPatternPrimaryNode*)callback(mp, pattern->pattern);
+    state.level = rootNode->level;
+    state.boundary = pattern->patternSize;
 
-    while (mp)
+    if (nextPattern && nextPattern->pattern == pattern->pattern + pattern->patternSize)
     {
-        tMatchedPatternList* tmpMp = mp;
-        mp = mp->next;
-        snort_free(tmpMp);
+        rootNode->patternTree->find_all((const char*)pattern->pattern,
+            pattern->patternSize + nextPattern->patternSize, patternMatcherCallback, false,
+            (void*)&state);
     }
+    else
+    {
+        rootNode->patternTree->find_all((const char*)pattern->pattern, pattern->patternSize,
+            patternMatcherCallback, false, (void*)&state);
+
+        if (nextPattern)
+        {
+            state.offset = pattern->patternSize;
+            rootNode->patternTree->find_all((const char*)nextPattern->pattern,
+                nextPattern->patternSize, patternMatcherCallback, false, (void*)&state);
+        }
+    }
+
+    primaryNode = (tPatternPrimaryNode*)callback(state.matches, pattern->pattern);
 
     if (primaryNode)
     {
         data = primaryNode->patternNode.userData;
-        tmpData = mlmpMatchPatternCustom(primaryNode->nextLevelMatcher, ++inputPatternList,
-            callback);
-        if (tmpData)
-            data = tmpData;
+
+        if (nextPattern && primaryNode->nextLevelMatcher)
+        {
+            tMatchedPatternList* own = nullptr;
+            tMatchedPatternList** tail = &own;
+            tMatchedPatternList* mp = state.nextMatches;
+
+            /*only the next level below the selected node applies */
+            state.nextMatches = nullptr;
+            while (mp)
+            {
+                tMatchedPatternList* tmpMp = mp;
+                mp = mp->next;
+                tmpMp->next = nullptr;
+
+                if (tmpMp->patternNode->parent == primaryNode)
+                {
+                    *tail = tmpMp;
+                    tail = &tmpMp->next;
+                }
+                else
+                    snort_free(tmpMp);
+            }
+
+            /*engines that report each pattern once may have reported these only where they
+              don't apply so they are looked for directly */
+            for (mp = state.early; mp; mp = mp->next)
+            {
+                tPatternNode* node = mp->patternNode;
+                size_t pos;
+
+                if (node->parent == primaryNode && !hasMatchedPattern(own, node) &&
+                    findPattern(nextPattern->pattern, nextPattern->patternSize,
+                    &node->pattern, &pos))
+                    addMatchedPattern(&own, node, pos);
+            }
+
+            tPatternPrimaryNode* nextNode = (tPatternPrimaryNode*)callback(own,
+                nextPattern->pattern);
+
+            freeMatchedPatterns(own);
+
+            if (nextNode)
+            {
+                void* tmpData = nextNode->patternNode.userData;
+
+                if (tmpData)
+                    data = tmpData;
+
+                tmpData = mlmpMatchPatternCustom(nextNode->nextLevelMatcher, nextPattern + 1,
+                    callback);
+
+                if (tmpData)
+                    data = tmpData;
+            }
+        }
     }
 
+    freeMatchedPatterns(state.matches);
+    freeMatchedPatterns(state.nextMatches);
+    freeMatchedPatterns(state.early);
+
     return data;
 }
 
@@ -194,34 +318,51 @@ static int compareMlmpPatterns(const void* p1, const void* p2)
     return ((int)pat1->patternSize - (int)pat2->patternSize);
 }
 
+static void addPatternNodes(snort::SearchTool* patternMatcher,
+    tPatternPrimaryNode* primaryNode, tPatternPrimaryNode* parent)
+{
+    for (tPatternNode* ddPatternNode = &primaryNode->patternNode;
+        ddPatternNode;
+        ddPatternNode = ddPatternNode->nextPattern)
+    {
+        ddPatternNode->parent = parent;
+        patternMatcher->add(ddPatternNode->pattern.pattern,
+            ddPatternNode->pattern.patternSize, ddPatternNode, true);
+    }
+}
+
 /*pattern trees are not freed on error because in case of error, caller should call
-   detroyTreesRecursively. */
+   detroyTreesRecursively.  each matcher holds its own level and the next one, whose trees
+   have no matcher of their own; the trees two levels down start over. */
 static int createTreesRecusively(tMlmpTree* rootNode)
 {
     snort::SearchTool* patternMatcher;
     tPatternPrimaryNode* primaryPatternNode;
-    tPatternNode* ddPatternNode;
 
     /* set up the MPSE for url patterns */
-    patternMatcher = rootNode->patternTree = new snort::SearchTool("ac_full", true);
+    patternMatcher = rootNode->patternTree = new snort::SearchTool(appid_search_method(), true);
 
     for (primaryPatternNode = rootNode->patternList;
         primaryPatternNode;
         primaryPatternNode = primaryPatternNode->nextPrimaryNode)
     {
-        /*recursion into next lower level */
-        if (primaryPatternNode->nextLevelMatcher)
-        {
-            if (createTreesRecusively(primaryPatternNode->nextLevelMatcher))
-                return -1;
-        }
+        addPatternNodes(patternMatcher, primaryPatternNode, nullptr);
 
-        for (ddPatternNode = &primaryPatternNode->patternNode;
-            ddPatternNode;
-            ddPatternNode = ddPatternNode->nextPattern)
+        if (!primaryPatternNode->nextLevelMatcher)
+            continue;
+
+        for (tPatternPrimaryNode* nextNode = primaryPatternNode->nextLevelMatcher->patternList;
+            nextNode;
+            nextNode = nextNode->nextPrimaryNode)
         {
-            patternMatcher->add(ddPatternNode->pattern.pattern,
-                ddPatternNode->pattern.patternSize, ddPatternNode, true);
+            addPatternNodes(patternMatcher, nextNode, primaryPatternNode);
+
+            /*recursion two levels down */
+            if (nextNode->nextLevelMatcher)
+            {
+                if (createTreesRecusively(nextNode->nextLevelMatcher))
+                    return -1;
+            }
         }
     }
 
@@ -339,10 +480,9 @@ static tPatternNode* genericPatternSelector(const tMatchedPatternList* patternMa
     return patternSelector (patternMatchList, payload, false);
 }
 
-static int patternMatcherCallback(void* id, void*, int match_end_pos, void* data, void*)
+static void addMatchedPattern(tMatchedPatternList** matchList, tPatternNode* target,
+    size_t match_start_pos)
 {
-    tPatternNode* target = (tPatternNode*)id;
-    tMatchedPatternList** matchList = (tMatchedPatternList**)data;
     tMatchedPatternList* prevNode;
     tMatchedPatternList* tmpList;
     tMatchedPatternList* newNode;
@@ -357,12 +497,12 @@ static int patternMatcherCallback(void* id, void*, int match_end_pos, void* data
         if (cmp > 0 )
             continue;
         if (cmp == 0)
-            return 0;
+            return;
         break;
     }
 
     newNode = (tMatchedPatternList*)snort_calloc(sizeof(tMatchedPatternList));
-    newNode->match_start_pos = match_end_pos - target->pattern.patternSize;
+    newNode->match_start_pos = match_start_pos;
     newNode->patternNode = target;
 
     if (prevNode == nullptr)
@@ -376,6 +516,35 @@ static int patternMatcherCallback(void* id, void*, int match_end_pos, void* data
         newNode->next = prevNode->next;
         prevNode->next = newNode;
     }
+}
+
+static void freeMatchedPatterns(tMatchedPatternList* matchList)
+{
+    while (matchList)
+    {
+        tMatchedPatternList* tmpMp = matchList;
+        matchList = matchList->next;
+        snort_free(tmpMp);
+    }
+}
+
+/*matches that cross from the first part into the second are dropped */
+static int patternMatcherCallback(void* id, void*, int match_end_pos, void* data, void*)
+{
+    tPatternNode* target = (tPatternNode*)id;
+    tMatchState* state = (tMatchState*)data;
+    size_t end = state->offset + match_end_pos;
+    size_t start = end - target->pattern.patternSize;
+
+    if (target->pattern.level == state->level)
+    {
+        if (end <= state->boundary)
+            addMatchedPattern(&state->matches, target, start);
+    }
+    else if (start >= state->boundary)
+        addMatchedPattern(&state->nextMatches, target, start - state->boundary);
+    else
+        addMatchedPattern(&state->early, target, 0);
 
     return 0;
 }
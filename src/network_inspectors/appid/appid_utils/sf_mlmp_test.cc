@@ -0,0 +1,346 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// sf_mlmp_test.cc
+// host / url matching with each available search engine and a url corpus
+// benchmark.  these are catch tests rather than part of sf_mlmp.cc because
+// the cpputest http pattern tests include that file.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "catch/snort_catch.h"
+#include "managers/mpse_manager.h"
+#include "utils/util.h"
+
+#include "appid_search_tool.h"
+#include "sf_mlmp.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace snort;
+
+struct UrlPattern
+{
+    std::string host;
+    std::string path;
+    unsigned id;
+};
+
+struct Url
+{
+    std::string host;
+    std::string path;
+};
+
+// hyperscan is left out since its scratch is only cloned for the packet
+// threads when snort loads a config
+static const char* const s_methods[] = { "ac_full", "ac_bnfa" };
+
+static bool have_method(const char* method)
+{
+    return MpseManager::get_search_api(method) != nullptr;
+}
+
+static tMlmpTree* build_tree(const char* method, std::vector<UrlPattern>& pats)
+{
+    set_appid_search_method(method);
+    tMlmpTree* tree = mlmpCreate();
+
+    for ( auto& p : pats )
+    {
+        // the tree owns the pattern strings
+        tMlmpPattern parts[3];
+        parts[0] = { (const uint8_t*)snort_strdup(p.host.c_str()), p.host.size(), 0 };
+        parts[1] = { (const uint8_t*)snort_strdup(p.path.c_str()), p.path.size(), 1 };
+        parts[2].pattern = nullptr;
+        mlmpAddPattern(tree, parts, &p.id);
+    }
+
+    if ( mlmpProcessPatterns(tree) )
+    {
+        mlmpDestroy(tree);
+        tree = nullptr;
+    }
+
+    set_appid_search_method(nullptr);
+    return tree;
+}
+
+static unsigned match_parts(
+    tMlmpTree* tree, const char* host, size_t host_len, const char* path, size_t path_len)
+{
+    tMlmpPattern parts[3];
+    parts[0] = { (const uint8_t*)host, host_len, 0 };
+    parts[1] = { (const uint8_t*)path, path_len, 1 };
+    parts[2].pattern = nullptr;
+
+    unsigned* id = (unsigned*)mlmpMatchPatternUrl(tree, parts);
+    return id ? *id : 0;
+}
+
+// host and path are separate buffers, as with a host header
+static unsigned match_url(tMlmpTree* tree, const Url& url)
+{
+    return match_parts(tree, url.host.c_str(), url.host.size(),
+        url.path.c_str(), url.path.size());
+}
+
+// host and path are adjacent, as when both are taken from the url; this is
+// matched with one scan
+static unsigned match_full_url(tMlmpTree* tree, const Url& url)
+{
+    std::string s = url.host + url.path;
+    const char* p = s.c_str();
+    return match_parts(tree, p, url.host.size(), p + url.host.size(), url.path.size());
+}
+
+//-------------------------------------------------------------------------
+// a synthetic corpus or one url (host/path) per line from APPID_URL_CORPUS
+
+static void make_patterns(unsigned num_hosts, std::vector<UrlPattern>& pats)
+{
+    static const char* const paths[] = { "/", "/video", "/api/v1", "/login" };
+    unsigned id = 0;
+
+    for ( unsigned h = 0; h < num_hosts; ++h )
+    {
+        std::string host = "s" + std::to_string(h) + ".example.com";
+
+        for ( auto p : paths )
+            pats.push_back({ host, p, ++id });
+    }
+}
+
+static void make_urls(unsigned num_hosts, unsigned num_urls, std::vector<Url>& urls)
+{
+    static const char* const subs[] = { "", "www.", "cdn.", "api." };
+    static const char* const paths[] =
+    { "/", "/video/watch?v=1", "/api/v1/items/42", "/login?next=/home", "/static/app.js" };
+
+    const char* corpus = getenv("APPID_URL_CORPUS");
+
+    if ( corpus )
+    {
+        std::ifstream in(corpus);
+        std::string line;
+
+        while ( std::getline(in, line) and urls.size() < num_urls )
+        {
+            size_t slash = line.find('/');
+
+            if ( slash == std::string::npos )
+                urls.push_back({ line, "/" });
+            else
+                urls.push_back({ line.substr(0, slash), line.substr(slash) });
+        }
+        if ( !urls.empty() )
+            return;
+    }
+
+    for ( unsigned i = 0; i < num_urls; ++i )
+    {
+        // one in four misses all hosts
+        unsigned h = (i * 2654435761u) % (num_hosts + num_hosts / 3);
+        std::string host = subs[i % 4];
+
+        if ( h < num_hosts )
+            host += "s" + std::to_string(h) + ".example.com";
+        else
+            host += "x" + std::to_string(h) + ".example.net";
+
+        urls.push_back({ host, paths[i % 5] });
+    }
+}
+
+//-------------------------------------------------------------------------
+
+TEST_CASE("appid url matching", "[appid_mlmp]")
+{
+    std::vector<UrlPattern> pats;
+    make_patterns(64, pats);
+
+    for ( auto method : s_methods )
+    {
+        if ( !have_method(method) )
+            continue;
+
+        INFO(method);
+        tMlmpTree* tree = build_tree(method, pats);
+        REQUIRE(tree != nullptr);
+
+        for ( auto match : { match_url, match_full_url } )
+        {
+            // pattern ids are 4 per host in paths order
+            CHECK(match(tree, { "s7.example.com", "/" }) == 29);
+            CHECK(match(tree, { "www.s7.example.com", "/video/watch" }) == 30);
+            CHECK(match(tree, { "cdn.s17.example.com", "/x/api/v1/y" }) == 71);
+            CHECK(match(tree, { "s63.example.com", "/login" }) == 256);
+
+            // host patterns only match on a label boundary
+            CHECK(match(tree, { "xs7.example.com", "/" }) == 0);
+            CHECK(match(tree, { "s7.example.net", "/" }) == 0);
+
+            // the longest path wins
+            CHECK(match(tree, { "s1.example.com", "/api/v1/login" }) == 7);
+        }
+
+        mlmpDestroy(tree);
+    }
+}
+
+TEST_CASE("appid url matching parts", "[appid_mlmp]")
+{
+    std::vector<UrlPattern> pats =
+    {
+        { "video.example.com", "/", 1 },
+        { "video.example.com", "video", 2 },
+        { "example.org", "/", 3 },
+        { "example.org", "/api", 4 },
+    };
+
+    for ( auto method : s_methods )
+    {
+        if ( !have_method(method) )
+            continue;
+
+        INFO(method);
+        tMlmpTree* tree = build_tree(method, pats);
+        REQUIRE(tree != nullptr);
+
+        for ( auto match : { match_url, match_full_url } )
+        {
+            // a path pattern is matched in the path even when it is first seen in the host
+            CHECK(match(tree, { "video.example.com", "/video/1" }) == 2);
+            CHECK(match(tree, { "video.example.com", "/watch" }) == 1);
+
+            // a host pattern seen only in the path doesn't match
+            CHECK(match(tree, { "x.example.net", "/example.org/api" }) == 0);
+
+            // nor does a path pattern for another host
+            CHECK(match(tree, { "example.org", "/video" }) == 3);
+
+            // or one that starts in the host
+            CHECK(match(tree, { "x.example.org/a", "pi/" }) == 3);
+            CHECK(match(tree, { "x.example.org/a", "pi/api" }) == 4);
+        }
+
+        mlmpDestroy(tree);
+    }
+}
+
+TEST_CASE("appid url matching engines agree", "[appid_mlmp]")
+{
+    std::vector<UrlPattern> pats;
+    std::vector<Url> urls;
+    make_patterns(1000, pats);
+    make_urls(1000, 20000, urls);
+
+    tMlmpTree* ref = build_tree("ac_full", pats);
+    REQUIRE(ref != nullptr);
+
+    std::vector<unsigned> expected;
+    unsigned adjacent = 0;
+
+    for ( auto& url : urls )
+    {
+        expected.push_back(match_url(ref, url));
+
+        if ( match_full_url(ref, url) != expected.back() )
+            ++adjacent;
+    }
+
+    CHECK(adjacent == 0);
+
+    mlmpDestroy(ref);
+
+    for ( auto method : s_methods )
+    {
+        if ( !have_method(method) )
+            continue;
+
+        INFO(method);
+        tMlmpTree* tree = build_tree(method, pats);
+        REQUIRE(tree != nullptr);
+
+        unsigned mismatches = 0;
+
+        for ( unsigned i = 0; i < urls.size(); ++i )
+            if ( match_full_url(tree, urls[i]) != expected[i] )
+                ++mismatches;
+
+        CHECK(mismatches == 0);
+        mlmpDestroy(tree);
+    }
+}
+
+#ifdef BENCHMARK_TEST
+// url lookups per second for each engine over the same tree of 10K hosts;
+// set APPID_URL_CORPUS to a file of urls to replay real traffic
+TEST_CASE("appid url corpus", "[appid_mlmp]")
+{
+    const unsigned num_hosts = 10000;
+    const unsigned num_urls = 200000;
+
+    std::vector<UrlPattern> pats;
+    std::vector<Url> urls;
+    make_patterns(num_hosts, pats);
+    make_urls(num_hosts, num_urls, urls);
+
+    std::vector<std::string> full_urls;
+
+    for ( auto& url : urls )
+        full_urls.push_back(url.host + url.path);
+
+    for ( auto method : s_methods )
+    {
+        if ( !have_method(method) )
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        tMlmpTree* tree = build_tree(method, pats);
+        std::chrono::duration<double> build = std::chrono::steady_clock::now() - start;
+        REQUIRE(tree != nullptr);
+
+        unsigned hits = 0;
+        start = std::chrono::steady_clock::now();
+
+        for ( unsigned i = 0; i < urls.size(); ++i )
+        {
+            const char* p = full_urls[i].c_str();
+            size_t host_len = urls[i].host.size();
+
+            if ( match_parts(tree, p, host_len, p + host_len, urls[i].path.size()) )
+                ++hits;
+        }
+
+        std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+
+        printf("%-10s build %.2fs, %.0f urls/sec, %u of %zu matched\n", method,
+            build.count(), urls.size() / secs.count(), hits, urls.size());
+
+        mlmpDestroy(tree);
+    }
+}
+#endif
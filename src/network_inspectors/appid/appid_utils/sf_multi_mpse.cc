@@ -28,6 +28,8 @@
 #include "search_engines/search_tool.h"
 #include "utils/util.h"
 
+#include "appid_search_tool.h"
+
 struct tPatternRootNode;
 struct tPatternList
 {
@@ -184,7 +186,7 @@ static int createTreesRecusively(void* root)
     tPatternList* patternNode;
 
     /* set up the MPSE for url patterns */
-    if (!(patternMatcher = rootNode->patternTree = new snort::SearchTool("ac_full", true)))
+    if (!(patternMatcher = rootNode->patternTree = new snort::SearchTool(appid_search_method(), true)))
         return -1;
 
     for (patternNode = rootNode->patternList;
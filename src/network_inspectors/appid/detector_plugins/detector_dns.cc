@@ -27,6 +27,7 @@
 
 #include "appid_config.h"
 #include "appid_dns_session.h"
+#include "appid_utils/appid_search_tool.h"
 #include "app_info_table.h"
 #include "application_ids.h"
 
@@ -184,7 +185,7 @@ static int dns_host_detector_create_matcher(DetectorDNSHostPattern* list)
     if (serviceDnsConfig.dns_host_host_matcher)
         delete serviceDnsConfig.dns_host_host_matcher;
 
-    serviceDnsConfig.dns_host_host_matcher = new snort::SearchTool("ac_full", true);
+    serviceDnsConfig.dns_host_host_matcher = new snort::SearchTool(appid_search_method(), true);
     if (!serviceDnsConfig.dns_host_host_matcher)
         return 0;
 
@@ -28,6 +28,7 @@
 #include <array>
 
 #include "app_info_table.h"
+#include "appid_utils/appid_search_tool.h"
 #include "search_engines/search_tool.h"
 #include "utils/util.h"
 
@@ -516,7 +517,7 @@ ImapClientDetector::~ImapClientDetector()
 
 void ImapClientDetector::do_custom_init()
 {
-    cmd_matcher = new snort::SearchTool("ac_full", true);
+    cmd_matcher = new snort::SearchTool(appid_search_method(), true);
 
     if ( !tcp_patterns.empty() )
     {
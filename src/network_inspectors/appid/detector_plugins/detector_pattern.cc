@@ -26,6 +26,7 @@
 #include "detector_pattern.h"
 
 #include "app_info_table.h"
+#include "appid_utils/appid_search_tool.h"
 #include "log/messages.h"
 #include "protocols/packet.h"
 #include "search_engines/search_tool.h"
@@ -123,7 +124,7 @@ static void register_pattern(snort::SearchTool** patterns, Pattern* pattern)
 {
     if (!*patterns)
     {
-        *patterns = new snort::SearchTool("ac_full", true);
+        *patterns = new snort::SearchTool(appid_search_method(), true);
         if (!*patterns)
         {
             snort::ErrorMessage("Error initializing the pattern table\n");
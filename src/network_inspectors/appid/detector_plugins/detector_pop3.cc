@@ -28,6 +28,7 @@
 #include <array>
 
 #include "app_info_table.h"
+#include "appid_utils/appid_search_tool.h"
 
 using namespace snort;
 
@@ -211,7 +212,7 @@ Pop3ClientDetector::~Pop3ClientDetector()
 
 void Pop3ClientDetector::do_custom_init()
 {
-    cmd_matcher = new snort::SearchTool("ac_full", true);
+    cmd_matcher = new snort::SearchTool(appid_search_method(), true);
 
     if ( !tcp_patterns.empty() )
     {
@@ -677,7 +677,7 @@ int HttpPatternMatchers::process_host_patterns(DetectorHTTPPatterns patterns)
 int HttpPatternMatchers::process_chp_list(CHPListElement* chplist)
 {
     for (size_t i = 0; i < NUM_HTTP_FIELDS; i++)
-        chp_matchers[i] = new snort::SearchTool("ac_full", true);
+        chp_matchers[i] = new snort::SearchTool(appid_search_method(), true);
 
     for (CHPListElement* chpe = chplist; chpe; chpe = chpe->next)
         chp_matchers[chpe->chp_action.ptype]->add(chpe->chp_action.pattern,
@@ -720,7 +720,7 @@ static FieldPattern http_field_patterns[] =
 static snort::SearchTool* process_http_field_patterns(FieldPattern* patternList,
     size_t patternListCount)
 {
-    snort::SearchTool* patternMatcher = new snort::SearchTool("ac_full", true);
+    snort::SearchTool* patternMatcher = new snort::SearchTool(appid_search_method(), true);
 
     for (size_t i=0; i < patternListCount; i++)
         patternMatcher->add( (const char*)patternList[i].data, patternList[i].length,
@@ -1572,7 +1572,6 @@ bool HttpPatternMatchers::get_appid_from_url(char* host, const char* url, char**
     const char* referer, AppId* ClientAppId, AppId* serviceAppId, AppId* payloadAppId,
     AppId* referredPayloadAppId, bool from_rtmp)
 {
-    char* temp_host = nullptr;
     tMlmpPattern patterns[3];
     bool payload_found = false;
     tMlmpTree* matcher = from_rtmp ? rtmp_host_url_matcher : host_url_matcher;
@@ -1597,25 +1596,14 @@ bool HttpPatternMatchers::get_appid_from_url(char* host, const char* url, char**
         url_len = strlen(url);
     }
 
+    // without a host field the host is the front of the url so the host and path are
+    // adjacent and matched with one scan
     int host_len;
     if (!host)
     {
-        host = (char*)strchr(url, '/');
-        if (host != nullptr)
-            host_len = host - url;
-        else
-            host_len = url_len;
-        if (host_len > 0)
-        {
-            temp_host = snort_strndup(url, host_len);
-            if (!temp_host)
-            {
-                host_len = 0;
-                host = nullptr;
-            }
-            else
-                host = temp_host;
-        }
+        const char* slash = strchr(url, '/');
+        host_len = slash ? slash - url : url_len;
+        host = (char*)url;
     }
     else
         host_len = strlen(host);
@@ -1625,10 +1613,7 @@ bool HttpPatternMatchers::get_appid_from_url(char* host, const char* url, char**
     if (url_len)
     {
         if (url_len < host_len)
-        {
-            snort_free(temp_host);
             return false;
-        }
         path_len = url_len - host_len;
         path = url + host_len;
     }
@@ -1666,8 +1651,6 @@ bool HttpPatternMatchers::get_appid_from_url(char* host, const char* url, char**
         *payloadAppId = data->payload_id;
     }
 
-    snort_free(temp_host);
-
     /* if referred_id feature id disabled, referer will be null */
     if ( referer and (referer[0] != '\0') and (!payload_found or
         AppInfoManager::get_instance().get_app_info_flags(data->payload_id,
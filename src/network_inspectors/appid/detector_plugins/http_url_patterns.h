@@ -31,6 +31,7 @@
 #include "utils/util.h"
 
 #include "appid_http_session.h"
+#include "appid_utils/appid_search_tool.h"
 #include "appid_utils/sf_mlmp.h"
 #include "appid_utils/sf_multi_mpse.h"
 #include "application_ids.h"
@@ -282,8 +283,10 @@ class HttpPatternMatchers
 {
 public:
     HttpPatternMatchers()
-        : url_matcher("ac_full", true), client_agent_matcher("ac_full", true), via_matcher("ac_full", true),
-          content_type_matcher("ac_full", true)
+        : url_matcher(appid_search_method(), true),
+          client_agent_matcher(appid_search_method(), true),
+          via_matcher(appid_search_method(), true),
+          content_type_matcher(appid_search_method(), true)
     { }
     ~HttpPatternMatchers();
 
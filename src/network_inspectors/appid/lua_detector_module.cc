@@ -29,13 +29,17 @@
 #include <libgen.h>
 
 #include <cassert>
+#include <cinttypes>
 #include <fstream>
+#include <vector>
 
 #include "appid_config.h"
 #include "lua_detector_util.h"
 #include "lua_detector_api.h"
 #include "lua_detector_flow_api.h"
 #include "detector_plugins/detector_http.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
 #include "utils/util.h"
 #include "utils/sflsq.h"
 #include "log/messages.h"
@@ -51,6 +55,31 @@ using namespace std;
 THREAD_LOCAL LuaDetectorManager* lua_detector_mgr = nullptr;
 static THREAD_LOCAL SF_LIST allocated_detector_flow_list;
 
+// With share_lua_detectors the control thread finds and compiles each
+// detector once and keeps the bytecode here; packet threads load their
+// states from it instead of reading and parsing every file again.  Each
+// lua_State still runs the detector and its DetectorInit since states can't
+// be shared, but the port and pattern registrations made from DetectorInit
+// are only processed by the control thread so those tables are already
+// shared.  This is written before the packet threads start and only read
+// after that.
+struct LuaDetectorCode
+{
+    std::string name;
+    std::string file_name;
+    std::string code;
+    bool is_custom;
+};
+
+static std::vector<LuaDetectorCode> detector_code;
+static size_t detector_code_size = 0;
+
+static int dump_detector(lua_State*, const void* p, size_t sz, void* ud)
+{
+    ((std::string*)ud)->append((const char*)p, sz);
+    return 0;
+}
+
 bool get_lua_field(lua_State* L, int table, const char* field, std::string& out)
 {
     lua_getfield(L, table, field);
@@ -205,6 +234,9 @@ void LuaDetectorManager::initialize(AppIdConfig& config, int is_control)
     if (lua_detector_mgr)
         return;
 
+    Stopwatch<SnortClock> sw;
+    sw.start();
+
     lua_detector_mgr = new LuaDetectorManager(config, is_control);
 
     if (!lua_detector_mgr->L)
@@ -213,6 +245,7 @@ void LuaDetectorManager::initialize(AppIdConfig& config, int is_control)
 
     lua_detector_mgr->initialize_lua_detectors();
     lua_detector_mgr->activate_lua_detectors();
+    lua_detector_mgr->init_usecs = clock_usecs(TO_USECS(sw.get()));
 
     if (config.mod_config->debug)
         lua_detector_mgr->list_lua_detectors();
@@ -390,6 +423,33 @@ void LuaDetectorManager::load_detector(char* detector_filename, bool isCustom)
         (isCustom ? "custom" : "odp"), basename(detector_filename));
 #endif
 
+    if (init(L) and config.mod_config->share_lua_detectors)
+    {
+        LuaDetectorCode dc { detectorName, detector_filename, "", isCustom };
+
+        if (!lua_dump(L, dump_detector, &dc.code))
+        {
+            detector_code_size += dc.code.size();
+            detector_code.emplace_back(std::move(dc));
+        }
+    }
+
+    run_detector(detectorName, detector_filename, isCustom);
+}
+
+void LuaDetectorManager::load_detector(const LuaDetectorCode& dc)
+{
+    // the bytecode was loaded by the control thread so this doesn't fail
+    if (luaL_loadbuffer(L, dc.code.data(), dc.code.size(), dc.file_name.c_str()))
+        return;
+
+    run_detector(dc.name.c_str(), dc.file_name.c_str(), dc.is_custom);
+}
+
+// the loaded chunk is at the top of the stack
+void LuaDetectorManager::run_detector(const char* detectorName, const char* detector_filename,
+    bool isCustom)
+{
     // create a new function environment and store it in the registry
     lua_newtable(L); // create _ENV tables
     lua_newtable(L); // create metatable
@@ -444,6 +504,19 @@ void LuaDetectorManager::initialize_lua_detectors()
     if ( !dir )
         return;
 
+    if ( !init(L) and !detector_code.empty() )
+    {
+        // odp detectors were compiled first
+        for ( auto& dc : detector_code )
+        {
+            load_detector(dc);
+
+            if ( !dc.is_custom )
+                num_odp_detectors = allocated_objects.size();
+        }
+        return;
+    }
+
     snprintf(path, sizeof(path), "%s/odp/lua", dir);
     load_lua_detectors(path, false);
     num_odp_detectors = allocated_objects.size();
@@ -502,7 +575,11 @@ void LuaDetectorManager::activate_lua_detectors()
 void LuaDetectorManager::list_lua_detectors()
 {
     LogMessage("AppId Lua-Detector Stats: instance %u, odp detectors %zu, custom detectors %zu,"
-        " total memory %d kb\n", get_instance_id(), num_odp_detectors,
-        (allocated_objects.size() - num_odp_detectors), lua_gc(L, LUA_GCCOUNT, 0));
+        " total memory %d kb, startup %" PRIu64 " usecs\n", get_instance_id(), num_odp_detectors,
+        (allocated_objects.size() - num_odp_detectors), lua_gc(L, LUA_GCCOUNT, 0), init_usecs);
+
+    if (init(L) and !detector_code.empty())
+        LogMessage("AppId Lua-Detector Stats: %zu detectors shared, bytecode %zu kb\n",
+            detector_code.size(), detector_code_size / 1024);
 }
 
@@ -36,6 +36,7 @@ class AppIdConfig;
 class AppIdDetector;
 struct DetectorFlow;
 class LuaObject;
+struct LuaDetectorCode;
 
 bool get_lua_field(lua_State* L, int table, const char* field, std::string& out);
 bool get_lua_field(lua_State* L, int table, const char* field, int& out);
@@ -58,11 +59,14 @@ private:
     void activate_lua_detectors();
     void list_lua_detectors();
     void load_detector(char* detectorName, bool isCustom);
+    void load_detector(const LuaDetectorCode&);
+    void run_detector(const char* detector_name, const char* detector_filename, bool is_custom);
     void load_lua_detectors(const char* path, bool isCustom);
 
     AppIdConfig& config;
     std::list<LuaObject*> allocated_objects;
     size_t num_odp_detectors = 0;
+    uint64_t init_usecs = 0;
 };
 
 extern THREAD_LOCAL LuaDetectorManager* lua_detector_mgr;
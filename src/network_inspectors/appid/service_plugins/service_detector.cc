@@ -128,6 +128,8 @@ int ServiceDetector::update_service_data(AppIdSession& asd, const Packet* pkt, A
     asd.service_port = port;
     ServiceDiscoveryState* sds = AppIdServiceState::add(ip, asd.protocol, port, asd.is_decrypted());
     sds->set_service_id_valid(this);
+    AppIdServiceVerdicts::confirm(ip, asd.protocol, port, asd.is_decrypted(), this,
+        asd.service_validates);
 
     return APPID_SUCCESS;
 }
@@ -418,6 +418,7 @@ int ServiceDiscovery::identify_service(AppIdSession& asd, Packet* p,
     AppidSessionDirection dir, AppidChangeBits& change_bits)
 {
     ServiceDiscoveryState* sds = nullptr;
+    ServiceDetector* cached_service = nullptr;
     bool got_brute_force = false;
     const SfIp* ip;
     uint16_t port;
@@ -472,6 +473,22 @@ int ServiceDiscovery::identify_service(AppIdSession& asd, Packet* p,
                 asd.service_detector = sds->select_detector_by_brute_force(proto);
                 got_brute_force = true;
             }
+            /* If another thread has identified this server, try its detector first. */
+            else if ( sds_state == SERVICE_ID_STATE::SEARCHING_PORT_PATTERN )
+            {
+                unsigned walk_cost = 0;
+                cached_service = AppIdServiceVerdicts::get(ip, proto, port,
+                    asd.is_decrypted(), walk_cost);
+
+                if ( cached_service )
+                {
+                    appid_stats.service_cache_hits++;
+                    if ( walk_cost > 1 )
+                        appid_stats.service_validates_saved += walk_cost - 1;
+                }
+                else
+                    appid_stats.service_cache_misses++;
+            }
         }
     }
 
@@ -479,22 +496,64 @@ int ServiceDiscovery::identify_service(AppIdSession& asd, Packet* p,
     bool got_incompatible_service = false;
     bool got_fail_service = false;
     AppIdDiscoveryArgs args(p->data, p->dsize, dir, asd, p, change_bits);
+
+    /* A cached verdict is validated as the only candidate so that if it is
+     * wrong the detector's failure is deferred like any candidate's, the
+     * verdict is dropped, and the port/pattern search below runs as if
+     * there had been no verdict. */
+    if ( cached_service )
+    {
+        asd.service_candidates.emplace_back(cached_service);
+        ret = cached_service->validate(args);
+        asd.service_candidates.clear();
+        asd.service_validates++;
+        appid_stats.service_validates++;
+
+        if (appidDebug->is_active())
+            LogMessage("AppIdDbg %s %s cached service detector returned %s (%d)\n",
+                appidDebug->get_debug_session(), cached_service->get_log_name().c_str(),
+                cached_service->get_code_string((APPID_STATUS_CODE)ret), ret);
+
+        if ( ret == APPID_NOMATCH or ret == APPID_NOT_COMPATIBLE )
+        {
+            if ( AppIdServiceVerdicts::invalidate(ip, proto, port, asd.is_decrypted(),
+                cached_service) )
+                appid_stats.service_cache_invalidations++;
+
+            asd.service_detector = nullptr;
+            ret = APPID_NOMATCH;
+        }
+        else
+        {
+            asd.service_detector = cached_service;
+            asd.service_search_state = SESSION_SERVICE_SEARCH_STATE::PENDING;
+        }
+    }
     /* If we already have a service to try, then try it out. */
-    if ( asd.service_detector )
+    else if ( asd.service_detector )
     {
         ret = asd.service_detector->validate(args);
+        asd.service_validates++;
+        appid_stats.service_validates++;
+
         if (ret == APPID_NOMATCH)
             got_fail_service = true;
         else if (ret == APPID_NOT_COMPATIBLE)
             got_incompatible_service = true;
+
+        if ( ( got_fail_service or got_incompatible_service ) and
+            AppIdServiceVerdicts::invalidate(ip, proto, port, asd.is_decrypted(),
+                asd.service_detector) )
+            appid_stats.service_cache_invalidations++;
         asd.service_search_state = SESSION_SERVICE_SEARCH_STATE::PENDING;
         if (appidDebug->is_active())
             LogMessage("AppIdDbg %s %s service detector returned %s (%d)\n",
                 appidDebug->get_debug_session(), asd.service_detector->get_log_name().c_str(),
                 asd.service_detector->get_code_string((APPID_STATUS_CODE)ret), ret);
     }
+
     /* Try to find detectors based on ports and patterns. */
-    else if (!got_brute_force)
+    if ( !asd.service_detector and !got_brute_force )
     {
         /* See if we've got more detector(s) to add to the candidate list. */
         if ( ( asd.service_search_state == SESSION_SERVICE_SEARCH_STATE::PORT )
@@ -513,6 +572,9 @@ int ServiceDiscovery::identify_service(AppIdSession& asd, Packet* p,
             int result;
 
             result = service->validate(args);
+            asd.service_validates++;
+            appid_stats.service_validates++;
+
             if ( appidDebug->is_active() )
                 LogMessage("AppIdDbg %s %s service candidate returned %s (%d)\n",
                     appidDebug->get_debug_session(), service->get_log_name().c_str(),
@@ -27,6 +27,7 @@
 
 #include "app_info_table.h"
 #include "appid_module.h"
+#include "appid_utils/appid_search_tool.h"
 #include "protocols/packet.h"
 #include "search_engines/search_tool.h"
 
@@ -107,7 +108,7 @@ MdnsServiceDetector::MdnsServiceDetector(ServiceDiscovery* sd)
         { 5353, IpProtocol::UDP, false },
     };
 
-    matcher = new snort::SearchTool("ac_full", true);
+    matcher = new snort::SearchTool(appid_search_method(), true);
     for (unsigned i = 0; i < sizeof(patterns) / sizeof(*patterns); i++)
         matcher->add((const char*)patterns[i].pattern, patterns[i].length, &patterns[i]);
     matcher->prep();
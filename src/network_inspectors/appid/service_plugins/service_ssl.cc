@@ -28,6 +28,7 @@
 #include <openssl/x509.h>
 
 #include "app_info_table.h"
+#include "appid_utils/appid_search_tool.h"
 #include "protocols/packet.h"
 
 using namespace snort;
@@ -238,7 +239,7 @@ static int ssl_detector_create_matcher(SearchTool** matcher, DetectorSSLCertPatt
     if (*matcher)
         delete *matcher;
 
-    if (!(*matcher = new SearchTool("ac_full", true)))
+    if (!(*matcher = new SearchTool(appid_search_method(), true)))
         return 0;
 
     patternIndex = &size;
@@ -27,6 +27,9 @@
 
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "log/messages.h"
 #include "sfip/sf_ip.h"
@@ -248,6 +251,155 @@ void AppIdServiceState::check_reset(AppIdSession& asd, const SfIp* ip, uint16_t
     }
 }
 
+//-------------------------------------------------------------------------
+// shared service verdicts
+//-------------------------------------------------------------------------
+
+#define VERDICT_SHARDS          64
+#define VERDICT_MIN_CONFIDENCE  2     // confirmations before other threads use it
+#define VERDICT_MAX_CONFIDENCE  8
+#define VERDICT_AGE_SECS        300   // idle time that costs one confirmation
+
+struct ServiceVerdict
+{
+    ServiceDetector* service;
+    unsigned confidence;
+    unsigned walk_cost;               // validate() calls it took to find
+    time_t last_seen;
+    std::list<AppIdServiceStateKey>::iterator lru;
+};
+
+struct ServiceVerdictKeyHash
+{
+    size_t operator()(const AppIdServiceStateKey& k) const
+    { return k.hash(); }
+};
+
+struct ServiceVerdictShard
+{
+    std::mutex lock;
+    std::unordered_map<AppIdServiceStateKey, ServiceVerdict, ServiceVerdictKeyHash> map;
+    std::list<AppIdServiceStateKey> lru;    // most recently confirmed first
+};
+
+static std::unique_ptr<ServiceVerdictShard[]> verdict_shards;
+static size_t verdict_shard_max = 0;
+
+static inline ServiceVerdictShard& get_shard(const AppIdServiceStateKey& key)
+{ return verdict_shards[(key.hash() >> 32) % VERDICT_SHARDS]; }
+
+static inline unsigned aged_confidence(const ServiceVerdict& v)
+{
+    unsigned age = (packet_time() - v.last_seen) / VERDICT_AGE_SECS;
+    return age < v.confidence ? v.confidence - age : 0;
+}
+
+void AppIdServiceVerdicts::initialize(size_t max_entries)
+{
+    verdict_shards.reset(max_entries ? new ServiceVerdictShard[VERDICT_SHARDS] : nullptr);
+    verdict_shard_max = (max_entries + VERDICT_SHARDS - 1) / VERDICT_SHARDS;
+}
+
+ServiceDetector* AppIdServiceVerdicts::get(const SfIp* ip, IpProtocol proto, uint16_t port,
+    bool decrypted, unsigned& walk_cost)
+{
+    if ( !verdict_shards )
+        return nullptr;
+
+    AppIdServiceStateKey key(ip, proto, port, decrypted);
+    ServiceVerdictShard& shard = get_shard(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto it = shard.map.find(key);
+
+    if ( it == shard.map.end() )
+        return nullptr;
+
+    unsigned confidence = aged_confidence(it->second);
+
+    if ( !confidence )
+    {
+        shard.lru.erase(it->second.lru);
+        shard.map.erase(it);
+        return nullptr;
+    }
+
+    if ( confidence < VERDICT_MIN_CONFIDENCE )
+        return nullptr;
+
+    walk_cost = it->second.walk_cost;
+    return it->second.service;
+}
+
+void AppIdServiceVerdicts::confirm(const SfIp* ip, IpProtocol proto, uint16_t port,
+    bool decrypted, ServiceDetector* service, unsigned walk_cost)
+{
+    if ( !verdict_shards )
+        return;
+
+    AppIdServiceStateKey key(ip, proto, port, decrypted);
+    ServiceVerdictShard& shard = get_shard(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto it = shard.map.find(key);
+
+    if ( it != shard.map.end() )
+    {
+        ServiceVerdict& v = it->second;
+
+        if ( v.service == service )
+        {
+            v.confidence = aged_confidence(v) + 1;
+
+            if ( v.confidence > VERDICT_MAX_CONFIDENCE )
+                v.confidence = VERDICT_MAX_CONFIDENCE;
+
+            // sessions started from the verdict only cost one validate()
+            if ( walk_cost > v.walk_cost )
+                v.walk_cost = walk_cost;
+        }
+        else
+        {
+            v.service = service;
+            v.confidence = 1;
+            v.walk_cost = walk_cost;
+        }
+        v.last_seen = packet_time();
+        shard.lru.splice(shard.lru.begin(), shard.lru, v.lru);
+        return;
+    }
+
+    if ( shard.map.size() >= verdict_shard_max )
+    {
+        shard.map.erase(shard.lru.back());
+        shard.lru.pop_back();
+    }
+
+    shard.lru.emplace_front(key);
+    shard.map.emplace(key,
+        ServiceVerdict { service, 1, walk_cost, packet_time(), shard.lru.begin() });
+}
+
+bool AppIdServiceVerdicts::invalidate(const SfIp* ip, IpProtocol proto, uint16_t port,
+    bool decrypted, ServiceDetector* service)
+{
+    if ( !verdict_shards )
+        return false;
+
+    AppIdServiceStateKey key(ip, proto, port, decrypted);
+    ServiceVerdictShard& shard = get_shard(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto it = shard.map.find(key);
+
+    if ( it == shard.map.end() or it->second.service != service )
+        return false;
+
+    shard.lru.erase(it->second.lru);
+    shard.map.erase(it);
+    return true;
+}
+
 void AppIdServiceState::dump_stats()
 {
     // FIXIT-L - do we need to keep ipv4 and ipv6 separate?  CRC: No.
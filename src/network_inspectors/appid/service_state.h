@@ -158,6 +158,24 @@ public:
     static void dump_stats();
 };
 
+// Service detectors confirmed for a server by any packet thread.  A new flow
+// to a server that isn't known to its own thread starts with the shared
+// detector instead of walking the port, pattern and brute force candidates.
+// Each confirmation raises the confidence in a verdict and it decays while
+// the server is idle; a verdict is dropped as soon as its detector fails.
+// The cache is sharded by key with a lock and LRU list per shard.
+class AppIdServiceVerdicts
+{
+public:
+    static void initialize(size_t max_entries);
+    static ServiceDetector* get(const snort::SfIp*, IpProtocol, uint16_t port, bool decrypted,
+        unsigned& walk_cost);
+    static void confirm(const snort::SfIp*, IpProtocol, uint16_t port, bool decrypted,
+        ServiceDetector*, unsigned walk_cost);
+    static bool invalidate(const snort::SfIp*, IpProtocol, uint16_t port, bool decrypted,
+        ServiceDetector*);
+};
+
 
 class AppIdServiceStateKey
 {
@@ -186,6 +204,20 @@ public:
         return memcmp((const uint8_t*) this, (const uint8_t*) &right, sizeof(*this)) < 0;
     }
 
+    bool operator==(const AppIdServiceStateKey& right) const
+    {
+        return memcmp((const uint8_t*) this, (const uint8_t*) &right, sizeof(*this)) == 0;
+    }
+
+    size_t hash() const
+    {
+        const uint32_t* a = ip.get_ip6_ptr();
+        uint64_t h = ((uint64_t)a[0] << 32 | a[1]) ^ ((uint64_t)a[2] << 32 | a[3]);
+        h ^= (uint64_t)port << 40 | (uint64_t)level << 32 | (uint64_t)proto;
+        h *= 0x9e3779b97f4a7c15;
+        return h ^ (h >> 29);
+    }
+
 private:
     snort::SfIp ip;
     uint16_t port;
@@ -90,6 +90,9 @@ ServiceDiscoveryState* AppIdServiceState::add(SfIp const*, IpProtocol, unsigned
 
 void ServiceDiscoveryState::set_service_id_valid(ServiceDetector*) { }
 
+void AppIdServiceVerdicts::confirm(SfIp const*, IpProtocol, unsigned short, bool,
+    ServiceDetector*, unsigned) { }
+
 // Stubs for service_plugins/service_discovery.h
 int ServiceDiscovery::incompatible_data(AppIdSession&, const Packet*, AppidSessionDirection, ServiceDetector*)
 {
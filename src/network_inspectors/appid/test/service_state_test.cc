@@ -51,7 +51,8 @@ char* snort_strdup(const char* str)
     memcpy(p, str, n);
     return p;
 }
-time_t packet_time() { return std::time(0); }
+static time_t s_packet_time = 0;
+time_t packet_time() { return s_packet_time ? s_packet_time : std::time(0); }
 }
 
 // Stubs for AppInfoManager
@@ -239,6 +240,64 @@ TEST(service_state_tests, service_cache)
     CHECK_TRUE( ss->qptr == ServiceCache.newest() );
 }
 
+TEST(service_state_tests, service_verdicts)
+{
+    AppIdServiceVerdicts::initialize(64);
+    s_packet_time = 1000;
+
+    SfIp ip;
+    ip.set("1.2.3.4");
+    IpProtocol proto = IpProtocol::TCP;
+    int a, b;
+    ServiceDetector* sd = (ServiceDetector*)&a;
+    ServiceDetector* other = (ServiceDetector*)&b;
+    unsigned cost = 0;
+
+    // other threads only use a verdict after it was confirmed twice
+    AppIdServiceVerdicts::confirm(&ip, proto, 443, false, sd, 5);
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 443, false, cost) == nullptr);
+    AppIdServiceVerdicts::confirm(&ip, proto, 443, false, sd, 1);
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 443, false, cost) == sd);
+    CHECK(cost == 5);
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 443, true, cost) == nullptr);
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 80, false, cost) == nullptr);
+
+    // a different detector starts over
+    AppIdServiceVerdicts::confirm(&ip, proto, 443, false, other, 3);
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 443, false, cost) == nullptr);
+    AppIdServiceVerdicts::confirm(&ip, proto, 443, false, other, 1);
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 443, false, cost) == other);
+
+    // only a failure of the cached detector invalidates it
+    CHECK_FALSE(AppIdServiceVerdicts::invalidate(&ip, proto, 443, false, sd));
+    CHECK_TRUE(AppIdServiceVerdicts::invalidate(&ip, proto, 443, false, other));
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 443, false, cost) == nullptr);
+
+    // confidence decays while the server is idle
+    for ( int i = 0; i < 3; i++ )
+        AppIdServiceVerdicts::confirm(&ip, proto, 22, false, sd, 2);
+    s_packet_time += 300;
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 22, false, cost) == sd);
+    s_packet_time += 300;
+    CHECK(AppIdServiceVerdicts::get(&ip, proto, 22, false, cost) == nullptr);
+
+    // the cache never holds more than the configured number of servers
+    for ( uint16_t port = 1000; port < 2000; port++ )
+    {
+        AppIdServiceVerdicts::confirm(&ip, proto, port, false, sd, 1);
+        AppIdServiceVerdicts::confirm(&ip, proto, port, false, sd, 1);
+    }
+    unsigned hits = 0;
+    for ( uint16_t port = 1000; port < 2000; port++ )
+        if ( AppIdServiceVerdicts::get(&ip, proto, port, false, cost) )
+            hits++;
+    CHECK(hits > 0);
+    CHECK(hits <= 64);
+
+    AppIdServiceVerdicts::initialize(0);
+    s_packet_time = 0;
+}
+
 int main(int argc, char** argv)
 {
     int rc = CommandLineTestRunner::RunAllTests(argc, argv);
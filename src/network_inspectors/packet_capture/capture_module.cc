@@ -37,6 +37,14 @@ using namespace std;
 static int enable(lua_State*);
 static int disable(lua_State*);
 
+static const Parameter s_filter[] =
+{
+    { "filter", Parameter::PT_STRING, nullptr, nullptr,
+      "bpf filter to use for packet dump" },
+
+    { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
+};
+
 static const Parameter s_capture[] =
 {
     { "enable", Parameter::PT_BOOL, nullptr, "false",
@@ -45,12 +53,18 @@ static const Parameter s_capture[] =
     { "filter", Parameter::PT_STRING, nullptr, nullptr,
       "bpf filter to use for packet dump" },
 
+    { "mmap", Parameter::PT_BOOL, nullptr, "false",
+      "write through memory mapped windows of the file instead of libpcap" },
+
+    { "snaplen", Parameter::PT_INT, "0:65535", "0",
+      "truncate dumped packets to this many bytes (0 dumps whole packets)" },
+
     { nullptr, Parameter::PT_MAX, nullptr, nullptr, nullptr }
 };
 
 static const Command cap_cmds[] =
 {
-    { "enable", enable, &s_capture[1], "dump raw packets"},
+    { "enable", enable, s_filter, "dump raw packets"},
     { "disable", disable, nullptr, "stop packet dump"},
     { nullptr, nullptr, nullptr, nullptr }
 };
@@ -117,7 +131,11 @@ void PacketCaptureDebug::execute(Analyzer&)
 
 CaptureModule::CaptureModule() :
     Module(CAPTURE_NAME, CAPTURE_HELP, s_capture)
-{ config.enabled = false; }
+{
+    config.enabled = false;
+    config.mmap = false;
+    config.snaplen = 0;
+}
 
 bool CaptureModule::set(const char*, Value& v, SnortConfig*)
 {
@@ -127,6 +145,12 @@ bool CaptureModule::set(const char*, Value& v, SnortConfig*)
     else if ( v.is("filter") )
         config.filter = v.get_string();
 
+    else if ( v.is("mmap") )
+        config.mmap = v.get_bool();
+
+    else if ( v.is("snaplen") )
+        config.snaplen = v.get_uint32();
+
     else
         return false;
 
@@ -29,6 +29,8 @@
 struct CaptureConfig
 {
     bool enabled;
+    bool mmap;
+    uint32_t snaplen;
     std::string filter;
 };
 
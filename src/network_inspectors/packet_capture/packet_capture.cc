@@ -26,8 +26,11 @@
 
 #include <pcap.h>
 
+#include <mutex>
+
 #include "framework/inspector.h"
 #include "log/messages.h"
+#include "log/pcap_writer.h"
 #include "protocols/packet.h"
 
 #ifdef UNIT_TEST
@@ -50,6 +53,7 @@ static CaptureConfig config;
 
 static THREAD_LOCAL pcap_t* pcap = nullptr;
 static THREAD_LOCAL pcap_dumper_t* dumper = nullptr;
+static THREAD_LOCAL PcapWriter* writer = nullptr;
 static THREAD_LOCAL struct bpf_program bpf;
 
 // -----------------------------------------------------------------------------
@@ -57,7 +61,7 @@ static THREAD_LOCAL struct bpf_program bpf;
 // -----------------------------------------------------------------------------
 
 static inline bool capture_initialized()
-{ return dumper != nullptr; }
+{ return dumper != nullptr or writer != nullptr; }
 
 static void _capture_term()
 {
@@ -66,6 +70,11 @@ static void _capture_term()
         pcap_dump_close(dumper);
         dumper = nullptr;
     }
+    if ( writer )
+    {
+        delete writer;
+        writer = nullptr;
+    }
     if ( pcap )
     {
         free(pcap);
@@ -76,8 +85,11 @@ static void _capture_term()
 
 static bool bpf_compile_and_validate()
 {
-    // FIXIT-M This BPF compilation is not thread-safe and should be handled by the main thread
-    // and this call should use DLT from DAQ rather then hard coding DLT_EN10MB
+    // older libpcap compilers are not reentrant so packet threads take turns
+    // FIXIT-M this call should use DLT from DAQ rather then hard coding DLT_EN10MB
+    static mutex compile_mutex;
+    lock_guard<mutex> lock(compile_mutex);
+
     if ( pcap_compile_nopcap(SNAP_LEN, DLT_EN10MB, &bpf,
         config.filter.c_str(), 1, 0) >= 0 )
     {
@@ -96,7 +108,22 @@ static bool open_pcap_dumper()
     string fname;
     get_instance_file(fname, FILE_NAME);
 
-    pcap = pcap_open_dead(DLT_EN10MB, SNAP_LEN);
+    uint32_t snaplen = config.snaplen ? config.snaplen : SNAP_LEN;
+
+    if ( config.mmap )
+    {
+        writer = new PcapWriter(DLT_EN10MB, snaplen);
+
+        if ( writer->open(fname.c_str()) )
+            return true;
+
+        delete writer;
+        writer = nullptr;
+        WarningMessage("Could not initialize dump file\n");
+        return false;
+    }
+
+    pcap = pcap_open_dead(DLT_EN10MB, snaplen);
     dumper = pcap ? pcap_dump_open(pcap, fname.c_str()) : nullptr;
 
     if (dumper)
@@ -219,9 +246,21 @@ void PacketCapture::eval(Packet* p)
 
 void PacketCapture::write_packet(Packet* p)
 {
+    uint32_t caplen = p->pkth->caplen;
+
+    if ( config.snaplen and caplen > config.snaplen )
+        caplen = config.snaplen;
+
+    // mapped pages are visible to readers without a flush
+    if ( writer )
+    {
+        writer->write(p->pkth->ts, caplen, p->pkth->pktlen, p->pkt);
+        return;
+    }
+
     struct pcap_pkthdr pcaphdr;
     pcaphdr.ts = p->pkth->ts;
-    pcaphdr.caplen = p->pkth->caplen;
+    pcaphdr.caplen = caplen;
     pcaphdr.len = p->pkth->pktlen;
     pcap_dump((unsigned char*)dumper, &pcaphdr, p->pkt);
     pcap_dump_flush(dumper);
@@ -0,0 +1,200 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// delta_format.h
+
+#ifndef DELTA_FORMAT_H
+#define DELTA_FORMAT_H
+
+// Encoding used by DeltaFormatter.  This header has no Snort dependencies
+// so tools can decode the files with it.
+//
+// file:    magic "PDLT", version, tracker name, section count, sections
+// section: name, field count, fields
+// field:   type (one byte), name
+// record:  size, payload
+// payload: timestamp delta, then each field in schema order:
+//          peg count  - value delta
+//          string     - 0 if unchanged else length + 1 and the bytes
+//          indexed    - size, number of changed elements, then an index
+//                       gap and value delta for each changed element
+//
+// All integers are LEB128 varints.  Deltas are from the same field in the
+// previous record of the file (or 0) and are zigzag encoded since counts
+// can go down.  Strings are a varint length and the bytes.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define DELTA_MAGIC "PDLT"
+#define DELTA_VERSION 1
+
+// field types; same values as FormatterType
+#define DELTA_PEG_COUNT     0
+#define DELTA_STRING        1
+#define DELTA_IDX_PEG_COUNT 2
+
+namespace delta_format
+{
+inline void put_varint(std::string& out, uint64_t u)
+{
+    while ( u >= 0x80 )
+    {
+        out.push_back((char)(u | 0x80));
+        u >>= 7;
+    }
+    out.push_back((char)u);
+}
+
+inline void put_delta(std::string& out, uint64_t now, uint64_t last)
+{
+    int64_t d = (int64_t)(now - last);
+    put_varint(out, ((uint64_t)d << 1) ^ (uint64_t)(d >> 63));
+}
+
+inline void put_string(std::string& out, const char* s, size_t n)
+{
+    put_varint(out, n);
+    out.append(s, n);
+}
+
+// returns false if the varint runs past end or is too long
+inline bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& u)
+{
+    u = 0;
+
+    for ( unsigned shift = 0; p < end and shift < 64; shift += 7 )
+    {
+        uint8_t b = *p++;
+        u |= (uint64_t)(b & 0x7F) << shift;
+
+        if ( !(b & 0x80) )
+            return true;
+    }
+    return false;
+}
+
+inline bool get_delta(const uint8_t*& p, const uint8_t* end, uint64_t& value)
+{
+    uint64_t z;
+
+    if ( !get_varint(p, end, z) )
+        return false;
+
+    value += (z >> 1) ^ (~(z & 1) + 1);
+    return true;
+}
+
+inline bool get_string(const uint8_t*& p, const uint8_t* end, std::string& s)
+{
+    uint64_t n;
+
+    if ( !get_varint(p, end, n) or n > (uint64_t)(end - p) )
+        return false;
+
+    s.assign((const char*)p, n);
+    p += n;
+    return true;
+}
+
+// the schema from the header and the values as of the last record
+struct DeltaField
+{
+    uint8_t type;
+    std::string name;
+    uint64_t peg = 0;
+    std::string str;
+    std::vector<uint64_t> vec;
+};
+
+struct DeltaSection
+{
+    std::string name;
+    std::vector<DeltaField> fields;
+};
+
+// apply the payload of one record to timestamp and the field values; returns
+// false if it is corrupt or doesn't match the schema
+inline bool get_record(const uint8_t* p, const uint8_t* end, uint64_t& timestamp,
+    std::vector<DeltaSection>& sections)
+{
+    if ( !get_delta(p, end, timestamp) )
+        return false;
+
+    for ( auto& section : sections )
+    {
+        for ( auto& f : section.fields )
+        {
+            switch ( f.type )
+            {
+            case DELTA_PEG_COUNT:
+                if ( !get_delta(p, end, f.peg) )
+                    return false;
+                break;
+
+            case DELTA_STRING:
+            {
+                uint64_t n;
+
+                if ( !get_varint(p, end, n) or n > (uint64_t)(end - p) + 1 )
+                    return false;
+
+                if ( n )
+                {
+                    f.str.assign((const char*)p, n - 1);
+                    p += n - 1;
+                }
+                break;
+            }
+            case DELTA_IDX_PEG_COUNT:
+            {
+                uint64_t n, changed, next = 0;
+
+                if ( !get_varint(p, end, n) or !get_varint(p, end, changed) )
+                    return false;
+
+                f.vec.resize(n, 0);
+
+                while ( changed-- )
+                {
+                    uint64_t gap;
+
+                    if ( !get_varint(p, end, gap) or next + gap >= n )
+                        return false;
+
+                    next += gap;
+
+                    if ( !get_delta(p, end, f.vec[next]) )
+                        return false;
+
+                    next++;
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+    }
+    return p == end;
+}
+}
+
+#endif
+
@@ -0,0 +1,432 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// delta_formatter.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "delta_formatter.h"
+
+#include <cstring>
+
+#include "delta_format.h"
+
+#ifdef UNIT_TEST
+#include <cstdio>
+#include <map>
+
+#include "catch/snort_catch.h"
+#endif
+
+#ifdef BENCHMARK_TEST
+#include <chrono>
+
+#include "catch/snort_catch.h"
+#include "csv_formatter.h"
+#endif
+
+using namespace std;
+using namespace delta_format;
+
+static_assert(FT_PEG_COUNT == DELTA_PEG_COUNT and FT_STRING == DELTA_STRING and
+    FT_IDX_PEG_COUNT == DELTA_IDX_PEG_COUNT, "delta types must match formatter types");
+
+void DeltaFormatter::finalize_fields()
+{
+    header.assign(DELTA_MAGIC);
+    put_varint(header, DELTA_VERSION);
+
+    string name = get_tracker_name();
+    put_string(header, name.c_str(), name.size());
+    put_varint(header, section_names.size());
+
+    for ( unsigned i = 0; i < section_names.size(); i++ )
+    {
+        put_string(header, section_names[i].c_str(), section_names[i].size());
+        put_varint(header, field_names[i].size());
+
+        for ( unsigned j = 0; j < field_names[i].size(); j++ )
+        {
+            header.push_back((char)types[i][j]);
+            put_string(header, field_names[i][j].c_str(), field_names[i][j].size());
+
+            Column c;
+            c.type = types[i][j];
+            c.value = values[i][j];
+            c.last = 0;
+            columns.emplace_back(std::move(c));
+        }
+    }
+    section_names.clear();
+    field_names.clear();
+}
+
+void DeltaFormatter::init_output(FILE* fh)
+{
+    // each file starts from zero
+    for ( auto& c : columns )
+    {
+        c.last = 0;
+        c.last_s.clear();
+        c.last_v.clear();
+    }
+    last_time = 0;
+
+    fwrite(header.data(), header.size(), 1, fh);
+    fflush(fh);
+}
+
+void DeltaFormatter::encode(string& out, time_t timestamp)
+{
+    record.clear();
+    put_delta(record, (uint64_t)timestamp, (uint64_t)last_time);
+    last_time = timestamp;
+
+    for ( auto& c : columns )
+    {
+        switch ( c.type )
+        {
+        case FT_PEG_COUNT:
+        {
+            PegCount v = *c.value.pc;
+            put_delta(record, v, c.last);
+            c.last = v;
+            break;
+        }
+        case FT_STRING:
+        {
+            const char* s = c.value.s ? c.value.s : "";
+
+            if ( c.last_s == s )
+                put_varint(record, 0);
+            else
+            {
+                size_t n = strlen(s);
+                put_varint(record, n + 1);
+                record.append(s, n);
+                c.last_s.assign(s, n);
+            }
+            break;
+        }
+        case FT_IDX_PEG_COUNT:
+        {
+            const vector<PegCount>& v = *c.value.ipc;
+            c.last_v.resize(v.size(), 0);
+
+            unsigned changed = 0;
+
+            for ( unsigned k = 0; k < v.size(); k++ )
+                if ( v[k] != c.last_v[k] )
+                    changed++;
+
+            put_varint(record, v.size());
+            put_varint(record, changed);
+
+            for ( unsigned k = 0, next = 0; changed; k++ )
+            {
+                if ( v[k] == c.last_v[k] )
+                    continue;
+
+                put_varint(record, k - next);
+                put_delta(record, v[k], c.last_v[k]);
+                c.last_v[k] = v[k];
+                next = k + 1;
+                changed--;
+            }
+            break;
+        }
+        }
+    }
+    put_varint(out, record.size());
+    out += record;
+}
+
+void DeltaFormatter::write(FILE* fh, time_t timestamp)
+{
+    string out;
+    encode(out, timestamp);
+    fwrite(out.data(), out.size(), 1, fh);
+    fflush(fh);
+}
+
+#ifdef UNIT_TEST
+
+// decode a file into "section.field" -> value per record
+typedef map<string, string> DeltaRecord;
+
+static bool decode(const string& buf, string& tracker, vector<DeltaRecord>& records)
+{
+    const uint8_t* p = (const uint8_t*)buf.data();
+    const uint8_t* end = p + buf.size();
+
+    if ( buf.compare(0, 4, DELTA_MAGIC) )
+        return false;
+
+    p += 4;
+    uint64_t version, num_sections;
+
+    if ( !get_varint(p, end, version) or version != DELTA_VERSION )
+        return false;
+
+    if ( !get_string(p, end, tracker) or !get_varint(p, end, num_sections) )
+        return false;
+
+    vector<DeltaSection> sections(num_sections);
+
+    for ( auto& section : sections )
+    {
+        uint64_t num_fields;
+
+        if ( !get_string(p, end, section.name) or !get_varint(p, end, num_fields) )
+            return false;
+
+        section.fields.resize(num_fields);
+
+        for ( auto& f : section.fields )
+        {
+            if ( p == end )
+                return false;
+
+            f.type = *p++;
+
+            if ( !get_string(p, end, f.name) )
+                return false;
+        }
+    }
+
+    uint64_t ts = 0;
+
+    while ( p < end )
+    {
+        uint64_t size;
+
+        if ( !get_varint(p, end, size) or size > (uint64_t)(end - p) )
+            return false;
+
+        if ( !get_record(p, p + size, ts, sections) )
+            return false;
+
+        p += size;
+
+        DeltaRecord rec;
+        rec["timestamp"] = to_string(ts);
+
+        for ( auto& section : sections )
+        {
+            for ( auto& f : section.fields )
+            {
+                string& value = rec[section.name + "." + f.name];
+
+                if ( f.type == FT_PEG_COUNT )
+                    value = to_string(f.peg);
+
+                else if ( f.type == FT_STRING )
+                    value = f.str;
+
+                else
+                {
+                    for ( auto v : f.vec )
+                        value += to_string(v) + ",";
+                }
+            }
+        }
+        records.emplace_back(rec);
+    }
+    return true;
+}
+
+static string read_file(FILE* fh)
+{
+    auto size = ftell(fh);
+    string buf(size, '\0');
+
+    rewind(fh);
+    CHECK(fread(&buf[0], size, 1, fh) == 1);
+    return buf;
+}
+
+TEST_CASE("delta output", "[DeltaFormatter]")
+{
+    PegCount one = 0, two = 1, three = 2;
+    char five[32] = "hellothere";
+    vector<PegCount> kvp;
+
+    FILE* fh = tmpfile();
+    DeltaFormatter f("delta_formatter");
+
+    f.register_section("name");
+    f.register_field("one", &one);
+    f.register_field("two", &two);
+    f.register_section("other");
+    f.register_field("three", &three);
+    f.register_field("five", five);
+    f.register_field("kvp", &kvp);
+    f.finalize_fields();
+    f.init_output(fh);
+
+    kvp.emplace_back(50);
+    kvp.emplace_back(60);
+    kvp.emplace_back(70);
+    f.write(fh, (time_t)1234567890);
+
+    // nothing changed
+    f.write(fh, (time_t)1234567891);
+
+    // counts can go down
+    two = 0;
+    three = 1000000;
+    five[0] = '\0';
+    kvp[1] = 0;
+    kvp.emplace_back(1);
+    f.write(fh, (time_t)1234567892);
+
+    string buf = read_file(fh);
+    string tracker;
+    vector<DeltaRecord> recs;
+
+    REQUIRE(decode(buf, tracker, recs));
+    CHECK(tracker == "delta_formatter");
+    REQUIRE(recs.size() == 3);
+
+    CHECK(recs[0]["timestamp"] == "1234567890");
+    CHECK(recs[0]["name.one"] == "0");
+    CHECK(recs[0]["name.two"] == "1");
+    CHECK(recs[0]["other.three"] == "2");
+    CHECK(recs[0]["other.five"] == "hellothere");
+    CHECK(recs[0]["other.kvp"] == "50,60,70,");
+
+    CHECK(recs[1]["timestamp"] == "1234567891");
+    recs[1]["timestamp"] = recs[0]["timestamp"];
+    CHECK(recs[1] == recs[0]);
+
+    CHECK(recs[2]["timestamp"] == "1234567892");
+    CHECK(recs[2]["name.two"] == "0");
+    CHECK(recs[2]["other.three"] == "1000000");
+    CHECK(recs[2]["other.five"] == "");
+    CHECK(recs[2]["other.kvp"] == "50,0,70,1,");
+
+    fclose(fh);
+}
+
+TEST_CASE("delta unchanged record size", "[DeltaFormatter]")
+{
+    // one byte per peg and vector when nothing changed
+    vector<PegCount> pegs(100, 12345678);
+    vector<PegCount> kvp(1000, 1);
+
+    DeltaFormatter f("delta_formatter");
+    f.register_section("pegs");
+
+    for ( unsigned i = 0; i < pegs.size(); i++ )
+        f.register_field("p" + to_string(i), &pegs[i]);
+
+    f.register_field("kvp", &kvp);
+    f.finalize_fields();
+
+    string first, second;
+    f.encode(first, (time_t)1000);
+    f.encode(second, (time_t)1001);
+
+    // size, timestamp, pegs, vector size (2 bytes) and changed
+    CHECK(second.size() == 1 + 1 + pegs.size() + 2 + 1);
+    CHECK(first.size() > second.size());
+}
+
+TEST_CASE("delta output restarts on new file", "[DeltaFormatter]")
+{
+    PegCount one = 7;
+
+    DeltaFormatter f("delta_formatter");
+    f.register_section("name");
+    f.register_field("one", &one);
+    f.finalize_fields();
+
+    FILE* fh = tmpfile();
+    f.init_output(fh);
+    f.write(fh, (time_t)10);
+    fclose(fh);
+
+    fh = tmpfile();
+    f.init_output(fh);
+    f.write(fh, (time_t)11);
+
+    string tracker;
+    vector<DeltaRecord> recs;
+
+    REQUIRE(decode(read_file(fh), tracker, recs));
+    REQUIRE(recs.size() == 1);
+    CHECK(recs[0]["timestamp"] == "11");
+    CHECK(recs[0]["name.one"] == "7");
+
+    fclose(fh);
+}
+
+#endif
+
+#ifdef BENCHMARK_TEST
+
+// time and bytes per interval for many slowly changing counts
+template <typename F>
+static void bench_format(const char* name)
+{
+    const unsigned num_pegs = 2000;
+    const unsigned intervals = 2000;
+
+    vector<PegCount> pegs(num_pegs);
+    F f("bench");
+    f.register_section("pegs");
+
+    for ( unsigned i = 0; i < num_pegs; i++ )
+        f.register_field("peg_" + to_string(i), &pegs[i]);
+
+    f.finalize_fields();
+
+    // the file is rewritten from the start each interval to get its size
+    FILE* fh = tmpfile();
+    f.init_output(fh);
+
+    auto start = chrono::steady_clock::now();
+    long bytes = 0;
+
+    for ( unsigned t = 0; t < intervals; t++ )
+    {
+        // a tenth of the counts move each interval
+        for ( unsigned i = t % 10; i < num_pegs; i += 10 )
+            pegs[i] += i * 1000 + t;
+
+        f.write(fh, (time_t)(1500000000 + t));
+        bytes += ftell(fh);
+        fseek(fh, 0, SEEK_SET);
+    }
+    chrono::duration<double, micro> us = chrono::steady_clock::now() - start;
+    fclose(fh);
+
+    printf("%-6s %.1f usec and %ld bytes per interval\n", name, us.count() / intervals,
+        bytes / intervals);
+}
+
+TEST_CASE("delta vs csv", "[DeltaFormatter]")
+{
+    bench_format<CSVFormatter>("csv");
+    bench_format<DeltaFormatter>("delta");
+}
+
+#endif
+
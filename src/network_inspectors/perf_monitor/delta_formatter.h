@@ -0,0 +1,68 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// delta_formatter.h
+
+#ifndef DELTA_FORMATTER_H
+#define DELTA_FORMATTER_H
+
+// binary output with the schema written once and each record holding only
+// the varint encoded change of each field since the previous record.  see
+// delta_format.h for the layout.  records are encoded on the packet thread
+// and written by the perf writer thread.
+
+#include "perf_formatter.h"
+
+class DeltaFormatter : public PerfFormatter
+{
+public:
+    using PerfFormatter::PerfFormatter;
+
+    const char* get_extension() override
+    { return ".delta"; }
+
+    // deltas can't continue from a previous run
+    bool allow_append() override
+    { return false; }
+
+    bool write_async() override
+    { return true; }
+
+    void finalize_fields() override;
+    void init_output(FILE*) override;
+    void encode(std::string&, time_t) override;
+    void write(FILE*, time_t) override;
+
+private:
+    struct Column
+    {
+        FormatterType type;
+        FormatterValue value;
+        PegCount last;
+        std::string last_s;
+        std::vector<PegCount> last_v;
+    };
+
+    std::string header;
+    std::string record;
+    std::vector<Column> columns;
+    time_t last_time = 0;
+};
+
+#endif
+
@@ -0,0 +1,232 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_cost_tracker.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "flow_cost_tracker.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "latency/latency_histogram.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#include "flow/flow_key.h"
+#endif
+
+#define TRACKER_NAME PERF_NAME "_flow_cost"
+
+using namespace std;
+
+static inline PegCount to_usecs(uint64_t ticks)
+{ return LatencyHistograms::to_nsecs(ticks) / 1000; }
+
+FlowCostTracker::FlowCostTracker(PerfConfig* perf) : PerfTracker(perf, TRACKER_NAME)
+{
+    formatter->register_section("flow_cost");
+    formatter->register_field("samples", &samples);
+    formatter->register_field("usecs", &usecs);
+
+    unsigned max = FlowCost::get_max_entries();
+
+    for ( unsigned t = 0; t < FC_TABLES; ++t )
+    {
+        stats[t].resize(max);
+        string table = FlowCost::get_table_name((FlowCostTable)t);
+
+        for ( unsigned i = 0; i < max; ++i )
+        {
+            CostStats& cs = stats[t][i];
+            memset(&cs, 0, sizeof(cs));
+
+            formatter->register_section(table + "_" + to_string(i + 1));
+            formatter->register_field("name", cs.name);
+            formatter->register_field("samples", &cs.samples);
+            formatter->register_field("usecs", &cs.usecs);
+            formatter->register_field("error_usecs", &cs.error);
+
+            for ( unsigned ph = 0; ph < FC_PHASES; ++ph )
+            {
+                string field = FlowCost::get_phase_name((FlowCostPhase)ph);
+                formatter->register_field(field + "_usecs", &cs.phases[ph]);
+            }
+        }
+    }
+    formatter->finalize_fields();
+}
+
+void FlowCostTracker::snapshot()
+{
+    vector<FlowCostEntry> v;
+
+    for ( unsigned t = 0; t < FC_TABLES; ++t )
+    {
+        last[t].clear();
+        FlowCost::get_top((FlowCostTable)t, v);
+
+        for ( auto& e : v )
+            last[t].emplace(e.name, e);
+    }
+    last_samples = FlowCost::get_samples();
+    last_total = FlowCost::get_total();
+}
+
+void FlowCostTracker::reset()
+{
+    snapshot();
+}
+
+void FlowCostTracker::set_stats(CostStats& cs, const FlowCostEntry& e)
+{
+    strncpy(cs.name, e.name.c_str(), sizeof(cs.name) - 1);
+    cs.name[sizeof(cs.name) - 1] = '\0';
+
+    cs.samples = e.samples;
+    cs.usecs = to_usecs(e.total);
+    cs.error = to_usecs(e.error);
+
+    for ( unsigned ph = 0; ph < FC_PHASES; ++ph )
+        cs.phases[ph] = to_usecs(e.ticks[ph]);
+}
+
+// each interval is the difference from the last snapshot.  a key that
+// replaced another since then starts over.
+void FlowCostTracker::process(bool)
+{
+    uint64_t cur_samples = FlowCost::get_samples();
+    uint64_t cur_total = FlowCost::get_total();
+
+    samples = cur_samples - last_samples;
+    usecs = to_usecs(cur_total - last_total);
+
+    vector<FlowCostEntry> v;
+
+    for ( unsigned t = 0; t < FC_TABLES; ++t )
+    {
+        FlowCost::get_top((FlowCostTable)t, v);
+        vector<FlowCostEntry> diffs;
+
+        for ( auto& e : v )
+        {
+            FlowCostEntry d = e;
+            auto it = last[t].find(e.name);
+
+            if ( it != last[t].end() and it->second.error == e.error and
+                it->second.samples <= e.samples )
+            {
+                const FlowCostEntry& prev = it->second;
+                d.samples -= prev.samples;
+                d.total -= prev.total;
+                d.error = 0;
+
+                for ( unsigned ph = 0; ph < FC_PHASES; ++ph )
+                    d.ticks[ph] -= std::min(d.ticks[ph], prev.ticks[ph]);
+            }
+            if ( d.samples )
+                diffs.emplace_back(d);
+        }
+
+        sort(diffs.begin(), diffs.end(),
+            [](const FlowCostEntry& a, const FlowCostEntry& b) { return a.total > b.total; });
+
+        for ( unsigned i = 0; i < stats[t].size(); ++i )
+        {
+            if ( i < diffs.size() )
+                set_stats(stats[t][i], diffs[i]);
+            else
+                memset(&stats[t][i], 0, sizeof(stats[t][i]));
+        }
+    }
+    snapshot();
+    write();
+}
+
+#ifdef UNIT_TEST
+
+class TestFlowCostTracker : public FlowCostTracker
+{
+public:
+    PerfFormatter* output;
+
+    TestFlowCostTracker(PerfConfig* perf) : FlowCostTracker(perf)
+    { output = formatter; }
+};
+
+TEST_CASE("flow cost intervals", "[FlowCostTracker]")
+{
+    FlowCost::tinit(1, 2);
+
+    snort::FlowKey fk[3];
+    memset(fk, 0, sizeof(fk));
+
+    for ( unsigned i = 0; i < 3; ++i )
+        fk[i].port_l = i + 1;
+
+    uint64_t ticks[FC_PHASES] = { 1000, 2000, 3000, 4000 };
+
+    PerfConfig config;
+    config.format = PerfFormat::MOCK;
+    TestFlowCostTracker tracker(&config);
+    MockFormatter* f = (MockFormatter*)tracker.output;
+
+    // recorded before reset are not in the first interval
+    FlowCost::record(fk, "http", "Firefox", ticks);
+    tracker.reset();
+
+    for ( unsigned i = 0; i < 3; ++i )
+        FlowCost::record(fk + 1, "ssl", nullptr, ticks);
+
+    FlowCost::record(fk, "http", "Firefox", ticks);
+    tracker.process(false);
+
+    CHECK(*f->public_values["flow_cost.samples"].pc == 4);
+    CHECK(*f->public_values["flow_1.samples"].pc == 3);
+    CHECK(*f->public_values["flow_1.usecs"].pc == 3 * to_usecs(10000));
+    CHECK(*f->public_values["flow_1.detect_usecs"].pc == 3 * to_usecs(4000));
+    CHECK(*f->public_values["flow_2.samples"].pc == 1);
+    CHECK(!strcmp(f->public_values["service_1.name"].s, "ssl"));
+    CHECK(!strcmp(f->public_values["service_2.name"].s, "http"));
+    CHECK(!strcmp(f->public_values["app_1.name"].s, "unknown"));
+    CHECK(*f->public_values["app_2.samples"].pc == 1);
+
+    // only the new samples are in the next interval
+    FlowCost::record(fk, "http", "Firefox", ticks);
+    tracker.process(false);
+
+    CHECK(*f->public_values["flow_cost.samples"].pc == 1);
+    CHECK(!strcmp(f->public_values["service_1.name"].s, "http"));
+    CHECK(*f->public_values["service_1.samples"].pc == 1);
+    CHECK(*f->public_values["service_2.samples"].pc == 0);
+
+    // a new flow takes over a slot and its error is reported
+    FlowCost::record(fk + 2, "dns", nullptr, ticks);
+    tracker.process(false);
+
+    CHECK(*f->public_values["flow_1.samples"].pc == 1);
+    CHECK(*f->public_values["flow_1.error_usecs"].pc > 0);
+    CHECK(*f->public_values["flow_2.samples"].pc == 0);
+
+    FlowCost::tterm();
+}
+
+#endif
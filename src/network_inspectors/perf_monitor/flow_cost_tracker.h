@@ -0,0 +1,71 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_cost_tracker.h
+
+#ifndef FLOW_COST_TRACKER_H
+#define FLOW_COST_TRACKER_H
+
+// Reports this thread's most costly flows, services, and apps for each
+// interval from the sampled flow cost tables (see latency/flow_cost.h).
+// Each table gets sections flow_1, service_1, app_1, etc. ordered by the
+// cost in the interval.
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "latency/flow_cost.h"
+
+#include "perf_tracker.h"
+
+class FlowCostTracker : public PerfTracker
+{
+public:
+    FlowCostTracker(PerfConfig*);
+
+    void reset() override;
+    void process(bool) override;
+
+private:
+    // usecs except samples
+    struct CostStats
+    {
+        char name[160];
+        PegCount samples;
+        PegCount usecs;
+        PegCount error;
+        PegCount phases[FC_PHASES];
+    };
+
+    typedef std::map<std::string, FlowCostEntry> EntryMap;
+
+    void snapshot();
+    void set_stats(CostStats&, const FlowCostEntry&);
+
+    PegCount samples = 0;
+    PegCount usecs = 0;
+
+    uint64_t last_samples = 0;
+    uint64_t last_total = 0;
+
+    std::vector<CostStats> stats[FC_TABLES];
+    EntryMap last[FC_TABLES];
+};
+
+#endif
@@ -0,0 +1,196 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_ip_table.h
+
+#ifndef FLOW_IP_TABLE_H
+#define FLOW_IP_TABLE_H
+
+// A fixed size table of per thread accumulators for the flow ip tracker and
+// flow records.  The table is open addressed and set associative: a key
+// hashes to a set of FIT_WAYS entries and the tags of the set fit in one
+// cache line, so a lookup reads one tag line and usually one entry.  When
+// a set is full the least recently stamped entry is evicted and handed back
+// to the caller to report, so memory is bounded by the memcap no matter how
+// many hosts are seen and nothing is dropped without being reported.
+//
+// Keys are compared with memcmp so they must not have uninitialized
+// padding.  Values are zeroed when an entry is claimed.
+
+#include <cstdint>
+#include <cstring>
+
+#define FIT_WAYS 8
+
+template<typename Key, typename Value>
+class FlowIPTable
+{
+public:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        uint32_t stamp;   // set by the caller; the lowest is evicted first
+    };
+
+    FlowIPTable(size_t memcap)
+    {
+        size_t sets = 1;
+
+        while ( 2 * sets * FIT_WAYS * (sizeof(Entry) + sizeof(uint32_t)) <= memcap )
+            sets *= 2;
+
+        set_mask = sets - 1;
+        tags = new uint32_t[sets * FIT_WAYS];
+        entries = new Entry[sets * FIT_WAYS];
+        clear();
+    }
+
+    ~FlowIPTable()
+    {
+        delete[] tags;
+        delete[] entries;
+    }
+
+    FlowIPTable(const FlowIPTable&) = delete;
+    FlowIPTable& operator=(const FlowIPTable&) = delete;
+
+    static uint32_t hash(const Key& key)
+    {
+        // fnv-1a over 32 bit words with the murmur3 finalizer since
+        // addresses often differ only in their last byte
+        uint32_t words[(sizeof(Key) + 3) / 4] = { };
+        memcpy(words, &key, sizeof(key));
+
+        uint32_t h = 2166136261u;
+
+        for ( auto w : words )
+            h = (h ^ w) * 16777619u;
+
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        return h ^ (h >> 16);
+    }
+
+    // returns the entry for key, claiming one if it isn't in the table.
+    // if the set was full the evicted entry is copied to evicted and true
+    // is returned in was_evicted.
+    Entry* get(const Key& key, uint32_t h, Entry& evicted, bool& was_evicted)
+    {
+        // 0 marks a free entry
+        uint32_t tag = h | 1;
+        unsigned base = ((h >> 8) & set_mask) * FIT_WAYS;
+        int free = -1;
+
+        for ( unsigned i = 0; i < FIT_WAYS; ++i )
+        {
+            if ( tags[base + i] == tag and !memcmp(&entries[base + i].key, &key, sizeof(key)) )
+            {
+                was_evicted = false;
+                return entries + base + i;
+            }
+            if ( free < 0 and !tags[base + i] )
+                free = i;
+        }
+
+        if ( free < 0 )
+        {
+            free = 0;
+
+            for ( unsigned i = 1; i < FIT_WAYS; ++i )
+            {
+                if ( entries[base + i].stamp < entries[base + free].stamp )
+                    free = i;
+            }
+            evicted = entries[base + free];
+            was_evicted = true;
+            ++evictions;
+        }
+        else
+        {
+            was_evicted = false;
+            ++used;
+        }
+
+        Entry* e = entries + base + free;
+        tags[base + free] = tag;
+        e->key = key;
+        memset(&e->value, 0, sizeof(e->value));
+        e->stamp = 0;
+        return e;
+    }
+
+    // the entry for key or null
+    Entry* find(const Key& key, uint32_t h)
+    {
+        uint32_t tag = h | 1;
+        unsigned base = ((h >> 8) & set_mask) * FIT_WAYS;
+
+        for ( unsigned i = 0; i < FIT_WAYS; ++i )
+        {
+            if ( tags[base + i] == tag and !memcmp(&entries[base + i].key, &key, sizeof(key)) )
+                return entries + base + i;
+        }
+        return nullptr;
+    }
+
+    // iterate over index 0 to capacity() - 1 and check is_used()
+    unsigned capacity() const
+    { return (set_mask + 1) * FIT_WAYS; }
+
+    bool is_used(unsigned idx) const
+    { return tags[idx] != 0; }
+
+    Entry* at(unsigned idx)
+    { return entries + idx; }
+
+    void remove(unsigned idx)
+    {
+        if ( tags[idx] )
+        {
+            tags[idx] = 0;
+            --used;
+        }
+    }
+
+    void remove(Entry* e)
+    { remove(e - entries); }
+
+    void clear()
+    {
+        memset(tags, 0, capacity() * sizeof(*tags));
+        used = 0;
+    }
+
+    unsigned get_used() const
+    { return used; }
+
+    uint64_t get_evictions() const
+    { return evictions; }
+
+private:
+    uint32_t* tags;
+    Entry* entries;
+    unsigned set_mask;
+    unsigned used = 0;
+    uint64_t evictions = 0;
+};
+
+#endif
@@ -27,49 +27,58 @@
 #include "log/messages.h"
 #include "protocols/packet.h"
 
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
 using namespace snort;
 
 #define TRACKER_NAME PERF_NAME "_flow_ip"
 
-struct FlowStateKey
-{
-    SfIp ipA;
-    SfIp ipB;
-};
-
 FlowStateValue* FlowIPTracker::find_stats(const SfIp* src_addr, const SfIp* dst_addr,
     int* swapped)
 {
-    FlowStateKey key;
-    FlowStateValue* value = nullptr;
+    FlowIPKey key;
+    const uint32_t* src = src_addr->get_ip6_ptr();
+    const uint32_t* dst = dst_addr->get_ip6_ptr();
 
-    if (src_addr->less_than(*dst_addr))
+    if ( memcmp(src, dst, sizeof(key.ip_a)) <= 0 )
     {
-        key.ipA.set(*src_addr);
-        key.ipB.set(*dst_addr);
+        memcpy(key.ip_a, src, sizeof(key.ip_a));
+        memcpy(key.ip_b, dst, sizeof(key.ip_b));
         *swapped = 0;
     }
     else
     {
-        key.ipA.set(*dst_addr);
-        key.ipB.set(*src_addr);
+        memcpy(key.ip_a, dst, sizeof(key.ip_a));
+        memcpy(key.ip_b, src, sizeof(key.ip_b));
         *swapped = 1;
     }
 
-    value = (FlowStateValue*)xhash_find(ip_map, &key);
-    if (!value)
-    {
-        XHashNode* node = xhash_get_node(ip_map, &key);
+    FlowIPMap::Entry evicted;
+    bool was_evicted;
 
-        if (!node)
-        {
-            return nullptr;
-        }
-        memset(node->data, 0, sizeof(FlowStateValue));
-        value = (FlowStateValue*)node->data;
-    }
+    FlowIPMap::Entry* e = ip_map->get(key, FlowIPMap::hash(key), evicted, was_evicted);
+
+    // a full set gives up its oldest pair, which is reported now rather
+    // than dropped
+    if ( was_evicted )
+        write_stats(evicted);
 
-    return value;
+    e->stamp = now;
+    return &e->value;
+}
+
+void FlowIPTracker::write_stats(const FlowIPMap::Entry& e)
+{
+    SfIp ip;
+    ip.set(e.key.ip_a);
+    ip.ntop(ip_a, sizeof(ip_a));
+    ip.set(e.key.ip_b);
+    ip.ntop(ip_b, sizeof(ip_b));
+    memcpy(&stats, &e.value, sizeof(stats));
+
+    write();
 }
 
 FlowIPTracker::FlowIPTracker(PerfConfig* perf) : PerfTracker(perf, TRACKER_NAME),
@@ -110,22 +119,17 @@ FlowIPTracker::FlowIPTracker(PerfConfig* perf) : PerfTracker(perf, TRACKER_NAME)
         &stats.state_changes[SFS_STATE_UDP_CREATED]);
     formatter->finalize_fields();
 
-    ip_map = xhash_new(1021, sizeof(FlowStateKey), sizeof(FlowStateValue),
-        perf->flowip_memcap, 1, nullptr, nullptr, 1);
-
-    if (!ip_map)
-        FatalError("Unable to allocate memory for FlowIP stats\n");
+    ip_map = new FlowIPMap(perf->flowip_memcap);
 }
 
 FlowIPTracker::~FlowIPTracker()
 {
-    if ( ip_map )
-        xhash_delete(ip_map);
+    delete ip_map;
 }
 
 void FlowIPTracker::reset()
 {
-    xhash_make_empty(ip_map);
+    ip_map->clear();
 }
 
 void FlowIPTracker::update(Packet* p)
@@ -138,6 +142,7 @@ void FlowIPTracker::update(Packet* p)
         const SfIp* src_addr = p->ptrs.ip_api.get_src();
         const SfIp* dst_addr = p->ptrs.ip_api.get_dst();
         int len = p->pkth->caplen;
+        now = p->pkth->ts.tv_sec;
 
         if (p->ptrs.tcph)
             type = SFS_TYPE_TCP;
@@ -145,9 +150,6 @@ void FlowIPTracker::update(Packet* p)
             type = SFS_TYPE_UDP;
 
         FlowStateValue* value = find_stats(src_addr, dst_addr, &swapped);
-        if (!value)
-            return;
-
         TrafficStats* stats = &value->traffic_stats[type];
 
         if (!swapped)
@@ -165,22 +167,33 @@ void FlowIPTracker::update(Packet* p)
     }
 }
 
+// pairs stay in the table across intervals; only those without traffic or
+// state changes since the last interval are removed
 void FlowIPTracker::process(bool)
 {
-    for (auto node = xhash_findfirst(ip_map); node; node = xhash_findnext(ip_map))
+    bool summary = perf_flags & PERF_SUMMARY;
+
+    for ( unsigned i = 0; i < ip_map->capacity(); ++i )
     {
-        FlowStateKey* key = (FlowStateKey*)node->key;
-        FlowStateValue* cur_stats = (FlowStateValue*)node->data;
+        if ( !ip_map->is_used(i) )
+            continue;
 
-        key->ipA.ntop(ip_a, sizeof(ip_a));
-        key->ipB.ntop(ip_b, sizeof(ip_b));
-        memcpy(&stats, cur_stats, sizeof(stats));
+        FlowIPMap::Entry* e = ip_map->at(i);
+        FlowStateValue& value = e->value;
 
-        write();
-    }
+        if ( !value.total_packets and !value.state_changes[SFS_STATE_TCP_ESTABLISHED] and
+            !value.state_changes[SFS_STATE_TCP_CLOSED] and
+            !value.state_changes[SFS_STATE_UDP_CREATED] )
+        {
+            ip_map->remove(i);
+            continue;
+        }
 
-    if ( !(perf_flags & PERF_SUMMARY) )
-        reset();
+        write_stats(*e);
+
+        if ( !summary )
+            memset(&value, 0, sizeof(value));
+    }
 }
 
 int FlowIPTracker::update_state(const SfIp* src_addr, const SfIp* dst_addr, FlowState state)
@@ -188,11 +201,132 @@ int FlowIPTracker::update_state(const SfIp* src_addr, const SfIp* dst_addr, Flow
     int swapped;
 
     FlowStateValue* value = find_stats(src_addr, dst_addr, &swapped);
-    if (!value)
-        return 1;
-
     value->state_changes[state]++;
 
     return 0;
 }
 
+
+#ifdef UNIT_TEST
+
+class TestFlowIPTracker : public FlowIPTracker
+{
+public:
+    PerfFormatter* output;
+
+    TestFlowIPTracker(PerfConfig* perf) : FlowIPTracker(perf)
+    { output = formatter; }
+};
+
+static FlowIPKey make_key(uint32_t a, uint32_t b)
+{
+    FlowIPKey key;
+    memset(&key, 0, sizeof(key));
+    key.ip_a[3] = a;
+    key.ip_b[3] = b;
+    return key;
+}
+
+TEST_CASE("flow ip table", "[FlowIPTracker]")
+{
+    // the smallest memcap holds 4 sets
+    FlowIPMap map(8200);
+    REQUIRE(map.capacity() == 4 * FIT_WAYS);
+    CHECK(map.capacity() * (sizeof(FlowIPMap::Entry) + sizeof(uint32_t)) <= 8200);
+
+    FlowIPMap::Entry evicted;
+    bool was_evicted;
+    unsigned num_evicted = 0;
+
+    for ( uint32_t i = 0; i < 100; ++i )
+    {
+        FlowIPKey key = make_key(i, i + 1);
+        FlowIPMap::Entry* e = map.get(key, FlowIPMap::hash(key), evicted, was_evicted);
+        CHECK(e->value.total_packets == 0);
+        e->value.total_packets = i + 1;
+        e->stamp = i;
+
+        if ( was_evicted )
+        {
+            // the oldest in the set goes first
+            CHECK(evicted.stamp < i);
+            CHECK(evicted.value.total_packets == evicted.stamp + 1);
+            ++num_evicted;
+        }
+    }
+    CHECK(map.get_used() == map.capacity());
+    CHECK(num_evicted == 100 - map.capacity());
+    CHECK(map.get_evictions() == num_evicted);
+
+    // the most recent pair is still there
+    FlowIPKey key = make_key(99, 100);
+    FlowIPMap::Entry* e = map.find(key, FlowIPMap::hash(key));
+    REQUIRE(e != nullptr);
+    CHECK(e->value.total_packets == 100);
+
+    map.remove(e);
+    CHECK(map.find(key, FlowIPMap::hash(key)) == nullptr);
+    CHECK(map.get_used() == map.capacity() - 1);
+
+    // a free entry is used before evicting
+    map.get(key, FlowIPMap::hash(key), evicted, was_evicted);
+    CHECK(!was_evicted);
+
+    map.clear();
+    CHECK(map.get_used() == 0);
+    CHECK(map.find(key, FlowIPMap::hash(key)) == nullptr);
+}
+
+TEST_CASE("flow ip intervals", "[FlowIPTracker]")
+{
+    PerfConfig config;
+    config.format = PerfFormat::MOCK;
+    config.flowip_memcap = 8200;
+
+    TestFlowIPTracker tracker(&config);
+    MockFormatter* f = (MockFormatter*)tracker.output;
+    tracker.reset();
+
+    SfIp a, b;
+    a.set("10.1.1.1");
+    b.set("10.1.1.2");
+
+    tracker.update_state(&b, &a, SFS_STATE_TCP_ESTABLISHED);
+    tracker.update_state(&a, &b, SFS_STATE_TCP_ESTABLISHED);
+    tracker.update_state(&a, &b, SFS_STATE_TCP_CLOSED);
+    tracker.process(false);
+
+    CHECK(!strcmp(f->public_values["flow_ip.ip_a"].s, "10.1.1.1"));
+    CHECK(!strcmp(f->public_values["flow_ip.ip_b"].s, "10.1.1.2"));
+    CHECK(*f->public_values["flow_ip.tcp_established"].pc == 2);
+    CHECK(*f->public_values["flow_ip.tcp_closed"].pc == 1);
+
+    // the pair is kept but its counts start over
+    tracker.update_state(&a, &b, SFS_STATE_UDP_CREATED);
+    tracker.process(false);
+
+    CHECK(*f->public_values["flow_ip.tcp_established"].pc == 0);
+    CHECK(*f->public_values["flow_ip.udp_created"].pc == 1);
+
+    // more pairs than fit are reported as they are evicted; 65 pairs and
+    // room for 32
+    unsigned written = 0;
+
+    for ( unsigned i = 0; i < 64; ++i )
+    {
+        std::string last = f->public_values["flow_ip.ip_b"].s;
+        std::string s = "10.2.0." + std::to_string(i);
+        SfIp c;
+        c.set(s.c_str());
+
+        tracker.update_state(&a, &c, SFS_STATE_TCP_ESTABLISHED);
+
+        if ( last != f->public_values["flow_ip.ip_b"].s )
+            ++written;
+    }
+    // the first eviction may be the 10.1.1.2 pair which isn't a change
+    CHECK(written >= 32);
+    CHECK(written <= 33);
+}
+
+#endif
@@ -23,7 +23,12 @@
 
 #include "perf_tracker.h"
 
-#include "hash/xhash.h"
+#include "flow_ip_table.h"
+
+namespace snort
+{
+struct SfIp;
+}
 
 enum FlowState
 {
@@ -57,6 +62,15 @@ struct FlowStateValue
     PegCount state_changes[SFS_STATE_MAX];
 };
 
+// the lower address is a; addresses are in network order and ipv4 is mapped
+struct FlowIPKey
+{
+    uint32_t ip_a[4];
+    uint32_t ip_b[4];
+};
+
+typedef FlowIPTable<FlowIPKey, FlowStateValue> FlowIPMap;
+
 class FlowIPTracker : public PerfTracker
 {
 public:
@@ -71,13 +85,13 @@ public:
 
 private:
     FlowStateValue stats;
-    snort::XHash* ip_map;
+    FlowIPMap* ip_map;
     char ip_a[41], ip_b[41];
     int perf_flags;
+    uint32_t now = 0;
 
     FlowStateValue* find_stats(const snort::SfIp* src_addr, const snort::SfIp* dst_addr, int* swapped);
-    void write_stats();
-    void display_stats();
+    void write_stats(const FlowIPMap::Entry&);
 };
 #endif
 
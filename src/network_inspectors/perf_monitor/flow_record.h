@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_record.h
+
+#ifndef FLOW_RECORD_H
+#define FLOW_RECORD_H
+
+// Layout of the flow records written by FlowRecordExporter.  This header
+// has no Snort dependencies so tools can decode the records with it.
+//
+// Records are sent in batches, each a FlowRecordBatch header followed by
+// count FlowRecords.  A file is a sequence of batches from one packet
+// thread; a connector message is one batch.  Fields are in host order,
+// which byte_order identifies, except for the addresses which are in
+// network order with ipv4 mapped to ipv6.
+//
+// Endpoint a is the one with the lower address, or the lower port if the
+// addresses are the same, so both directions of a flow have one record.
+
+#include <cstdint>
+
+#define FLOW_RECORD_MAGIC "PFLR"
+#define FLOW_RECORD_VERSION 1
+#define FLOW_RECORD_BYTE_ORDER 0x01020304
+
+// why a record was exported
+enum FlowRecordReason : uint8_t
+{
+    FLOW_RECORD_END,        // tcp session closed
+    FLOW_RECORD_ACTIVE,     // active timeout; the flow continues
+    FLOW_RECORD_IDLE,       // no packets for the idle timeout
+    FLOW_RECORD_EVICTED,    // its slot was needed for another flow
+    FLOW_RECORD_SHUTDOWN,   // still open when the thread exited
+    FLOW_RECORD_MAX
+};
+
+struct FlowRecordBatch
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t count;
+    uint32_t byte_order;
+    uint32_t thread;
+};
+
+struct FlowRecord
+{
+    uint32_t ip_a[4];
+    uint32_t ip_b[4];
+    uint32_t first_sec;     // packet time of the first and last packets
+    uint32_t last_sec;
+    uint64_t packets_a_b;
+    uint64_t bytes_a_b;
+    uint64_t packets_b_a;
+    uint64_t bytes_b_a;
+    uint16_t port_a;
+    uint16_t port_b;
+    uint8_t proto;
+    uint8_t tcp_flags;      // union of the flags seen in both directions
+    uint8_t reason;
+    uint8_t reserved;
+};
+
+static_assert(sizeof(FlowRecordBatch) == 16, "flow record batch layout changed");
+static_assert(sizeof(FlowRecord) == 80, "flow record layout changed");
+
+#endif
@@ -0,0 +1,509 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_record_exporter.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "flow_record_exporter.h"
+
+#include <cstring>
+
+#include "flow/flow.h"
+#include "framework/connector.h"
+#include "log/messages.h"
+#include "main/thread.h"
+#include "managers/connector_manager.h"
+#include "protocols/packet.h"
+#include "protocols/tcp.h"
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#endif
+
+using namespace snort;
+
+#define FLOW_RECORD_FILE PERF_NAME "_flow_records.bin"
+
+// returns true if src is b
+static bool make_key(const uint32_t* src, uint16_t sp, const uint32_t* dst, uint16_t dp,
+    uint8_t proto, FlowRecordKey& key)
+{
+    memset(&key, 0, sizeof(key));
+    key.proto = proto;
+
+    int cmp = memcmp(src, dst, sizeof(key.ip_a));
+
+    if ( cmp < 0 or (!cmp and sp <= dp) )
+    {
+        memcpy(key.ip_a, src, sizeof(key.ip_a));
+        memcpy(key.ip_b, dst, sizeof(key.ip_b));
+        key.port_a = sp;
+        key.port_b = dp;
+        return false;
+    }
+    memcpy(key.ip_a, dst, sizeof(key.ip_a));
+    memcpy(key.ip_b, src, sizeof(key.ip_b));
+    key.port_a = dp;
+    key.port_b = sp;
+    return true;
+}
+
+FlowRecordExporter::FlowRecordExporter(PerfConfig* perf)
+{
+    flows = new FlowRecordMap(perf->flow_records_memcap);
+    connector_name = perf->flow_records_connector;
+    active_timeout = perf->flow_records_active_timeout;
+    idle_timeout = perf->flow_records_idle_timeout;
+
+    // cover the table once per the shorter timeout
+    uint32_t timeout = active_timeout < idle_timeout ? active_timeout : idle_timeout;
+    sweep_per_sec = flows->capacity() / timeout + 1;
+
+    memcpy(header.magic, FLOW_RECORD_MAGIC, sizeof(header.magic));
+    header.version = FLOW_RECORD_VERSION;
+    header.count = 0;
+    header.byte_order = FLOW_RECORD_BYTE_ORDER;
+    header.thread = 0;
+}
+
+FlowRecordExporter::~FlowRecordExporter()
+{
+    for ( unsigned i = 0; i < flows->capacity(); ++i )
+    {
+        if ( flows->is_used(i) and flows->at(i)->value.first_sec )
+            export_record(*flows->at(i), FLOW_RECORD_SHUTDOWN);
+    }
+    flush();
+
+    if ( fh and !fname.empty() )
+        fclose(fh);
+
+    delete flows;
+}
+
+bool FlowRecordExporter::open()
+{
+    header.thread = get_instance_id();
+
+    if ( !connector_name.empty() )
+    {
+        connector = ConnectorManager::get_connector(connector_name);
+
+        if ( !connector )
+        {
+            ErrorMessage("perfmonitor: Cannot find flow records connector '%s'.\n",
+                connector_name.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    get_instance_file(fname, FLOW_RECORD_FILE);
+
+    // each batch stands alone so the file is appended to
+    fh = fopen(fname.c_str(), "ab");
+
+    if ( !fh )
+    {
+        ErrorMessage("perfmonitor: Cannot open flow records file '%s'.\n", fname.c_str());
+        return false;
+    }
+    return true;
+}
+
+void FlowRecordExporter::update(Packet* p)
+{
+    if ( !p->has_ip() or p->is_rebuilt() )
+        return;
+
+    uint32_t now = p->pkth->ts.tv_sec;
+
+    if ( now != last_tick )
+        tick(now);
+
+    FlowRecordKey key;
+    bool swapped = make_key(
+        p->ptrs.ip_api.get_src()->get_ip6_ptr(), p->ptrs.sp,
+        p->ptrs.ip_api.get_dst()->get_ip6_ptr(), p->ptrs.dp,
+        (uint8_t)p->get_ip_proto_next(), key);
+
+    FlowRecordMap::Entry evicted;
+    bool was_evicted;
+
+    FlowRecordMap::Entry* e = flows->get(key, FlowRecordMap::hash(key), evicted, was_evicted);
+
+    if ( was_evicted and evicted.value.first_sec )
+        export_record(evicted, FLOW_RECORD_EVICTED);
+
+    FlowRecordValue& v = e->value;
+
+    if ( !v.first_sec )
+        v.first_sec = now;
+
+    v.last_sec = now;
+    e->stamp = now;
+
+    if ( swapped )
+    {
+        ++v.packets_b_a;
+        v.bytes_b_a += p->pkth->caplen;
+    }
+    else
+    {
+        ++v.packets_a_b;
+        v.bytes_a_b += p->pkth->caplen;
+    }
+
+    if ( p->ptrs.tcph )
+        v.tcp_flags |= p->ptrs.tcph->th_flags;
+}
+
+void FlowRecordExporter::end(Flow* flow)
+{
+    FlowRecordKey key;
+    make_key(flow->client_ip.get_ip6_ptr(), flow->client_port,
+        flow->server_ip.get_ip6_ptr(), flow->server_port, flow->ip_proto, key);
+
+    FlowRecordMap::Entry* e = flows->find(key, FlowRecordMap::hash(key));
+
+    if ( !e )
+        return;
+
+    if ( e->value.first_sec )
+        export_record(*e, FLOW_RECORD_END);
+
+    flows->remove(e);
+}
+
+void FlowRecordExporter::tick(uint32_t now)
+{
+    if ( last_tick and now > last_tick )
+    {
+        uint64_t n = (uint64_t)(now - last_tick) * sweep_per_sec;
+        sweep(now, n < flows->capacity() ? n : flows->capacity());
+    }
+    last_tick = now;
+
+    // a partial batch waits at most a second
+    flush();
+}
+
+void FlowRecordExporter::sweep(uint32_t now, unsigned n)
+{
+    unsigned cap = flows->capacity();
+
+    while ( n-- )
+    {
+        unsigned i = sweep_pos;
+        sweep_pos = (sweep_pos + 1) % cap;
+
+        if ( !flows->is_used(i) )
+            continue;
+
+        FlowRecordMap::Entry* e = flows->at(i);
+        FlowRecordValue& v = e->value;
+
+        if ( now - v.last_sec >= idle_timeout )
+        {
+            // nothing is left to report if the last record was active
+            if ( v.first_sec )
+                export_record(*e, FLOW_RECORD_IDLE);
+
+            flows->remove(i);
+        }
+        else if ( v.first_sec and now - v.first_sec >= active_timeout )
+        {
+            export_record(*e, FLOW_RECORD_ACTIVE);
+
+            // the next record starts with the next packet
+            uint32_t last_sec = v.last_sec;
+            memset(&v, 0, sizeof(v));
+            v.last_sec = last_sec;
+        }
+    }
+}
+
+void FlowRecordExporter::export_record(const FlowRecordMap::Entry& e, FlowRecordReason reason)
+{
+    FlowRecord& r = records[count];
+    const FlowRecordValue& v = e.value;
+
+    memcpy(r.ip_a, e.key.ip_a, sizeof(r.ip_a));
+    memcpy(r.ip_b, e.key.ip_b, sizeof(r.ip_b));
+    r.first_sec = v.first_sec;
+    r.last_sec = v.last_sec;
+    r.packets_a_b = v.packets_a_b;
+    r.bytes_a_b = v.bytes_a_b;
+    r.packets_b_a = v.packets_b_a;
+    r.bytes_b_a = v.bytes_b_a;
+    r.port_a = e.key.port_a;
+    r.port_b = e.key.port_b;
+    r.proto = e.key.proto;
+    r.tcp_flags = v.tcp_flags;
+    r.reason = reason;
+    r.reserved = 0;
+
+    ++exported[reason];
+
+    if ( ++count == FLOW_RECORD_BATCH )
+        flush();
+}
+
+void FlowRecordExporter::flush()
+{
+    if ( !count )
+        return;
+
+    header.count = count;
+    uint32_t len = sizeof(header) + count * sizeof(*records);
+
+    if ( connector )
+    {
+        const uint8_t* data;
+
+        if ( ConnectorMsgHandle* h = connector->alloc_message(len, &data) )
+        {
+            uint8_t* out = const_cast<uint8_t*>(data);
+            memcpy(out, &header, sizeof(header));
+            memcpy(out + sizeof(header), records, len - sizeof(header));
+            connector->transmit_message(h);
+        }
+    }
+    else if ( fh )
+    {
+        fwrite(&header, sizeof(header), 1, fh);
+        fwrite(records, sizeof(*records), count, fh);
+        fflush(fh);
+    }
+
+    count = 0;
+    ++batches;
+}
+
+#ifdef UNIT_TEST
+
+struct TestPacket
+{
+    Packet p;
+    DAQ_PktHdr_t pkth;
+    ip::IP4Hdr h4;
+    tcp::TCPHdr tcph;
+
+    TestPacket() : p(false)
+    {
+        memset(&pkth, 0, sizeof(pkth));
+        memset(&h4, 0, sizeof(h4));
+        memset(&tcph, 0, sizeof(tcph));
+        p.pkth = &pkth;
+        p.ptrs.ip_api.set(&h4);
+    }
+
+    Packet* set(uint32_t src, uint16_t sp, uint32_t dst, uint16_t dp, uint32_t sec,
+        uint8_t flags = 0)
+    {
+        h4.ip_src = htonl(src);
+        h4.ip_dst = htonl(dst);
+        p.ptrs.ip_api.set(&h4);
+        p.ptrs.sp = sp;
+        p.ptrs.dp = dp;
+        p.ptrs.tcph = flags ? &tcph : nullptr;
+        p.ip_proto_next = flags ? IpProtocol::TCP : IpProtocol::UDP;
+        tcph.th_flags = flags;
+        pkth.ts.tv_sec = sec;
+        pkth.caplen = 100;
+        return &p;
+    }
+};
+
+static std::vector<FlowRecord> read_records(FILE* f, unsigned& batches)
+{
+    std::vector<FlowRecord> recs;
+    FlowRecordBatch hdr;
+    batches = 0;
+    rewind(f);
+
+    while ( fread(&hdr, sizeof(hdr), 1, f) == 1 )
+    {
+        CHECK(!memcmp(hdr.magic, FLOW_RECORD_MAGIC, sizeof(hdr.magic)));
+        CHECK(hdr.version == FLOW_RECORD_VERSION);
+        CHECK(hdr.byte_order == FLOW_RECORD_BYTE_ORDER);
+        CHECK(hdr.count > 0);
+        CHECK(hdr.count <= FLOW_RECORD_BATCH);
+
+        for ( unsigned i = 0; i < hdr.count; ++i )
+        {
+            FlowRecord r;
+            REQUIRE(fread(&r, sizeof(r), 1, f) == 1);
+            recs.push_back(r);
+        }
+        ++batches;
+    }
+    return recs;
+}
+
+static PerfConfig* make_config(size_t memcap)
+{
+    PerfConfig* config = new PerfConfig;
+    config->flow_records_memcap = memcap;
+    config->flow_records_active_timeout = 10;
+    config->flow_records_idle_timeout = 5;
+    return config;
+}
+
+TEST_CASE("flow record reasons", "[FlowRecordExporter]")
+{
+    PerfConfig* config = make_config(65536);
+    FILE* f = tmpfile();
+    REQUIRE(f);
+
+    {
+        FlowRecordExporter fr(config);
+        fr.set_output(f);
+        TestPacket tp;
+
+        // a tcp flow from the higher address and a udp flow
+        fr.update(tp.set(0x0a000002, 40000, 0x0a000001, 80, 100, TH_SYN));
+        fr.update(tp.set(0x0a000001, 80, 0x0a000002, 40000, 100, TH_SYN|TH_ACK));
+        fr.update(tp.set(0x0a000002, 40000, 0x0a000001, 80, 101, TH_ACK));
+        fr.update(tp.set(0x0a000003, 5353, 0x0a000004, 53, 101));
+
+        // the tcp flow ends
+        Flow flow;
+        tp.set(0x0a000002, 40000, 0x0a000001, 80, 101, TH_ACK);
+        flow.client_ip.set(&tp.h4.ip_src, AF_INET);
+        flow.server_ip.set(&tp.h4.ip_dst, AF_INET);
+        flow.client_port = 40000;
+        flow.server_port = 80;
+        flow.ip_proto = (uint8_t)IpProtocol::TCP;
+        fr.end(&flow);
+        CHECK(fr.get_exported(FLOW_RECORD_END) == 1);
+
+        // a long udp flow is exported at its active timeout and idles out
+        for ( uint32_t sec = 102; sec < 120; ++sec )
+            fr.update(tp.set(0x0a000005, 123, 0x0a000006, 123, sec));
+
+        CHECK(fr.get_exported(FLOW_RECORD_ACTIVE) == 1);
+        CHECK(fr.get_exported(FLOW_RECORD_IDLE) == 1);
+
+        // the remaining flow is exported at shutdown
+    }
+
+    unsigned batches;
+    std::vector<FlowRecord> recs = read_records(f, batches);
+    REQUIRE(recs.size() == 4);
+
+    // the sweep finds the idle and active flows in either order
+    const FlowRecord* by_reason[FLOW_RECORD_MAX] = { };
+
+    for ( auto& r : recs )
+    {
+        REQUIRE(r.reason < FLOW_RECORD_MAX);
+        by_reason[r.reason] = &r;
+    }
+    REQUIRE(by_reason[FLOW_RECORD_END]);
+    REQUIRE(by_reason[FLOW_RECORD_IDLE]);
+    REQUIRE(by_reason[FLOW_RECORD_ACTIVE]);
+    REQUIRE(by_reason[FLOW_RECORD_SHUTDOWN]);
+
+    // the end record is sent within a second
+    CHECK(recs[0].reason == FLOW_RECORD_END);
+    CHECK(batches >= 3);
+
+    const FlowRecord& tcp = *by_reason[FLOW_RECORD_END];
+    CHECK(ntohl(tcp.ip_a[3]) == 0x0a000001);
+    CHECK(tcp.ip_a[2] == htonl(0xffff));
+    CHECK(tcp.port_a == 80);
+    CHECK(tcp.port_b == 40000);
+    CHECK(tcp.proto == (uint8_t)IpProtocol::TCP);
+    CHECK(tcp.packets_a_b == 1);
+    CHECK(tcp.packets_b_a == 2);
+    CHECK(tcp.bytes_b_a == 200);
+    CHECK(tcp.first_sec == 100);
+    CHECK(tcp.last_sec == 101);
+    CHECK(tcp.tcp_flags == (TH_SYN|TH_ACK));
+
+    const FlowRecord& idle = *by_reason[FLOW_RECORD_IDLE];
+    CHECK(idle.port_a == 5353);
+    CHECK(idle.port_b == 53);
+    CHECK(idle.packets_a_b == 1);
+    CHECK(idle.packets_b_a == 0);
+
+    const FlowRecord& active = *by_reason[FLOW_RECORD_ACTIVE];
+    CHECK(active.first_sec == 102);
+    CHECK(active.last_sec - active.first_sec >= 9);
+    CHECK(active.packets_a_b == active.last_sec - active.first_sec + 1);
+
+    const FlowRecord& rest = *by_reason[FLOW_RECORD_SHUTDOWN];
+    CHECK(rest.first_sec == active.last_sec + 1);
+    CHECK(rest.last_sec == 119);
+    CHECK(active.packets_a_b + rest.packets_a_b == 18);
+
+    fclose(f);
+    delete config;
+}
+
+TEST_CASE("flow records are bounded", "[FlowRecordExporter]")
+{
+    PerfConfig* config = make_config(8200);
+    FILE* f = tmpfile();
+    REQUIRE(f);
+
+    unsigned num_flows = 5000;
+    uint64_t evicted;
+
+    {
+        FlowRecordExporter fr(config);
+        fr.set_output(f);
+        TestPacket tp;
+
+        // every flow is reported once even though few fit
+        for ( unsigned i = 0; i < num_flows; ++i )
+            fr.update(tp.set(0x0a000000 + i, 1024 + i % 7, 0xc0a80001, 443, 100, TH_SYN));
+
+        // all sets are full
+        FlowRecordMap map(config->flow_records_memcap);
+        evicted = fr.get_exported(FLOW_RECORD_EVICTED);
+        CHECK(evicted == num_flows - map.capacity());
+        CHECK(fr.get_batches() == evicted / FLOW_RECORD_BATCH);
+    }
+
+    unsigned batches;
+    std::vector<FlowRecord> recs = read_records(f, batches);
+    CHECK(recs.size() == num_flows);
+
+    uint64_t packets = 0;
+    unsigned shutdown = 0;
+
+    for ( auto& r : recs )
+    {
+        packets += r.packets_a_b + r.packets_b_a;
+
+        if ( r.reason == FLOW_RECORD_SHUTDOWN )
+            ++shutdown;
+    }
+    CHECK(packets == num_flows);
+    CHECK(shutdown == num_flows - evicted);
+
+    fclose(f);
+    delete config;
+}
+
+#endif
@@ -0,0 +1,129 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// flow_record_exporter.h
+
+#ifndef FLOW_RECORD_EXPORTER_H
+#define FLOW_RECORD_EXPORTER_H
+
+// FlowRecordExporter accumulates per flow counts on the packet thread and
+// exports a FlowRecord (see flow_record.h) when the flow ends, at its active
+// timeout, when it has been idle, or when its entry is needed for another
+// flow.  Records are sent in batches to a file or a connector.  Memory is
+// bounded by flow_records_memcap regardless of how many hosts are seen.
+//
+// Timeouts are checked by sweeping a part of the table each second of
+// packet time so the whole table is covered once per timeout.
+
+#include <cstdio>
+#include <string>
+
+#include "flow_ip_table.h"
+#include "flow_record.h"
+#include "perf_module.h"
+
+namespace snort
+{
+class Connector;
+class Flow;
+struct Packet;
+}
+
+#define FLOW_RECORD_BATCH 64
+
+// a is the lower (address, port); the padding must be zero
+struct FlowRecordKey
+{
+    uint32_t ip_a[4];
+    uint32_t ip_b[4];
+    uint16_t port_a;
+    uint16_t port_b;
+    uint8_t proto;
+    uint8_t pad[3];
+};
+
+struct FlowRecordValue
+{
+    uint32_t first_sec;
+    uint32_t last_sec;
+    uint64_t packets_a_b;
+    uint64_t bytes_a_b;
+    uint64_t packets_b_a;
+    uint64_t bytes_b_a;
+    uint8_t tcp_flags;
+};
+
+typedef FlowIPTable<FlowRecordKey, FlowRecordValue> FlowRecordMap;
+
+class FlowRecordExporter
+{
+public:
+    FlowRecordExporter(PerfConfig*);
+    ~FlowRecordExporter();
+
+    FlowRecordExporter(const FlowRecordExporter&) = delete;
+    FlowRecordExporter& operator=(const FlowRecordExporter&) = delete;
+
+    // opens the file or finds the connector for this thread
+    bool open();
+
+    void update(snort::Packet*);
+
+    // exports the flow's record when its tcp session closes
+    void end(snort::Flow*);
+
+    // sends the records batched so far
+    void flush();
+
+    uint64_t get_exported(FlowRecordReason r) const
+    { return exported[r]; }
+
+    uint64_t get_batches() const
+    { return batches; }
+
+#ifdef UNIT_TEST
+    void set_output(FILE* f) { fh = f; }
+#endif
+
+private:
+    void tick(uint32_t now);
+    void sweep(uint32_t now, unsigned n);
+    void export_record(const FlowRecordMap::Entry&, FlowRecordReason);
+
+private:
+    FlowRecordMap* flows;
+    std::string fname;
+    std::string connector_name;
+    snort::Connector* connector = nullptr;
+    FILE* fh = nullptr;
+
+    uint32_t active_timeout;
+    uint32_t idle_timeout;
+    unsigned sweep_per_sec;
+    unsigned sweep_pos = 0;
+    uint32_t last_tick = 0;
+
+    unsigned count = 0;
+    FlowRecordBatch header;
+    FlowRecord records[FLOW_RECORD_BATCH];
+
+    uint64_t exported[FLOW_RECORD_MAX] = { };
+    uint64_t batches = 0;
+};
+
+#endif
@@ -0,0 +1,236 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// latency_tracker.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "latency_tracker.h"
+
+#include <algorithm>
+
+#ifdef UNIT_TEST
+#include "catch/snort_catch.h"
+#include "detection/treenodes.h"
+#endif
+
+#define TRACKER_NAME PERF_NAME "_latency"
+
+using namespace std;
+
+LatencyTracker::LatencyTracker(PerfConfig* perf) : PerfTracker(perf, TRACKER_NAME)
+{
+    // ids added by a reload are picked up when threads restart
+    unsigned num_ids = LatencyHistograms::get_num_ids();
+
+    for ( unsigned id = LH_PACKET; id < num_ids; ++id )
+        ids.emplace_back(id);
+
+    last.resize(ids.size());
+    stats.resize(ids.size());
+    rule_stats.resize(LatencyHistograms::get_max_rules());
+
+    for ( unsigned i = 0; i < ids.size(); ++i )
+    {
+        // dots separate sections from fields in some formats
+        string name = LatencyHistograms::get_name(ids[i]);
+        replace(name.begin(), name.end(), '.', '_');
+
+        formatter->register_section(name);
+        register_stats(stats[i]);
+    }
+
+    for ( unsigned i = 0; i < rule_stats.size(); ++i )
+    {
+        formatter->register_section("rule_" + to_string(i + 1));
+        formatter->register_field("gid", &rule_stats[i].gid);
+        formatter->register_field("sid", &rule_stats[i].sid);
+        formatter->register_field("rev", &rule_stats[i].rev);
+        register_stats(rule_stats[i].stats);
+    }
+    formatter->finalize_fields();
+}
+
+void LatencyTracker::register_stats(Stats& s)
+{
+    formatter->register_field("count", &s.count);
+    formatter->register_field("avg_nsecs", &s.avg);
+    formatter->register_field("p50_nsecs", &s.p50);
+    formatter->register_field("p90_nsecs", &s.p90);
+    formatter->register_field("p99_nsecs", &s.p99);
+    formatter->register_field("p999_nsecs", &s.p999);
+    formatter->register_field("max_nsecs", &s.max);
+}
+
+void LatencyTracker::set_stats(Stats& s, const LatencyHistogram& h)
+{
+    s.count = h.get_count();
+
+    if ( !s.count )
+    {
+        s = Stats();
+        return;
+    }
+    s.avg = LatencyHistograms::to_nsecs(h.get_sum() / s.count);
+    s.p50 = LatencyHistograms::to_nsecs(h.get_percentile(0.50));
+    s.p90 = LatencyHistograms::to_nsecs(h.get_percentile(0.90));
+    s.p99 = LatencyHistograms::to_nsecs(h.get_percentile(0.99));
+    s.p999 = LatencyHistograms::to_nsecs(h.get_percentile(0.999));
+    s.max = LatencyHistograms::to_nsecs(h.get_max());
+}
+
+void LatencyTracker::snapshot()
+{
+    for ( unsigned i = 0; i < ids.size(); ++i )
+    {
+        if ( const LatencyHistogram* h = LatencyHistograms::get_histogram(ids[i]) )
+            last[i] = *h;
+        else
+            last[i].reset();
+    }
+    LatencyHistograms::get_rules(last_rules);
+}
+
+void LatencyTracker::reset()
+{
+    snapshot();
+}
+
+// each interval is the difference from the last snapshot
+void LatencyTracker::process(bool)
+{
+    for ( unsigned i = 0; i < ids.size(); ++i )
+    {
+        const LatencyHistogram* h = LatencyHistograms::get_histogram(ids[i]);
+
+        if ( !h )
+        {
+            stats[i] = Stats();
+            continue;
+        }
+        LatencyHistogram cur(*h);
+        LatencyHistogram diff(cur);
+        diff.subtract(last[i]);
+        last[i] = cur;
+        set_stats(stats[i], diff);
+    }
+
+    LatencyHistograms::get_rules(rules);
+
+    for ( unsigned i = 0; i < rule_stats.size(); ++i )
+    {
+        RuleStats& rs = rule_stats[i];
+
+        if ( i >= rules.size() )
+        {
+            rs = RuleStats();
+            continue;
+        }
+        const LatencyRule& lr = rules[i];
+        LatencyHistogram diff(lr.hist);
+
+        // a slot taken by another rule starts over
+        if ( i < last_rules.size() and last_rules[i].gid == lr.gid and
+            last_rules[i].sid == lr.sid )
+            diff.subtract(last_rules[i].hist);
+
+        rs.gid = lr.gid;
+        rs.sid = lr.sid;
+        rs.rev = lr.rev;
+        set_stats(rs.stats, diff);
+    }
+    last_rules.swap(rules);
+
+    write();
+}
+
+#ifdef UNIT_TEST
+
+class TestLatencyTracker : public LatencyTracker
+{
+public:
+    PerfFormatter* output;
+
+    TestLatencyTracker(PerfConfig* perf) : LatencyTracker(perf)
+    { output = formatter; }
+};
+
+TEST_CASE("latency intervals", "[LatencyTracker]")
+{
+    unsigned id = LatencyHistograms::get_id("inspector.tracker_test");
+    LatencyHistograms::tinit(2);
+
+    OptTreeNode otn[3];
+
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        otn[i].sigInfo.gid = 1;
+        otn[i].sigInfo.sid = 2000 + i;
+        otn[i].sigInfo.rev = 3;
+    }
+
+    PerfConfig config;
+    config.format = PerfFormat::MOCK;
+    TestLatencyTracker tracker(&config);
+    MockFormatter* f = (MockFormatter*)tracker.output;
+
+    // recorded before reset are not in the first interval
+    LatencyHistograms::record(id, hr_duration(1000));
+    tracker.reset();
+
+    for ( unsigned i = 0; i < 100; ++i )
+        LatencyHistograms::record(id, hr_duration(i < 99 ? 10 : 10000));
+
+    LatencyHistograms::record(otn, hr_duration(100));
+    tracker.process(false);
+
+    CHECK(*f->public_values["inspector_tracker_test.count"].pc == 100);
+    CHECK(*f->public_values["inspector_tracker_test.p50_nsecs"].pc ==
+        LatencyHistograms::to_nsecs(10));
+    CHECK(*f->public_values["inspector_tracker_test.p999_nsecs"].pc >=
+        LatencyHistograms::to_nsecs(9000));
+    CHECK(*f->public_values["packet.count"].pc == 0);
+
+    CHECK(*f->public_values["rule_1.sid"].pc == 2000);
+    CHECK(*f->public_values["rule_1.count"].pc == 1);
+    CHECK(*f->public_values["rule_2.count"].pc == 0);
+
+    // only the new records are in the next interval
+    LatencyHistograms::record(id, hr_duration(20));
+    LatencyHistograms::record(otn, hr_duration(100));
+    LatencyHistograms::record(otn + 1, hr_duration(200));
+    tracker.process(false);
+
+    CHECK(*f->public_values["inspector_tracker_test.count"].pc == 1);
+    CHECK(*f->public_values["inspector_tracker_test.max_nsecs"].pc ==
+        LatencyHistograms::to_nsecs(20));
+    CHECK(*f->public_values["rule_1.count"].pc == 1);
+    CHECK(*f->public_values["rule_2.sid"].pc == 2001);
+    CHECK(*f->public_values["rule_2.rev"].pc == 3);
+    CHECK(*f->public_values["rule_2.count"].pc == 1);
+
+    tracker.process(false);
+    CHECK(*f->public_values["inspector_tracker_test.count"].pc == 0);
+    CHECK(*f->public_values["rule_1.count"].pc == 0);
+
+    LatencyHistograms::tterm();
+}
+
+#endif
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// latency_tracker.h
+
+#ifndef LATENCY_TRACKER_H
+#define LATENCY_TRACKER_H
+
+// Reports percentiles of this thread's latency histograms for each interval.
+// Each packet, inspector, and search histogram gets a section; the top rule
+// slots get rule_1 etc. with the gid:sid:rev of the rule that holds it.
+
+#include <vector>
+
+#include "latency/latency_histogram.h"
+
+#include "perf_tracker.h"
+
+class LatencyTracker : public PerfTracker
+{
+public:
+    LatencyTracker(PerfConfig*);
+
+    void reset() override;
+    void process(bool) override;
+
+private:
+    // nsecs except count
+    struct Stats
+    {
+        PegCount count = 0;
+        PegCount avg = 0;
+        PegCount p50 = 0;
+        PegCount p90 = 0;
+        PegCount p99 = 0;
+        PegCount p999 = 0;
+        PegCount max = 0;
+    };
+
+    struct RuleStats
+    {
+        PegCount gid = 0;
+        PegCount sid = 0;
+        PegCount rev = 0;
+        Stats stats;
+    };
+
+    void register_stats(Stats&);
+    void set_stats(Stats&, const LatencyHistogram&);
+    void snapshot();
+
+    std::vector<unsigned> ids;
+    std::vector<LatencyHistogram> last;
+    std::vector<Stats> stats;
+
+    std::vector<LatencyRule> rules;
+    std::vector<LatencyRule> last_rules;
+    std::vector<RuleStats> rule_stats;
+};
+
+#endif
@@ -42,6 +42,9 @@
 // init_output should be implemented where metadata needs to be written on
 // output open.
 //
+// Formatters that return true from write_async also implement encode;
+// PerfTracker then hands the encoded records to a background writer.
+//
 
 #include <ctime>
 #include <string>
@@ -88,6 +91,13 @@ public:
     virtual void write(FILE*, time_t) = 0;
     virtual void finalize_output(FILE*) {}
 
+    // formatters that can encode a record into a buffer have it written by
+    // the perf writer thread instead of the packet thread
+    virtual bool write_async()
+    { return false; }
+
+    virtual void encode(std::string&, time_t) {}
+
 protected:
     std::vector<std::vector<FormatterType>> types;
     std::vector<std::vector<FormatterValue>> values;
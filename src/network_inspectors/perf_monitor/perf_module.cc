@@ -64,6 +64,27 @@ static const Parameter s_params[] =
     { "flow_ip", Parameter::PT_BOOL, nullptr, "false",
       "enable statistics on host pairs" },
 
+    { "latency", Parameter::PT_BOOL, nullptr, "false",
+      "enable latency percentiles for packets, inspectors, searches, and rules" },
+
+    { "flow_cost", Parameter::PT_BOOL, nullptr, "false",
+      "enable the most costly flows, services, and apps from latency flow cost sampling" },
+
+    { "flow_records", Parameter::PT_BOOL, nullptr, "false",
+      "export a binary record for each flow when it ends or times out" },
+
+    { "flow_records_memcap", Parameter::PT_INT, "8200:maxSZ", "52428800",
+      "maximum memory in bytes for open flow records" },
+
+    { "flow_records_active_timeout", Parameter::PT_INT, "1:max32", "1800",
+      "export a record for flows active this many seconds" },
+
+    { "flow_records_idle_timeout", Parameter::PT_INT, "1:max32", "15",
+      "export a record for flows idle this many seconds" },
+
+    { "flow_records_connector", Parameter::PT_STRING, nullptr, nullptr,
+      "send flow records to this connector instead of a file" },
+
     { "packets", Parameter::PT_INT, "0:max32", "10000",
       "minimum packets to report" },
 
@@ -85,7 +106,7 @@ static const Parameter s_params[] =
     { "modules", Parameter::PT_LIST, module_params, nullptr,
       "gather statistics from the specified modules" },
 
-    { "format", Parameter::PT_ENUM, "csv | text | json" FLATBUFFERS_ENUM, "csv",
+    { "format", Parameter::PT_ENUM, "csv | text | json | delta" FLATBUFFERS_ENUM, "csv",
       "output format for stats" },
 
     { "summary", Parameter::PT_BOOL, nullptr, "false",
@@ -136,6 +157,37 @@ bool PerfMonModule::set(const char*, Value& v, SnortConfig*)
         if ( v.get_bool() )
             config->perf_flags |= PERF_FLOWIP;
     }
+    else if ( v.is("latency") )
+    {
+        if ( v.get_bool() )
+            config->perf_flags |= PERF_LATENCY;
+    }
+    else if ( v.is("flow_cost") )
+    {
+        if ( v.get_bool() )
+            config->perf_flags |= PERF_FLOW_COST;
+    }
+    else if ( v.is("flow_records") )
+    {
+        if ( v.get_bool() )
+            config->perf_flags |= PERF_FLOW_RECORDS;
+    }
+    else if ( v.is("flow_records_memcap") )
+    {
+        config->flow_records_memcap = v.get_size();
+    }
+    else if ( v.is("flow_records_active_timeout") )
+    {
+        config->flow_records_active_timeout = v.get_uint32();
+    }
+    else if ( v.is("flow_records_idle_timeout") )
+    {
+        config->flow_records_idle_timeout = v.get_uint32();
+    }
+    else if ( v.is("flow_records_connector") )
+    {
+        config->flow_records_connector = v.get_string();
+    }
     else if ( v.is("packets") )
     {
         config->pkt_cnt = v.get_uint32();
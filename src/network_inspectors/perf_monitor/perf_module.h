@@ -36,6 +36,9 @@
 #define PERF_BASE_MAX   0x00000010
 #define PERF_FLOWIP     0x00000020
 #define PERF_SUMMARY    0x00000040
+#define PERF_LATENCY    0x00000080
+#define PERF_FLOW_COST  0x00000100
+#define PERF_FLOW_RECORDS 0x00000200
 
 #define ROLLOVER_THRESH     512
 #define MAX_PERF_FILE_SIZE  UINT64_MAX
@@ -46,6 +49,7 @@ enum class PerfFormat
     CSV,
     TEXT,
     JSON,
+    DELTA,
     FBS,
     MOCK
 };
@@ -81,6 +85,10 @@ struct PerfConfig
     uint64_t max_file_size = 0;
     int flow_max_port_to_track = 0;
     size_t flowip_memcap = 0;
+    size_t flow_records_memcap = 0;
+    uint32_t flow_records_active_timeout = 0;
+    uint32_t flow_records_idle_timeout = 0;
+    std::string flow_records_connector;
     PerfFormat format = PerfFormat::CSV;
     PerfOutput output = PerfOutput::TO_FILE;
     std::vector<ModuleConfig> modules;
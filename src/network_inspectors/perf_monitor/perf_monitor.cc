@@ -36,8 +36,11 @@
 
 #include "base_tracker.h"
 #include "cpu_tracker.h"
+#include "flow_cost_tracker.h"
 #include "flow_ip_tracker.h"
+#include "flow_record_exporter.h"
 #include "flow_tracker.h"
+#include "latency_tracker.h"
 #include "perf_module.h"
 
 #ifdef UNIT_TEST
@@ -50,6 +53,7 @@ THREAD_LOCAL SimpleStats pmstats;
 THREAD_LOCAL ProfileStats perfmonStats;
 
 static THREAD_LOCAL std::vector<PerfTracker*>* trackers;
+static THREAD_LOCAL FlowRecordExporter* flow_records;
 
 //-------------------------------------------------------------------------
 // class stuff
@@ -134,8 +138,11 @@ public:
         if ( state == SFS_STATE_MAX )
             return;
 
-        FlowIPTracker* tracker = perf_monitor.get_flow_ip();
-        tracker->update_state(&flow->client_ip, &flow->server_ip, state);
+        if ( FlowIPTracker* tracker = perf_monitor.get_flow_ip() )
+            tracker->update_state(&flow->client_ip, &flow->server_ip, state);
+
+        if ( flow_records and state == SFS_STATE_TCP_CLOSED )
+            flow_records->end(flow);
     }
 
 private:
@@ -169,8 +176,22 @@ void PerfMonitor::show(SnortConfig*)
     {
         LogMessage("    Flow IP Memcap:   %zu\n", config->flowip_memcap);
     }
+    LogMessage("  Flow Records:     %s\n",
+        (config->perf_flags & PERF_FLOW_RECORDS) ? "ACTIVE" : "INACTIVE");
+    if (config->perf_flags & PERF_FLOW_RECORDS)
+    {
+        LogMessage("    Memcap:           %zu\n", config->flow_records_memcap);
+        LogMessage("    Active Timeout:   %u\n", config->flow_records_active_timeout);
+        LogMessage("    Idle Timeout:     %u\n", config->flow_records_idle_timeout);
+        if ( !config->flow_records_connector.empty() )
+            LogMessage("    Connector:        %s\n", config->flow_records_connector.c_str());
+    }
     LogMessage("  CPU Stats:    %s\n",
         (config->perf_flags & PERF_CPU) ? "ACTIVE" : "INACTIVE");
+    LogMessage("  Latency Stats:    %s\n",
+        (config->perf_flags & PERF_LATENCY) ? "ACTIVE" : "INACTIVE");
+    LogMessage("  Flow Cost Stats:    %s\n",
+        (config->perf_flags & PERF_FLOW_COST) ? "ACTIVE" : "INACTIVE");
     switch ( config->output )
     {
         case PerfOutput::TO_CONSOLE:
@@ -191,6 +212,9 @@ void PerfMonitor::show(SnortConfig*)
         case PerfFormat::JSON:
             LogMessage("    Output Format:  json\n");
             break;
+        case PerfFormat::DELTA:
+            LogMessage("    Output Format:  delta\n");
+            break;
 #ifdef HAVE_FLATBUFFERS
         case PerfFormat::FBS:
             LogMessage("    Output Format:  flatbuffers\n");
@@ -207,7 +231,10 @@ void PerfMonitor::disable_tracker(size_t i)
 
     if ( tracker == flow_ip_tracker )
     {
-        DataBus::unsubscribe_default(FLOW_STATE_EVENT, flow_ip_handler);
+        // flow records still need the flow events
+        if ( !(config->perf_flags & PERF_FLOW_RECORDS) )
+            DataBus::unsubscribe_default(FLOW_STATE_EVENT, flow_ip_handler);
+
         flow_ip_tracker = nullptr;
     }
 
@@ -226,7 +253,7 @@ bool PerfMonitor::configure(SnortConfig*)
     new PerfIdleHandler(*this);
     new PerfRotateHandler(*this);
 
-    if ( config->perf_flags & PERF_FLOWIP )
+    if ( config->perf_flags & (PERF_FLOWIP | PERF_FLOW_RECORDS) )
         flow_ip_handler = new FlowIPDataHandler(*this);
 
     return config->resolve();
@@ -251,6 +278,13 @@ void PerfMonitor::tinit()
     if (config->perf_flags & PERF_CPU )
         trackers->emplace_back(new CPUTracker(config));
 
+    if (config->perf_flags & PERF_LATENCY )
+        trackers->emplace_back(new LatencyTracker(config));
+
+    // flow cost sampling may be disabled by latency.flow_cost_interval
+    if ( (config->perf_flags & PERF_FLOW_COST) and FlowCost::get_max_entries() )
+        trackers->emplace_back(new FlowCostTracker(config));
+
     for (unsigned i = 0; i < trackers->size(); i++)
     {
         if (!(*trackers)[i]->open(true))
@@ -259,6 +293,18 @@ void PerfMonitor::tinit()
 
     for (auto& tracker : *trackers)
         tracker->reset();
+
+    if ( config->perf_flags & PERF_FLOW_RECORDS )
+    {
+        flow_records = new FlowRecordExporter(config);
+
+        if ( !flow_records->open() )
+        {
+            WarningMessage("Disabling %s flow records\n", PERF_NAME);
+            delete flow_records;
+            flow_records = nullptr;
+        }
+    }
 }
 
 void PerfMonitor::tterm()
@@ -275,6 +321,10 @@ void PerfMonitor::tterm()
         }
         delete trackers;
     }
+
+    // exports the open flows
+    delete flow_records;
+    flow_records = nullptr;
 }
 
 void PerfMonitor::rotate()
@@ -295,7 +345,12 @@ void PerfMonitor::eval(Packet* p)
             tracker->update(p);
             tracker->update_time(p->pkth->ts.tv_sec);
         }
+
+        if ( flow_records )
+            flow_records->update(p);
     }
+    else if ( flow_records )
+        flow_records->flush();
 
     if ( (!p || !p->is_rebuilt()) && !(config->perf_flags & PERF_SUMMARY) )
     {
@@ -27,6 +27,10 @@
 #include <sys/stat.h>
 
 #include <climits>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #include "log/messages.h"
 #include "main/snort_config.h"
@@ -38,12 +42,136 @@
 #endif
 
 #include "csv_formatter.h"
+#include "delta_formatter.h"
 #include "json_formatter.h"
 #include "text_formatter.h"
 
 using namespace snort;
 using namespace std;
 
+//-------------------------------------------------------------------------
+// one background thread writes the records of all async formatters so
+// packet threads only encode.  it runs while any tracker uses it.
+//-------------------------------------------------------------------------
+
+class PerfWriter
+{
+public:
+    static void acquire();
+    static void release();
+
+    // takes ownership of the buffer; pending counts the caller's jobs that
+    // are not written yet and is only accessed under the writer's lock
+    static void post(FILE*, string*, unsigned& pending);
+
+    // wait until everything posted with this count is written
+    static void sync(const unsigned& pending);
+
+private:
+    static void run();
+
+    struct Job
+    {
+        FILE* fh;
+        string* buf;
+        unsigned* pending;
+    };
+
+    static mutex life_mutex;
+    static unsigned refs;
+    static thread* writer;
+
+    static mutex queue_mutex;
+    static condition_variable queued;
+    static condition_variable written;
+    static deque<Job> queue;
+    static bool stop;
+};
+
+mutex PerfWriter::life_mutex;
+unsigned PerfWriter::refs = 0;
+thread* PerfWriter::writer = nullptr;
+
+mutex PerfWriter::queue_mutex;
+condition_variable PerfWriter::queued;
+condition_variable PerfWriter::written;
+deque<PerfWriter::Job> PerfWriter::queue;
+bool PerfWriter::stop = false;
+
+void PerfWriter::acquire()
+{
+    lock_guard<mutex> hold(life_mutex);
+
+    if ( !refs++ )
+    {
+        stop = false;
+        writer = new thread(run);
+    }
+}
+
+void PerfWriter::release()
+{
+    lock_guard<mutex> hold(life_mutex);
+
+    if ( --refs )
+        return;
+
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stop = true;
+    }
+    queued.notify_one();
+    writer->join();
+    delete writer;
+    writer = nullptr;
+}
+
+void PerfWriter::post(FILE* fh, string* buf, unsigned& pending)
+{
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        queue.push_back({ fh, buf, &pending });
+        ++pending;
+    }
+    queued.notify_one();
+}
+
+void PerfWriter::sync(const unsigned& pending)
+{
+    unique_lock<mutex> lock(queue_mutex);
+    written.wait(lock, [&pending]() { return !pending; });
+}
+
+void PerfWriter::run()
+{
+    unique_lock<mutex> lock(queue_mutex);
+
+    while ( true )
+    {
+        queued.wait(lock, []() { return stop or !queue.empty(); });
+
+        // everything posted is written before stopping
+        if ( queue.empty() )
+            break;
+
+        Job job = queue.front();
+        queue.pop_front();
+        lock.unlock();
+
+        fwrite(job.buf->data(), job.buf->size(), 1, job.fh);
+        fflush(job.fh);
+        delete job.buf;
+
+        lock.lock();
+        --*job.pending;
+        written.notify_all();
+    }
+}
+
+//-------------------------------------------------------------------------
+// tracker
+//-------------------------------------------------------------------------
+
 static inline bool check_file_size(FILE* fh, uint64_t max_file_size)
 {
     int fd;
@@ -69,6 +197,7 @@ PerfTracker::PerfTracker(PerfConfig* config, const char* tracker_name)
         case PerfFormat::CSV: formatter = new CSVFormatter(tracker_name); break;
         case PerfFormat::TEXT: formatter = new TextFormatter(tracker_name); break;
         case PerfFormat::JSON: formatter = new JSONFormatter(tracker_name); break;
+        case PerfFormat::DELTA: formatter = new DeltaFormatter(tracker_name); break;
 #ifdef HAVE_FLATBUFFERS
         case PerfFormat::FBS: formatter = new FbsFormatter(tracker_name); break;
 #endif
@@ -86,10 +215,24 @@ PerfTracker::PerfTracker(PerfConfig* config, const char* tracker_name)
     }
 
     this->tracker_name = tracker_name;
+
+    if ( formatter->write_async() )
+    {
+        async = true;
+        PerfWriter::acquire();
+    }
 }
 
 PerfTracker::~PerfTracker()
 {
+    if ( async )
+    {
+        if ( fh )
+            PerfWriter::sync(pending);
+
+        PerfWriter::release();
+    }
+
     formatter->finalize_output(fh);
     delete formatter;
 
@@ -342,6 +485,9 @@ bool PerfTracker::rotate()
 {
     if (fh && fh != stdout)
     {
+        if ( async )
+            PerfWriter::sync(pending);
+
         if (!rotate_file(fname.c_str(), fh, max_file_size))
             return false;
 
@@ -358,7 +504,20 @@ bool PerfTracker::auto_rotate()
     return true;
 }
 
+// with async output the file size checked by auto_rotate() may be behind
+// by what is still queued
 void PerfTracker::write()
 {
-    formatter->write(fh, cur_time);
+    if ( async )
+    {
+        // nothing is queued until open() succeeds
+        if ( !fh )
+            return;
+
+        string* buf = new string;
+        formatter->encode(*buf, cur_time);
+        PerfWriter::post(fh, buf, pending);
+    }
+    else
+        formatter->write(fh, cur_time);
 }
@@ -81,6 +81,8 @@ private:
     std::string tracker_name;
     FILE* fh = nullptr;
     time_t cur_time;
+    bool async = false;
+    unsigned pending = 0;   // async writes not done yet
 };
 #endif
 
@@ -36,7 +36,7 @@
 
 using namespace snort;
 
-THREAD_LOCAL SimpleStats spstats;
+THREAD_LOCAL PsPegStats spstats;
 THREAD_LOCAL ProfileStats psPerfStats;
 
 static void make_port_scan_info(Packet* p, PS_PROTO* proto)
@@ -364,7 +364,11 @@ static void PrintPortscanConf(PortscanConfig* config)
 
     LogMessage("%s\n", buf);
     LogMessage("    Memcap (in bytes): %zu\n", config->memcap);
-    LogMessage("    Number of Nodes:   %zu\n", config->memcap / ps_node_size());
+
+    if ( config->sketch )
+        LogMessage("    Sketch mode:       %s\n", "yes");
+    else
+        LogMessage("    Number of Nodes:   %zu\n", config->memcap / ps_node_size());
 
     if ( config->logfile )
         LogMessage("    Logfile:           %s\n", "yes");
@@ -420,7 +424,10 @@ PortScan::~PortScan()
 
 void PortScan::tinit()
 {
-    ps_init_hash(config->memcap);
+    if ( config->sketch )
+        ps_init_sketch(config);
+    else
+        ps_init_hash(config->memcap);
 }
 
 void PortScan::tterm()
@@ -441,7 +448,7 @@ void PortScan::eval(Packet* p)
     if ( p->packet_flags & PKT_REBUILT_STREAM )
         return;
 
-    ++spstats.total_packets;
+    ++spstats.packets;
     PS_PKT ps_pkt(p);
 
     ps_detect(&ps_pkt);
@@ -33,8 +33,8 @@
 
 #include "ps_detect.h"
 
-#include "hash/xhash.h"
 #include "log/messages.h"
+#include "main/snort_config.h"
 #include "protocols/icmp4.h"
 #include "protocols/packet.h"
 #include "protocols/tcp.h"
@@ -44,19 +44,32 @@
 #include "utils/stats.h"
 
 #include "ps_inspect.h"
+#include "ps_module.h"
+#include "ps_sketch.h"
+#include "ps_table.h"
 
 using namespace snort;
 
-PADDING_GUARD_BEGIN
-struct PS_HASH_KEY
+static THREAD_LOCAL PsTrackerTable* portscan_hash = nullptr;
+
+// in sketch mode there is one sketch per protocol and the estimates for the
+// scanned and scanner keys of the current packet are loaded into these
+// scratch trackers so detection and alerting work as usual
+struct PS_SKETCH_TRACKER
 {
-    int protocol;
-    SfIp scanner;
-    SfIp scanned;
+    PS_TRACKER tracker;
+    PS_HASH_KEY key;
+    PsSketch* sketch;
 };
-PADDING_GUARD_END
 
-static THREAD_LOCAL XHash* portscan_hash = nullptr;
+#define PS_SKETCH_PROTOS 4
+
+static THREAD_LOCAL PsSketch* portscan_sketch[PS_SKETCH_PROTOS] = { };
+static THREAD_LOCAL PS_SKETCH_TRACKER* sketch_trackers = nullptr;   // scanned, scanner
+
+// PS_PROTO_TCP, UDP, ICMP and IP are single bits
+static inline unsigned ps_sketch_index(int proto)
+{ return __builtin_ctz(proto); }
 
 PS_PKT::PS_PKT(Packet* p)
 {
@@ -82,62 +95,64 @@ PortscanConfig::~PortscanConfig()
         ipset_free(watch_ip);
 }
 
-/*
-**  This function is passed into the hash algorithm, so that
-**  we only reuse nodes that aren't priority nodes.  We have to make
-**  sure that we only track so many priority nodes, otherwise we could
-**  have all priority nodes and not be able to allocate more.
-*/
-static int ps_tracker_free(void* key, void* data)
-{
-    if (!key || !data)
-        return 0;
-
-    PS_TRACKER* tracker = (PS_TRACKER*)data;
-
-    if (!tracker->priority_node)
-        return 0;
-
-    /*
-    **  Cycle through the protos to see if it's past the time.
-    **  We only get here if we ARE a priority node.
-    */
-    if (tracker->proto.window >= packet_time())
-        return 1;
-
-    return 0;
-}
-
 void ps_cleanup()
 {
-    if ( portscan_hash )
+    delete portscan_hash;
+    portscan_hash = nullptr;
+
+    for ( auto& sketch : portscan_sketch )
     {
-        xhash_delete(portscan_hash);
-        portscan_hash = nullptr;
+        delete sketch;
+        sketch = nullptr;
     }
+
+    delete[] sketch_trackers;
+    sketch_trackers = nullptr;
 }
 
 unsigned ps_node_size()
-{ return sizeof(PS_HASH_KEY) + sizeof(PS_TRACKER); }
+{ return PsTrackerTable::slot_size(); }
 
 void ps_init_hash(unsigned long memcap)
 {
     if ( portscan_hash )
         return;
 
-    int rows = memcap / ps_node_size();
+    uint32_t seed = SnortConfig::static_hash() ? 3193 : (uint32_t)rand();
+    portscan_hash = new PsTrackerTable(memcap, seed);
+}
+
+void ps_init_sketch(const PortscanConfig* config)
+{
+    if ( sketch_trackers )
+        return;
+
+    int protos = config->detect_scans & PS_PROTO_ALL;
+    unsigned num = __builtin_popcount(protos);
 
-    portscan_hash = xhash_new(rows, sizeof(PS_HASH_KEY), sizeof(PS_TRACKER),
-        memcap, 1, ps_tracker_free, nullptr, 1);
+    if ( !num )
+        return;
+
+    uint32_t seed = SnortConfig::static_hash() ? 3193 : (uint32_t)rand();
+    sketch_trackers = new PS_SKETCH_TRACKER[2];
 
-    if ( !portscan_hash )
-        FatalError("Failed to initialize portscan hash table.\n");
+    for ( unsigned i = 0; i < PS_SKETCH_PROTOS; ++i )
+    {
+        if ( protos & (1 << i) )
+            portscan_sketch[i] = new PsSketch(config->memcap / num, seed);
+    }
 }
 
 void ps_reset()
 {
     if ( portscan_hash )
-        xhash_make_empty(portscan_hash);
+        portscan_hash->clear();
+
+    for ( auto sketch : portscan_sketch )
+    {
+        if ( sketch )
+            sketch->clear();
+    }
 }
 
 //  Check scanner and scanned ips to see if we can filter them out.
@@ -273,24 +288,99 @@ bool PortScan::ps_filter_ignore(PS_PKT* ps_pkt)
 
 /*
 **  Get a tracker node by either finding one or starting a new one.  We may
-**  return null, in which case we wait `til the next packet.
+**  return null, in which case we wait `til the next packet.  The tracker
+**  already found for this packet is pinned so adding the other one can't
+**  evict it.
 */
-static PS_TRACKER* ps_tracker_get(PS_HASH_KEY* key)
+static PS_TRACKER* ps_tracker_get(PS_HASH_KEY* key, const PS_TRACKER* pinned)
 {
-    PS_TRACKER* ht = (PS_TRACKER*)xhash_find(portscan_hash, (void*)key);
+    uint64_t evictions = portscan_hash->get_evictions();
+    PS_TRACKER* ht = portscan_hash->get(*key, packet_time(), pinned);
+
+    if ( !ht )
+        ++spstats.alloc_failures;
+
+    spstats.alloc_prunes += portscan_hash->get_evictions() - evictions;
+    spstats.trackers = portscan_hash->get_count();
+
+    return ht;
+}
 
-    if ( ht )
-        return ht;
+static PS_TRACKER* ps_sketch_get(PS_HASH_KEY* key, unsigned slot, unsigned window)
+{
+    PsSketch* sketch = portscan_sketch[ps_sketch_index(key->protocol)];
 
-    if ( xhash_add(portscan_hash, (void*)key, nullptr) != XHASH_OK )
+    if ( !sketch )
         return nullptr;
 
-    ht = (PS_TRACKER*)xhash_mru(portscan_hash);
+    sketch->roll(packet_time(), window);
 
-    if ( ht )
-        memset(ht, 0x00, sizeof(PS_TRACKER));
+    PS_SKETCH_TRACKER& st = sketch_trackers[slot];
+    memset(&st.tracker, 0, sizeof(st.tracker));
+    st.key = *key;
+    st.sketch = sketch;
 
-    return ht;
+    sketch->load(st.key, st.tracker.proto);
+    return &st.tracker;
+}
+
+static PS_SKETCH_TRACKER* ps_sketch_find(const PS_PROTO* proto)
+{
+    for ( unsigned i = 0; i < 2; ++i )
+    {
+        if ( proto == &sketch_trackers[i].tracker.proto )
+            return &sketch_trackers[i];
+    }
+    return nullptr;
+}
+
+// apply the update to the sketch and reload the estimates; low and high are
+// only the current address and port since the sketch can't keep ranges
+static void ps_sketch_update(PS_PROTO* proto, int ps_cnt, int pri_cnt,
+    const SfIp* ip, unsigned short port)
+{
+    PS_SKETCH_TRACKER* st = ps_sketch_find(proto);
+
+    if ( !st )
+        return;
+
+    st->sketch->update(st->key, ps_cnt, pri_cnt, ip, port);
+
+    unsigned char alerts = proto->alerts;
+    st->sketch->load(st->key, *proto);
+    proto->alerts = alerts;
+
+    if ( ps_cnt > 0 and !pri_cnt )
+    {
+        proto->low_ip.set(*ip);
+        proto->high_ip.set(*ip);
+        proto->low_p = proto->high_p = port;
+    }
+}
+
+static void ps_sketch_alerted(const PS_TRACKER* tracker)
+{
+    if ( !tracker or !tracker->proto.alerts or tracker->proto.alerts == PS_ALERT_GENERATED )
+        return;
+
+    if ( PS_SKETCH_TRACKER* st = ps_sketch_find(&tracker->proto) )
+        st->sketch->set_alerted(st->key);
+}
+
+unsigned PortScan::ps_get_window(int proto)
+{
+    switch ( proto )
+    {
+    case PS_PROTO_TCP:
+        return config->tcp_window;
+    case PS_PROTO_UDP:
+        return config->udp_window;
+    case PS_PROTO_ICMP:
+        return config->icmp_window;
+    case PS_PROTO_IP:
+        return config->ip_window;
+    }
+    return 0;
 }
 
 bool PortScan::ps_tracker_lookup(
@@ -299,6 +389,8 @@ bool PortScan::ps_tracker_lookup(
     PS_HASH_KEY key;
     Packet* p = (Packet*)ps_pkt->pkt;
 
+    memset(&key, 0, sizeof(key));
+
     if (ps_get_proto(ps_pkt, &key.protocol) == -1)
         return false;
 
@@ -318,7 +410,10 @@ bool PortScan::ps_tracker_lookup(
         else
             key.scanned.set(*p->ptrs.ip_api.get_dst());
 
-        *scanned = ps_tracker_get(&key);
+        if ( config->sketch )
+            *scanned = ps_sketch_get(&key, 0, ps_get_window(key.protocol));
+        else
+            *scanned = ps_tracker_get(&key, nullptr);
     }
 
     //  Let's lookup the host that is scanning.
@@ -331,7 +426,10 @@ bool PortScan::ps_tracker_lookup(
         else
             key.scanner.set(*p->ptrs.ip_api.get_src());
 
-        *scanner = ps_tracker_get(&key);
+        if ( config->sketch )
+            *scanner = ps_sketch_get(&key, 1, ps_get_window(key.protocol));
+        else
+            *scanner = ps_tracker_get(&key, *scanned);
     }
 
     return *scanner or *scanned;
@@ -427,6 +525,12 @@ int PortScan::ps_proto_update(PS_PROTO* proto, int ps_cnt, int pri_cnt,
     if (!proto)
         return 0;
 
+    if ( config->sketch )
+    {
+        ps_sketch_update(proto, ps_cnt, pri_cnt, ip, port);
+        return 0;
+    }
+
     /*
     **  If the ps_cnt is negative, that means we are just taking off
     **  for valid connection, and we don't want to do anything else,
@@ -1197,6 +1301,12 @@ int PortScan::ps_detect(PS_PKT* ps_pkt)
         if ( !ps_tracker_alert(ps_pkt, scanner, scanned) )
             return 0;
 
+        if ( config->sketch )
+        {
+            ps_sketch_alerted(scanner);
+            ps_sketch_alerted(scanned);
+        }
+
         /* This is added to address the case of no
          * session and a RST packet going back from the Server. */
         if ( p->ptrs.tcph and (p->ptrs.tcph->th_flags & TH_RST) and !p->flow )
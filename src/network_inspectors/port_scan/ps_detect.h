@@ -86,6 +86,7 @@ struct PortscanConfig
 
     bool alert_all;
     bool logfile;
+    bool sketch;
 
     unsigned tcp_window;
     unsigned udp_window;
@@ -165,6 +166,7 @@ void ps_reset();
 
 unsigned ps_node_size();
 void ps_init_hash(unsigned long);
+void ps_init_sketch(const PortscanConfig*);
 int ps_detect(PS_PKT*);
 
 #endif
@@ -56,6 +56,7 @@ private:
 
     bool ps_filter_ignore(PS_PKT*);
     int ps_get_proto(PS_PKT*, int* proto);
+    unsigned ps_get_window(int proto);
     int ps_detect(PS_PKT*);
 
     bool ps_tracker_lookup(PS_PKT*, PS_TRACKER** scanner, PS_TRACKER** scanned);
@@ -33,6 +33,16 @@ using namespace snort;
 // port_scan params
 //-------------------------------------------------------------------------
 
+static const PegInfo ps_pegs[] =
+{
+    { CountType::SUM, "packets", "number of packets processed by port scan" },
+    { CountType::NOW, "trackers", "current number of trackers" },
+    { CountType::SUM, "alloc_prunes", "number of trackers evicted to make room for new ones" },
+    { CountType::SUM, "alloc_failures", "number of packets without a tracker because the table "
+      "was full of active priority trackers" },
+    { CountType::END, nullptr, nullptr }
+};
+
 // order of protos and scans must match PS_* flags
 #define protos \
     "tcp | udp | icmp | ip | all"
@@ -83,6 +93,10 @@ static const Parameter ps_params[] =
     { "include_midstream", Parameter::PT_BOOL, nullptr, "false",
       "list of CIDRs with optional ports" },
 
+    { "sketch", Parameter::PT_BOOL, nullptr, "false",
+      "estimate counts with fixed size count-min and hyperloglog sketches instead of "
+      "tracking each host; memory stays within memcap for any number of scanners" },
+
     { "tcp_ports", Parameter::PT_TABLE, scan_params, nullptr,
       "TCP port scan configuration (one-to-one)" },
 
@@ -199,7 +213,7 @@ ProfileStats* PortScanModule::get_profile() const
 { return &psPerfStats; }
 
 const PegInfo* PortScanModule::get_pegs() const
-{ return snort::simple_pegs; }
+{ return ps_pegs; }
 
 PegCount* PortScanModule::get_counts() const
 { return (PegCount*)&spstats; }
@@ -258,6 +272,9 @@ bool PortScanModule::set(const char* fqn, Value& v, SnortConfig*)
     else if ( v.is("include_midstream") )
         config->include_midstream = v.get_bool();
 
+    else if ( v.is("sketch") )
+        config->sketch = v.get_bool();
+
     else if ( v.is("watch_ip") )
     {
         IPSET*& ips = config->watch_ip;
@@ -330,6 +347,7 @@ bool PortScanModule::end(const char* fqn, int, SnortConfig*)
     if (strcmp(fqn, "port_scan") == 0)
     {
         static size_t saved_memcap = 0;
+        static bool saved_sketch = false;
 
         if (saved_memcap != 0  )
         {
@@ -337,10 +355,15 @@ bool PortScanModule::end(const char* fqn, int, SnortConfig*)
             {
                 ReloadError("Changing port_scan.memcap requires a restart\n");
             }
+            if (config->sketch != saved_sketch)
+            {
+                ReloadError("Changing port_scan.sketch requires a restart\n");
+            }
         }
         else
         {
             saved_memcap = config->memcap;
+            saved_sketch = config->sketch;
         }
     }
 
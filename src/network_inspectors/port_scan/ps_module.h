@@ -130,7 +130,15 @@
 
 //-------------------------------------------------------------------------
 
-extern THREAD_LOCAL SimpleStats spstats;
+struct PsPegStats
+{
+    PegCount packets;
+    PegCount trackers;
+    PegCount alloc_prunes;
+    PegCount alloc_failures;
+};
+
+extern THREAD_LOCAL PsPegStats spstats;
 extern THREAD_LOCAL snort::ProfileStats psPerfStats;
 
 struct PortscanConfig;
@@ -0,0 +1,298 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// ps_sketch.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ps_sketch.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "utils/util.h"
+
+using namespace snort;
+
+//-------------------------------------------------------------------------
+// count-min
+//-------------------------------------------------------------------------
+
+void PsCountMin::init(size_t bytes)
+{
+    width = bytes / (PS_SKETCH_DEPTH * sizeof(*counts));
+
+    if ( !width )
+        width = 1;
+
+    counts = (int32_t*)snort_calloc(PS_SKETCH_DEPTH * width, sizeof(*counts));
+}
+
+void PsCountMin::release()
+{
+    snort_free(counts);
+    counts = nullptr;
+}
+
+void PsCountMin::clear()
+{ memset(counts, 0, size()); }
+
+void PsCountMin::add(uint32_t h1, uint32_t h2, int delta)
+{
+    for ( unsigned r = 0; r < PS_SKETCH_DEPTH; ++r )
+    {
+        int32_t& c = counts[index(r, h1, h2)];
+        c += delta;
+
+        if ( c < 0 )
+            c = 0;
+    }
+}
+
+int PsCountMin::estimate(uint32_t h1, uint32_t h2) const
+{
+    int32_t est = counts[index(0, h1, h2)];
+
+    for ( unsigned r = 1; r < PS_SKETCH_DEPTH; ++r )
+    {
+        int32_t c = counts[index(r, h1, h2)];
+
+        if ( c < est )
+            est = c;
+    }
+    return est;
+}
+
+//-------------------------------------------------------------------------
+// virtual hyperloglog
+//-------------------------------------------------------------------------
+
+static_assert((PS_SKETCH_VREGS & (PS_SKETCH_VREGS - 1)) == 0, "vregs must be a power of 2");
+
+static const unsigned vreg_bits = 5;
+static_assert((1 << vreg_bits) == PS_SKETCH_VREGS, "vreg_bits must match");
+
+static double hll_alpha(unsigned m)
+{
+    switch ( m )
+    {
+    case 16: return 0.673;
+    case 32: return 0.697;
+    case 64: return 0.709;
+    default: return 0.7213 / (1.0 + 1.079 / m);
+    }
+}
+
+// raw estimate with the linear counting correction for small cardinalities
+static double hll_estimate(unsigned m, double inv_sum, unsigned zeros)
+{
+    double est = hll_alpha(m) * m * m / inv_sum;
+
+    if ( est <= 2.5 * m and zeros )
+        est = m * log((double)m / zeros);
+
+    return est;
+}
+
+void PsVirtualHll::init(size_t bytes)
+{
+    num_regs = bytes > 4 * PS_SKETCH_VREGS ? bytes : 4 * PS_SKETCH_VREGS;
+    regs = (uint8_t*)snort_calloc(num_regs, sizeof(*regs));
+    inv_sum = num_regs;
+    zeros = num_regs;
+}
+
+void PsVirtualHll::release()
+{
+    snort_free(regs);
+    regs = nullptr;
+}
+
+void PsVirtualHll::clear()
+{
+    memset(regs, 0, num_regs);
+    inv_sum = num_regs;
+    zeros = num_regs;
+}
+
+unsigned PsVirtualHll::reg_index(uint32_t key_hash, unsigned vreg) const
+{
+    uint32_t w[2] = { key_hash, vreg };
+    return ps_hash(w, sizeof(w), 0x5bd1e995) % num_regs;
+}
+
+void PsVirtualHll::add(uint32_t key_hash, uint32_t elem_hash)
+{
+    unsigned vreg = elem_hash & (PS_SKETCH_VREGS - 1);
+    uint32_t w = elem_hash >> vreg_bits;
+    uint8_t rank = w ? __builtin_clz(w) - vreg_bits + 1 : 32 - vreg_bits + 1;
+
+    uint8_t& r = regs[reg_index(key_hash, vreg)];
+
+    if ( rank <= r )
+        return;
+
+    if ( !r )
+        --zeros;
+
+    inv_sum += ldexp(1.0, -rank) - ldexp(1.0, -r);
+    r = rank;
+}
+
+double PsVirtualHll::estimate(uint32_t key_hash) const
+{
+    const unsigned s = PS_SKETCH_VREGS;
+    double sum = 0;
+    unsigned z = 0;
+
+    for ( unsigned v = 0; v < s; ++v )
+    {
+        uint8_t r = regs[reg_index(key_hash, v)];
+        sum += ldexp(1.0, -r);
+
+        if ( !r )
+            ++z;
+    }
+
+    double m = num_regs;
+    double est_s = hll_estimate(s, sum, z);
+    double est_m = hll_estimate(num_regs, inv_sum, zeros);
+    double est = (m * s / (m - s)) * (est_s / s - est_m / m);
+
+    return est > 0 ? est : 0;
+}
+
+//-------------------------------------------------------------------------
+// sketch
+//-------------------------------------------------------------------------
+
+PsSketch::PsSketch(size_t memcap, uint32_t s)
+{
+    seed = s;
+
+    // 5/16 to each count-min, 3/16 to each vhll and 1/16 for alerts
+    size_t unit = memcap / 16;
+
+    connections.init(5 * unit);
+    priorities.init(5 * unit);
+    ips.init(3 * unit);
+    ports.init(3 * unit);
+
+    alert_bits = (unit * 8) & ~63;
+
+    if ( alert_bits < 64 )
+        alert_bits = 64;
+
+    alerted = (uint64_t*)snort_calloc(alert_bits / 64, sizeof(*alerted));
+}
+
+PsSketch::~PsSketch()
+{
+    connections.release();
+    priorities.release();
+    ips.release();
+    ports.release();
+    snort_free(alerted);
+}
+
+size_t PsSketch::size() const
+{
+    return connections.size() + priorities.size() + ips.size() + ports.size() +
+        alert_bits / 8;
+}
+
+void PsSketch::clear()
+{
+    connections.clear();
+    priorities.clear();
+    ips.clear();
+    ports.clear();
+    memset(alerted, 0, alert_bits / 8);
+}
+
+void PsSketch::roll(time_t now, unsigned window)
+{
+    if ( now <= window_end )
+        return;
+
+    if ( window_end )
+        clear();
+
+    window_end = now + window;
+}
+
+static inline uint32_t second_hash(const PS_HASH_KEY& key, uint32_t seed)
+{ return ps_hash(key, seed ^ 0x9e3779b9) | 1; }
+
+uint32_t PsSketch::alert_bit(const PS_HASH_KEY& key) const
+{ return ps_hash(key, seed) % alert_bits; }
+
+void PsSketch::set_alerted(const PS_HASH_KEY& key)
+{
+    uint32_t b = alert_bit(key);
+    alerted[b / 64] |= (uint64_t)1 << (b % 64);
+}
+
+bool PsSketch::get_alerted(const PS_HASH_KEY& key) const
+{
+    uint32_t b = alert_bit(key);
+    return alerted[b / 64] & ((uint64_t)1 << (b % 64));
+}
+
+void PsSketch::load(const PS_HASH_KEY& key, PS_PROTO& proto) const
+{
+    uint32_t h1 = ps_hash(key, seed);
+    uint32_t h2 = second_hash(key, seed);
+
+    proto.connection_count = connections.estimate(h1, h2);
+    proto.priority_count = priorities.estimate(h1, h2);
+    proto.u_ip_count = lround(ips.estimate(h1));
+    proto.u_port_count = lround(ports.estimate(h1));
+    proto.alerts = get_alerted(key) ? PS_ALERT_GENERATED : 0;
+    proto.window = window_end;
+}
+
+// mirrors PortScan::ps_proto_update() except that addresses and ports are
+// counted when first seen rather than whenever they change
+void PsSketch::update(const PS_HASH_KEY& key, int ps_cnt, int pri_cnt, const SfIp* ip,
+    unsigned short port)
+{
+    uint32_t h1 = ps_hash(key, seed);
+    uint32_t h2 = second_hash(key, seed);
+
+    if ( ps_cnt < 0 )
+    {
+        connections.add(h1, h2, ps_cnt);
+        return;
+    }
+
+    if ( pri_cnt )
+    {
+        priorities.add(h1, h2, pri_cnt);
+        return;
+    }
+
+    connections.add(h1, h2, ps_cnt);
+
+    uint32_t p = port;
+    ips.add(h1, ps_hash(ip->get_ip6_ptr(), 16, seed + 1));
+    ports.add(h1, ps_hash(&p, sizeof(p), seed + 2));
+}
+
@@ -0,0 +1,133 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// ps_sketch.h
+
+#ifndef PS_SKETCH_H
+#define PS_SKETCH_H
+
+// Sketches for port_scan's sketch mode.  Instead of a tracker per scanner
+// and scanned host, each protocol keeps a fixed set of sketches keyed by
+// the same PS_HASH_KEY:
+//
+// - count-min sketches for the connection and priority (negative response)
+//   counts
+// - virtual HyperLogLogs (vHLL) for the distinct addresses and ports seen
+//   by each key; every key uses PS_SKETCH_VREGS registers picked by hash
+//   from one shared array and the noise added by other keys is subtracted
+//   using an estimate over the whole array
+// - a bitmap of keys that already alerted in the current window
+//
+// Memory is fixed when the sketch is built so it does not grow with the
+// number of scanners; accuracy degrades instead.  All sketches are cleared
+// together when the window expires.
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include "ps_table.h"
+
+#define PS_SKETCH_DEPTH 4
+#define PS_SKETCH_VREGS 32
+
+class PsCountMin
+{
+public:
+    void init(size_t bytes);
+    void release();
+    void clear();
+
+    // negative deltas are applied to every row and clamped at zero
+    void add(uint32_t h1, uint32_t h2, int delta);
+    int estimate(uint32_t h1, uint32_t h2) const;
+
+    size_t size() const
+    { return PS_SKETCH_DEPTH * width * sizeof(*counts); }
+
+private:
+    unsigned index(unsigned row, uint32_t h1, uint32_t h2) const
+    { return row * width + (h1 + row * h2) % width; }
+
+    int32_t* counts = nullptr;
+    unsigned width = 0;
+};
+
+class PsVirtualHll
+{
+public:
+    void init(size_t bytes);
+    void release();
+    void clear();
+
+    void add(uint32_t key_hash, uint32_t elem_hash);
+    double estimate(uint32_t key_hash) const;
+
+    size_t size() const
+    { return num_regs; }
+
+private:
+    unsigned reg_index(uint32_t key_hash, unsigned vreg) const;
+
+    uint8_t* regs = nullptr;
+    unsigned num_regs = 0;
+
+    // maintained over all registers for the noise estimate
+    double inv_sum = 0;
+    unsigned zeros = 0;
+};
+
+class PsSketch
+{
+public:
+    PsSketch(size_t memcap, uint32_t seed);
+    ~PsSketch();
+
+    // clear everything once the window has passed
+    void roll(time_t now, unsigned window);
+
+    // fill proto with the current estimates for key; low and high address
+    // and port are left alone
+    void load(const PS_HASH_KEY&, PS_PROTO&) const;
+
+    void update(const PS_HASH_KEY&, int ps_cnt, int pri_cnt, const snort::SfIp*,
+        unsigned short port);
+
+    void set_alerted(const PS_HASH_KEY&);
+    bool get_alerted(const PS_HASH_KEY&) const;
+
+    void clear();
+    size_t size() const;
+
+private:
+    uint32_t alert_bit(const PS_HASH_KEY&) const;
+
+    PsCountMin connections;
+    PsCountMin priorities;
+    PsVirtualHll ips;
+    PsVirtualHll ports;
+
+    uint64_t* alerted;
+    unsigned alert_bits;
+
+    uint32_t seed;
+    time_t window_end = 0;
+};
+
+#endif
+
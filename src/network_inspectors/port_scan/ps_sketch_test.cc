@@ -0,0 +1,259 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// ps_sketch_test.cc
+// sketch tests and an accuracy versus memory report for sketch mode.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "catch/snort_catch.h"
+
+#include "ps_sketch.h"
+
+#include <cmath>
+#include <cstring>
+
+using namespace snort;
+
+static void make_key(PS_HASH_KEY& key, uint32_t scanner, uint32_t scanned)
+{
+    memset(&key, 0, sizeof(key));
+    key.protocol = PS_PROTO_TCP;
+
+    if ( scanner )
+        key.scanner.set(&scanner, AF_INET);
+    else
+        key.scanner.clear();
+
+    if ( scanned )
+        key.scanned.set(&scanned, AF_INET);
+    else
+        key.scanned.clear();
+}
+
+static SfIp make_ip(uint32_t a)
+{
+    SfIp ip;
+    ip.set(&a, AF_INET);
+    return ip;
+}
+
+TEST_CASE("ps count-min", "[ps_sketch]")
+{
+    PsCountMin cm;
+    cm.init(64 * 1024);
+
+    for ( uint32_t k = 1; k <= 1000; ++k )
+        cm.add(k * 2654435761u, k * 40503u | 1, k % 10);
+
+    unsigned exact = 0;
+
+    for ( uint32_t k = 1; k <= 1000; ++k )
+    {
+        int est = cm.estimate(k * 2654435761u, k * 40503u | 1);
+        CHECK(est >= (int)(k % 10));
+
+        if ( est == (int)(k % 10) )
+            ++exact;
+    }
+    CHECK(exact > 990);
+
+    // decrements clamp at zero
+    cm.add(7, 3, 2);
+    cm.add(7, 3, -5);
+    CHECK(cm.estimate(7, 3) == 0);
+
+    cm.release();
+}
+
+TEST_CASE("ps virtual hll", "[ps_sketch]")
+{
+    PsVirtualHll hll;
+    hll.init(256 * 1024);
+
+    CHECK(hll.estimate(1) == Approx(0).margin(1));
+
+    // background keys with a few elements each
+    for ( uint32_t k = 100; k < 20100; ++k )
+        for ( uint32_t e = 0; e < 3; ++e )
+            hll.add(ps_hash(&k, sizeof(k), 1), ps_hash(&e, sizeof(e), k));
+
+    uint32_t key = 7;
+    uint32_t kh = ps_hash(&key, sizeof(key), 1);
+
+    for ( uint32_t e = 0; e < 500; ++e )
+        hll.add(kh, ps_hash(&e, sizeof(e), 2));
+
+    CHECK(hll.estimate(kh) == Approx(500).epsilon(0.3));
+
+    hll.clear();
+    CHECK(hll.estimate(kh) == Approx(0).margin(1));
+    hll.release();
+}
+
+TEST_CASE("ps sketch one to one", "[ps_sketch]")
+{
+    PsSketch sketch(1024 * 1024, 3193);
+    PS_HASH_KEY scanned;
+    make_key(scanned, 0, 0x0a000001);
+
+    SfIp scanner = make_ip(0xc0a80001);
+    sketch.roll(100, 0);
+
+    for ( unsigned short port = 1; port <= 60; ++port )
+    {
+        sketch.update(scanned, 1, 0, &scanner, port);
+        sketch.update(scanned, 0, 1, &scanner, port);
+    }
+
+    PS_PROTO proto;
+    memset(&proto, 0, sizeof(proto));
+    sketch.load(scanned, proto);
+
+    CHECK(proto.connection_count == 60);
+    CHECK(proto.priority_count == 60);
+    CHECK(proto.u_ip_count <= 2);
+    CHECK(proto.u_port_count == Approx(60).epsilon(0.3));
+    CHECK(proto.alerts == 0);
+
+    sketch.set_alerted(scanned);
+    sketch.load(scanned, proto);
+    CHECK(proto.alerts == PS_ALERT_GENERATED);
+
+    // nothing changes inside the window
+    sketch.roll(100, 0);
+    sketch.load(scanned, proto);
+    CHECK(proto.connection_count == 60);
+
+    sketch.roll(101, 0);
+    sketch.load(scanned, proto);
+    CHECK(proto.connection_count == 0);
+    CHECK(proto.u_port_count == 0);
+    CHECK(proto.alerts == 0);
+}
+
+#ifdef BENCHMARK_TEST
+//-------------------------------------------------------------------------
+// accuracy versus memory over a synthetic mix: many background sources
+// touching 2 ports each on random hosts plus one to one scans (ports),
+// sweeps (hosts), decoy and distributed scans (hosts and ports on one
+// target).  reported per memcap: mean relative error of the distinct
+// counts for the scans and how many scans and background keys cross the
+// default threshold of 25.
+
+static const unsigned background = 500000;
+static const unsigned scans = 100;
+static const unsigned scan_width = 100;
+static const int threshold = 25;
+
+static uint32_t next_rand(uint32_t& s)
+{
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+}
+
+static void report(size_t memcap)
+{
+    PsSketch sketch(memcap, 3193);
+    sketch.roll(100, 60);
+
+    uint32_t r = 1;
+    PS_HASH_KEY key;
+
+    for ( unsigned i = 0; i < background; ++i )
+    {
+        uint32_t src = 0x0b000000 + i;
+        SfIp dst = make_ip(0x0c000000 + next_rand(r) % 100000);
+        SfIp sip = make_ip(src);
+
+        make_key(key, src, 0);
+        sketch.update(key, 1, 0, &dst, 80);
+        sketch.update(key, 1, 0, &dst, 443);
+
+        make_key(key, 0, dst.get_ip4_value());
+        sketch.update(key, 1, 0, &sip, 80);
+    }
+
+    // one to one and decoy / distributed targets are scanned keys; sweeps
+    // are scanner keys
+    double port_err = 0, ip_err = 0;
+    unsigned port_hits = 0, ip_hits = 0;
+
+    for ( unsigned s = 0; s < scans; ++s )
+    {
+        uint32_t target = 0x0d000000 + s;
+        SfIp scanner = make_ip(0x0e000000 + s);
+        make_key(key, 0, target);
+
+        for ( unsigned short p = 1; p <= scan_width; ++p )
+            sketch.update(key, 1, 0, &scanner, p);
+
+        PS_PROTO proto;
+        sketch.load(key, proto);
+        port_err += fabs(proto.u_port_count - (double)scan_width) / scan_width;
+        port_hits += proto.u_port_count >= threshold;
+
+        uint32_t sweeper = 0x0f000000 + s;
+        make_key(key, sweeper, 0);
+
+        for ( unsigned h = 0; h < scan_width; ++h )
+        {
+            SfIp dst = make_ip(0x10000000 + s * scan_width + h);
+            sketch.update(key, 1, 0, &dst, 22);
+        }
+
+        sketch.load(key, proto);
+        ip_err += fabs(proto.u_ip_count - (double)scan_width) / scan_width;
+        ip_hits += proto.u_ip_count >= threshold;
+    }
+
+    unsigned false_hits = 0;
+
+    for ( unsigned i = 0; i < background; i += 100 )
+    {
+        PS_PROTO proto;
+        make_key(key, 0x0b000000 + i, 0);
+        sketch.load(key, proto);
+
+        if ( proto.u_ip_count >= threshold or proto.u_port_count >= threshold )
+            ++false_hits;
+    }
+
+    printf("%8zu KB  port err %5.1f%%  ip err %5.1f%%  scans found %3u/%u  "
+        "sweeps found %3u/%u  false %u/%u\n", sketch.size() / 1024,
+        100 * port_err / scans, 100 * ip_err / scans, port_hits, scans,
+        ip_hits, scans, false_hits, background / 100);
+}
+
+TEST_CASE("ps sketch accuracy", "[ps_sketch]")
+{
+    // one tracker per background source, per background target and per scan
+    size_t trackers = background + 100000 + 2 * scans;
+
+    printf("sketch accuracy with %u background sources, exact trackers need %zu KB\n",
+        background, trackers * PsTrackerTable::slot_size() / 1024);
+
+    for ( size_t memcap : { 256 * 1024, 1024 * 1024, 4 * 1024 * 1024, 16 * 1024 * 1024 } )
+        report(memcap);
+}
+#endif
+
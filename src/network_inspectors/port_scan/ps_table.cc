@@ -0,0 +1,197 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// ps_table.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ps_table.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "utils/util.h"
+
+static_assert(sizeof(PS_HASH_KEY) % sizeof(uint32_t) == 0, "key is hashed as words");
+
+static inline uint32_t rotl(uint32_t x, int r)
+{ return (x << r) | (x >> (32 - r)); }
+
+PsTrackerTable::PsTrackerTable(size_t memcap, uint32_t s)
+{
+    size_t groups = memcap / (slot_size() * PS_TABLE_GROUP);
+    num_groups = groups ? (groups < UINT32_MAX / PS_TABLE_GROUP ? groups :
+        UINT32_MAX / PS_TABLE_GROUP) : 1;
+    seed = s;
+
+    unsigned cap = get_capacity();
+    tags = (uint32_t*)snort_calloc(cap, sizeof(*tags));
+    refs = (uint8_t*)snort_calloc(cap, sizeof(*refs));
+    hands = (uint8_t*)snort_calloc(num_groups, sizeof(*hands));
+    entries = (Entry*)snort_calloc(cap, sizeof(*entries));
+}
+
+PsTrackerTable::~PsTrackerTable()
+{
+    snort_free(tags);
+    snort_free(refs);
+    snort_free(hands);
+    snort_free(entries);
+}
+
+unsigned PsTrackerTable::slot_size()
+{
+    return sizeof(Entry) + sizeof(*tags) + sizeof(*refs) +
+        (sizeof(*hands) + PS_TABLE_GROUP - 1) / PS_TABLE_GROUP;
+}
+
+void PsTrackerTable::clear()
+{
+    unsigned cap = get_capacity();
+    memset(tags, 0, cap * sizeof(*tags));
+    memset(refs, 0, cap * sizeof(*refs));
+    memset(hands, 0, num_groups * sizeof(*hands));
+    count = 0;
+}
+
+uint32_t ps_hash(const void* key, size_t len, uint32_t seed)
+{
+    const uint32_t* w = (const uint32_t*)key;
+    uint32_t h = seed;
+
+    for ( unsigned i = 0; i < len / sizeof(*w); ++i )
+    {
+        uint32_t k = w[i] * 0xcc9e2d51;
+        k = rotl(k, 15) * 0x1b873593;
+        h ^= k;
+        h = rotl(h, 13) * 5 + 0xe6546b64;
+    }
+
+    h ^= len;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+bool PsTrackerTable::evictable(unsigned slot, time_t now, const PS_TRACKER* pinned) const
+{
+    const PS_TRACKER* t = &entries[slot].tracker;
+
+    if ( t == pinned )
+        return false;
+
+    return !t->priority_node or t->proto.window < now;
+}
+
+PS_TRACKER* PsTrackerTable::find(const PS_HASH_KEY& key)
+{
+    uint32_t h = ps_hash(key, seed);
+    uint32_t tag = h | 1;
+    unsigned base = get_group(h) * PS_TABLE_GROUP;
+
+    for ( unsigned s = base; s < base + PS_TABLE_GROUP; ++s )
+    {
+        if ( tags[s] == tag and !memcmp(&entries[s].key, &key, sizeof(key)) )
+        {
+            refs[s] = 1;
+            return &entries[s].tracker;
+        }
+    }
+    return nullptr;
+}
+
+PS_TRACKER* PsTrackerTable::get(const PS_HASH_KEY& key, time_t now, const PS_TRACKER* pinned)
+{
+    uint32_t h = ps_hash(key, seed);
+    uint32_t tag = h | 1;
+    unsigned group = get_group(h);
+    unsigned base = group * PS_TABLE_GROUP;
+
+    unsigned free_slot = UINT32_MAX;
+    unsigned stale_slot = UINT32_MAX;
+
+    for ( unsigned s = base; s < base + PS_TABLE_GROUP; ++s )
+    {
+        if ( tags[s] == tag and !memcmp(&entries[s].key, &key, sizeof(key)) )
+        {
+            refs[s] = 1;
+            return &entries[s].tracker;
+        }
+
+        if ( !tags[s] )
+        {
+            if ( free_slot == UINT32_MAX )
+                free_slot = s;
+        }
+        else if ( stale_slot == UINT32_MAX and entries[s].tracker.proto.window < now and
+            &entries[s].tracker != pinned )
+        {
+            stale_slot = s;
+        }
+    }
+
+    unsigned slot = free_slot != UINT32_MAX ? free_slot : stale_slot;
+
+    if ( slot == UINT32_MAX )
+    {
+        // two passes give every referenced slot its second chance
+        for ( unsigned n = 0; n < 2 * PS_TABLE_GROUP; ++n )
+        {
+            unsigned s = base + hands[group];
+            hands[group] = (hands[group] + 1) % PS_TABLE_GROUP;
+
+            if ( !evictable(s, now, pinned) )
+                continue;
+
+            if ( refs[s] )
+            {
+                refs[s] = 0;
+                continue;
+            }
+            slot = s;
+            break;
+        }
+
+        if ( slot == UINT32_MAX )
+        {
+            ++failures;
+            return nullptr;
+        }
+    }
+
+    if ( tags[slot] )
+        ++evictions;
+    else
+        ++count;
+
+    assert(count <= get_capacity());
+
+    tags[slot] = tag;
+    refs[slot] = 1;
+    entries[slot].key = key;
+    memset(&entries[slot].tracker, 0, sizeof(entries[slot].tracker));
+
+    return &entries[slot].tracker;
+}
+
@@ -0,0 +1,113 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// ps_table.h
+
+#ifndef PS_TABLE_H
+#define PS_TABLE_H
+
+// Fixed capacity tracker table.  Slots are grouped in sets of PS_TABLE_GROUP
+// and a key may only live in the group its hash selects, so a lookup or an
+// insert probes at most one group of contiguous tags.  A full group evicts
+// with CLOCK: a hit sets the slot's reference bit and the group's hand clears
+// bits until it reaches a slot not referenced since its last pass.  Trackers
+// whose window has passed would be reset on their next update so they are
+// reused first, and priority trackers still inside their window are never
+// evicted.  Nothing is allocated after construction so a flood of new
+// scanners costs the same per packet as steady traffic.
+
+#include <cstdint>
+
+#include "utils/cpp_macros.h"
+
+#include "ps_detect.h"
+
+#define PS_TABLE_GROUP 8
+
+PADDING_GUARD_BEGIN
+struct PS_HASH_KEY
+{
+    int protocol;
+    snort::SfIp scanner;
+    snort::SfIp scanned;
+};
+PADDING_GUARD_END
+
+// murmur3 over the words of a key
+uint32_t ps_hash(const void* key, size_t len, uint32_t seed);
+
+inline uint32_t ps_hash(const PS_HASH_KEY& key, uint32_t seed)
+{ return ps_hash(&key, sizeof(key), seed); }
+
+class PsTrackerTable
+{
+public:
+    PsTrackerTable(size_t memcap, uint32_t seed);
+    ~PsTrackerTable();
+
+    // return the tracker for key, adding a cleared one if needed; pinned is
+    // not evicted to make room.  null if every tracker in the group is a
+    // priority tracker inside its window.
+    PS_TRACKER* get(const PS_HASH_KEY&, time_t now, const PS_TRACKER* pinned = nullptr);
+    PS_TRACKER* find(const PS_HASH_KEY&);
+
+    void clear();
+
+    // bytes of memcap used per tracker
+    static unsigned slot_size();
+
+    unsigned get_capacity() const
+    { return num_groups * PS_TABLE_GROUP; }
+
+    unsigned get_count() const
+    { return count; }
+
+    uint64_t get_evictions() const
+    { return evictions; }
+
+    uint64_t get_failures() const
+    { return failures; }
+
+private:
+    struct Entry
+    {
+        PS_HASH_KEY key;
+        PS_TRACKER tracker;
+    };
+
+    unsigned get_group(uint32_t h) const
+    { return ((uint64_t)h * num_groups) >> 32; }
+
+    bool evictable(unsigned slot, time_t now, const PS_TRACKER* pinned) const;
+
+private:
+    uint32_t* tags;     // hash | 1 for a used slot, 0 for a free one
+    uint8_t* refs;
+    uint8_t* hands;     // one per group
+    Entry* entries;
+
+    unsigned num_groups;
+    unsigned count = 0;
+    uint32_t seed;
+
+    uint64_t evictions = 0;
+    uint64_t failures = 0;
+};
+
+#endif
+
@@ -0,0 +1,209 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// ps_table_test.cc
+// tracker table tests and a scan flood benchmark against the xhash the
+// table replaced.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "catch/snort_catch.h"
+#include "hash/xhash.h"
+
+#include "ps_table.h"
+
+#include <chrono>
+#include <cstring>
+
+using namespace snort;
+
+static void make_key(PS_HASH_KEY& key, uint32_t scanner, uint32_t scanned)
+{
+    memset(&key, 0, sizeof(key));
+    key.protocol = PS_PROTO_TCP;
+    key.scanner.set(&scanner, AF_INET);
+    key.scanned.set(&scanned, AF_INET);
+}
+
+TEST_CASE("ps table find and add", "[ps_table]")
+{
+    PsTrackerTable table(64 * PsTrackerTable::slot_size(), 3193);
+    CHECK(table.get_capacity() == 64);
+
+    PS_HASH_KEY key;
+    make_key(key, 1, 2);
+
+    CHECK(table.find(key) == nullptr);
+    PS_TRACKER* t = table.get(key, 100);
+    REQUIRE(t != nullptr);
+    CHECK(t->proto.connection_count == 0);
+    CHECK(table.get_count() == 1);
+
+    t->proto.connection_count = 7;
+    CHECK(table.find(key) == t);
+    CHECK(table.get(key, 100) == t);
+    CHECK(table.get_count() == 1);
+
+    PS_HASH_KEY other;
+    make_key(other, 2, 1);
+    CHECK(table.get(other, 100) != t);
+    CHECK(table.get_count() == 2);
+
+    table.clear();
+    CHECK(table.get_count() == 0);
+    CHECK(table.find(key) == nullptr);
+}
+
+TEST_CASE("ps table eviction", "[ps_table]")
+{
+    // one group so every key competes for the same slots
+    PsTrackerTable table(PS_TABLE_GROUP * PsTrackerTable::slot_size(), 3193);
+    REQUIRE(table.get_capacity() == PS_TABLE_GROUP);
+
+    PS_HASH_KEY keys[PS_TABLE_GROUP + 1];
+    PS_TRACKER* trackers[PS_TABLE_GROUP];
+    const time_t now = 100;
+
+    for ( unsigned i = 0; i < PS_TABLE_GROUP; ++i )
+    {
+        make_key(keys[i], i + 1, 1000);
+        trackers[i] = table.get(keys[i], now);
+        REQUIRE(trackers[i] != nullptr);
+
+        // active priority trackers can't be evicted
+        trackers[i]->priority_node = 1;
+        trackers[i]->proto.window = now + 60;
+    }
+    CHECK(table.get_count() == PS_TABLE_GROUP);
+
+    make_key(keys[PS_TABLE_GROUP], 99, 1000);
+    CHECK(table.get(keys[PS_TABLE_GROUP], now) == nullptr);
+    CHECK(table.get_failures() == 1);
+
+    SECTION("expired windows are reused first")
+    {
+        trackers[3]->proto.window = now - 1;
+        CHECK(table.get(keys[PS_TABLE_GROUP], now) == trackers[3]);
+        CHECK(table.find(keys[3]) == nullptr);
+        CHECK(table.get_evictions() == 1);
+    }
+    SECTION("clock evicts unreferenced ordinary trackers")
+    {
+        trackers[2]->priority_node = 0;
+        trackers[5]->priority_node = 0;
+
+        // the first pass clears both reference bits; 2 is reached first
+        CHECK(table.get(keys[PS_TABLE_GROUP], now) == trackers[2]);
+        CHECK(table.find(keys[2]) == nullptr);
+        CHECK(table.find(keys[5]) == trackers[5]);
+    }
+    SECTION("pinned trackers are kept")
+    {
+        trackers[4]->priority_node = 0;
+        CHECK(table.get(keys[PS_TABLE_GROUP], now, trackers[4]) == nullptr);
+        CHECK(table.find(keys[4]) == trackers[4]);
+    }
+    CHECK(table.get_count() == PS_TABLE_GROUP);
+}
+
+#ifdef BENCHMARK_TEST
+//-------------------------------------------------------------------------
+// a scan flood: every packet is a new scanner so every packet is a miss
+// and an insert into a full table.  the xhash is configured the way
+// port_scan used it before.
+
+static const unsigned flood_memcap = 1048576;
+static const unsigned flood_packets = 10000000;
+
+static int xhash_tracker_free(void* key, void* data)
+{
+    if ( !key or !data )
+        return 0;
+
+    PS_TRACKER* tracker = (PS_TRACKER*)data;
+
+    if ( !tracker->priority_node )
+        return 0;
+
+    return tracker->proto.window >= 100 ? 1 : 0;
+}
+
+static PS_TRACKER* xhash_get(XHash* hash, PS_HASH_KEY& key)
+{
+    PS_TRACKER* t = (PS_TRACKER*)xhash_find(hash, &key);
+
+    if ( t )
+        return t;
+
+    if ( xhash_add(hash, &key, nullptr) != XHASH_OK )
+        return nullptr;
+
+    t = (PS_TRACKER*)xhash_mru(hash);
+
+    if ( t )
+        memset(t, 0, sizeof(*t));
+
+    return t;
+}
+
+template<typename Get>
+static void flood(const char* name, Get get)
+{
+    PS_HASH_KEY key;
+    unsigned found = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for ( unsigned i = 0; i < flood_packets; ++i )
+    {
+        // one in eight packets is from a scanner the table already knows
+        uint32_t scanner = (i & 7) ? i : i % 1024;
+        make_key(key, scanner, 0x0a000001);
+
+        if ( PS_TRACKER* t = get(key) )
+        {
+            t->proto.connection_count++;
+            ++found;
+        }
+    }
+
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+
+    printf("%-6s %.1f ns/packet, %u of %u packets tracked\n", name,
+        1e9 * secs.count() / flood_packets, found, flood_packets);
+}
+
+TEST_CASE("ps table scan flood", "[ps_table]")
+{
+    unsigned rows = flood_memcap / (sizeof(PS_HASH_KEY) + sizeof(PS_TRACKER));
+    XHash* hash = xhash_new(rows, sizeof(PS_HASH_KEY), sizeof(PS_TRACKER),
+        flood_memcap, 1, xhash_tracker_free, nullptr, 1);
+    REQUIRE(hash != nullptr);
+
+    flood("xhash", [hash](PS_HASH_KEY& key) { return xhash_get(hash, key); });
+    xhash_delete(hash);
+
+    PsTrackerTable table(flood_memcap, 3193);
+    flood("table", [&table](PS_HASH_KEY& key) { return table.get(key, 100); });
+
+    printf("table: %u trackers in %u bytes, %lu evictions\n", table.get_capacity(),
+        flood_memcap, (unsigned long)table.get_evictions());
+}
+#endif
+
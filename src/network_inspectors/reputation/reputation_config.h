@@ -83,9 +83,13 @@ struct ReputationConfig
     std::string whitelist_path;
     bool memcap_reached = false;
     uint8_t* reputation_segment = nullptr;
+    size_t segment_size = 0;
     table_flat_t* ip_list = nullptr;
     ListFiles list_files;
     std::string list_dir;
+    std::string database;
+    uint8_t* database_map = nullptr;
+    size_t database_size = 0;
 
     ~ReputationConfig();
 };
@@ -103,6 +107,8 @@ struct ReputationStats
     PegCount whitelisted;
     PegCount monitored;
     PegCount memory_allocated;
+    PegCount lookups;
+    PegCount lookup_ticks;
 };
 
 extern const PegInfo reputation_peg_names[];
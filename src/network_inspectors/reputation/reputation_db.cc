@@ -0,0 +1,402 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// reputation_db.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "reputation_db.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_set>
+
+#include "log/messages.h"
+#include "utils/util.h"
+
+using namespace snort;
+
+// the table is cache line aligned in the file; the mapping itself is page
+// aligned so this holds in memory too
+#define REPUTATION_DB_ALIGN 64
+
+static uint64_t db_align(uint64_t off)
+{ return (off + REPUTATION_DB_ALIGN - 1) & ~(uint64_t)(REPUTATION_DB_ALIGN - 1); }
+
+static bool write_bytes(FILE* fp, const void* buf, size_t len)
+{ return fwrite(buf, 1, len, fp) == len; }
+
+static bool write_db(FILE* fp, ReputationConfig* config)
+{
+    ReputationDbHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    memcpy(hdr.magic, REPUTATION_DB_MAGIC, sizeof(hdr.magic));
+    hdr.version = REPUTATION_DB_VERSION;
+    hdr.byte_order = REPUTATION_DB_BYTE_ORDER;
+    hdr.num_lists = config->list_files.size();
+    hdr.num_entries = sfrt_flat_num_entries(config->ip_list);
+    hdr.lists_offset = sizeof(hdr);
+
+    uint64_t off = hdr.lists_offset;
+
+    for (auto& file : config->list_files)
+        off += sizeof(ReputationDbList) + file->zones.size() * sizeof(uint32_t);
+
+    hdr.table_offset = db_align(off);
+    hdr.table_size = config->segment_size - segment_unusedmem();
+    hdr.file_size = hdr.table_offset + hdr.table_size;
+
+    if ( !write_bytes(fp, &hdr, sizeof(hdr)) )
+        return false;
+
+    for (auto& file : config->list_files)
+    {
+        ReputationDbList rec;
+        memset(&rec, 0, sizeof(rec));
+
+        rec.list_id = file->list_id;
+        rec.num_zones = file->zones.size();
+        rec.file_type = file->file_type;
+        rec.all_zones_enabled = file->all_zones_enabled;
+
+        if ( !write_bytes(fp, &rec, sizeof(rec)) )
+            return false;
+
+        for (auto zone : file->zones)
+        {
+            uint32_t id = zone;
+
+            if ( !write_bytes(fp, &id, sizeof(id)) )
+                return false;
+        }
+    }
+
+    static const uint8_t pad[REPUTATION_DB_ALIGN] = { };
+
+    if ( !write_bytes(fp, pad, hdr.table_offset - off) )
+        return false;
+
+    return write_bytes(fp, config->reputation_segment, hdr.table_size);
+}
+
+bool reputation_db_save(const char* path, ReputationConfig* config)
+{
+    if ( !config->ip_list or !config->reputation_segment )
+    {
+        ErrorMessage("No reputation entries to save in %s.\n", path);
+        return false;
+    }
+
+    std::string tmp = std::string(path) + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+
+    if ( !fp )
+    {
+        ErrorMessage("Unable to create reputation database %s, Error: %s\n", tmp.c_str(),
+            get_error(errno));
+        return false;
+    }
+
+    bool ok = write_db(fp, config);
+
+    if ( fclose(fp) )
+        ok = false;
+
+    if ( ok and rename(tmp.c_str(), path) )
+        ok = false;
+
+    if ( !ok )
+    {
+        ErrorMessage("Unable to write reputation database %s, Error: %s\n", path,
+            get_error(errno));
+        unlink(tmp.c_str());
+    }
+
+    return ok;
+}
+
+static bool check_header(const ReputationDbHeader* hdr, uint64_t size)
+{
+    if ( memcmp(hdr->magic, REPUTATION_DB_MAGIC, sizeof(hdr->magic)) )
+        return false;
+
+    if ( hdr->version != REPUTATION_DB_VERSION or hdr->byte_order != REPUTATION_DB_BYTE_ORDER )
+        return false;
+
+    // list indexes are stored in a byte in each entry
+    if ( hdr->num_lists > UINT8_MAX )
+        return false;
+
+    if ( hdr->file_size != size or hdr->lists_offset < sizeof(*hdr) )
+        return false;
+
+    if ( hdr->table_offset % REPUTATION_DB_ALIGN or hdr->table_offset > size )
+        return false;
+
+    if ( hdr->table_size < sizeof(table_flat_t) or hdr->table_size > size - hdr->table_offset )
+        return false;
+
+    return true;
+}
+
+// lookups follow the offsets and indexes stored in the table without
+// checking them, so everything they can reach is checked once here.  the
+// walk follows the DIR_8x16 layout read by sfrt_flat_dir8x_lookup().
+struct TableCheck
+{
+    const uint8_t* base;
+    uint64_t size;
+    const table_flat_t* table;
+    unsigned num_lists;
+
+    std::unordered_set<MEM_OFFSET> sub_tables;
+    std::unordered_set<MEM_OFFSET> infos;
+};
+
+static const int ip4_widths[] = { 16, 8, 4, 4 };
+static const int ip6_widths[] = { 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 };
+
+static bool in_table(const TableCheck& c, uint64_t off, uint64_t len)
+{ return off <= c.size and len <= c.size - off; }
+
+// a chain may end in one that was already checked but must not loop
+static bool check_info(TableCheck& c, MEM_OFFSET off)
+{
+    std::unordered_set<MEM_OFFSET> chain;
+
+    while ( !c.infos.count(off) )
+    {
+        if ( !in_table(c, off, sizeof(IPrepInfo)) or !chain.emplace(off).second )
+            return false;
+
+        const IPrepInfo* info = (const IPrepInfo*)(c.base + off);
+
+        for ( int i = 0; i < NUM_INDEX_PER_ENTRY; i++ )
+        {
+            int index = info->list_indexes[i];
+
+            if ( index < 0 or index > (int)c.num_lists )
+                return false;
+        }
+
+        if ( !info->next )
+            break;
+
+        off = info->next;
+    }
+
+    c.infos.insert(chain.begin(), chain.end());
+    return true;
+}
+
+static bool check_data(TableCheck& c)
+{
+    const table_flat_t* t = c.table;
+
+    if ( !t->num_ent or t->num_ent > t->max_size or
+        !in_table(c, t->data, (uint64_t)t->max_size * sizeof(INFO)) )
+        return false;
+
+    const INFO* data = (const INFO*)(c.base + t->data);
+
+    for ( uint32_t i = 0; i < t->num_ent; i++ )
+    {
+        if ( data[i] and !check_info(c, data[i]) )
+            return false;
+    }
+    return true;
+}
+
+// sub tables are never shared so each is walked once
+static bool check_sub_table(TableCheck& c, MEM_OFFSET off, const int* widths,
+    unsigned level, unsigned levels)
+{
+    if ( !off or !in_table(c, off, sizeof(dir_sub_table_flat_t)) or
+        !c.sub_tables.emplace(off).second )
+        return false;
+
+    const dir_sub_table_flat_t* sub = (const dir_sub_table_flat_t*)(c.base + off);
+
+    if ( sub->width != widths[level] or sub->num_entries != (1 << widths[level]) or
+        !in_table(c, sub->entries, (uint64_t)sub->num_entries * sizeof(DIR_Entry)) )
+        return false;
+
+    const DIR_Entry* entries = (const DIR_Entry*)(c.base + sub->entries);
+
+    for ( int i = 0; i < sub->num_entries; i++ )
+    {
+        const DIR_Entry& e = entries[i];
+
+        if ( !e.value or e.length )
+        {
+            if ( e.value >= c.table->num_ent )
+                return false;
+        }
+        // lookups stop at the last level
+        else if ( level + 1 < levels and
+            !check_sub_table(c, e.value, widths, level + 1, levels) )
+            return false;
+    }
+    return true;
+}
+
+static bool check_root(TableCheck& c, MEM_OFFSET off, const int* widths, unsigned levels)
+{
+    if ( !off or !in_table(c, off, sizeof(dir_table_flat_t)) )
+        return false;
+
+    const dir_table_flat_t* rt = (const dir_table_flat_t*)(c.base + off);
+
+    if ( rt->dim_size != (int)levels )
+        return false;
+
+    for ( unsigned i = 0; i < levels; i++ )
+    {
+        if ( rt->dimensions[i] != widths[i] )
+            return false;
+    }
+    return check_sub_table(c, rt->sub_table, widths, 0, levels);
+}
+
+static bool check_table(const uint8_t* base, uint64_t size, unsigned num_lists)
+{
+    TableCheck c;
+    c.base = base;
+    c.size = size;
+    c.table = (const table_flat_t*)base;
+    c.num_lists = num_lists;
+
+    if ( c.table->table_flat_type != DIR_8x16 )
+        return false;
+
+    return check_data(c) and
+        check_root(c, c.table->rt, ip4_widths, sizeof(ip4_widths) / sizeof(*ip4_widths)) and
+        check_root(c, c.table->rt6, ip6_widths, sizeof(ip6_widths) / sizeof(*ip6_widths));
+}
+
+static bool load_lists(const ReputationDbHeader* hdr, const uint8_t* base,
+    ReputationConfig* config)
+{
+    uint64_t off = hdr->lists_offset;
+
+    for (unsigned i = 0; i < hdr->num_lists; i++)
+    {
+        if ( off + sizeof(ReputationDbList) > hdr->table_offset )
+            return false;
+
+        const ReputationDbList* rec = (const ReputationDbList*)(base + off);
+        off += sizeof(*rec);
+
+        if ( rec->num_zones > (hdr->table_offset - off) / sizeof(uint32_t) )
+            return false;
+
+        ListFile* list_item = new ListFile;
+        list_item->file_name = config->database;
+        list_item->file_type = rec->file_type;
+        list_item->list_id = rec->list_id;
+        list_item->all_zones_enabled = rec->all_zones_enabled;
+
+        const uint32_t* zones = (const uint32_t*)(base + off);
+        off += rec->num_zones * sizeof(uint32_t);
+
+        for (unsigned z = 0; z < rec->num_zones; z++)
+            list_item->zones.emplace(zones[z]);
+
+        config->list_files.emplace_back(list_item);
+    }
+    return true;
+}
+
+bool reputation_db_load(const char* path, ReputationConfig* config)
+{
+    int fd = open(path, O_RDONLY);
+
+    if ( fd < 0 )
+    {
+        ErrorMessage("Unable to open reputation database %s, Error: %s\n", path,
+            get_error(errno));
+        return false;
+    }
+
+    struct stat st;
+
+    if ( fstat(fd, &st) or (size_t)st.st_size < sizeof(ReputationDbHeader) )
+    {
+        ErrorMessage("Invalid reputation database %s.\n", path);
+        close(fd);
+        return false;
+    }
+
+    // the file is replaced by rename so a shared read only mapping sees one
+    // version for its lifetime and is shared with other generations
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if ( map == MAP_FAILED )
+    {
+        ErrorMessage("Unable to map reputation database %s, Error: %s\n", path,
+            get_error(errno));
+        return false;
+    }
+
+    config->database_map = (uint8_t*)map;
+    config->database_size = st.st_size;
+
+    const ReputationDbHeader* hdr = (const ReputationDbHeader*)map;
+    const uint8_t* base = (const uint8_t*)map;
+
+    if ( !check_header(hdr, st.st_size) or !load_lists(hdr, base, config) or
+        !check_table(base + hdr->table_offset, hdr->table_size, hdr->num_lists) )
+    {
+        ErrorMessage("Invalid reputation database %s.\n", path);
+        reputation_db_unload(config);
+        return false;
+    }
+
+    // lookups only read the table
+    config->ip_list = (table_flat_t*)(base + hdr->table_offset);
+    return true;
+}
+
+void reputation_db_unload(ReputationConfig* config)
+{
+    if ( !config->database_map )
+        return;
+
+    uint8_t* table = (uint8_t*)config->ip_list;
+
+    if ( table >= config->database_map and
+        table < config->database_map + config->database_size )
+        config->ip_list = nullptr;
+
+    munmap(config->database_map, config->database_size);
+    config->database_map = nullptr;
+    config->database_size = 0;
+}
+
@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// reputation_db.h
+
+#ifndef REPUTATION_DB_H
+#define REPUTATION_DB_H
+
+// Compiled reputation database.  The flat IP table only holds offsets from
+// its own start so the segment it was built in can be saved as is and
+// mapped read only later.  The file is:
+//
+//     header | list records (each followed by its zones) | table image
+//
+// Lists keep their file type rather than the decision so priority and white
+// action are still taken from the running config when the file is loaded.
+
+#include <cstdint>
+
+#include "reputation_config.h"
+
+#define REPUTATION_DB_MAGIC      "SNORTREP"
+#define REPUTATION_DB_VERSION    1
+#define REPUTATION_DB_BYTE_ORDER 0x01020304
+
+struct ReputationDbHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_lists;
+    uint32_t num_entries;
+    uint64_t lists_offset;
+    uint64_t table_offset;
+    uint64_t table_size;
+    uint64_t file_size;
+};
+
+struct ReputationDbList
+{
+    uint32_t list_id;
+    uint32_t num_zones;   // uint32_t zone ids follow
+    uint8_t file_type;
+    uint8_t all_zones_enabled;
+    uint8_t reserved[6];
+};
+
+// write the table built by ip_list_init() to path; the file is written
+// next to path and renamed over it so a running snort never maps a
+// partial file
+bool reputation_db_save(const char* path, ReputationConfig*);
+
+// map path read only and point the config at the table and lists in it
+bool reputation_db_load(const char* path, ReputationConfig*);
+void reputation_db_unload(ReputationConfig*);
+
+#endif
+
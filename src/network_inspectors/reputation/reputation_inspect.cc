@@ -32,6 +32,8 @@
 #include "network_inspectors/packet_tracer/packet_tracer.h"
 #include "packet_io/active.h"
 #include "profiler/profiler.h"
+#include "time/clock_defs.h"
+#include "time/stopwatch.h"
 
 #include "reputation_parse.h"
 
@@ -49,6 +51,8 @@ const PegInfo reputation_peg_names[] =
 { CountType::SUM, "whitelisted", "number of packets whitelisted" },
 { CountType::SUM, "monitored", "number of packets monitored" },
 { CountType::SUM, "memory_allocated", "total memory allocated" },
+{ CountType::SUM, "lookups", "number of addresses looked up" },
+{ CountType::SUM, "lookup_ticks", "clock ticks spent looking up addresses" },
 
 { CountType::END, nullptr, nullptr }
 };
@@ -103,6 +107,9 @@ static void print_reputation_conf(ReputationConfig* config)
     LogMessage("    White action: %s %s \n",
         WhiteActionOption[config->white_action],
         config->white_action ==  UNBLACK ? "(Default)" : "");
+    if (config->database.size())
+        LogMessage("    Database: %s\n", config->database.c_str());
+
     if (config->blacklist_path.size())
         LogMessage("    Blacklist File Path: %s\n", config->blacklist_path.c_str());
 
@@ -112,21 +119,24 @@ static void print_reputation_conf(ReputationConfig* config)
     LogMessage("\n");
 }
 
-static inline IPrepInfo* reputation_lookup(ReputationConfig* config, const SfIp* ip)
+// look up all of the addresses together so their table walks overlap
+static inline void reputation_lookup(ReputationConfig* config, const SfIp** ips,
+    GENERIC* results, unsigned num)
 {
-    IPrepInfo* result;
-
-    if (!config->scanlocal)
+    for (unsigned i = 0; i < num; i++)
     {
-        if (ip->is_private() )
-        {
-            return nullptr;
-        }
+        if (!config->scanlocal and ips[i]->is_private())
+            ips[i] = nullptr;
+        else
+            reputationstats.lookups++;
     }
 
-    result = (IPrepInfo*)sfrt_flat_dir8x_lookup(ip, config->ip_list);
+    Stopwatch<SnortClock> sw;
+    sw.start();
+    sfrt_flat_dir8x_lookup_batch(ips, results, num, config->ip_list);
+    sw.stop();
 
-    return (result);
+    reputationstats.lookup_ticks += TO_TICKS(sw.get());
 }
 
 static inline IPdecision get_reputation(ReputationConfig* config, IPrepInfo* rep_info,
@@ -177,26 +187,19 @@ static inline IPdecision get_reputation(ReputationConfig* config, IPrepInfo* rep
 static bool decision_per_layer(ReputationConfig* config, Packet* p,
     uint32_t ingressZone, uint32_t egressZone, const ip::IpApi& ip_api, IPdecision* decision_final)
 {
-    const SfIp* ip;
-    IPdecision decision;
-    IPrepInfo* result;
+    const SfIp* ips[2] = { ip_api.get_src(), ip_api.get_dst() };
+    GENERIC results[2];
 
-    ip = ip_api.get_src();
-    result = reputation_lookup(config, ip);
-    if (result)
-    {
-        decision = get_reputation(config, result, &p->iplist_id, ingressZone, egressZone);
+    reputation_lookup(config, ips, results, 2);
 
-        *decision_final = decision;
-        if ( config->priority == decision)
-            return true;
-    }
-
-    ip = ip_api.get_dst();
-    result = reputation_lookup(config, ip);
-    if (result)
+    // source first, then destination
+    for (auto result : results)
     {
-        decision = get_reputation(config, result, &p->iplist_id, ingressZone, egressZone);
+        if (!result)
+            continue;
+
+        IPdecision decision = get_reputation(config, (IPrepInfo*)result, &p->iplist_id,
+            ingressZone, egressZone);
 
         *decision_final = decision;
         if ( config->priority == decision)
@@ -328,6 +331,17 @@ Reputation::Reputation(ReputationConfig* pc)
     reputation_id = create_reputation_id();
     config = *pc;
     ReputationConfig* conf = &config;
+
+    if (!config.database.empty())
+    {
+        // the table is used in place so this is constant time for any list size
+        if (!load_database(conf))
+            ParseError("reputation: can't load database %s", config.database.c_str());
+
+        reputationstats.memory_allocated = conf->ip_list ? sfrt_flat_usage(conf->ip_list) : 0;
+        return;
+    }
+
     if (!config.list_dir.empty())
         read_manifest(MANIFEST_FILENAME, conf);
 
@@ -46,6 +46,9 @@ static const Parameter s_params[] =
     { "blacklist", Parameter::PT_STRING, nullptr, nullptr,
       "blacklist file name with IP lists" },
 
+    { "database", Parameter::PT_STRING, nullptr, nullptr,
+      "database file compiled by reputation_db; replaces blacklist, whitelist, and list_dir" },
+
     { "list_dir", Parameter::PT_STRING, nullptr, nullptr,
       "directory for IP lists and manifest file" },
 
@@ -111,6 +114,9 @@ bool ReputationModule::set(const char*, Value& v, SnortConfig*)
     if ( v.is("blacklist") )
         conf->blacklist_path = v.get_string();
 
+    else if ( v.is("database") )
+        conf->database = v.get_string();
+
     else if ( v.is("list_dir") )
         conf->list_dir = v.get_string();
 
@@ -160,5 +166,12 @@ bool ReputationModule::end(const char*, int, SnortConfig*)
             conf->priority = WHITELISTED_UNBLACK;
     }
 
+    if ( !conf->database.empty() and (!conf->blacklist_path.empty() or
+        !conf->whitelist_path.empty() or !conf->list_dir.empty()) )
+    {
+        ParseWarning(WARN_CONF, "reputation: lists are ignored when a database is "
+            "configured.\n");
+    }
+
     return true;
 }
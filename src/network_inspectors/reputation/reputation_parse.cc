@@ -36,6 +36,8 @@
 #include "utils/util.h"
 #include "utils/util_cstring.h"
 
+#include "reputation_db.h"
+
 using namespace snort;
 using namespace std;
 
@@ -61,11 +63,6 @@ static char monitor_info[] = "monitorlist";
 #define BLACK_TYPE_KEYWORD       "block"
 #define MONITOR_TYPE_KEYWORD     "monitor"
 
-#define UNKNOWN_LIST    0
-#define MONITOR_LIST    1
-#define BLACK_LIST      2
-#define WHITE_LIST      3
-
 #define MAX_MSGS_TO_PRINT      20
 
 unsigned long total_duplicates;
@@ -80,6 +77,9 @@ ReputationConfig::~ReputationConfig()
     if (reputation_segment != nullptr)
         snort_free(reputation_segment);
 
+    if (database_map != nullptr)
+        reputation_db_unload(this);
+
     for (auto& file : list_files)
     {
         delete file;
@@ -118,6 +118,7 @@ void ip_list_init(uint32_t max_entries, ReputationConfig* config)
         uint32_t mem_size;
         mem_size = estimate_size(max_entries, config->memcap);
         config->reputation_segment = (uint8_t*)snort_alloc(mem_size);
+        config->segment_size = mem_size;
 
         segment_meminit(config->reputation_segment, mem_size);
 
@@ -134,23 +135,29 @@ void ip_list_init(uint32_t max_entries, ReputationConfig* config)
         }
 
         total_duplicates = 0;
-        for (size_t i = 0; i < config->list_files.size(); i++)
-        {
-            config->list_files[i]->list_index = (uint8_t)i + 1;
-            if (config->list_files[i]->file_type == WHITE_LIST)
-            {
-                if (config->white_action == UNBLACK)
-                    config->list_files[i]->list_type = WHITELISTED_UNBLACK;
-                else
-                    config->list_files[i]->list_type = WHITELISTED_TRUST;
-            }
-            else if (config->list_files[i]->file_type == BLACK_LIST)
-                config->list_files[i]->list_type = BLACKLISTED;
-            else if (config->list_files[i]->file_type == MONITOR_LIST)
-                config->list_files[i]->list_type = MONITORED;
+        set_list_types(config);
 
-            load_list_file(config->list_files[i], config);
+        for (auto& file : config->list_files)
+            load_list_file(file, config);
+    }
+}
+
+void set_list_types(ReputationConfig* config)
+{
+    for (size_t i = 0; i < config->list_files.size(); i++)
+    {
+        config->list_files[i]->list_index = (uint8_t)i + 1;
+        if (config->list_files[i]->file_type == WHITE_LIST)
+        {
+            if (config->white_action == UNBLACK)
+                config->list_files[i]->list_type = WHITELISTED_UNBLACK;
+            else
+                config->list_files[i]->list_type = WHITELISTED_TRUST;
         }
+        else if (config->list_files[i]->file_type == BLACK_LIST)
+            config->list_files[i]->list_type = BLACKLISTED;
+        else if (config->list_files[i]->file_type == MONITOR_LIST)
+            config->list_files[i]->list_type = MONITORED;
     }
 }
 
@@ -676,6 +683,21 @@ static void load_list_file(ListFile* list_info, ReputationConfig* config)
     fclose(fp);
 }
 
+bool load_database(ReputationConfig* config)
+{
+    char full_path_filename[PATH_MAX+1];
+
+    update_path_to_file(full_path_filename, PATH_MAX, config->database.c_str());
+    LogMessage("    Loading reputation database %s\n", full_path_filename);
+
+    if (!reputation_db_load(full_path_filename, config))
+        return false;
+
+    set_list_types(config);
+    config->num_entries = sfrt_flat_num_entries(config->ip_list);
+    return true;
+}
+
 static int num_lines_in_file(char* fname)
 {
     FILE* fp;
@@ -24,8 +24,15 @@
 
 #define MANIFEST_FILENAME "zone.info"
 
+#define UNKNOWN_LIST    0
+#define MONITOR_LIST    1
+#define BLACK_LIST      2
+#define WHITE_LIST      3
+
 void ip_list_init(uint32_t,ReputationConfig *config);
+void set_list_types(ReputationConfig* config);
 void estimate_num_entries(ReputationConfig* config);
+bool load_database(ReputationConfig* config);
 int read_manifest(const char* filename, ReputationConfig* config);
 void add_black_white_List(ReputationConfig* config);
 
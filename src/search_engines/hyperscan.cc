@@ -95,11 +95,14 @@ typedef std::vector<Pattern> PatternVector;
 
 // we need to update scratch in the main thread as each pattern is processed
 // and then clone to thread specific after all rules are loaded.  s_scratch is
-// a prototype that is large enough for all uses.
+// a prototype that is large enough for all uses.  it is kept until the last
+// database is freed because some databases (eg appid's) outlive the config
+// they were compiled with and must fit the scratch cloned for later configs.
 
 static hs_scratch_t* s_scratch = nullptr;
 static unsigned int scratch_index;
 static bool scratch_registered = false;
+static unsigned s_databases = 0;
 
 //-------------------------------------------------------------------------
 // mpse
@@ -118,8 +121,16 @@ public:
     ~HyperscanMpse() override
     {
         if ( hs_db )
+        {
             hs_free_database(hs_db);
 
+            if ( !--s_databases and s_scratch )
+            {
+                hs_free_scratch(s_scratch);
+                s_scratch = nullptr;
+            }
+        }
+
         if ( agent )
             user_dtor();
     }
@@ -243,6 +254,8 @@ int HyperscanMpse::prep_patterns(SnortConfig* sc)
         return -2;
     }
 
+    ++s_databases;
+
     if ( hs_error_t err = hs_alloc_scratch(hs_db, &s_scratch) )
     {
         ParseError("can't allocate search scratch space (%d)", err);
@@ -300,12 +313,7 @@ static void scratch_setup(SnortConfig* sc)
         if ( s_scratch )
             hs_clone_scratch(s_scratch, ss);
         else
-            ss = nullptr;
-    }
-    if ( s_scratch )
-    {
-        hs_free_scratch(s_scratch);
-        s_scratch = nullptr;
+            *ss = nullptr;
     }
 }
 
@@ -32,12 +32,18 @@
 #include "sf_ipvar.h"
 
 #include <cassert>
+#include <algorithm>
+#include <vector>
+
 #include "utils/util.h"
 
 #include "sf_cidr.h"
 #include "sf_vartable.h"
 
 #ifdef UNIT_TEST
+#include <chrono>
+#include <string>
+
 #include "catch/snort_catch.h"
 #include "utils/util_cstring.h"
 #endif
@@ -50,6 +56,9 @@ using namespace snort;
 static SfIpRet sfvar_list_compare(sfip_node_t*, sfip_node_t*);
 static inline void sfip_node_free(sfip_node_t*);
 static inline void sfip_node_freelist(sfip_node_t*);
+static void sfvar_free_ranges(sfip_var_t*);
+static void sfvar_copy_ranges(sfip_var_t*, const sfip_var_t*);
+static void sfvar_compile(sfip_var_t*);
 
 static inline sfip_var_t* _alloc_var()
 {
@@ -67,6 +76,8 @@ void sfvar_free(sfip_var_t* var)
     if (var->value)
         snort_free(var->value);
 
+    sfvar_free_ranges(var);
+
     if (var->mode == SFIP_LIST)
     {
         sfip_node_freelist(var->head);
@@ -225,6 +236,7 @@ sfip_var_t* sfvar_deep_copy(const sfip_var_t* var)
     ret->neg_head = _sfvar_deep_copy_list(var->neg_head);
     ret->head_count = var->head_count;
     ret->neg_head_count = var->neg_head_count;
+    sfvar_copy_ranges(ret, var);
 
     return ret;
 }
@@ -331,6 +343,7 @@ static SfIpRet sfvar_add(sfip_var_t* dst, sfip_var_t* src)
     sfip_var_t* copiedvar;
 
     assert(dst and src);
+    sfvar_free_ranges(dst);
 
     if ((copiedvar = sfvar_deep_copy(src)) == nullptr)
     {
@@ -342,6 +355,7 @@ static SfIpRet sfvar_add(sfip_var_t* dst, sfip_var_t* src)
     dst->neg_head = merge_lists(dst->neg_head, copiedvar->neg_head, dst->neg_head_count,
         copiedvar->neg_head_count, dst->neg_head_count);
 
+    sfvar_free_ranges(copiedvar);
     snort_free(copiedvar);
 
     return SFIP_SUCCESS;
@@ -360,6 +374,8 @@ static SfIpRet sfvar_add_node(sfip_var_t* var, sfip_node_t* node, int negated)
     if (!var || !node)
         return SFIP_ARG_ERR;
 
+    sfvar_free_ranges(var);
+
     // As of this writing, 11/20/06, nodes are always added to
     // the list, regardless of the mode (list or table).
 
@@ -480,6 +496,7 @@ sfip_var_t* sfvar_create_alias(const sfip_var_t* alias_from, const char* alias_t
 
     ret->name = snort_strdup(alias_to);
     ret->id = alias_from->id;
+    sfvar_compile(ret);
 
     return ret;
 }
@@ -591,6 +608,8 @@ static void _negate_lists(sfip_var_t* var)
     sfip_node_t* temp;
     uint32_t temp_count;
 
+    sfvar_free_ranges(var);
+
     for (node = var->head; node; node=node->next)
         _negate_node(node);
 
@@ -608,7 +627,7 @@ static void _negate_lists(sfip_var_t* var)
     var->head_count = temp_count;
 }
 
-SfIpRet sfvar_parse_iplist(vartable_t* table, sfip_var_t* var,
+static SfIpRet parse_iplist(vartable_t* table, sfip_var_t* var,
     const char* str, int negation)
 {
     const char* end;
@@ -660,7 +679,7 @@ SfIpRet sfvar_parse_iplist(vartable_t* table, sfip_var_t* var,
             str++;
             list_tok = snort_strndup(str, end - str);
 
-            if ((ret = sfvar_parse_iplist(table, var, list_tok,
+            if ((ret = parse_iplist(table, var, list_tok,
                     negation ^ neg_ip)) != SFIP_SUCCESS)
             {
                 snort_free(list_tok);
@@ -781,6 +800,17 @@ SfIpRet sfvar_parse_iplist(vartable_t* table, sfip_var_t* var,
     return SFIP_SUCCESS;
 }
 
+SfIpRet sfvar_parse_iplist(vartable_t* table, sfip_var_t* var,
+    const char* str, int negation)
+{
+    SfIpRet ret = parse_iplist(table, var, str, negation);
+
+    if ( ret == SFIP_SUCCESS )
+        sfvar_compile(var);
+
+    return ret;
+}
+
 SfIpRet sfvar_validate(sfip_var_t* var)
 {
     sfip_node_t* idx, * neg_idx;
@@ -934,6 +964,266 @@ sfip_var_t* sfvar_alloc(vartable_t* table, const char* variable, SfIpRet* status
     return ret;
 }
 
+//--------------------------------------------------------------------------
+// compiled ranges
+//
+// each var is compiled to the set of addresses it matches: the union of
+// the positive nodes minus the union of the negated nodes, kept per family
+// as sorted, disjoint ranges.  a lookup is then a binary search for the
+// last range starting at or below the address, with no branches on the
+// data in the search loop.  this gives the same answers as the list walk
+// below including its quirks: a positive node that is not set (any)
+// matches both families, a v4 node with a zero address matches all of v4,
+// and a var without positive nodes matches everything not negated.
+//--------------------------------------------------------------------------
+
+// v6 addresses in host order; v4 addresses are built in lo
+struct SfIpKey
+{
+    uint64_t hi;
+    uint64_t lo;
+};
+
+struct SfIpKeyRange
+{
+    SfIpKey start;
+    SfIpKey end;
+};
+
+struct sfip_ranges_t
+{
+    std::vector<uint32_t> start4;
+    std::vector<uint32_t> end4;
+    std::vector<SfIpKey> start6;
+    std::vector<SfIpKey> end6;
+};
+
+static inline bool key_le(const SfIpKey& a, const SfIpKey& b)
+{ return (a.hi < b.hi) | ((a.hi == b.hi) & (a.lo <= b.lo)); }
+
+static inline bool key_lt(const SfIpKey& a, const SfIpKey& b)
+{ return (a.hi < b.hi) | ((a.hi == b.hi) & (a.lo < b.lo)); }
+
+static inline bool key_eq(const SfIpKey& a, const SfIpKey& b)
+{ return a.hi == b.hi and a.lo == b.lo; }
+
+static inline SfIpKey key_next(const SfIpKey& a)
+{ return { a.hi + (a.lo == UINT64_MAX), a.lo + 1 }; }
+
+static inline SfIpKey key_prev(const SfIpKey& a)
+{ return { a.hi - (a.lo == 0), a.lo - 1 }; }
+
+static inline SfIpKey key_from_ip6(const uint32_t* w)
+{
+    return { ((uint64_t)ntohl(w[0]) << 32) | ntohl(w[1]),
+             ((uint64_t)ntohl(w[2]) << 32) | ntohl(w[3]) };
+}
+
+static const SfIpKeyRange all4 = { { 0, 0 }, { 0, UINT32_MAX } };
+static const SfIpKeyRange all6 = { { 0, 0 }, { UINT64_MAX, UINT64_MAX } };
+
+static void add_node_ranges(const sfip_node_t* node, bool positive,
+    std::vector<SfIpKeyRange>& v4, std::vector<SfIpKeyRange>& v6)
+{
+    const SfCidr* cidr = node->ip;
+
+    if ( positive and !cidr->is_set() )
+    {
+        v4.push_back(all4);
+        v6.push_back(all6);
+        return;
+    }
+
+    const SfIp* addr = cidr->get_addr();
+    unsigned bits = cidr->get_bits();
+
+    if ( addr->get_family() == AF_INET )
+    {
+        uint32_t ip = ntohl(addr->get_ip4_value());
+
+        if ( !ip or bits <= 96 )
+        {
+            v4.push_back(all4);
+            return;
+        }
+        uint32_t mask = UINT32_MAX << (128 - bits);
+        v4.push_back({ { 0, ip & mask }, { 0, (ip & mask) | ~mask } });
+    }
+    else if ( addr->get_family() == AF_INET6 )
+    {
+        SfIpKey ip = key_from_ip6(addr->get_ip6_ptr());
+        uint64_t hi_mask, lo_mask;
+
+        if ( bits >= 128 )
+            hi_mask = lo_mask = UINT64_MAX;
+        else if ( bits >= 64 )
+        {
+            hi_mask = UINT64_MAX;
+            lo_mask = bits > 64 ? UINT64_MAX << (128 - bits) : 0;
+        }
+        else
+        {
+            hi_mask = bits ? UINT64_MAX << (64 - bits) : 0;
+            lo_mask = 0;
+        }
+        v6.push_back({ { ip.hi & hi_mask, ip.lo & lo_mask },
+            { ip.hi | ~hi_mask, ip.lo | ~lo_mask } });
+    }
+}
+
+// sort and merge overlapping or adjacent ranges
+static void merge_ranges(std::vector<SfIpKeyRange>& v)
+{
+    std::sort(v.begin(), v.end(),
+        [](const SfIpKeyRange& a, const SfIpKeyRange& b)
+        { return key_lt(a.start, b.start); });
+
+    size_t n = 0;
+
+    for ( auto& r : v )
+    {
+        if ( n )
+        {
+            SfIpKeyRange& last = v[n - 1];
+
+            if ( key_eq(last.end, all6.end) or key_le(r.start, key_next(last.end)) )
+            {
+                if ( key_lt(last.end, r.end) )
+                    last.end = r.end;
+                continue;
+            }
+        }
+        v[n++] = r;
+    }
+    v.resize(n);
+}
+
+// remove the negated ranges; both are sorted and disjoint
+static void subtract_ranges(std::vector<SfIpKeyRange>& pos, const std::vector<SfIpKeyRange>& neg)
+{
+    std::vector<SfIpKeyRange> out;
+    size_t j = 0;
+
+    for ( auto r : pos )
+    {
+        while ( j < neg.size() and key_lt(neg[j].end, r.start) )
+            ++j;
+
+        bool covered = false;
+
+        for ( size_t k = j; k < neg.size() and key_le(neg[k].start, r.end); ++k )
+        {
+            if ( key_lt(r.start, neg[k].start) )
+                out.push_back({ r.start, key_prev(neg[k].start) });
+
+            if ( key_le(r.end, neg[k].end) )
+            {
+                covered = true;
+                break;
+            }
+            r.start = key_next(neg[k].end);
+        }
+        if ( !covered )
+            out.push_back(r);
+    }
+    pos.swap(out);
+}
+
+static void sfvar_free_ranges(sfip_var_t* var)
+{
+    delete var->ranges;
+    var->ranges = nullptr;
+}
+
+static void sfvar_copy_ranges(sfip_var_t* dst, const sfip_var_t* src)
+{
+    sfvar_free_ranges(dst);
+
+    if ( src->ranges )
+        dst->ranges = new sfip_ranges_t(*src->ranges);
+}
+
+static void sfvar_compile(sfip_var_t* var)
+{
+    sfvar_free_ranges(var);
+
+    std::vector<SfIpKeyRange> pos4, pos6, neg4, neg6;
+
+    if ( !var->head )
+    {
+        pos4.push_back(all4);
+        pos6.push_back(all6);
+    }
+
+    for ( const sfip_node_t* node = var->head; node; node = node->next )
+        add_node_ranges(node, true, pos4, pos6);
+
+    for ( const sfip_node_t* node = var->neg_head; node; node = node->next )
+        add_node_ranges(node, false, neg4, neg6);
+
+    merge_ranges(pos4);
+    merge_ranges(pos6);
+    merge_ranges(neg4);
+    merge_ranges(neg6);
+
+    subtract_ranges(pos4, neg4);
+    subtract_ranges(pos6, neg6);
+
+    sfip_ranges_t* ranges = new sfip_ranges_t;
+
+    for ( auto& r : pos4 )
+    {
+        ranges->start4.push_back((uint32_t)r.start.lo);
+        ranges->end4.push_back((uint32_t)r.end.lo);
+    }
+    for ( auto& r : pos6 )
+    {
+        ranges->start6.push_back(r.start);
+        ranges->end6.push_back(r.end);
+    }
+    var->ranges = ranges;
+}
+
+static inline bool sfvar_ranges_in4(const sfip_ranges_t* ranges, const SfIp* ip)
+{
+    unsigned n = ranges->start4.size();
+
+    if ( !n )
+        return false;
+
+    uint32_t key = ntohl(ip->get_ip4_value());
+    const uint32_t* start = ranges->start4.data();
+    const uint32_t* base = start;
+
+    while ( n > 1 )
+    {
+        unsigned half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    return *base <= key and key <= ranges->end4[base - start];
+}
+
+static inline bool sfvar_ranges_in6(const sfip_ranges_t* ranges, const SfIp* ip)
+{
+    unsigned n = ranges->start6.size();
+
+    if ( !n )
+        return false;
+
+    SfIpKey key = key_from_ip6(ip->get_ip6_ptr());
+    const SfIpKey* start = ranges->start6.data();
+    const SfIpKey* base = start;
+
+    while ( n > 1 )
+    {
+        unsigned half = n / 2;
+        base = key_le(base[half], key) ? base + half : base;
+        n -= half;
+    }
+    return key_le(*base, key) and key_le(key, ranges->end6[base - start]);
+}
+
 /* Support function for sfvar_ip_in  */
 static inline bool sfvar_ip_in4(sfip_var_t* var, const SfIp* ip)
 {
@@ -1073,6 +1363,14 @@ bool sfvar_ip_in(sfip_var_t* var, const SfIp* ip)
     if (!var || !ip)
         return false;
 
+    if ( var->ranges )
+    {
+        if ( ip->get_family() == AF_INET )
+            return sfvar_ranges_in4(var->ranges, ip);
+
+        return sfvar_ranges_in6(var->ranges, ip);
+    }
+
     /* Since this is a performance-critical function it uses different
      * codepaths for IPv6 and IPv4 traffic, rather than the dual-stack
      * functions. */
@@ -1265,5 +1563,261 @@ TEST_CASE("SfIpVarAny", "[SfIpVar]")
     sfvt_free_table(table);
 }
 
+// the list walk is the reference for the compiled ranges
+static bool list_ip_in(sfip_var_t* var, const SfIp* ip)
+{
+    sfip_ranges_t* ranges = var->ranges;
+    var->ranges = nullptr;
+    bool in = sfvar_ip_in(var, ip);
+    var->ranges = ranges;
+    return in;
+}
+
+static uint32_t next_rand(uint32_t& r)
+{
+    r = r * 1103515245 + 12345;
+    return r >> 8;
+}
+
+static void make_ip(SfIp& ip, uint32_t r, bool v6)
+{
+    if ( v6 )
+    {
+        uint32_t a[4] = { htonl(0x20010db8), htonl(r & 0xffff0000), 0, htonl(r & 0xff) };
+        ip.set(a, AF_INET6);
+    }
+    else
+    {
+        uint32_t a = htonl(0x0a000000 | (r & 0x00ffffff));
+        ip.set(&a, AF_INET);
+    }
+}
+
+TEST_CASE("SfIpVarRanges", "[SfIpVar]")
+{
+    vartable_t* table = sfvt_alloc_table();
+    sfip_var_t* var;
+    SfIp ip;
+
+    CHECK(sfvt_add_str(table, "home [ 10.0.0.0/8, !10.1.0.0/16, !10.2.3.4, 192.168.1.0/24, "
+        "2001:db8::/32, !2001:db8:1::/48 ]", &var) == SFIP_SUCCESS);
+    REQUIRE(var->ranges != nullptr);
+
+    // 10/8 less the negations and 192.168.1/24
+    CHECK(var->ranges->start4.size() == 4);
+    CHECK(var->ranges->start6.size() == 2);
+
+    ip.set("10.0.255.255");
+    CHECK(sfvar_ip_in(var, &ip));
+    ip.set("10.1.0.0");
+    CHECK(!sfvar_ip_in(var, &ip));
+    ip.set("10.2.3.4");
+    CHECK(!sfvar_ip_in(var, &ip));
+    ip.set("10.2.3.5");
+    CHECK(sfvar_ip_in(var, &ip));
+    ip.set("11.0.0.0");
+    CHECK(!sfvar_ip_in(var, &ip));
+    ip.set("2001:db8:1::1");
+    CHECK(!sfvar_ip_in(var, &ip));
+    ip.set("2001:db8:2::1");
+    CHECK(sfvar_ip_in(var, &ip));
+
+    // only negations match everything else in both families
+    CHECK(sfvt_add_str(table, "nets [ 10.0.0.0/8, 2001:db8::/32 ]", &var) == SFIP_SUCCESS);
+    CHECK(sfvt_add_str(table, "ext [ !$nets ]", &var) == SFIP_SUCCESS);
+    ip.set("11.1.2.3");
+    CHECK(sfvar_ip_in(var, &ip));
+    ip.set("10.0.0.1");
+    CHECK(!sfvar_ip_in(var, &ip));
+    ip.set("fe80::1");
+    CHECK(sfvar_ip_in(var, &ip));
+
+    // adjacent addresses are merged
+    CHECK(sfvt_add_str(table, "adj [ 1.2.3.4, 1.2.3.5, 1.2.3.6/31, 255.255.255.255 ]", &var)
+        == SFIP_SUCCESS);
+    CHECK(var->ranges->start4.size() == 2);
+    ip.set("1.2.3.7");
+    CHECK(sfvar_ip_in(var, &ip));
+    ip.set("1.2.3.8");
+    CHECK(!sfvar_ip_in(var, &ip));
+    ip.set("255.255.255.255");
+    CHECK(sfvar_ip_in(var, &ip));
+
+    CHECK(sfvt_add_str(table, "all [ any ]", &var) == SFIP_SUCCESS);
+    ip.set("::1");
+    CHECK(sfvar_ip_in(var, &ip));
+
+    // aliases are compiled too
+    CHECK(sfvt_add_str(table, "alias $home", &var) == SFIP_SUCCESS);
+    CHECK(var->ranges != nullptr);
+
+    sfvt_free_table(table);
+}
+
+TEST_CASE("SfIpVarDeepCopyRanges", "[SfIpVar]")
+{
+    vartable_t* table = sfvt_alloc_table();
+    sfip_var_t* var;
+    SfIp ip;
+
+    CHECK(sfvt_add_str(table, "home [ 10.0.0.0/8, !10.1.0.0/16, 2001:db8::/32 ]", &var)
+        == SFIP_SUCCESS);
+    REQUIRE(var->ranges != nullptr);
+
+    // rule headers are copied this way and must keep the binary search
+    sfip_var_t* copy = sfvar_deep_copy(var);
+    REQUIRE(copy->ranges != nullptr);
+    CHECK(copy->ranges != var->ranges);
+    CHECK(copy->ranges->start4 == var->ranges->start4);
+    CHECK(copy->ranges->end4 == var->ranges->end4);
+    CHECK(copy->ranges->start6.size() == var->ranges->start6.size());
+
+    // the copy searches its own ranges, not the lists
+    sfip_node_t* head = copy->head;
+    copy->head = nullptr;
+
+    ip.set("10.0.0.1");
+    CHECK(sfvar_ip_in(copy, &ip));
+    ip.set("10.1.0.1");
+    CHECK(!sfvar_ip_in(copy, &ip));
+    ip.set("2001:db8::1");
+    CHECK(sfvar_ip_in(copy, &ip));
+
+    copy->head = head;
+    sfvar_free(copy);
+    sfvt_free_table(table);
+}
+
+TEST_CASE("SfIpVarRangesMatchLists", "[SfIpVar]")
+{
+    vartable_t* table = sfvt_alloc_table();
+    uint32_t r = 1;
+
+    for ( unsigned v = 0; v < 200; ++v )
+    {
+        // positive /16s and /12s with more specific negations inside them
+        std::string str = "v" + std::to_string(v) + " [";
+        unsigned num = 1 + next_rand(r) % 12;
+
+        for ( unsigned i = 0; i < num; ++i )
+        {
+            unsigned b = next_rand(r) % 64;
+            bool v6 = next_rand(r) % 4 == 0;
+
+            if ( v6 )
+                str += " 2001:db8:" + std::to_string(b) + "::/48,";
+            else
+                str += " 10." + std::to_string(b) + ".0.0/" + (b % 2 ? "12," : "16,");
+
+            if ( next_rand(r) % 2 )
+            {
+                unsigned c = next_rand(r) % 4;
+
+                if ( v6 )
+                    str += " !2001:db8:" + std::to_string(b) + ":" + std::to_string(c) + "::/64,";
+                else
+                    str += " !10." + std::to_string(b) + "." + std::to_string(c) + ".0/24,";
+            }
+        }
+        str += " ]";
+
+        sfip_var_t* var;
+        SfIpRet ret = sfvt_add_str(table, str.c_str(), &var);
+
+        // overlapping picks can still make a negation more general
+        if ( ret == SFIP_CONFLICT )
+            continue;
+
+        INFO(str);
+        REQUIRE(ret == SFIP_SUCCESS);
+        REQUIRE(var->ranges != nullptr);
+
+        unsigned mismatches = 0;
+
+        for ( unsigned i = 0; i < 2000; ++i )
+        {
+            SfIp ip;
+            make_ip(ip, next_rand(r) & 0x3f03ff, i % 4 == 0);
+
+            if ( sfvar_ip_in(var, &ip) != list_ip_in(var, &ip) )
+                ++mismatches;
+        }
+        CHECK(mismatches == 0);
+    }
+    sfvt_free_table(table);
+}
+
+#ifdef BENCHMARK_TEST
+// a rule header check is a source and destination lookup with typical
+// HOME_NET / EXTERNAL_NET vars.  each size is the number of /24s in
+// HOME_NET; a quarter of them have a negated host and there is a /48 for
+// every 8 of them.  EXTERNAL_NET is everything but the /24s.
+TEST_CASE("SfIpVar rule header check", "[SfIpVar]")
+{
+    const unsigned num_pkts = 1 << 16;
+    const unsigned loops = 16;
+
+    for ( unsigned size : { 4, 32, 256, 2048 } )
+    {
+        vartable_t* table = sfvt_alloc_table();
+        std::string home = "HOME_NET [";
+        std::string ext = "EXTERNAL_NET [";
+        uint32_t r = 7;
+
+        for ( unsigned i = 0; i < size; ++i )
+        {
+            uint32_t net = (i * 40503u) & 0xffff;
+            std::string n = "10." + std::to_string(net >> 8) + "." + std::to_string(net & 0xff);
+            home += " " + n + ".0/24,";
+            ext += " !" + n + ".0/24,";
+
+            if ( i % 4 == 0 )
+                home += " !" + n + ".1,";
+
+            if ( i % 8 == 0 )
+                home += " 2001:db8:" + std::to_string(i) + "::/48,";
+        }
+        home += " ]";
+        ext += " ]";
+
+        sfip_var_t* home_net;
+        sfip_var_t* ext_net;
+        REQUIRE(sfvt_add_str(table, home.c_str(), &home_net) == SFIP_SUCCESS);
+        REQUIRE(sfvt_add_str(table, ext.c_str(), &ext_net) == SFIP_SUCCESS);
+
+        std::vector<SfIp> pkts(num_pkts);
+
+        for ( auto& ip : pkts )
+            make_ip(ip, next_rand(r), next_rand(r) % 8 == 0);
+
+        for ( bool lists : { true, false } )
+        {
+            sfip_ranges_t* home_ranges = home_net->ranges;
+            sfip_ranges_t* ext_ranges = ext_net->ranges;
+
+            if ( lists )
+                home_net->ranges = ext_net->ranges = nullptr;
+
+            unsigned hits = 0;
+            auto start = std::chrono::steady_clock::now();
+
+            for ( unsigned l = 0; l < loops; ++l )
+                for ( unsigned i = 0; i < num_pkts; ++i )
+                    hits += sfvar_ip_in(ext_net, &pkts[i]) and
+                        sfvar_ip_in(home_net, &pkts[(i + 1) % num_pkts]);
+
+            std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+
+            home_net->ranges = home_ranges;
+            ext_net->ranges = ext_ranges;
+
+            printf("%5u nets %-6s %8.1f ns/header (%u)\n", size, lists ? "lists" : "ranges",
+                ns.count() / (loops * num_pkts), hits);
+        }
+        sfvt_free_table(table);
+    }
+}
+#endif
+
 #endif
 
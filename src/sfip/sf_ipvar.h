@@ -43,6 +43,8 @@ struct SfIp;
 struct SfCidr;
 }
 
+struct sfip_ranges_t;
+
 /* Selects which mode a given variable is using to
  * store and lookup IP addresses */
 typedef enum _modes
@@ -71,13 +73,13 @@ struct sfip_var_t
      * or any other method added later */
     MODES mode;
 
-    /* Linked lists.  Switch to something faster later */
+    /* Linked lists.  These are what is parsed, merged, and compared */
     sfip_node_t* head;
     sfip_node_t* neg_head;
 
-    /* The mode above will select whether to use the sfip_node_t linked list
-     * or the IP routing table */
-//    sfrt rt;
+    /* Sorted, disjoint address ranges compiled from the lists above with
+     * the negations applied.  sfvar_ip_in() searches these when set */
+    sfip_ranges_t* ranges;
 
     /* Linked list of IP variables for the variable table */
     sfip_var_t* next;
@@ -98,7 +100,8 @@ struct vartable_t
 };
 
 /* Creates a new variable that is an alias of another variable
- * Does a "deep" copy so it owns it's own pointers */
+ * Does a "deep" copy so it owns it's own pointers, including the
+ * compiled ranges */
 sfip_var_t* sfvar_deep_copy(const sfip_var_t*);
 sfip_var_t* sfvar_create_alias(const sfip_var_t* alias_from, const char* alias_to);
 
@@ -109,7 +112,8 @@ sfip_var_t* sfvar_alloc(vartable_t* table, const char* str, SfIpRet* status);
    Returns SFIP_CONFLICT if so */
 SfIpRet sfvar_validate(sfip_var_t* var);
 
-/* Parses an IP list described by 'str' and saves the results in 'var'. */
+/* Parses an IP list described by 'str' and saves the results in 'var'.
+ * The ranges used for lookups are rebuilt on success. */
 SfIpRet sfvar_parse_iplist(vartable_t* table, sfip_var_t* var,
     const char* str, int negation);
 
@@ -119,7 +123,9 @@ SfIpRet sfvar_compare(const sfip_var_t* one, const sfip_var_t* two);
 /* Free an allocated variable */
 void sfvar_free(sfip_var_t* var);
 
-// returns true if both args are valid and ip is contained by var
+// returns true if both args are valid and ip is contained by var; this is
+// a binary search over the compiled ranges when the var has them and a
+// walk of the lists otherwise
 bool sfvar_ip_in(sfip_var_t* var, const snort::SfIp* ip);
 
 #endif
@@ -166,6 +166,16 @@ table_t* sfrt_new(char table_type, char ip_type, long data_size, uint32_t mem_ca
 
         break;
 
+    case POPTRIE:
+        table->insert = sfrt_poptrie_insert;
+        table->lookup = sfrt_poptrie_lookup;
+        table->free = sfrt_poptrie_free;
+        table->usage = sfrt_poptrie_usage;
+        table->print = sfrt_poptrie_print;
+        table->remove = sfrt_poptrie_remove;
+
+        break;
+
     default:
         snort_free(table->data);
         snort_free(table);
@@ -218,6 +228,10 @@ table_t* sfrt_new(char table_type, char ip_type, long data_size, uint32_t mem_ca
         table->rt6 = sfrt_dir_new(mem_cap, 16,
             8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8);
         break;
+    case POPTRIE:
+        table->rt = sfrt_poptrie_new(mem_cap, 32);
+        table->rt6 = sfrt_poptrie_new(mem_cap, 128);
+        break;
     }
 
     if ((!table->rt) || (!table->rt6))
@@ -41,6 +41,7 @@ struct tuple_t
 };
 
 #include "sfrt/sfrt_dir.h"
+#include "sfrt/sfrt_poptrie.h"
 
 enum types
 {
@@ -55,6 +56,7 @@ enum types
     DIR_16x7_4x4,
     DIR_16x8,
     DIR_8x16,
+    POPTRIE,
     IPv4,
     IPv6
 };
@@ -91,7 +93,7 @@ typedef uint32_t (* table_usage)(GENERIC);
 typedef void (* table_print)(GENERIC);
 typedef void (* table_free)(GENERIC);
 
-// Master table struct.  Abstracts DIR and LC-trie methods
+// Master table struct.  Abstracts DIR and poptrie methods
 struct table_t
 {
     GENERIC* data;               // data table. Each IP points to an entry here
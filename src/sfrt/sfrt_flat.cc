@@ -482,3 +482,113 @@ GENERIC sfrt_flat_dir8x_lookup(const SfIp* ip, table_flat_t* table)
     return nullptr;
 }
 
+/* State of one walk in a batch.  Each level is two dependent loads: the sub
+ * table header for its entries offset and then the entry itself.  The index
+ * into each level is taken from the address up front: DIR_16_8_4x2 for IPv4
+ * and DIR_8x16 for IPv6 as in sfrt_flat_dir8x_lookup. */
+struct Dir8xWalk
+{
+    const dir_sub_table_flat_t* subtable;
+    const DIR_Entry* entry;
+    unsigned level;
+    unsigned levels;
+    uint16_t index[16];
+};
+
+static void dir8x_batch(const SfIp* const* ips, GENERIC* results, unsigned num,
+    table_flat_t* table)
+{
+    uint8_t* base = (uint8_t*)table;
+    INFO* data = (INFO*)(&base[table->data]);
+    Dir8xWalk walks[SFRT_FLAT_BATCH_MAX];
+    unsigned active[SFRT_FLAT_BATCH_MAX];
+    unsigned num_active = 0;
+
+    for (unsigned i = 0; i < num; i++)
+    {
+        const SfIp* ip = ips[i];
+        dir_table_flat_t* rt;
+        Dir8xWalk& w = walks[i];
+
+        results[i] = nullptr;
+
+        if (!ip)
+            continue;
+
+        if (ip->is_ip4())
+        {
+            const uint8_t* key = (const uint8_t*)ip->get_ip4_ptr();
+            rt = (dir_table_flat_t*)(&base[table->rt]);
+            w.index[0] = (key[0] << 8) | key[1];
+            w.index[1] = key[2];
+            w.index[2] = key[3] >> 4;
+            w.index[3] = key[3] & 0xF;
+            w.levels = 4;
+        }
+        else if (ip->is_ip6())
+        {
+            const uint8_t* key = (const uint8_t*)ip->get_ip6_ptr();
+            rt = (dir_table_flat_t*)(&base[table->rt6]);
+            for (unsigned b = 0; b < 16; b++)
+                w.index[b] = key[b];
+            w.levels = 16;
+        }
+        else
+            continue;
+
+        w.level = 0;
+        w.subtable = (dir_sub_table_flat_t*)(&base[rt->sub_table]);
+        active[num_active++] = i;
+    }
+
+    while (num_active)
+    {
+        unsigned still_active = 0;
+
+        /* the sub tables were prefetched by the previous pass */
+        for (unsigned a = 0; a < num_active; a++)
+        {
+            Dir8xWalk& w = walks[active[a]];
+            const DIR_Entry* entries = (const DIR_Entry*)(&base[w.subtable->entries]);
+
+            w.entry = &entries[w.index[w.level]];
+            __builtin_prefetch(w.entry);
+        }
+
+        for (unsigned a = 0; a < num_active; a++)
+        {
+            Dir8xWalk& w = walks[active[a]];
+            const DIR_Entry* entry = w.entry;
+
+            if ( !entry->value || entry->length)
+            {
+                if (data[entry->value])
+                    results[active[a]] = (GENERIC)&base[data[entry->value]];
+                continue;
+            }
+
+            if (++w.level == w.levels)
+                continue;
+
+            w.subtable = (const dir_sub_table_flat_t*)(&base[entry->value]);
+            __builtin_prefetch(w.subtable);
+            active[still_active++] = active[a];
+        }
+        num_active = still_active;
+    }
+}
+
+void sfrt_flat_dir8x_lookup_batch(const SfIp* const* ips, GENERIC* results, unsigned num,
+    table_flat_t* table)
+{
+    while (num)
+    {
+        unsigned n = num < SFRT_FLAT_BATCH_MAX ? num : SFRT_FLAT_BATCH_MAX;
+        dir8x_batch(ips, results, n, table);
+
+        ips += n;
+        results += n;
+        num -= n;
+    }
+}
+
@@ -77,6 +77,14 @@ void sfrt_flat_free(TABLE_PTR table);
 GENERIC sfrt_flat_lookup(const snort::SfIp* ip, table_flat_t* table);
 GENERIC sfrt_flat_dir8x_lookup(const snort::SfIp* ip, table_flat_t* table);
 
+// Look up several addresses at once with the same restrictions as
+// sfrt_flat_dir8x_lookup.  The walks advance one step each in turn and
+// prefetch their next step so their cache misses overlap instead of being
+// taken one after another.  A null address gives a null result.
+#define SFRT_FLAT_BATCH_MAX 16
+void sfrt_flat_dir8x_lookup_batch(const snort::SfIp* const* ips, GENERIC* results,
+    unsigned num, table_flat_t* table);
+
 int sfrt_flat_insert(snort::SfCidr* cidr, unsigned char len, INFO ptr, int behavior,
     table_flat_t* table, updateEntryInfoFunc updateEntry);
 uint32_t sfrt_flat_usage(table_flat_t* table);
@@ -0,0 +1,713 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// sfrt_poptrie.cc
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sfrt.h"  // FIXIT-L these includes are circular
+#include "sfrt_poptrie.h"
+
+#include <cassert>
+
+#include "utils/util.h"
+
+#define POPTRIE_DIRECT_SIZE (1 << POPTRIE_DIRECT_BITS)
+#define POPTRIE_FANOUT      (1 << POPTRIE_STRIDE)
+
+// the address in host order as one 128 bit key; IPv4 only fills the top
+// 32 bits so extracting a stride never has to pick a 32 bit word
+struct poptrie_key_t
+{
+    uint64_t hi;
+    uint64_t lo;
+};
+
+// a node unpacked into one entry per index while it is updated
+struct poptrie_entry_t
+{
+    poptrie_leaf_t leaf;
+    poptrie_node_t node;
+    bool is_node;
+};
+
+static inline void make_key(const uint32_t* addr, int numAddrDwords, poptrie_key_t& key)
+{
+    uint32_t h_addr[4] = { 0, 0, 0, 0 };
+
+    for ( int i = 0; i < numAddrDwords and i < 4; i++ )
+        h_addr[i] = ntohl(addr[i]);
+
+    key.hi = ((uint64_t)h_addr[0] << 32) | h_addr[1];
+    key.lo = ((uint64_t)h_addr[2] << 32) | h_addr[3];
+}
+
+static inline unsigned key_bits(const poptrie_key_t& key, unsigned offset, unsigned width)
+{
+    uint64_t bits;
+
+    if ( offset >= 64 )
+        bits = key.lo << (offset - 64);
+    else if ( offset )
+        bits = (key.hi << offset) | (key.lo >> (64 - offset));
+    else
+        bits = key.hi;
+
+    return (unsigned)(bits >> (64 - width));
+}
+
+// without a popcnt instruction the builtin is a libgcc call; the bit slice
+// count below is a handful of inlined instructions on the lookup path
+static inline unsigned popcount(uint64_t v)
+{
+#ifdef __POPCNT__
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (unsigned)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+static inline bool same_leaf(const poptrie_leaf_t& a, const poptrie_leaf_t& b)
+{ return a.index == b.index and a.length == b.length; }
+
+//--------------------------------------------------------------------------
+// node packing
+//--------------------------------------------------------------------------
+
+static void unpack(const poptrie_node_t* node, unsigned width, poptrie_entry_t* e)
+{
+    const poptrie_leaf_t* leaf = node->leaves - 1;
+    const poptrie_node_t* child = node->children;
+
+    for ( unsigned v = 0; v < (1u << width); v++ )
+    {
+        uint64_t bit = (uint64_t)1 << v;
+
+        if ( node->vector & bit )
+        {
+            e[v].is_node = true;
+            e[v].node = *child++;
+        }
+        else
+        {
+            if ( node->leafvec & bit )
+                leaf++;
+
+            e[v].is_node = false;
+            e[v].leaf = *leaf;
+        }
+    }
+}
+
+// rebuild the node's arrays from its entries; children move by value so
+// their own arrays are not touched
+static void pack(poptrie_table_t* table, poptrie_node_t* node, unsigned width,
+    const poptrie_entry_t* e)
+{
+    unsigned num_children = 0;
+    unsigned num_leaves = 0;
+    const poptrie_leaf_t* last = nullptr;
+
+    for ( unsigned v = 0; v < (1u << width); v++ )
+    {
+        if ( e[v].is_node )
+            num_children++;
+
+        else if ( !last or !same_leaf(*last, e[v].leaf) )
+        {
+            num_leaves++;
+            last = &e[v].leaf;
+        }
+    }
+
+    poptrie_node_t* children = num_children ?
+        (poptrie_node_t*)snort_alloc(num_children * sizeof(poptrie_node_t)) : nullptr;
+    poptrie_leaf_t* leaves = num_leaves ?
+        (poptrie_leaf_t*)snort_alloc(num_leaves * sizeof(poptrie_leaf_t)) : nullptr;
+
+    uint64_t vector = 0;
+    uint64_t leafvec = 0;
+    unsigned c = 0;
+    unsigned l = 0;
+    last = nullptr;
+
+    for ( unsigned v = 0; v < (1u << width); v++ )
+    {
+        uint64_t bit = (uint64_t)1 << v;
+
+        if ( e[v].is_node )
+        {
+            vector |= bit;
+            children[c++] = e[v].node;
+        }
+        else if ( !last or !same_leaf(*last, e[v].leaf) )
+        {
+            leafvec |= bit;
+            leaves[l++] = e[v].leaf;
+            last = &e[v].leaf;
+        }
+    }
+
+    table->allocated -= popcount(node->vector) * sizeof(poptrie_node_t) +
+        popcount(node->leafvec) * sizeof(poptrie_leaf_t);
+    table->allocated += num_children * sizeof(poptrie_node_t) +
+        num_leaves * sizeof(poptrie_leaf_t);
+
+    if ( node->children )
+        snort_free(node->children);
+
+    if ( node->leaves )
+        snort_free(node->leaves);
+
+    node->vector = vector;
+    node->leafvec = leafvec;
+    node->children = children;
+    node->leaves = leaves;
+}
+
+static bool node_new(poptrie_table_t* table, poptrie_node_t& node, poptrie_leaf_t prefill)
+{
+    if ( table->mem_cap < table->allocated + sizeof(poptrie_node_t) + sizeof(poptrie_leaf_t) )
+        return false;
+
+    node.vector = 0;
+    node.leafvec = 1;
+    node.children = nullptr;
+    node.leaves = (poptrie_leaf_t*)snort_alloc(sizeof(poptrie_leaf_t));
+    node.leaves[0] = prefill;
+
+    table->allocated += sizeof(poptrie_leaf_t);
+    table->num_nodes++;
+    return true;
+}
+
+static void node_free(poptrie_table_t* table, poptrie_node_t& node)
+{
+    unsigned num_children = popcount(node.vector);
+
+    for ( unsigned c = 0; c < num_children; c++ )
+        node_free(table, node.children[c]);
+
+    table->allocated -= num_children * sizeof(poptrie_node_t) +
+        popcount(node.leafvec) * sizeof(poptrie_leaf_t);
+
+    if ( node.children )
+        snort_free(node.children);
+
+    if ( node.leaves )
+        snort_free(node.leaves);
+
+    node.children = nullptr;
+    node.leaves = nullptr;
+    node.vector = node.leafvec = 0;
+    table->num_nodes--;
+}
+
+// a node can be collapsed once all of its entries were removed
+static inline bool node_empty(const poptrie_node_t& node)
+{ return !node.vector and popcount(node.leafvec) == 1 and !node.leaves[0].index; }
+
+//--------------------------------------------------------------------------
+// updates
+//--------------------------------------------------------------------------
+
+static void node_fill_less_specific(poptrie_table_t*, poptrie_node_t*, int depth,
+    poptrie_leaf_t);
+
+static void fill_all(poptrie_table_t* table, poptrie_entry_t* e, unsigned index,
+    unsigned fill, poptrie_leaf_t leaf)
+{
+    for ( ; index < fill; index++ )
+    {
+        if ( e[index].is_node )
+            node_free(table, e[index].node);
+
+        e[index].is_node = false;
+        e[index].leaf = leaf;
+    }
+}
+
+static void fill_less_specific(poptrie_table_t* table, int depth, poptrie_entry_t* e,
+    unsigned index, unsigned fill, poptrie_leaf_t leaf)
+{
+    for ( ; index < fill; index++ )
+    {
+        // more specific information is below; fill whatever it leaves open
+        if ( e[index].is_node )
+            node_fill_less_specific(table, &e[index].node, depth + 1, leaf);
+
+        else if ( leaf.length >= e[index].leaf.length )
+            e[index].leaf = leaf;
+    }
+}
+
+static void node_fill_less_specific(poptrie_table_t* table, poptrie_node_t* node, int depth,
+    poptrie_leaf_t leaf)
+{
+    unsigned width = table->widths[depth];
+    poptrie_entry_t e[POPTRIE_FANOUT];
+
+    unpack(node, width, e);
+    fill_less_specific(table, depth, e, 0, 1 << width, leaf);
+    pack(table, node, width, e);
+}
+
+static int node_insert(poptrie_table_t* table, poptrie_node_t* node, int depth,
+    const poptrie_key_t& key, unsigned offset, int cur_len, poptrie_leaf_t leaf, int behavior)
+{
+    unsigned width = table->widths[depth];
+    unsigned index = key_bits(key, offset, width);
+    poptrie_entry_t e[POPTRIE_FANOUT];
+    int ret = RT_SUCCESS;
+
+    unpack(node, width, e);
+
+    if ( (int)width >= cur_len )
+    {
+        unsigned shift = width - cur_len;
+        index = (index >> shift) << shift;
+
+        if ( behavior == RT_FAVOR_TIME )
+            fill_all(table, e, index, index + (1 << shift), leaf);
+        else
+            fill_less_specific(table, depth, e, index, index + (1 << shift), leaf);
+    }
+    else
+    {
+        if ( !e[index].is_node )
+        {
+            if ( depth + 1 >= table->depth )
+                return RT_INSERT_FAILURE;
+
+            if ( !node_new(table, e[index].node, e[index].leaf) )
+                return MEM_ALLOC_FAILURE;
+
+            e[index].is_node = true;
+        }
+        ret = node_insert(table, &e[index].node, depth + 1, key, offset + width,
+            cur_len - width, leaf, behavior);
+    }
+
+    pack(table, node, width, e);
+    return ret;
+}
+
+static uint32_t remove_all(poptrie_table_t* table, poptrie_entry_t* e, unsigned index,
+    unsigned fill, uint32_t length)
+{
+    uint32_t value_index = 0;
+
+    for ( ; index < fill; index++ )
+    {
+        if ( e[index].is_node )
+            node_free(table, e[index].node);
+
+        else if ( length == e[index].leaf.length )
+            value_index = e[index].leaf.index;
+
+        e[index].is_node = false;
+        e[index].leaf = { 0, 0 };
+    }
+    return value_index;
+}
+
+static uint32_t node_remove_less_specific(poptrie_table_t*, poptrie_node_t*, int depth,
+    uint32_t length);
+
+static uint32_t remove_less_specific(poptrie_table_t* table, int depth, poptrie_entry_t* e,
+    unsigned index, unsigned fill, uint32_t length)
+{
+    uint32_t value_index = 0;
+
+    for ( ; index < fill; index++ )
+    {
+        if ( e[index].is_node )
+        {
+            uint32_t v = node_remove_less_specific(table, &e[index].node, depth + 1, length);
+
+            if ( v )
+                value_index = v;
+
+            if ( node_empty(e[index].node) )
+            {
+                node_free(table, e[index].node);
+                e[index].is_node = false;
+                e[index].leaf = { 0, 0 };
+            }
+        }
+        else if ( length == e[index].leaf.length )
+        {
+            if ( e[index].leaf.index )
+                value_index = e[index].leaf.index;
+
+            e[index].leaf = { 0, 0 };
+        }
+    }
+    return value_index;
+}
+
+static uint32_t node_remove_less_specific(poptrie_table_t* table, poptrie_node_t* node,
+    int depth, uint32_t length)
+{
+    unsigned width = table->widths[depth];
+    poptrie_entry_t e[POPTRIE_FANOUT];
+
+    unpack(node, width, e);
+    uint32_t value_index = remove_less_specific(table, depth, e, 0, 1 << width, length);
+    pack(table, node, width, e);
+
+    return value_index;
+}
+
+static uint32_t node_remove(poptrie_table_t* table, poptrie_node_t* node, int depth,
+    const poptrie_key_t& key, unsigned offset, int length, int cur_len, int behavior)
+{
+    unsigned width = table->widths[depth];
+    unsigned index = key_bits(key, offset, width);
+    poptrie_entry_t e[POPTRIE_FANOUT];
+    uint32_t value_index;
+
+    unpack(node, width, e);
+
+    if ( (int)width >= cur_len )
+    {
+        unsigned shift = width - cur_len;
+        index = (index >> shift) << shift;
+
+        if ( behavior == RT_FAVOR_TIME )
+            value_index = remove_all(table, e, index, index + (1 << shift), length);
+        else
+            value_index = remove_less_specific(table, depth, e, index, index + (1 << shift),
+                length);
+    }
+    else
+    {
+        if ( !e[index].is_node )
+            return 0;
+
+        value_index = node_remove(table, &e[index].node, depth + 1, key, offset + width,
+            length, cur_len - width, behavior);
+
+        if ( node_empty(e[index].node) )
+        {
+            node_free(table, e[index].node);
+            e[index].is_node = false;
+            e[index].leaf = { 0, 0 };
+        }
+    }
+
+    pack(table, node, width, e);
+    return value_index;
+}
+
+//--------------------------------------------------------------------------
+// direct array
+//--------------------------------------------------------------------------
+
+// the roots array is grown here rather than by the vector so its size is
+// known and counted against the cap before it is allocated
+static bool roots_reserve(poptrie_table_t* table)
+{
+    size_t cap = table->roots.capacity();
+
+    if ( table->roots.size() < cap )
+        return true;
+
+    size_t grow = cap ? cap : 1;
+
+    if ( table->mem_cap < table->allocated + grow * sizeof(poptrie_node_t) )
+        return false;
+
+    table->roots.reserve(cap + grow);
+    table->allocated += (table->roots.capacity() - cap) * sizeof(poptrie_node_t);
+    return true;
+}
+
+static poptrie_node_t* root_new(poptrie_table_t* table, uint32_t slot)
+{
+    uint32_t id;
+
+    if ( table->free_roots.empty() )
+    {
+        if ( !roots_reserve(table) )
+            return nullptr;
+
+        id = table->roots.size();
+        table->roots.emplace_back();
+    }
+    else
+    {
+        id = table->free_roots.back();
+        table->free_roots.pop_back();
+    }
+
+    if ( !node_new(table, table->roots[id], table->direct[slot]) )
+    {
+        table->free_roots.emplace_back(id);
+        return nullptr;
+    }
+
+    table->direct[slot] = { id, POPTRIE_NODE };
+    return &table->roots[id];
+}
+
+static void root_free(poptrie_table_t* table, uint32_t slot, poptrie_leaf_t leaf)
+{
+    uint32_t id = table->direct[slot].index;
+
+    node_free(table, table->roots[id]);
+    table->free_roots.emplace_back(id);
+    table->direct[slot] = leaf;
+}
+
+poptrie_table_t* sfrt_poptrie_new(uint32_t mem_cap, int addr_bits)
+{
+    uint32_t direct_size = POPTRIE_DIRECT_SIZE * sizeof(poptrie_leaf_t);
+
+    if ( addr_bits <= POPTRIE_DIRECT_BITS or mem_cap < sizeof(poptrie_table_t) + direct_size )
+        return nullptr;
+
+    poptrie_table_t* table = new poptrie_table_t;
+
+    table->widths[0] = POPTRIE_DIRECT_BITS;
+    table->depth = 1;
+
+    for ( int bits = addr_bits - POPTRIE_DIRECT_BITS; bits > 0; bits -= POPTRIE_STRIDE )
+    {
+        assert(table->depth < POPTRIE_MAX_DEPTH);
+        table->widths[table->depth++] = bits < POPTRIE_STRIDE ? bits : POPTRIE_STRIDE;
+    }
+
+    table->mem_cap = mem_cap;
+    table->num_nodes = 0;
+    table->direct = (poptrie_leaf_t*)snort_calloc(POPTRIE_DIRECT_SIZE, sizeof(poptrie_leaf_t));
+    table->allocated = sizeof(poptrie_table_t) + direct_size;
+
+    return table;
+}
+
+void sfrt_poptrie_free(void* tbl)
+{
+    poptrie_table_t* table = (poptrie_table_t*)tbl;
+
+    if ( !table )
+        return;
+
+    for ( uint32_t slot = 0; slot < POPTRIE_DIRECT_SIZE; slot++ )
+    {
+        if ( table->direct[slot].length == POPTRIE_NODE )
+            node_free(table, table->roots[table->direct[slot].index]);
+    }
+
+    snort_free(table->direct);
+    delete table;
+}
+
+// the most an insert below the direct array adds: a new node and its leaf
+// on each level, that node's slot in its parent's children, and two leaf
+// runs split where the prefix ends.  anything else an insert repacks can
+// only stay the same size or shrink.
+static inline uint32_t insert_reserve(const poptrie_table_t* table)
+{
+    return (table->depth - 1) * (sizeof(poptrie_node_t) + sizeof(poptrie_leaf_t)) +
+        2 * sizeof(poptrie_leaf_t);
+}
+
+int sfrt_poptrie_insert(const uint32_t* addr, int numAddrDwords, int len, word data_index,
+    int behavior, void* tbl)
+{
+    poptrie_table_t* table = (poptrie_table_t*)tbl;
+
+    if ( !table or len <= 0 )
+        return DIR_INSERT_FAILURE;
+
+    poptrie_key_t key;
+    make_key(addr, numAddrDwords, key);
+
+    poptrie_leaf_t leaf = { (uint32_t)data_index, (uint32_t)len };
+    uint32_t slot = key_bits(key, 0, POPTRIE_DIRECT_BITS);
+
+    if ( len > POPTRIE_DIRECT_BITS )
+    {
+        poptrie_node_t* root;
+
+        // packing can't fail part way, so the cap is checked up front
+        if ( table->mem_cap < table->allocated + insert_reserve(table) )
+            return MEM_ALLOC_FAILURE;
+
+        if ( table->direct[slot].length == POPTRIE_NODE )
+            root = &table->roots[table->direct[slot].index];
+
+        else if ( !(root = root_new(table, slot)) )
+            return MEM_ALLOC_FAILURE;
+
+        return node_insert(table, root, 1, key, POPTRIE_DIRECT_BITS,
+            len - POPTRIE_DIRECT_BITS, leaf, behavior);
+    }
+
+    unsigned shift = POPTRIE_DIRECT_BITS - len;
+    slot = (slot >> shift) << shift;
+
+    for ( uint32_t fill = slot + (1 << shift); slot < fill; slot++ )
+    {
+        if ( table->direct[slot].length == POPTRIE_NODE )
+        {
+            if ( behavior == RT_FAVOR_TIME )
+                root_free(table, slot, leaf);
+            else
+                node_fill_less_specific(table, &table->roots[table->direct[slot].index], 1, leaf);
+        }
+        else if ( behavior == RT_FAVOR_TIME or leaf.length >= table->direct[slot].length )
+            table->direct[slot] = leaf;
+    }
+    return RT_SUCCESS;
+}
+
+word sfrt_poptrie_remove(const uint32_t* addr, int numAddrDwords, int len, int behavior,
+    void* tbl)
+{
+    poptrie_table_t* table = (poptrie_table_t*)tbl;
+
+    if ( !table or len <= 0 )
+        return 0;
+
+    poptrie_key_t key;
+    make_key(addr, numAddrDwords, key);
+
+    uint32_t slot = key_bits(key, 0, POPTRIE_DIRECT_BITS);
+    uint32_t value_index = 0;
+
+    if ( len > POPTRIE_DIRECT_BITS )
+    {
+        if ( table->direct[slot].length != POPTRIE_NODE )
+            return 0;
+
+        poptrie_node_t* root = &table->roots[table->direct[slot].index];
+
+        value_index = node_remove(table, root, 1, key, POPTRIE_DIRECT_BITS, len,
+            len - POPTRIE_DIRECT_BITS, behavior);
+
+        if ( node_empty(*root) )
+            root_free(table, slot, { 0, 0 });
+
+        return value_index;
+    }
+
+    unsigned shift = POPTRIE_DIRECT_BITS - len;
+    slot = (slot >> shift) << shift;
+
+    for ( uint32_t fill = slot + (1 << shift); slot < fill; slot++ )
+    {
+        poptrie_leaf_t& entry = table->direct[slot];
+
+        if ( entry.length == POPTRIE_NODE )
+        {
+            if ( behavior == RT_FAVOR_TIME )
+            {
+                root_free(table, slot, { 0, 0 });
+                continue;
+            }
+            uint32_t v = node_remove_less_specific(table, &table->roots[entry.index], 1, len);
+
+            if ( v )
+                value_index = v;
+
+            if ( node_empty(table->roots[entry.index]) )
+                root_free(table, slot, { 0, 0 });
+        }
+        else if ( entry.length == (uint32_t)len )
+        {
+            if ( entry.index )
+                value_index = entry.index;
+
+            entry = { 0, 0 };
+        }
+        else if ( behavior == RT_FAVOR_TIME )
+            entry = { 0, 0 };
+    }
+    return value_index;
+}
+
+tuple_t sfrt_poptrie_lookup(const uint32_t* addr, int numAddrDwords, void* tbl)
+{
+    const poptrie_table_t* table = (const poptrie_table_t*)tbl;
+    tuple_t ret = { 0, 0 };
+
+    if ( !table or numAddrDwords < 1 )
+        return ret;
+
+    poptrie_key_t key;
+    make_key(addr, numAddrDwords, key);
+
+    poptrie_leaf_t leaf = table->direct[key.hi >> (64 - POPTRIE_DIRECT_BITS)];
+
+    if ( leaf.length == POPTRIE_NODE )
+    {
+        const poptrie_node_t* node = &table->roots[leaf.index];
+        unsigned offset = POPTRIE_DIRECT_BITS;
+        int depth = 1;
+
+        while ( true )
+        {
+            unsigned width = table->widths[depth];
+            uint64_t bit = (uint64_t)1 << key_bits(key, offset, width);
+
+            if ( !(node->vector & bit) )
+            {
+                // bit << 1 wraps to 0 for index 63 which makes the mask all ones
+                leaf = node->leaves[popcount(node->leafvec & ((bit << 1) - 1)) - 1];
+                break;
+            }
+            node = &node->children[popcount(node->vector & (bit - 1))];
+            offset += width;
+            depth++;
+        }
+    }
+
+    ret.index = leaf.index;
+    ret.length = leaf.length;
+    return ret;
+}
+
+uint32_t sfrt_poptrie_usage(void* tbl)
+{
+    poptrie_table_t* table = (poptrie_table_t*)tbl;
+
+    if ( !table )
+        return 0;
+
+    return table->allocated;
+}
+
+void sfrt_poptrie_print(void* tbl)
+{
+    poptrie_table_t* table = (poptrie_table_t*)tbl;
+
+    if ( !table )
+        return;
+
+    printf("Nodes in use: %u, roots: %zu, depth: %d, allocated: %u bytes\n",
+        table->num_nodes, table->roots.size() - table->free_roots.size(), table->depth,
+        sfrt_poptrie_usage(table));
+}
+
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// sfrt_poptrie.h
+
+#ifndef SFRT_POPTRIE_H
+#define SFRT_POPTRIE_H
+
+// A poptrie (Asai and Ohara) style multibit trie.  The first 16 bits index
+// a direct array; each deeper level is a node with a 6 bit stride (4 for
+// the last level) whose children and leaves are kept in two contiguous
+// arrays.  A child is found by counting the bits set below it in the
+// node's vector bitmap and a leaf by counting the leaf runs in its leafvec
+// bitmap, so runs of identical leaves are stored once.
+//
+// Inserts and removes have the same semantics as DIR-n-m: each leaf keeps
+// the length of the prefix that set it for favor specific updates.  Only
+// the nodes on the updated path are rebuilt.
+
+#include <cstdint>
+#include <vector>
+
+#define POPTRIE_DIRECT_BITS 16
+#define POPTRIE_STRIDE      6
+#define POPTRIE_MAX_DEPTH   20   // 16 + 18 * 6 + 4 for IPv6
+
+// leaves carry the data index and prefix length like a DIR-n-m entry; a
+// direct entry with length POPTRIE_NODE holds a root node id instead
+#define POPTRIE_NODE UINT32_MAX
+
+struct poptrie_leaf_t
+{
+    uint32_t index;
+    uint32_t length;
+};
+
+struct poptrie_node_t
+{
+    uint64_t vector;            // bit set for each child node
+    uint64_t leafvec;           // bit set where each run of equal leaves starts
+    poptrie_leaf_t* leaves;
+    poptrie_node_t* children;
+};
+
+struct poptrie_table_t
+{
+    uint8_t widths[POPTRIE_MAX_DEPTH];
+    int depth;
+    uint32_t mem_cap;
+    uint32_t allocated;
+    uint32_t num_nodes;
+
+    poptrie_leaf_t* direct;     // 1 << POPTRIE_DIRECT_BITS entries
+    std::vector<poptrie_node_t> roots;
+    std::vector<uint32_t> free_roots;
+};
+
+/******************************************************************
+   poptrie functions, these are not intended to be called directly */
+poptrie_table_t* sfrt_poptrie_new(uint32_t mem_cap, int addr_bits);
+void sfrt_poptrie_free(void*);
+tuple_t sfrt_poptrie_lookup(const uint32_t* addr, int numAddrDwords, void* table);
+int sfrt_poptrie_insert(const uint32_t* addr, int numAddrDwords, int len, word data_index,
+    int behavior, void* table);
+uint32_t sfrt_poptrie_usage(void* table);
+void sfrt_poptrie_print(void* table);
+word sfrt_poptrie_remove(const uint32_t* addr, int numAddrDwords, int len, int behavior,
+    void* table);
+
+#endif
+
@@ -27,6 +27,12 @@
 #include "utils/util.h"
 
 #include "sfrt.h"
+#include "sfrt_flat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
 
 using namespace snort;
 
@@ -250,3 +256,373 @@ TEST_CASE("sfrt", "[sfrt]")
     }
 }
 
+//---------------------------------------------------------------
+// poptrie must give the same answers as DIR-n-m for any sequence of updates
+
+static void random_cidr(std::mt19937& rng, bool ip6, SfCidr& cidr)
+{
+    uint32_t addr[4];
+
+    // a few top level blocks so both tables share most of their nodes
+    for ( auto& a : addr )
+        a = rng();
+
+    addr[0] = (addr[0] & 0x0003ffff) | ((ip6 ? 0x20010000 : 0x0a000000) & 0xfffc0000);
+
+    unsigned bits = ip6 ? 8 + rng() % 121 : 8 + rng() % 25;
+
+    for ( auto& a : addr )
+        a = htonl(a);
+
+    if ( ip6 )
+        cidr.set(addr, AF_INET6);
+    else
+    {
+        cidr.set(addr, AF_INET);
+        bits += 96;
+    }
+    cidr.set_bits(bits);
+}
+
+static void random_ip(std::mt19937& rng, const SfCidr& near, SfIp& ip)
+{
+    uint32_t addr[4];
+    memcpy(addr, near.get_addr()->get_ip6_ptr(), sizeof(addr));
+
+    // flip some low order bits so lookups land inside and around the prefix
+    addr[3] ^= htonl(rng() & ((1u << (rng() % 32)) - 1));
+
+    if ( near.get_addr()->is_ip4() )
+        ip.set(&addr[3], AF_INET);
+    else
+    {
+        addr[rng() % 4] ^= htonl(rng() & 0xff);
+        ip.set(addr, AF_INET6);
+    }
+}
+
+static void check_same(std::mt19937& rng, const std::vector<SfCidr>& cidrs,
+    table_t* dir, table_t* pop)
+{
+    for ( unsigned i = 0; i < 20000; i++ )
+    {
+        SfIp ip;
+        random_ip(rng, cidrs[rng() % cidrs.size()], ip);
+        CHECK(sfrt_lookup(&ip, dir) == sfrt_lookup(&ip, pop));
+    }
+}
+
+static void test_poptrie_matches_dir(int behavior)
+{
+    std::mt19937 rng(behavior + 1);
+    std::vector<SfCidr> cidrs(3000);
+    std::vector<int> values(cidrs.size());
+
+    table_t* dir = sfrt_new(DIR_8x16, IPv6, cidrs.size() + 1, 512);
+    table_t* pop = sfrt_new(POPTRIE, IPv6, cidrs.size() + 1, 512);
+    REQUIRE(dir != nullptr);
+    REQUIRE(pop != nullptr);
+
+    for ( unsigned i = 0; i < cidrs.size(); i++ )
+    {
+        random_cidr(rng, i & 1, cidrs[i]);
+        values[i] = i;
+
+        int a = sfrt_insert(&cidrs[i], cidrs[i].get_bits(), &values[i], behavior, dir);
+        int b = sfrt_insert(&cidrs[i], cidrs[i].get_bits(), &values[i], behavior, pop);
+        CHECK(a == b);
+    }
+    CHECK(sfrt_num_entries(dir) == sfrt_num_entries(pop));
+    check_same(rng, cidrs, dir, pop);
+
+    for ( unsigned i = 0; i < cidrs.size(); i += 2 )
+    {
+        GENERIC a = nullptr;
+        GENERIC b = nullptr;
+
+        CHECK(sfrt_remove(&cidrs[i], cidrs[i].get_bits(), &a, behavior, dir) ==
+            sfrt_remove(&cidrs[i], cidrs[i].get_bits(), &b, behavior, pop));
+        CHECK(a == b);
+    }
+    check_same(rng, cidrs, dir, pop);
+
+    for ( unsigned i = 0; i < cidrs.size(); i++ )
+    {
+        GENERIC a = nullptr;
+        sfrt_remove(&cidrs[i], cidrs[i].get_bits(), &a, behavior, pop);
+    }
+
+    // removing everything collapses the trie back to the direct array
+    CHECK(pop->rt6 != nullptr);
+    CHECK(((poptrie_table_t*)pop->rt)->num_nodes == 0);
+    CHECK(((poptrie_table_t*)pop->rt6)->num_nodes == 0);
+
+    sfrt_free(dir);
+    sfrt_free(pop);
+}
+
+TEST_CASE("sfrt poptrie", "[sfrt]")
+{
+    SECTION("matches DIR favoring specific")
+    {
+        test_poptrie_matches_dir(RT_FAVOR_SPECIFIC);
+    }
+    SECTION("matches DIR favoring time")
+    {
+        test_poptrie_matches_dir(RT_FAVOR_TIME);
+    }
+    SECTION("remove after insert")
+    {
+        table_t* pop = sfrt_new(POPTRIE, IPv6, 16, 16);
+        REQUIRE(pop != nullptr);
+
+        int value = 1;
+        SfCidr cidr;
+        cidr.set("192.168.0.0/16");
+
+        CHECK(sfrt_insert(&cidr, cidr.get_bits(), &value, RT_FAVOR_SPECIFIC, pop) ==
+            RT_SUCCESS);
+        CHECK(sfrt_lookup(cidr.get_addr(), pop) == &value);
+
+        GENERIC result = nullptr;
+        CHECK(sfrt_remove(&cidr, cidr.get_bits(), &result, RT_FAVOR_SPECIFIC, pop) ==
+            RT_SUCCESS);
+        CHECK(result == &value);
+        CHECK(sfrt_lookup(cidr.get_addr(), pop) == nullptr);
+
+        sfrt_free(pop);
+    }
+    SECTION("memory cap")
+    {
+        // the direct array and room for a few hundred nodes
+        uint32_t cap = sizeof(poptrie_table_t) +
+            (1 << POPTRIE_DIRECT_BITS) * sizeof(poptrie_leaf_t) + 64 * 1024;
+
+        poptrie_table_t* pop = sfrt_poptrie_new(cap, 128);
+        REQUIRE(pop != nullptr);
+
+        std::mt19937 rng(7);
+        uint32_t most = 0;
+        unsigned n = 0;
+        int ret = RT_SUCCESS;
+
+        while ( ret != MEM_ALLOC_FAILURE and n < 100000 )
+        {
+            SfCidr cidr;
+            random_cidr(rng, true, cidr);
+
+            ret = sfrt_poptrie_insert(cidr.get_addr()->get_ip6_ptr(), 4, cidr.get_bits(), ++n,
+                RT_FAVOR_SPECIFIC, pop);
+
+            if ( pop->allocated > most )
+                most = pop->allocated;
+        }
+        CHECK(ret == MEM_ALLOC_FAILURE);
+        CHECK(most <= cap);
+        CHECK(sfrt_poptrie_usage(pop) <= cap);
+
+        sfrt_poptrie_free(pop);
+    }
+}
+
+//---------------------------------------------------------------
+// batched flat lookups must give the same answers as single ones
+
+static int64_t update_flat_entry(INFO* entry, INFO info, SaveDest, uint8_t*)
+{
+    *entry = info;
+    return 0;
+}
+
+static table_flat_t* flat_table(std::vector<uint8_t>& segment, std::vector<SfCidr>& cidrs)
+{
+    segment_meminit(segment.data(), segment.size());
+    table_flat_t* table = sfrt_flat_new(DIR_8x16, IPv6, cidrs.size() + 1, segment.size() >> 20);
+    MEM_OFFSET values = segment_snort_calloc(cidrs.size(), sizeof(uint32_t));
+
+    if ( !table or !values )
+        return nullptr;
+
+    for ( unsigned i = 0; i < cidrs.size(); i++ )
+        sfrt_flat_insert(&cidrs[i], cidrs[i].get_bits(), values + i * sizeof(uint32_t),
+            RT_FAVOR_SPECIFIC, table, update_flat_entry);
+
+    return table;
+}
+
+TEST_CASE("sfrt flat batch", "[sfrt]")
+{
+    // the 2000 prefixes below take about 12 MB
+    std::vector<uint8_t> segment(16 * 1024 * 1024);
+    std::vector<SfCidr> cidrs(2000);
+    std::mt19937 rng(7);
+
+    for ( unsigned i = 0; i < cidrs.size(); i++ )
+        random_cidr(rng, i & 1, cidrs[i]);
+
+    table_flat_t* table = flat_table(segment, cidrs);
+    REQUIRE(table != nullptr);
+
+    std::vector<SfIp> ips(1000);
+
+    for ( auto& ip : ips )
+        random_ip(rng, cidrs[rng() % cidrs.size()], ip);
+
+    // more than one batch and some holes
+    std::vector<const SfIp*> batch;
+    std::vector<GENERIC> results(ips.size());
+
+    for ( unsigned i = 0; i < ips.size(); i++ )
+        batch.emplace_back(i % 7 ? &ips[i] : nullptr);
+
+    sfrt_flat_dir8x_lookup_batch(batch.data(), results.data(), batch.size(), table);
+
+    unsigned found = 0;
+
+    for ( unsigned i = 0; i < ips.size(); i++ )
+    {
+        GENERIC single = batch[i] ? sfrt_flat_dir8x_lookup(batch[i], table) : nullptr;
+        CHECK(results[i] == single);
+        found += single != nullptr;
+    }
+    CHECK(found > 0);
+}
+
+#ifdef BENCHMARK_TEST
+//---------------------------------------------------------------
+// lookups and memory for 1M prefixes in each engine
+
+#define BENCH_PREFIXES 1000000
+
+// roughly the length mix of a full BGP table, mostly /24
+static unsigned bench_ip4_bits(std::mt19937& rng)
+{
+    unsigned r = rng() % 100;
+    return r < 60 ? 24 : r < 70 ? 22 : r < 80 ? 23 : r < 90 ? 20 : 8 + rng() % 17;
+}
+
+// global unicast under a limited set of /32 allocations, mostly /48
+static unsigned bench_ip6_bits(std::mt19937& rng)
+{
+    unsigned r = rng() % 100;
+    return r < 50 ? 48 : r < 70 ? 44 : r < 85 ? 40 : r < 95 ? 36 : 32;
+}
+
+static void bench_prefixes(bool ip6, std::vector<SfCidr>& cidrs, std::vector<SfIp>& ips)
+{
+    std::mt19937 rng(ip6 ? 6 : 4);
+    cidrs.resize(BENCH_PREFIXES);
+    ips.resize(BENCH_PREFIXES);
+
+    for ( unsigned i = 0; i < cidrs.size(); i++ )
+    {
+        uint32_t addr[4] = { static_cast<uint32_t>(rng()), static_cast<uint32_t>(rng()),
+            static_cast<uint32_t>(rng()), static_cast<uint32_t>(rng()) };
+
+        if ( ip6 )
+        {
+            addr[0] = 0x20010000 | (rng() % 1024);
+            for ( auto& a : addr )
+                a = htonl(a);
+            cidrs[i].set(addr, AF_INET6);
+            cidrs[i].set_bits(bench_ip6_bits(rng));
+            ips[i].set(addr, AF_INET6);
+        }
+        else
+        {
+            addr[0] = htonl(addr[0]);
+            cidrs[i].set(addr, AF_INET);
+            cidrs[i].set_bits(bench_ip4_bits(rng) + 96);
+            ips[i].set(addr, AF_INET);
+        }
+    }
+    std::shuffle(ips.begin(), ips.end(), rng);
+}
+
+static void bench_type(const char* name, types type, bool ip6,
+    std::vector<SfCidr>& cidrs, const std::vector<SfIp>& ips)
+{
+    table_t* table = sfrt_new(type, IPv6, cidrs.size() + 1, 4000);
+    REQUIRE(table != nullptr);
+
+    std::vector<int> values(cidrs.size());
+    unsigned failed = 0;
+
+    for ( unsigned i = 0; i < cidrs.size(); i++ )
+    {
+        values[i] = i;
+
+        if ( sfrt_insert(&cidrs[i], cidrs[i].get_bits(), &values[i], RT_FAVOR_SPECIFIC, table)
+            != RT_SUCCESS )
+            failed++;
+    }
+
+    unsigned found = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for ( const auto& ip : ips )
+        found += sfrt_lookup(&ip, table) != nullptr;
+
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+
+    printf("%-20s %s: %10.0f lookups/sec, %6u MB, %u found, %u inserts failed\n",
+        name, ip6 ? "ip6" : "ip4", ips.size() / secs.count(), sfrt_usage(table) >> 20,
+        found, failed);
+
+    sfrt_free(table);
+}
+
+TEST_CASE("sfrt engines", "[sfrt]")
+{
+    static const struct { const char* name; types type; } engines[] =
+    {
+        { "DIR_8x16", DIR_8x16 }, { "DIR_16x8", DIR_16x8 }, { "DIR_16x7_4x4", DIR_16x7_4x4 },
+        { "DIR_16_4x4_16x5_4x4", DIR_16_4x4_16x5_4x4 }, { "POPTRIE", POPTRIE },
+    };
+
+    for ( bool ip6 : { false, true } )
+    {
+        std::vector<SfCidr> cidrs;
+        std::vector<SfIp> ips;
+        bench_prefixes(ip6, cidrs, ips);
+
+        for ( const auto& e : engines )
+            bench_type(e.name, e.type, ip6, cidrs, ips);
+    }
+}
+
+TEST_CASE("sfrt flat batch lookups", "[sfrt]")
+{
+    std::vector<uint8_t> segment(512 * 1024 * 1024);
+    std::vector<SfCidr> cidrs;
+    std::vector<SfIp> ips;
+
+    // a large IPv4 list; the lookups are spread over the whole space
+    bench_prefixes(false, cidrs, ips);
+    cidrs.resize(BENCH_PREFIXES / 4);
+
+    table_flat_t* table = flat_table(segment, cidrs);
+    REQUIRE(table != nullptr);
+
+    std::vector<const SfIp*> batch;
+    std::vector<GENERIC> results(ips.size());
+
+    for ( const auto& ip : ips )
+        batch.emplace_back(&ip);
+
+    BENCHMARK("single")
+    {
+        for ( unsigned i = 0; i < ips.size(); i++ )
+            results[i] = sfrt_flat_dir8x_lookup(&ips[i], table);
+    }
+    BENCHMARK("pairs")
+    {
+        for ( unsigned i = 0; i + 1 < ips.size(); i += 2 )
+            sfrt_flat_dir8x_lookup_batch(&batch[i], &results[i], 2, table);
+    }
+    BENCHMARK("batch")
+    {
+        sfrt_flat_dir8x_lookup_batch(batch.data(), results.data(), batch.size(), table);
+    }
+}
+#endif
@@ -20,17 +20,21 @@
 //  This program is a simple utility for reading the flatbuffers files
 //  Snort generates. The files consist of a schema with a stream of
 //  timestamped records that this program converts into a YAML array for
-//  further data processing.
+//  further data processing.  perf_monitor delta files are read the same
+//  way.
 
 #include <csignal>
 #include <cstring>
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <flatbuffers/idl.h>
 #include <flatbuffers/reflection.h>
 
+#include "src/network_inspectors/perf_monitor/delta_format.h"
 #include "src/utils/endian.h"
 
 #define OPT_INFILE     0x1
@@ -48,11 +52,11 @@ FILE* file;
 
 static void help()
 {
-    cout << "Flatbuffers Multirecord Streamer for Snort 3\n\n"
+    cout << "Flatbuffers and Delta Multirecord Streamer for Snort 3\n\n"
          << "Records are output in pairs of YAML objects, representing\n"
          << "timestamp and record data\n\n"
          << "Usage: fbstreamer -i file [-b time] [-a time] [-t]\n"
-         << "-i: FlatBuffers records file from Snort (required)\n"
+         << "-i: FlatBuffers or delta records file from Snort (required)\n"
          << "-b: Stream all records before or equal to this timestamp\n"
          << "-a: Stream all records after or equal to this timestamp\n"
          << "-t: Tail mode for reading live files\n";
@@ -196,6 +200,158 @@ static uint8_t* scan_record(bool skip, uint32_t& size)
     return nullptr;
 }
 
+//-------------------------------------------------------------------------
+// delta files
+//-------------------------------------------------------------------------
+
+static uint64_t read_varint(const char* on_error)
+{
+    uint64_t u = 0;
+
+    for ( unsigned shift = 0; shift < 64; shift += 7 )
+    {
+        auto b = read<uint8_t>(on_error);
+        u |= (uint64_t)(b & 0x7F) << shift;
+
+        if ( !(b & 0x80) )
+            return u;
+    }
+    error(on_error);
+    return 0;
+}
+
+static string read_string(const char* on_error)
+{
+    auto size = read_varint(on_error);
+    string s(size, '\0');
+
+    if( size && !tail_read(&s[0], size) )
+        error(on_error);
+
+    return s;
+}
+
+// like the flatbuffers text, zero values are left out
+static void print_delta(const string& tracker, vector<delta_format::DeltaSection>& sections)
+{
+    cout << "{\n  " << tracker << ": {";
+    bool first_section = true;
+
+    for( auto& section : sections )
+    {
+        bool first_field = true;
+
+        for( auto& f : section.fields )
+        {
+            bool nz = false;
+
+            for( auto v : f.vec )
+                nz = nz || v;
+
+            if( (f.type == DELTA_PEG_COUNT && !f.peg) || (f.type == DELTA_STRING && f.str.empty())
+                || (f.type == DELTA_IDX_PEG_COUNT && !nz) )
+                continue;
+
+            if( first_field )
+            {
+                cout << (first_section ? "\n" : ",\n") << "    " << section.name << ": {\n";
+                first_section = false;
+            }
+            else
+                cout << ",\n";
+
+            first_field = false;
+            cout << "      " << f.name << ": ";
+
+            if( f.type == DELTA_PEG_COUNT )
+                cout << f.peg;
+
+            else if( f.type == DELTA_STRING )
+                cout << "\"" << f.str << "\"";
+
+            else
+            {
+                cout << "[";
+                for( unsigned i = 0; i < f.vec.size(); i++ )
+                    cout << (i ? ", " : "") << f.vec[i];
+                cout << "]";
+            }
+        }
+        if( !first_field )
+            cout << "\n    }";
+    }
+    cout << "\n  }\n}\n";
+}
+
+static void stream_delta()
+{
+    const char* bad_header = "Unable to read delta header";
+
+    if( read_varint(bad_header) != DELTA_VERSION )
+        error("Unknown delta version");
+
+    string tracker = read_string(bad_header);
+    vector<delta_format::DeltaSection> sections(read_varint(bad_header));
+
+    for( auto& section : sections )
+    {
+        section.name = read_string(bad_header);
+        section.fields.resize(read_varint(bad_header));
+
+        for( auto& f : section.fields )
+        {
+            f.type = read<uint8_t>(bad_header);
+            f.name = read_string(bad_header);
+        }
+    }
+
+    // every record is decoded since each is relative to the one before
+    uint64_t timestamp = 0;
+
+    while( !ferror(file) && !feof(file) && !done )
+    {
+        uint64_t size = 0;
+        bool got_size = true;
+
+        for( unsigned shift = 0; shift < 64; shift += 7 )
+        {
+            uint8_t b;
+            if( !tail_read(&b, 1) )
+            {
+                got_size = false;
+                break;
+            }
+            size |= (uint64_t)(b & 0x7F) << shift;
+
+            if( !(b & 0x80) )
+                break;
+        }
+        if( !got_size )
+            break;
+
+        auto record = read(size, "Unable to read record");
+
+        if( !delta_format::get_record(record, record + size, timestamp, sections) )
+        {
+            cerr << "{ status: \"Record appears to be corrupt\", timestamp: "
+                 << timestamp << " },\n";
+            free(record);
+            break;
+        }
+        free(record);
+
+        if( is_after_b_stamp(timestamp) )
+            break;
+
+        if( is_before_a_stamp(timestamp) )
+            continue;
+
+        cout << "[\n{ timestamp: " << timestamp << " },\n";
+        print_delta(tracker, sections);
+        cout << "],\n";
+    }
+}
+
 int main(int argc, char* argv[])
 {
     signal(SIGINT, sigint_handler);
@@ -212,7 +368,17 @@ int main(int argc, char* argv[])
     if( !file )
         error("Unable to open file");
 
-    if( ntohl(read<uint32_t>("Unable to read file magic")) != 0x464C5449 )
+    auto magic = ntohl(read<uint32_t>("Unable to read file magic"));
+
+    if( magic == 0x50444C54 )  // DELTA_MAGIC
+    {
+        stream_delta();
+        fclose(file);
+        cout << "{ status: \"done\" }\n]\n";
+        return 0;
+    }
+
+    if( magic != 0x464C5449 )
         error("Unknown file magic");
 
     flatbuffers::Parser parser;
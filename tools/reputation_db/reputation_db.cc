@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------
+// Copyright (C) 2019-2019 Cisco and/or its affiliates. All rights reserved.
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License Version 2 as published
+// by the Free Software Foundation.  You may not use, modify or distribute
+// this program under any other version of the GNU General Public License.
+//
+// This program is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//--------------------------------------------------------------------------
+
+// reputation_db.cc - compiles reputation IP lists into a database file that
+// the reputation inspector maps with its database parameter
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <unistd.h>
+
+#include <cctype>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "log/messages.h"
+#include "network_inspectors/reputation/reputation_db.h"
+#include "network_inspectors/reputation/reputation_parse.h"
+#include "parser/config_file.h"
+#include "utils/util.h"
+
+#define SUCCESS 0
+#define FAILURE 1
+
+// defined with the list parser
+extern unsigned long total_duplicates;
+extern unsigned long total_invalids;
+
+// the list parser uses these snort support functions; list paths that are
+// not absolute are relative to the current directory
+namespace snort
+{
+void LogMessage(const char* format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stdout, format, ap);
+    va_end(ap);
+}
+
+void ErrorMessage(const char* format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+void ParseWarning(WarningGroup, const char* format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+const char* get_error(int errnum)
+{ return strerror(errnum); }
+
+char* snort_strdup(const char* str)
+{
+    size_t n = strlen(str) + 1;
+    char* p = (char*)snort_alloc(n);
+    memcpy(p, str, n);
+    return p;
+}
+}
+
+const char* get_snort_conf_dir()
+{ return "."; }
+
+static void usage()
+{
+    fprintf(stderr,
+        "Usage: reputation_db [-b blacklist] [-w whitelist] [-d list_dir] [-m memcap] <outfile>\n"
+        "  -b file  blacklist file name with IP lists\n"
+        "  -w file  whitelist file name with IP lists\n"
+        "  -d dir   directory for IP lists and manifest file (zone.info)\n"
+        "  -m MB    maximum total MB of memory for the table (1:4095, default 500)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    ReputationConfig config;
+    int c;
+    opterr = 0;
+
+    while ((c = getopt (argc, argv, "b:w:d:m:")) != -1)
+    {
+        switch (c)
+        {
+        case 'b':
+            config.blacklist_path = optarg;
+            break;
+        case 'w':
+            config.whitelist_path = optarg;
+            break;
+        case 'd':
+            config.list_dir = optarg;
+            break;
+        case 'm':
+        {
+            char* end;
+            long memcap = strtol(optarg, &end, 10);
+
+            if ( *end or memcap < 1 or memcap > 4095 )
+            {
+                fprintf(stderr, "Invalid memcap %s.\n", optarg);
+                return FAILURE;
+            }
+            config.memcap = (uint32_t)memcap;
+            break;
+        }
+        case '?':
+            if (strchr("bwdm", optopt))
+                fprintf(stderr, "Option -%c requires an argument.\n", optopt);
+            else if (isprint (optopt))
+                fprintf(stderr, "Unknown option -%c.\n", optopt);
+            usage();
+            return FAILURE;
+        default:
+            abort();
+        }
+    }
+
+    if (optind != (argc - 1))
+    {
+        usage();
+        return FAILURE;
+    }
+
+    const char* output_filename = argv[optind];
+
+    if (!config.list_dir.empty() and read_manifest(MANIFEST_FILENAME, &config))
+        return FAILURE;
+
+    add_black_white_List(&config);
+    estimate_num_entries(&config);
+
+    if (config.num_entries <= 0)
+    {
+        fprintf(stderr, "Error: no whitelist/blacklist entries found.\n");
+        return FAILURE;
+    }
+
+    ip_list_init(config.num_entries + 1, &config);
+
+    if (!config.ip_list)
+        return FAILURE;
+
+    if (config.memcap_reached)
+    {
+        fprintf(stderr, "Error: memcap %u Mbytes reached; increase it with -m.\n",
+            config.memcap);
+        return FAILURE;
+    }
+
+    if (!reputation_db_save(output_filename, &config))
+        return FAILURE;
+
+    printf("Reputation entries: %u, invalid: %lu, re-defined: %lu, table: %u bytes\n",
+        sfrt_flat_num_entries(config.ip_list), total_invalids, total_duplicates,
+        sfrt_flat_usage(config.ip_list));
+    printf("Wrote %s\n", output_filename);
+
+    return SUCCESS;
+}
+